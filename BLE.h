@@ -31,19 +31,6 @@
 
 #define TICKS_TO_DELAY 1000
 
-const char* processTemplateLong = "%s%d%s%d";
-const char* processTemplateShort = "%s%d";
-static char processMessage[20];
-
-bool onScanProcessed = true;
-bool onScanPopulated = true;
-bool onScanPropagated = true;
-bool onScanPostPopulated = true;
-bool onScanRendered = true;
-bool onScanDone = true;
-bool scanTaskRunning = false;
-bool scanTaskStopped = true;
-
 
 #ifdef WITH_WIFI
 static bool WiFiStarted = false;
@@ -69,17 +56,6 @@ TaskHandle_t TimeClientTaskHandle;
 TaskHandle_t FileServerTaskHandle;
 TaskHandle_t FileClientTaskHandle;
 
-static uint16_t processedDevicesCount = 0;
-bool foundDeviceToggler = true;
-
-
-enum AfterScanSteps {
-  POPULATE  = 0,
-  IFEXISTS  = 1,
-  RENDER    = 2,
-  PROPAGATE = 3
-};
-
 
 /*
 // work in progress: MAC blacklist/whitelist
@@ -142,58 +118,25 @@ class FoundDeviceCallbacks: public BLEAdvertisedDeviceCallbacks {
     void onResult( BLEAdvertisedDevice *advertisedDevice )
     {
       devicesStatCount++; // raw stats for heapgraph
+      advertisementsCount++;
 
       bool scanShouldStop =  deviceHasKnownPayload( advertisedDevice );
 
-      if ( onScanDone  ) return;
+      BLETrace.capture( advertisedDevice ); // only when recording
 
+      if ( onScanDone  ) {
+        droppedDevicesCount++;
+        return;
+      }
+
+      uint32_t stageStart = LatencyStats.begin();
       if ( scan_cursor < MAX_DEVICES_PER_SCAN ) {
         log_i("will store advertisedDevice in cache #%d", scan_cursor);
         BLEDevHelper.store( BLEDevScanCache[scan_cursor], advertisedDevice );
-        //bool is_random = strcmp( BLEDevScanCache[scan_cursor]->ouiname, "[random]" ) == 0;
-        bool is_random = (BLEDevScanCache[scan_cursor]->addr_type == BLE_ADDR_RANDOM );
-        //bool is_blacklisted = isBlackListed( BLEDevScanCache[scan_cursor]->address );
-        if ( UI.filterVendors && is_random ) {
-          //TODO: scan_cursor++
-          log_i( "Filtering %s", BLEDevScanCache[scan_cursor]->address );
-        } else {
-          if ( DB.hasPsram ) {
-            if ( !is_random ) {
-              DB.getOUI( BLEDevScanCache[scan_cursor]->address, BLEDevScanCache[scan_cursor]->ouiname );
-            }
-            if ( BLEDevScanCache[scan_cursor]->manufid > -1 ) {
-              DB.getVendor( BLEDevScanCache[scan_cursor]->manufid, BLEDevScanCache[scan_cursor]->manufname );
-            }
-            BLEDevScanCache[scan_cursor]->is_anonymous = BLEDevHelper.isAnonymous( BLEDevScanCache[scan_cursor] );
-            log_i(  "  stored and populated #%02d : %s", scan_cursor, advertisedDevice->getName().c_str());
-          } else {
-            log_i(  "  stored #%02d : %s", scan_cursor, advertisedDevice->getName().c_str());
-          }
-          scan_cursor++;
-          processedDevicesCount++;
-        }
-        if ( scan_cursor == MAX_DEVICES_PER_SCAN ) {
-          onScanDone = true;
-        }
-      } else {
-        onScanDone = true;
-      }
-      if ( onScanDone ) {
-        advertisedDevice->getScan()->stop();
-        scan_cursor = 0;
-        if ( SCAN_DURATION - 1 >= MIN_SCAN_DURATION ) {
-          SCAN_DURATION--;
-        }
-      }
-      foundDeviceToggler = !foundDeviceToggler;
-      if (foundDeviceToggler) {
-        //UI.BLEStateIconSetColor(BLE_GREEN);
-        BLEActivityIcon.setStatus( ICON_STATUS_ADV_WHITELISTED );
-      } else {
-        //UI.BLEStateIconSetColor(BLE_DARKGREEN);
-        BLEActivityIcon.setStatus( ICON_STATUS_ADV_SCAN );
       }
-      if( scanShouldStop ) {
+      bool scanDone = onScanResult();
+      LatencyStats.end( STAGE_STORE, stageStart );
+      if ( scanDone || scanShouldStop ) {
         advertisedDevice->getScan()->stop();
       }
     }
@@ -227,7 +170,8 @@ ToggleTpl* TogglableProps;
 uint16_t Tsize = 0;
 
 
-class BLEScanUtils {
+// the after-scan steps come from ScanPipelineUtils, this adds the radio, the UI and the serial commands
+class BLEScanUtils : public ScanPipelineUtils {
 
   public:
 
@@ -283,7 +227,7 @@ class BLEScanUtils {
       }
 
       static void startAlternateSourceTask( void * param = NULL ) {
-        xTaskCreatePinnedToCore( setAlternateSource, "setAlternateSource", 16000, NULL, 2, NULL, TASKLAUNCHER_CORE );
+        spawnTask( setAlternateSource, "setAlternateSource", 16000, NULL, 2, NULL, TASKLAUNCHER_CORE );
       }
     */
 
@@ -298,7 +242,7 @@ class BLEScanUtils {
       }
 
       static void doStopBLE( void * param = NULL ) {
-        xTaskCreatePinnedToCore( stopBLE, "stopBLE", 8192, param, 5, NULL, TASKLAUNCHER_CORE ); /* last = Task Core */
+        spawnTask( stopBLE, "stopBLE", 8192, param, 5, NULL, TASKLAUNCHER_CORE ); /* last = Task Core */
         while( UI.BLEStarted == true ) {
           vTaskDelay( 100 );
         }
@@ -321,7 +265,7 @@ class BLEScanUtils {
           doStopBLE();
         }
         if( WiFiStarted ) return;
-        xTaskCreatePinnedToCore( startWifi, "startWifi", 16384, param, 16, NULL, TASKLAUNCHER_CORE ); /* last = Task Core */
+        spawnTask( startWifi, "startWifi", 16384, param, 16, NULL, TASKLAUNCHER_CORE ); /* last = Task Core */
         while( WiFiStarted == false ) {
           // TODO: timeout this
           vTaskDelay( 100 );
@@ -354,7 +298,7 @@ class BLEScanUtils {
       }
 
       static void doStopWiFi( void * param = NULL ) {
-        xTaskCreatePinnedToCore( stopWiFi, "stopWiFi", 8192, param, 5, NULL, TASKLAUNCHER_CORE ); /* last = Task Core */
+        spawnTask( stopWiFi, "stopWiFi", 8192, param, 5, NULL, TASKLAUNCHER_CORE ); /* last = Task Core */
         while( WiFiStarted == true ) {
           // TODO: timeout this
           vTaskDelay( 100 );
@@ -395,7 +339,7 @@ class BLEScanUtils {
         }
         UI.PrintMessage("Contacting NTP Server...");
         NTPDateSet = false;
-        xTaskCreatePinnedToCore( startNTPUpdater, "startNTPUpdater", 16384, param, 16, NULL, TASKLAUNCHER_CORE ); /* last = Task Core */
+        spawnTask( startNTPUpdater, "startNTPUpdater", 16384, param, 16, NULL, TASKLAUNCHER_CORE ); /* last = Task Core */
         while( NTPDateSet == false ) {
           // TODO: timeout this
           vTaskDelay( 100 );
@@ -426,7 +370,7 @@ class BLEScanUtils {
         UI.PrintMessage("Checking DB Files...");
 
         WiFiDownloaderRunning = true;
-        xTaskCreatePinnedToCore( runWifiDownloader, "runWifiDownloader", 16384, param, 16, NULL, WIFITASK_CORE ); /* last = Task Core */
+        spawnTask( runWifiDownloader, "runWifiDownloader", 16384, param, 16, NULL, WIFITASK_CORE ); /* last = Task Core */
         while( WiFiDownloaderRunning ) {
           vTaskDelay( 100 );
         }
@@ -531,6 +475,11 @@ class BLEScanUtils {
           return false;
         }
 
+        // .blz containers are unpacked as they come, anything else is written as is
+        LZStreamDecoder decoder;
+        decoder.begin( LZStreamUtils::fileSink, &outFile );
+        bool writeError = false;
+
         //uint8_t buff[4096] = { 0 };
         //size_t sizeOfBuff = sizeof(buff);
         size_t sizeOfBuff = 4096;
@@ -547,7 +496,11 @@ class BLEScanUtils {
           if(size) {
             // read up to 512 byte
             int c = stream->readBytes(buff, ((size > sizeOfBuff) ? sizeOfBuff : size));
-            outFile.write( buff, c );
+            if( !decoder.write( buff, c ) ) {
+              log_e("Can't write %s", path );
+              writeError = true;
+              break;
+            }
             bytesLeftToDownload -= c;
             bytesDownloaded += c;
             Serial.printf("%d bytes left\n", bytesLeftToDownload );
@@ -555,9 +508,21 @@ class BLEScanUtils {
             UI.PrintProgressBar( progress, 100.0 );
           }
         }
+        if( !writeError && !decoder.finish() ) {
+          log_e("Incomplete download for %s", path );
+          writeError = true;
+        }
+        decoder.end();
         outFile.close();
         free( buff );
         free( client );
+        if( writeError ) {
+          fs.remove( path );
+          return false;
+        }
+        if( !decoder.passthrough ) {
+          log_w("Unpacked %d bytes to %s", decoder.written, path );
+        }
         return fs.exists( path );
       }
 
@@ -594,7 +559,7 @@ class BLEScanUtils {
       if ( !scanTaskRunning ) {
         log_d("Starting scan" );
         uint16_t stackSize = DB.hasPsram ? 5120 : 5120;
-        xTaskCreatePinnedToCore( scanTask, "scanTask", stackSize, NULL, 8, NULL, SCANTASK_CORE ); /* last = Task Core */
+        spawnTask( scanTask, "scanTask", stackSize, NULL, 8, NULL, SCANTASK_CORE ); /* last = Task Core */
         while ( scanTaskStopped ) {
           log_d("Waiting for scan to start...");
           vTaskDelay(1000);
@@ -620,7 +585,7 @@ class BLEScanUtils {
 
     static void restartCB( void * param = NULL ) {
       // detach from this thread before it's destroyed
-      xTaskCreatePinnedToCore( doRestart, "doRestart", 16384, param, 5, NULL, TASKLAUNCHER_CORE ); // last = Task Core
+      spawnTask( doRestart, "doRestart", 16384, param, 5, NULL, TASKLAUNCHER_CORE ); // last = Task Core
     }
 
     static void doRestart( void * param = NULL ) {
@@ -643,7 +608,7 @@ class BLEScanUtils {
     static void startFileSharingServer( void * param = NULL ) {
       if ( ! fileDownloadingEnabled ) {
         fileDownloadingEnabled = true;
-        xTaskCreatePinnedToCore( startFileSharingServerTask, "startFileSharingServerTask", 2048, param, 0, NULL, TASKLAUNCHER_CORE ); // last = Task Core
+        spawnTask( startFileSharingServerTask, "startFileSharingServerTask", 2048, param, 0, NULL, TASKLAUNCHER_CORE ); // last = Task Core
       }
     }
 
@@ -661,7 +626,7 @@ class BLEScanUtils {
 
       fileSharingServerTaskIsRunning = true;
       BLERoleIcon.setStatus( ICON_STATUS_ROLE_FILE_SEEKING );
-      xTaskCreatePinnedToCore( FileSharingServerTask, "FileSharingServerTask", 12000, NULL, 5, &FileServerTaskHandle, FILESHARETASK_CORE );
+      spawnTask( FileSharingServerTask, "FileSharingServerTask", 12000, NULL, 5, &FileServerTaskHandle, FILESHARETASK_CORE );
       if ( scanWasRunning ) {
         while ( fileSharingServerTaskIsRunning ) {
           vTaskDelay( 1000 );
@@ -690,7 +655,7 @@ class BLEScanUtils {
 
       fileSharingClientTaskIsRunning = true;
       BLERoleIcon.setStatus( ICON_STATUS_ROLE_FILE_SHARING );
-      xTaskCreatePinnedToCore( FileSharingClientTask, "FileSharingClientTask", 12000, param, 5, &FileClientTaskHandle, FILESHARETASK_CORE ); // last = Task Core
+      spawnTask( FileSharingClientTask, "FileSharingClientTask", 12000, param, 5, &FileClientTaskHandle, FILESHARETASK_CORE ); // last = Task Core
       if ( scanWasRunning ) {
         while ( fileSharingClientTaskIsRunning ) {
           vTaskDelay( 1000 );
@@ -708,7 +673,7 @@ class BLEScanUtils {
     static void setTimeClientOn( void * param = NULL ) {
       if( !timeClientisStarted ) {
         timeClientisStarted = true;
-        xTaskCreatePinnedToCore( startTimeClient, "startTimeClient", 2560, param, 0, NULL, TASKLAUNCHER_CORE ); // last = Task Core
+        spawnTask( startTimeClient, "startTimeClient", 2560, param, 0, NULL, TASKLAUNCHER_CORE ); // last = Task Core
       } else {
         log_w("startTimeClient already called, time is also about patience");
       }
@@ -723,7 +688,7 @@ class BLEScanUtils {
       }
       if ( scanTaskRunning ) stopScanCB();
       BLERoleIcon.setStatus( ICON_STATUS_ROLE_CLOCK_SEEKING );
-      xTaskCreatePinnedToCore( TimeClientTask, "TimeClientTask", 2560, NULL, 5, &TimeClientTaskHandle, TIMECLIENTTASK_CORE ); // TimeClient task prefers core 0
+      spawnTask( TimeClientTask, "TimeClientTask", 2560, NULL, 5, &TimeClientTaskHandle, TIMECLIENTTASK_CORE ); // TimeClient task prefers core 0
       if ( scanWasRunning ) {
         while ( timeClientisRunning ) {
           vTaskDelay( 1000 );
@@ -742,7 +707,7 @@ class BLEScanUtils {
     static void setTimeServerOn( void * param = NULL ) {
       if( !timeServerStarted ) {
         timeServerStarted = true;
-        xTaskCreatePinnedToCore( startTimeServer, "startTimeServer", 8192, param, 0, NULL, TASKLAUNCHER_CORE ); // last = Task Core
+        spawnTask( startTimeServer, "startTimeServer", 8192, param, 0, NULL, TASKLAUNCHER_CORE ); // last = Task Core
       }
     }
 
@@ -755,7 +720,7 @@ class BLEScanUtils {
       BLERoleIcon.setStatus(ICON_STATUS_ROLE_CLOCK_SHARING );
       UI.headerStats( "Starting Time Server" );
       vTaskDelay(1);
-      xTaskCreatePinnedToCore( TimeServerTask, "TimeServerTask", 4096, NULL, 1, &TimeServerTaskHandle, TIMESERVERTASK_CORE ); // TimeServerTask prefers core 1
+      spawnTask( TimeServerTask, "TimeServerTask", 4096, NULL, 1, &TimeServerTaskHandle, TIMESERVERTASK_CORE ); // TimeServerTask prefers core 1
       log_w("TimeServerTask started");
       if ( scanWasRunning ) {
         while( ! timeServerStarted ) {
@@ -820,7 +785,7 @@ class BLEScanUtils {
     }
 
     static void rmFileCB( void * param = NULL ) {
-      xTaskCreatePinnedToCore(rmFileTask, "rmFileTask", 5000, param, 2, NULL, TASKLAUNCHER_CORE ); /* last = Task Core */
+      spawnTask(rmFileTask, "rmFileTask", 5000, param, 2, NULL, TASKLAUNCHER_CORE ); /* last = Task Core */
     }
 
     static void rmFileTask( void * param = NULL ) {
@@ -840,7 +805,7 @@ class BLEScanUtils {
     }
 
     static void screenShowCB( void * param = NULL ) {
-      xTaskCreate(screenShowTask, "screenShowTask", 16000, param, 2, NULL);
+      spawnTask(screenShowTask, "screenShowTask", 16000, param, 2, NULL, tskNO_AFFINITY);
     }
 
     static void screenShowTask( void * param = NULL ) {
@@ -849,7 +814,7 @@ class BLEScanUtils {
     }
 
     static void screenShotCB( void * param = NULL ) {
-      xTaskCreate(screenShotTask, "screenShotTask", 16000, NULL, 2, NULL);
+      spawnTask(screenShotTask, "screenShotTask", 16000, NULL, 2, NULL, tskNO_AFFINITY);
     }
 
     static void screenShotTask( void * param = NULL ) {
@@ -890,7 +855,7 @@ class BLEScanUtils {
 
 
     static void listDirCB( void * param = NULL ) {
-      xTaskCreatePinnedToCore(listDirTask, "listDirTask", 5000, param, 8, NULL, TASKLAUNCHER_CORE ); /* last = Task Core */
+      spawnTask(listDirTask, "listDirTask", 5000, param, 8, NULL, TASKLAUNCHER_CORE ); /* last = Task Core */
     }
 
     static void listDirTask( void * param = NULL ) {
@@ -935,6 +900,206 @@ class BLEScanUtils {
       }
     }
 
+    static void metricsCB( void * param = NULL ) {
+      if ( param != NULL ) {
+        Metrics.period = atoi( (const char*)param );
+      } else {
+        Metrics.emit(); // one-shot
+        return;
+      }
+      Serial.printf("Metrics period: %d seconds%s\n", Metrics.period, Metrics.period == 0 ? " (disabled)" : "" );
+      setPrefs();
+    }
+
+    static void sessionsCB( void * param = NULL ) {
+      if ( param != NULL && atoi( (const char*)param ) > 0 ) {
+        PresenceSessions.timeout = atoi( (const char*)param );
+        setPrefs();
+      }
+      Serial.printf("Presence sessions: %d open, %d opened, %d closed (%d early), %d queued, %d dropped, timeout: %d seconds\n",
+        PresenceSessions.openCount(), PresenceSessions.opened, PresenceSessions.closed, PresenceSessions.evicted,
+        PresenceSessions.pending(), PresenceSessions.dropped, PresenceSessions.timeout );
+    }
+
+    static void rollupsCB( void * param = NULL ) {
+      DB.printRollups( param != NULL && strcmp( (const char*)param, "day" ) == 0 ? "day" : "hour" );
+    }
+
+    static void topCB( void * param = NULL ) {
+      TaskMonitor.print();
+    }
+
+    static void statsCB( void * param = NULL ) {
+      if ( param != NULL && strcmp( (const char*)param, "reset" ) == 0 ) {
+        LatencyStats.reset();
+        Serial.println("Stage latencies cleared");
+        return;
+      }
+      Serial.printf("\nScan stage latencies (scan #%d)\n\n", scan_rounds);
+      LatencyStats.print();
+      Serial.printf("\n  Render queue : %d pushed, %d dropped, %d coalesced, %d pending\n", RenderQueue.pushed, RenderQueue.dropped, RenderQueue.coalesced, RenderQueue.size() );
+      Serial.printf("  Compositor   : %d frames, %d skipped, last frame %d pixels\n\n", Compositor.frames, Compositor.skipped, Compositor.lastFramePixels );
+    }
+
+    static void benchCB( void * param = NULL ) {
+      spawnTask(benchTask, "benchTask", 8192, param, 2, NULL, TASKLAUNCHER_CORE ); /* last = Task Core */
+    }
+
+    static void benchTask( void * param = NULL ) {
+      uint32_t iterations = param != NULL ? atoi( (const char*)param ) : 0;
+      bool scanWasRunning = scanTaskRunning;
+      if ( scanTaskRunning ) stopScanCB();
+      if ( !Benchmark.init( iterations, DB.hasPsram ) ) {
+        log_e("Not enough memory to run the benchmarks");
+        vTaskDelete( NULL );
+        return;
+      }
+      Benchmark.runAll();
+      if ( scanWasRunning ) startScanCB();
+      vTaskDelete( NULL );
+    }
+
+    static void ftbenchCB( void * param = NULL ) {
+      spawnTask(ftbenchTask, "ftbenchTask", 4096, param, 2, NULL, TASKLAUNCHER_CORE ); /* last = Task Core */
+    }
+
+    // file transfer between two simulated endpoints, no radio involved
+    static void ftbenchTask( void * param = NULL ) {
+      int kbytes = 933, loss = -1, mtu = 517, window = FT_WINDOW, corrupt = 0;
+      if ( param != NULL ) {
+        sscanf( (const char*)param, "%d %d %d %d %d", &kbytes, &loss, &mtu, &window, &corrupt );
+      }
+      if ( loss > -1 ) {
+        FileTransferLoopback.run( kbytes * 1024, loss, mtu, window, corrupt );
+      } else {
+        FileTransferLoopback.runSuite( kbytes * 1024, mtu, window );
+      }
+      Serial.println("BENCH {\"done\":true}");
+      vTaskDelete( NULL );
+    }
+
+    static void dbSummaryCB( void * param = NULL ) {
+      spawnTask(dbSummaryTask, "dbSummaryTask", 6144, param, 2, NULL, TASKLAUNCHER_CORE ); /* last = Task Core */
+    }
+
+    // what 'blesend' offers to the peer when syncing the daily DBs
+    static void dbSummaryTask( void * param = NULL ) {
+      static DBSyncSummary summary;
+      char days[DBSYNC_MAX_DAYS][DBSYNC_DAY_LEN];
+      uint8_t count = 0;
+      if ( param != NULL && DBSyncUtils::validDay( (const char*)param ) ) {
+        snprintf( days[0], DBSYNC_DAY_LEN, "%s", (const char*)param );
+        count = 1;
+      } else {
+        count = DBSync.listDays( days, DBSYNC_MAX_DAYS );
+      }
+      for ( uint8_t i = 0; i < count; i++ ) {
+        if ( !DBSync.summarize( days[i], &summary ) ) continue;
+        uint16_t buckets = 0;
+        for ( uint16_t b = 0; b < DBSYNC_BUCKETS; b++ ) {
+          if ( summary.leaves[b] != 0 ) buckets++;
+        }
+        Serial.printf("%s: %d rows, %d buckets, last update %d, root ", summary.day, summary.rows, buckets, summary.maxUpdated );
+        for ( uint8_t b = 0; b < 8; b++ ) {
+          Serial.printf("%02x", summary.root[b] );
+        }
+        Serial.println();
+      }
+      vTaskDelete( NULL );
+    }
+
+    static void packCB( void * param = NULL ) {
+      const char* path = param != NULL ? (const char*)param : MAC_OUI_NAMES_DB_FS_PATH;
+      unsigned long started = millis();
+      size_t packedSize = LZStream.packFile( path );
+      if ( packedSize == 0 ) {
+        Serial.printf("Can't pack %s\n", path );
+        return;
+      }
+      Serial.printf("Packed %s to %s%s: %d bytes in %d ms\n", path, path, LZ_SUFFIX, packedSize, millis() - started );
+    }
+
+    static void printLookupTable( const char* name, LookupTable &table, NameCache &cache ) {
+      Serial.printf("%-7s: cache %d slots, %d hits (%d negative), %d misses, %d evictions\n", name,
+        cache.size(), cache.hits, cache.negativeHits, cache.misses, cache.evictions );
+      if ( !table.isReady() ) {
+        Serial.printf("%-7s: unavailable, using SQLite queries\n", name );
+        return;
+      }
+      const LookupHeader& h = table.info();
+      Serial.printf("%-7s: v%d %s, %d entries, %d bytes pool, crc %08x, %s\n", name, h.version,
+        h.flags & LOOKUP_GENERATED ? "generated" : "compiled", h.entries, h.poolSize, h.checksum,
+        table.inPsram() ? "psram" : BLE_FS_TYPE );
+      if ( table.filterSize() > 0 ) {
+        Serial.printf("         presence filter: %d bits, %d lookups rejected\n", table.filterSize(), table.filterRejects );
+      }
+      if ( table.isPaged() ) {
+        Serial.printf("         paged index: %d pages, %d cached, %d page reads, %d page cache hits\n",
+          table.pageCount(), table.pageCacheSize(), table.pageReads, table.pageHits );
+      }
+      if ( h.created > 0 ) {
+        DateTime created = DateTime( h.created );
+        Serial.printf("         source lists from %04d-%02d-%02d\n", created.year(), created.month(), created.day() );
+      }
+    }
+
+    // no args: print the lookup tables, [file]: swap in a generated table copied on the SD
+    static void lookupsCB( void * param = NULL ) {
+      if ( param == NULL || isEmpty( (const char*)param ) ) {
+        printLookupTable( "OUI", OUILookup, OuiNameCache );
+        printLookupTable( "Vendor", VendorLookup, VendorNameCache );
+        return;
+      }
+      const char* path = (const char*)param;
+      LookupHeader h;
+      LookupTable* table = OUILookup.verify( path, h ) ? &OUILookup : VendorLookup.verify( path, h ) ? &VendorLookup : NULL;
+      if ( table == NULL || !table->stage( path ) ) {
+        Serial.printf("%s is not a valid generated lookup table\n", path );
+        return;
+      }
+      Serial.printf("%s staged, swapped in before the next scan\n", path );
+    }
+
+    // prints the RSSI history of a cached device
+    static void rssiHistoryCB( void * param = NULL ) {
+      int cacheIndex = param != NULL ? getDeviceCacheIndex( (const char*)param ) : -1;
+      if ( cacheIndex < 0 || RSSIHistory.count( cacheIndex ) == 0 ) {
+        Serial.println("No RSSI history for this address");
+        return;
+      }
+      uint32_t time;
+      int8_t rssi;
+      for ( uint8_t i=0; RSSIHistory.get( cacheIndex, i, time, rssi ); i++ ) {
+        Serial.printf("%10u %4d dBm\n", time, rssi );
+      }
+    }
+
+    static void traceRecordCB( void * param = NULL ) {
+      if ( !BLETrace.startRecording( param != NULL ? (const char*)param : TRACE_DEFAULT_PATH ) ) {
+        Serial.println("Can't start recording");
+      }
+    }
+
+    static void traceReplayCB( void * param = NULL ) {
+      const char* path = TRACE_DEFAULT_PATH;
+      uint16_t speed = 1;
+      char *args = NULL;
+      if ( param != NULL ) {
+        path = strtok_r( (char*)param, " ", &args );
+        if ( args != NULL && !isEmpty( args ) ) {
+          speed = atoi( args );
+        }
+      }
+      if ( !BLETrace.startReplay( path, speed ) ) {
+        Serial.println("Can't start replay");
+      }
+    }
+
+    static void traceStopCB( void * param = NULL ) {
+      BLETrace.stopRecording();
+      BLETrace.stopReplay();
+    }
+
     static void nullCB( void * param = NULL ) {
       if ( param != NULL ) {
         Serial.printf("nullCB param: %s\n", (const char*)param);
@@ -944,7 +1109,7 @@ class BLEScanUtils {
     static void startSerialTask() {
       serialBuffer = (char*)calloc( SERIAL_BUFFER_SIZE, sizeof(char) );
       tempBuffer   = (char*)calloc( SERIAL_BUFFER_SIZE, sizeof(char) );
-      xTaskCreatePinnedToCore(serialTask, "serialTask", 8192 + SERIAL_BUFFER_SIZE, NULL, 0, NULL, SERIALTASK_CORE ); /* last = Task Core */
+      spawnTask(serialTask, "serialTask", 8192 + SERIAL_BUFFER_SIZE, NULL, 0, NULL, SERIALTASK_CORE ); /* last = Task Core */
     }
 
     static void serialTask( void * parameter ) {
@@ -967,8 +1132,22 @@ class BLEScanUtils {
         { "screenshot",    screenShotCB,           "Make a screenshot and save it on the SD" },
         { "screenshow",    screenShowCB,           "Show screenshot" },
         { "toggle",        toggleCB,               "toggle a bool value" },
+        { "traceRecord",   traceRecordCB,          "Record advertisements to [file] on the SD" },
+        { "traceReplay",   traceReplayCB,          "Replay [file] [speed] instead of scanning (speed 0 = max)" },
+        { "traceStop",     traceStopCB,            "Stop trace recording/replay" },
         { "resetDB",       resetCB,                "Hard Reset DB + forced restart" },
         { "pruneDB",       pruneCB,                "Soft Reset DB without restarting (hopefully)" },
+        { "bench",         benchCB,                "Run the lookup/cache microbenchmarks [iterations]" },
+        { "ftbench",       ftbenchCB,              "Simulate a file transfer [kbytes] [loss per mille] [mtu] [window] [corrupt per mille]" },
+        { "dbsummary",     dbSummaryCB,            "Print the sync summary of the daily DBs [YYYY-MM-DD]" },
+        { "pack",          packCB,                 "Write the .blz container of a file [path]" },
+        { "lookups",       lookupsCB,              "Show the OUI/Vendor lookup tables and caches, or swap in a generated [file]" },
+        { "sessions",      sessionsCB,             "Show the presence sessions, or set the absence [timeout] in seconds" },
+        { "rollups",       rollupsCB,              "Show unique devices and mean RSSI per [hour|day] from the rollup tables" },
+        { "rssi",          rssiHistoryCB,          "Show the RSSI history of a cached device [address]" },
+        { "stats",         statsCB,                "Show scan stage latencies ('stats reset' to clear)" },
+        { "top",           topCB,                  "Show core, stack usage and CPU share of the collector tasks" },
+        { "metrics",       metricsCB,              "Emit InfluxDB metrics every [seconds] on serial, 0 = off (persistent)" },
         #if HAS_EXTERNAL_RTC
           { "bleclock",      setTimeServerOn,        "Broadcast time to another BLE Device (implicit)" },
           { "bletime",       setTimeClientOn,        "Get time from another BLE Device (explicit)" },
@@ -1007,6 +1186,7 @@ class BLEScanUtils {
         { "HourChangeTrigger",   HourChangeTrigger },
         { "fileSharingEnabled",  fileSharingEnabled },
         { "timeServerIsRunning", timeServerIsRunning },
+        { "LatencyStats.graph",  LatencyStats.graph },
       };
       TogglableProps = ToggleProps;
       Tsize = (sizeof(ToggleProps) / sizeof(ToggleProps[0]));
@@ -1055,6 +1235,8 @@ class BLEScanUtils {
           GPSRead();
         #endif
 
+        Metrics.loop();
+
         if( hasHID() ) {
           if( lastHidCheck + 150 < millis() ) {
             M5.update();
@@ -1207,7 +1389,20 @@ class BLEScanUtils {
         if ( onAfterScanSteps( onAfterScanStep, scan_cursor ) ) continue;
         dumpStats("BeforeScan::");
         onBeforeScan();
-        pBLEScan->start(SCAN_DURATION);
+        unsigned long scanStart = micros();
+        Metrics.scanStarted();
+        if ( BLETrace.mode == TRACE_REPLAYING ) {
+          replayScan(SCAN_DURATION);
+        } else {
+          #if BLE_SIMULATION
+            simulateScan(SCAN_DURATION);
+          #else
+            pBLEScan->start(SCAN_DURATION);
+          #endif
+        }
+        LatencyStats.add( STAGE_SCAN, micros() - scanStart );
+        Metrics.scanEnded();
+        BLETrace.flush(); // only when recording
         onAfterScan();
         //DB.maintain();
         dumpStats("AfterScan:::");
@@ -1218,190 +1413,11 @@ class BLEScanUtils {
     }
 
 
-    static bool onAfterScanSteps( byte &onAfterScanStep, uint16_t &scan_cursor ) {
-      switch ( onAfterScanStep ) {
-        case POPULATE: // 0
-          onScanPopulate( scan_cursor ); // OUI / vendorname / isanonymous
-          onAfterScanStep++;
-          return true;
-          break;
-        case IFEXISTS: // 1
-          onScanIfExists( scan_cursor ); // exists + hits
-          onAfterScanStep++;
-          return true;
-          break;
-        case RENDER: // 2
-          onScanRender( scan_cursor ); // ui work
-          onAfterScanStep++;
-          return true;
-          break;
-        case PROPAGATE: // 3
-          onAfterScanStep = 0;
-          if ( onScanPropagate( scan_cursor ) ) { // copy to DB / cache
-            scan_cursor++;
-            return true;
-          }
-          break;
-        default:
-          log_w("Exit flat loop on afterScanStep value : %d", onAfterScanStep);
-          onAfterScanStep = 0;
-          break;
-      }
-      return false;
-    }
-
-
-    static bool onScanPopulate( uint16_t _scan_cursor ) {
-      if ( onScanPopulated ) {
-        log_v("%s", " onScanPopulated = true ");
-        return false;
-      }
-      if ( _scan_cursor >= devicesCount) {
-        onScanPopulated = true;
-        log_d("%s", "done all");
-        return false;
-      }
-      if ( isEmpty( BLEDevScanCache[_scan_cursor]->address ) ) {
-        log_w("empty addess");
-        return true; // end of cache
-      }
-      populate( BLEDevScanCache[_scan_cursor] );
-      return true;
-    }
-
-
-    static bool onScanIfExists( int _scan_cursor ) {
-      if ( onScanPostPopulated ) {
-        log_v("onScanPostPopulated = true");
-        return false;
-      }
-      if ( _scan_cursor >= devicesCount) {
-        log_d("done all");
-        onScanPostPopulated = true;
-        return false;
-      }
-      int deviceIndexIfExists = -1;
-      deviceIndexIfExists = getDeviceCacheIndex( BLEDevScanCache[_scan_cursor]->address );
-      if ( deviceIndexIfExists > -1 ) {
-        inCacheCount++;
-        BLEDevRAMCache[deviceIndexIfExists]->hits++;
-        if ( TimeIsSet ) {
-          if ( BLEDevRAMCache[deviceIndexIfExists]->created_at.year() <= 1970 ) {
-            BLEDevRAMCache[deviceIndexIfExists]->created_at = nowDateTime;
-          }
-          BLEDevRAMCache[deviceIndexIfExists]->updated_at = nowDateTime;
-        }
-        BLEDevHelper.mergeItems( BLEDevScanCache[_scan_cursor], BLEDevRAMCache[deviceIndexIfExists] ); // merge scan data into existing psram cache
-        BLEDevHelper.copyItem( BLEDevRAMCache[deviceIndexIfExists], BLEDevScanCache[_scan_cursor] ); // copy back merged data for rendering
-        log_i( "Device %d / %s exists in cache, increased hits to %d", _scan_cursor, BLEDevScanCache[_scan_cursor]->address, BLEDevScanCache[_scan_cursor]->hits );
-      } else {
-        if ( BLEDevScanCache[_scan_cursor]->is_anonymous ) {
-          // won't land in DB (won't be checked either) but will land in cache
-          uint16_t nextCacheIndex = BLEDevHelper.getNextCacheIndex( BLEDevRAMCache, BLEDevCacheIndex );
-          BLEDevHelper.reset( BLEDevRAMCache[nextCacheIndex] );
-          BLEDevScanCache[_scan_cursor]->hits++;
-          BLEDevHelper.copyItem( BLEDevScanCache[_scan_cursor], BLEDevRAMCache[nextCacheIndex] );
-          log_v( "Device %d / %s is anonymous, won't be inserted", _scan_cursor, BLEDevScanCache[_scan_cursor]->address, BLEDevScanCache[_scan_cursor]->hits );
-        } else {
-          deviceIndexIfExists = DB.deviceExists( BLEDevScanCache[_scan_cursor]->address ); // will load returning devices from DB if necessary
-          if (deviceIndexIfExists > -1) {
-            uint16_t nextCacheIndex = BLEDevHelper.getNextCacheIndex( BLEDevRAMCache, BLEDevCacheIndex );
-            BLEDevHelper.reset( BLEDevRAMCache[nextCacheIndex] );
-            BLEDevDBCache->hits++;
-            if ( TimeIsSet ) {
-              if ( BLEDevDBCache->created_at.year() <= 1970 ) {
-                BLEDevDBCache->created_at = nowDateTime;
-              }
-              BLEDevDBCache->updated_at = nowDateTime;
-            }
-            BLEDevHelper.mergeItems( BLEDevScanCache[_scan_cursor], BLEDevDBCache ); // merge scan data into BLEDevDBCache
-            BLEDevHelper.copyItem( BLEDevDBCache, BLEDevRAMCache[nextCacheIndex] ); // copy merged data to assigned psram cache
-            BLEDevHelper.copyItem( BLEDevDBCache, BLEDevScanCache[_scan_cursor] ); // copy back merged data for rendering
-
-            log_v( "Device %d / %s is already in DB, increased hits to %d", _scan_cursor, BLEDevScanCache[_scan_cursor]->address, BLEDevScanCache[_scan_cursor]->hits );
-          } else {
-            // will be inserted after rendering
-            BLEDevScanCache[_scan_cursor]->in_db = false;
-            log_v( "Device %d / %s is not in DB", _scan_cursor, BLEDevScanCache[_scan_cursor]->address );
-          }
-        }
-      }
-      return true;
-    }
-
-
-    static bool onScanRender( uint16_t _scan_cursor ) {
-      if ( onScanRendered ) {
-        log_v("onScanRendered = true");
-        return false;
-      }
-      if ( _scan_cursor >= devicesCount) {
-        log_v("done all");
-        onScanRendered = true;
-        return false;
-      }
-      UI.BLECardTheme.setTheme( IN_CACHE_ANON );
-      BLEDevTmp = BLEDevScanCache[_scan_cursor];
-      UI.printBLECard( (BlueToothDeviceLink){.cacheIndex=_scan_cursor,.device=BLEDevTmp} ); // render
-      delay(1);
-      sprintf( processMessage, processTemplateLong, "Rendered ", _scan_cursor + 1, " / ", devicesCount );
-      UI.headerStats( processMessage );
-      delay(1);
-      UI.cacheStats();
-      delay(1);
-      UI.footerStats();
-      delay(1);
-      return true;
-    }
-
-
-    static bool onScanPropagate( uint16_t &_scan_cursor ) {
-      if ( onScanPropagated ) {
-        log_v("onScanPropagated = true");
-        return false;
-      }
-      if ( _scan_cursor >= devicesCount) {
-        log_v("done all");
-        onScanPropagated = true;
-        _scan_cursor = 0;
-        return false;
-      }
-      //BLEDevScanCacheIndex = _scan_cursor;
-      if ( isEmpty( BLEDevScanCache[_scan_cursor]->address ) ) {
-        return true;
-      }
-      if ( BLEDevScanCache[_scan_cursor]->is_anonymous || BLEDevScanCache[_scan_cursor]->in_db ) { // don't DB-insert anon or duplicates
-        sprintf( processMessage, processTemplateLong, "Released ", _scan_cursor + 1, " / ", devicesCount );
-        if ( BLEDevScanCache[_scan_cursor]->is_anonymous ) AnonymousCacheHit++;
-      } else {
-        if ( DB.insertBTDevice( BLEDevScanCache[_scan_cursor] ) == DBUtils::INSERTION_SUCCESS ) {
-          sprintf( processMessage, processTemplateLong, "Saved ", _scan_cursor + 1, " / ", devicesCount );
-          log_d( "Device %d successfully inserted in DB", _scan_cursor );
-          entries++;
-        } else {
-          log_e( "  [!!! BD INSERT FAIL !!!] Device %d could not be inserted", _scan_cursor );
-          sprintf( processMessage, processTemplateLong, "Failed ", _scan_cursor + 1, " / ", devicesCount );
-        }
-      }
-      BLEDevHelper.reset( BLEDevScanCache[_scan_cursor] ); // discard
-      UI.headerStats( processMessage );
-      return true;
-    }
-
-
     static void onBeforeScan() {
       DB.maintain();
       UI.headerStats("Scan in progress");
       UI.startBlink();
-      processedDevicesCount = 0;
-      devicesCount = 0;
-      scan_cursor = 0;
-      onScanProcessed = false;
-      onScanDone = false;
-      onScanPopulated = false;
-      onScanPropagated = false;
-      onScanPostPopulated = false;
-      onScanRendered = false;
+      beginScan();
       foundTimeServer = false;
       foundFileServer = false;
     }
@@ -1416,7 +1432,7 @@ class BLEScanUtils {
           if( fileServerBLEAddress != "" ) {
             UI.headerStats("File Sharing ...");
             log_w("Launching FileSharingClient Task");
-            xTaskCreatePinnedToCore( startFileSharingClient, "startFileSharingClient", 2048, NULL, 5, NULL, TASKLAUNCHER_CORE );
+            spawnTask( startFileSharingClient, "startFileSharingClient", 2048, NULL, 5, NULL, TASKLAUNCHER_CORE );
             while( scanTaskRunning ) {
               vTaskDelay( 10 );
             }
@@ -1431,7 +1447,7 @@ class BLEScanUtils {
           if( timeServerBLEAddress != "" ) {
             UI.headerStats("BLE Time sync ...");
             log_w("HOBO mode: found a peer with time provider service, launching BLE TimeClient Task");
-            xTaskCreatePinnedToCore(startTimeClient, "startTimeClient", 2048, NULL, 0, NULL, TASKLAUNCHER_CORE ); /* last = Task Core */
+            spawnTask(startTimeClient, "startTimeClient", 2048, NULL, 0, NULL, TASKLAUNCHER_CORE ); /* last = Task Core */
             while( scanTaskRunning ) {
               vTaskDelay( 10 );
             }
@@ -1441,45 +1457,14 @@ class BLEScanUtils {
       }
 
       UI.headerStats("Showing results ...");
-      devicesCount = processedDevicesCount;
       BLEDevice::getScan()->clearResults();
-      if ( devicesCount < MAX_DEVICES_PER_SCAN ) {
-        if ( SCAN_DURATION + 1 < MAX_SCAN_DURATION ) {
-          SCAN_DURATION++;
-        }
-      } else if ( devicesCount > MAX_DEVICES_PER_SCAN ) {
-        if ( SCAN_DURATION - 1 >= MIN_SCAN_DURATION ) {
-          SCAN_DURATION--;
-        }
-        log_w("Cache overflow (%d results vs %d slots), truncating results...", devicesCount, MAX_DEVICES_PER_SCAN);
-        devicesCount = MAX_DEVICES_PER_SCAN;
-      } else {
-        // same amount
-      }
-      sessDevicesCount += devicesCount;
-      notInCacheCount = 0;
-      inCacheCount = 0;
-      onScanDone = true;
-      scan_cursor = 0;
+      endScan();
 
       UI.update();
 
     }
 
 
-    static int getDeviceCacheIndex(const char* address) {
-      if ( isEmpty( address ) )  return -1;
-      for (int i = 0; i < BLEDEVCACHE_SIZE; i++) {
-        if ( strcmp(address, BLEDevRAMCache[i]->address ) == 0  ) {
-          BLEDevCacheHit++;
-          log_v("[CACHE HIT] BLEDevCache ID #%s has %d cache hits", address, BLEDevRAMCache[i]->hits);
-          return i;
-        }
-        delay(1);
-      }
-      return -1;
-    }
-
     // used for serial debugging
     static void dumpStats(const char* prefixStr) {
       if (lastheap > freeheap) {
@@ -1503,7 +1488,7 @@ class BLEScanUtils {
       lastheap = freeheap;
       lastscanduration = SCAN_DURATION;
 
-      log_i("%s[Scan#%02d][%s][Duration%s%d][Processed:%d of %d][Heap%s%d / %d] [Cache hits][BLEDevCards:%d][Anonymous:%d][Oui:%d][Vendor:%d]",
+      log_i("%s[Scan#%02d][%s][Duration%s%d][Processed:%d of %d][Heap%s%d / %d] [Cache hits][BLEDevCards:%d][Anonymous:%d][Rotating:%d][Oui:%d][Vendor:%d] [Filtered][Oui:%d][Vendor:%d] [Rotating addresses:%d][Entities:%d]",
         prefixStr,
         scan_rounds,
         hhmmssString,
@@ -1516,8 +1501,13 @@ class BLEScanUtils {
         freepsheap,
         BLEDevCacheHit,
         AnonymousCacheHit,
+        RotatingCache.hits,
         OuiCacheHit,
-        VendorCacheHit
+        VendorCacheHit,
+        OUILookup.filterRejects,
+        VendorLookup.filterRejects,
+        RotatingCache.inserts,
+        PseudoDevices.used()
        );
     }
 
@@ -1530,6 +1520,8 @@ class BLEScanUtils {
       UI.brightness    = preferences.getUChar("brightness", BASE_BRIGHTNESS);
       timeZone         = preferences.getFloat("timeZone", timeZone);
       summerTime       = preferences.getBool("summerTime", summerTime);
+      Metrics.period   = preferences.getUShort("metricsPeriod", 0);
+      PresenceSessions.timeout = preferences.getUShort("sessionTimeout", SESSIONS_ABSENCE_TIMEOUT);
       log_d("Defrosted brightness: %d", UI.brightness );
       log_w("Loaded NVS Prefs:");
       log_w("  serialEcho\t%s",    Out.serialEcho?"true":"false");
@@ -1537,6 +1529,8 @@ class BLEScanUtils {
       log_w("  brightness\t%d",    UI.brightness );
       log_w("  timeZone\t\t%.2g",    timeZone );
       log_w("  summerTime\t%s",    summerTime?"true":"false");
+      log_w("  metricsPeriod\t%d",  Metrics.period );
+      log_w("  sessionTimeout\t%d", PresenceSessions.timeout );
       #ifdef WITH_WIFI
         String poolZone  = preferences.getString( "poolZone", String( DEFAULT_NTP_SERVER ) );
         log_w("  poolZone\t\t%s", poolZone );
@@ -1550,30 +1544,15 @@ class BLEScanUtils {
       preferences.putUChar("brightness", UI.brightness );
       preferences.putFloat("timeZone", timeZone);
       preferences.putBool("summerTime", summerTime);
+      preferences.putUShort("metricsPeriod", Metrics.period);
+      preferences.putUShort("sessionTimeout", PresenceSessions.timeout);
       preferences.end();
     }
 
-    // completes unpopulated fields of a given entry by performing DB oui/vendor lookups
-    static void populate( BlueToothDevice *CacheItem ) {
-      if ( strcmp( CacheItem->ouiname, "[unpopulated]" ) == 0 ) {
-        log_d("  [populating OUI for %s]", CacheItem->address);
-        DB.getOUI( CacheItem->address, CacheItem->ouiname );
-      }
-      if ( strcmp( CacheItem->manufname, "[unpopulated]" ) == 0 ) {
-        if ( CacheItem->manufid != -1 ) {
-          log_d("  [populating Vendor for :%d]", CacheItem->manufid );
-          DB.getVendor( CacheItem->manufid, CacheItem->manufname );
-        } else {
-          BLEDevHelper.set( CacheItem, "manufname", '\0');
-        }
-      }
-      CacheItem->is_anonymous = BLEDevHelper.isAnonymous( CacheItem );
-      log_v("[populated :%s]", CacheItem->address);
-    }
-
 };
 
 
 
 
 BLEScanUtils BLECollector;
+
@@ -140,6 +140,7 @@ static byte lastPrintedMacIndex = 0; // index in the circular buffer
 static uint16_t notInCacheCount = 0; // scan-relative
 static uint16_t inCacheCount = 0; // scan-relative
 static int BLEDevCacheHit = 0; // cache relative
+static int BLEDevCacheLookups = 0; // cache relative
 //static int SelfCacheHit = 0; // cache relative
 static int AnonymousCacheHit = 0; // cache relative
 static int scan_rounds = 0; // how many scans
@@ -152,6 +153,15 @@ static uint16_t OuiCacheUsed = 0; // for statistics
 static DateTime lastSyncDateTime;
 static DateTime nowDateTime;
 
+// what the two most significant bits of a random address say about it
+enum BLEAddrKind {
+  ADDR_KIND_PUBLIC   = 0, // public or identity address
+  ADDR_KIND_STATIC   = 1, // 0b11, static random, stable until power cycle
+  ADDR_KIND_RPA      = 2, // 0b01, resolvable private, rotates every ~15mn
+  ADDR_KIND_NRPA     = 3, // 0b00, non-resolvable private, rotates
+  ADDR_KIND_RESERVED = 4  // 0b10
+};
+
 struct BlueToothDevice {
   bool in_db          = false;
   bool is_anonymous   = true;
@@ -160,6 +170,9 @@ struct BlueToothDevice {
   int rssi            = 0; // RSSI
   int manufid         = -1;// manufacturer data (or ID)
   uint8_t addr_type;
+  uint8_t addr_kind   = ADDR_KIND_PUBLIC;
+  uint64_t fingerprint = 0; // hash of the stable advertisement content, 0 = nothing stable
+  uint32_t entity      = 0; // pseudo-device linking rotating addresses, 0 = unlinked
   char* name      = NULL;// device name
   char* address   = NULL;// device mac address
   char* ouiname   = NULL;// oui vendor name (from mac address, see oui.h)
@@ -169,6 +182,28 @@ struct BlueToothDevice {
   DateTime updated_at = 0;
 };
 
+static uint32_t cacheYieldUs = 0; // time spent in cacheYield() since boot
+
+// the cache scans give the cpu away at every slot so they don't starve the other tasks,
+// the time spent there is accounted apart so the benchmarks can tell it from the scan itself
+static void cacheYield() {
+  unsigned long start = micros();
+  delay(1);
+  cacheYieldUs += micros() - start;
+}
+
+#define BLEADV_MAX_PAYLOAD 62 // advertisement + scan response
+
+// radio-agnostic advertisement, as produced by the simulator
+struct BLEAdvRecord {
+  uint32_t timestamp   = 0; // millis()
+  uint8_t  mac[6]      = {0}; // display order, mac[0] is the most significant byte
+  uint8_t  addr_type   = BLE_ADDR_PUBLIC;
+  int8_t   rssi        = 0;
+  uint8_t  payload_len = 0;
+  uint8_t  payload[BLEADV_MAX_PAYLOAD] = {0}; // raw AD structures
+};
+
 struct BlueToothDeviceLink {
   uint16_t cacheIndex;
   BlueToothDevice *device;
@@ -233,6 +268,9 @@ class BlueToothDeviceHelper {
       CacheItem->appearance = 0;
       CacheItem->rssi       = 0;
       CacheItem->manufid    = -1;
+      CacheItem->addr_kind  = ADDR_KIND_PUBLIC;
+      CacheItem->fingerprint = 0;
+      CacheItem->entity     = 0;
       memset( CacheItem->name,      0, MAX_FIELD_LEN+1 );
       memset( CacheItem->address,   0, MAC_LEN+1 );
       memset( CacheItem->ouiname,   0, MAX_FIELD_LEN+1 );
@@ -251,6 +289,7 @@ class BlueToothDeviceHelper {
       //log_d( "setting address type for %s", BLEAddrTypeToString( val ) ); // https://github.com/nkolban/ESP32_BLE_Arduino/blob/934702b6169b92c71cbc850876fd17fb9ee3236d/src/BLEAdvertisedDevice.h#L44
       if(!prop) return;
       else if(strcmp(prop, "addr_type")==0)   { CacheItem->addr_type = (uint8_t)(val); }
+      else if(strcmp(prop, "addr_kind")==0)   { CacheItem->addr_kind = (uint8_t)(val); }
     }
     static void set( BlueToothDevice *CacheItem, const char* prop, DateTime val ) {
        if(!prop) return;
@@ -294,6 +333,9 @@ class BlueToothDeviceHelper {
       if(overwrite) set( DestItem, "hits",         SourceItem->hits );
       if(overwrite) set( DestItem, "rssi",         SourceItem->rssi );
       if(overwrite) set( DestItem, "addr_type",    SourceItem->addr_type );
+      if(overwrite) set( DestItem, "addr_kind",    SourceItem->addr_kind );
+      if(overwrite || DestItem->fingerprint==0)           DestItem->fingerprint = SourceItem->fingerprint;
+      if(overwrite || DestItem->entity==0)                DestItem->entity      = SourceItem->entity;
       if(overwrite || DestItem->appearance==0)            set( DestItem, "appearance", SourceItem->appearance );
       if(overwrite || DestItem->manufid==-1)              set( DestItem, "manufid",    SourceItem->manufid );
       if(overwrite || isEmpty(DestItem->name))            set( DestItem, "name",       SourceItem->name );
@@ -310,11 +352,8 @@ class BlueToothDeviceHelper {
       set(CacheItem, "address", advertisedDevice->getAddress().toString().c_str());
       set(CacheItem, "rssi", advertisedDevice->getRSSI());
       set(CacheItem, "addr_type", advertisedDevice->getAddressType());
-      if(  advertisedDevice->getAddressType() == BLE_ADDR_RANDOM ) {
-        set(CacheItem, "ouiname", "[random]");
-      } else {
-        set(CacheItem, "ouiname", "[unpopulated]");
-      }
+      classify( CacheItem );
+      CacheItem->fingerprint = fingerprint( advertisedDevice->getPayload(), advertisedDevice->getPayloadLength() );
       if ( advertisedDevice->haveName() ) {
         set(CacheItem, "name", advertisedDevice->getName().c_str());
       }
@@ -419,13 +458,150 @@ class BlueToothDeviceHelper {
       CacheItem->hits = 1;
     }
 
+    // same as above from a raw advertisement record, only the fields used by the collector are decoded
+    static void store( BlueToothDevice *CacheItem, const BLEAdvRecord *record ) {
+      reset(CacheItem);// avoid mixing new and old data
+      char address[MAC_LEN+1];
+      snprintf( address, MAC_LEN+1, "%02x:%02x:%02x:%02x:%02x:%02x", record->mac[0], record->mac[1], record->mac[2], record->mac[3], record->mac[4], record->mac[5] );
+      set(CacheItem, "address", address);
+      set(CacheItem, "rssi", (int)record->rssi);
+      set(CacheItem, "addr_type", record->addr_type);
+      classify( CacheItem );
+      CacheItem->fingerprint = fingerprint( record->payload, record->payload_len );
+      bool hasUUID = false;
+      uint8_t pos = 0;
+      // AD structures: [length][type][data * length-1]
+      while( pos + 1 < record->payload_len ) {
+        uint8_t len = record->payload[pos];
+        if( len == 0 || pos + len >= record->payload_len ) break; // padding or truncated
+        uint8_t type = record->payload[pos+1];
+        const uint8_t *data = &record->payload[pos+2];
+        uint8_t datalen = len - 1;
+        switch( type ) {
+          case 0x08: // shortened local name
+          case 0x09: // complete local name
+          {
+            char name[MAX_FIELD_LEN+1] = {0};
+            memcpy( name, data, datalen > MAX_FIELD_LEN ? MAX_FIELD_LEN : datalen );
+            set(CacheItem, "name", name);
+          }
+          break;
+          case 0x19: // appearance
+            if( datalen >= 2 ) set(CacheItem, "appearance", (int)(data[0] | data[1] << 8));
+          break;
+          case 0xff: // manufacturer data
+            if( datalen >= 2 ) {
+              set(CacheItem, "manufname", "[unpopulated]");
+              set(CacheItem, "manufid", (int)(data[0] | data[1] << 8));
+            }
+          break;
+          case 0x02: // incomplete list of 16-bit service UUIDs
+          case 0x03: // complete list of 16-bit service UUIDs
+            if( !hasUUID && datalen >= 2 ) {
+              set(CacheItem, "uuid", BLEUUID( (uint16_t)(data[0] | data[1] << 8) ).toString().c_str());
+              hasUUID = true;
+            }
+          break;
+          case 0x06: // incomplete list of 128-bit service UUIDs
+          case 0x07: // complete list of 128-bit service UUIDs
+            if( !hasUUID && datalen >= 16 ) {
+              set(CacheItem, "uuid", BLEUUID( data, 16, false ).toString().c_str());
+              hasUUID = true;
+            }
+          break;
+          default:
+          break;
+        }
+        pos += len + 1;
+      }
+      if( TimeIsSet ) {
+        CacheItem->created_at = nowDateTime;
+      }
+      CacheItem->hits = 1;
+    }
+
+    // tags the address kind from the address type and the two MSBs, random addresses have no OUI to look up
+    static void classify( BlueToothDevice *CacheItem ) {
+      uint8_t kind = ADDR_KIND_PUBLIC;
+      if( CacheItem->addr_type == BLE_ADDR_RANDOM || CacheItem->addr_type == BLE_ADDR_RANDOM_ID ) {
+        char msbStr[3] = { CacheItem->address[0], CacheItem->address[1], '\0' };
+        switch( strtol( msbStr, NULL, 16 ) >> 6 ) {
+          case 0b11: kind = ADDR_KIND_STATIC;   break;
+          case 0b01: kind = ADDR_KIND_RPA;      break;
+          case 0b00: kind = ADDR_KIND_NRPA;     break;
+          default:   kind = ADDR_KIND_RESERVED; break;
+        }
+      }
+      set(CacheItem, "addr_kind", kind);
+      switch( kind ) {
+        case ADDR_KIND_PUBLIC: set(CacheItem, "ouiname", "[unpopulated]"); break;
+        case ADDR_KIND_STATIC: set(CacheItem, "ouiname", "[static]");      break;
+        default:               set(CacheItem, "ouiname", "[random]");      break;
+      }
+    }
+
+    // FNV-1a over the AD structures that survive an address rotation: name, appearance, tx power,
+    // service UUID lists, service data UUIDs and the manufacturer data prefix (company id + frame type),
+    // plus the length of each structure, the rest (flags, service data, manufacturer payload) changes
+    // between advertisements. Many devices share a signature (e.g. iPhones only advertising 4C 00 10 xx),
+    // PseudoDevices.link() only hands an entity over to a new address once its last one went quiet
+    static uint64_t fingerprint( const uint8_t *payload, size_t payload_len ) {
+      uint64_t hash = 0xcbf29ce484222325ULL;
+      bool stable = false;
+      size_t pos = 0;
+      while( pos + 1 < payload_len ) {
+        uint8_t len = payload[pos];
+        if( len == 0 || pos + len >= payload_len ) break; // padding or truncated
+        uint8_t type = payload[pos+1];
+        uint8_t datalen = len - 1;
+        uint8_t hashlen = datalen;
+        switch( type ) {
+          case 0xff: // manufacturer data
+            hashlen = min( datalen, (uint8_t)FINGERPRINT_MANUF_PREFIX );
+          break;
+          case 0x16: // service data, 16-bit UUID
+            hashlen = min( datalen, (uint8_t)2 );
+          break;
+          case 0x20: // service data, 32-bit UUID
+            hashlen = min( datalen, (uint8_t)4 );
+          break;
+          case 0x21: // service data, 128-bit UUID
+            hashlen = min( datalen, (uint8_t)16 );
+          break;
+          case 0x02: case 0x03: // 16-bit service UUIDs
+          case 0x04: case 0x05: // 32-bit service UUIDs
+          case 0x06: case 0x07: // 128-bit service UUIDs
+          case 0x08: case 0x09: // local name
+          case 0x0a: // tx power
+          case 0x19: // appearance
+          break;
+          default:
+            pos += len + 1;
+            continue;
+        }
+        hash = ( hash ^ type ) * 0x100000001b3ULL;
+        hash = ( hash ^ datalen ) * 0x100000001b3ULL;
+        for( uint8_t i=0; i<hashlen; i++ ) {
+          hash = ( hash ^ payload[pos+2+i] ) * 0x100000001b3ULL;
+        }
+        stable = true;
+        pos += len + 1;
+      }
+      return stable ? hash | 1 : 0; // never 0 when something was hashed
+    }
+
+    // rotating addresses are one-off entries: they don't go in BLEDevRAMCache or in the DB
+    static bool isRotating( BlueToothDevice *CacheItem ) {
+      return CacheItem->addr_kind >= ADDR_KIND_RPA;
+    }
+
     // determines whether a device is worth saving or not
     static bool isAnonymous( BlueToothDevice *CacheItem ) {
       // if( !isEmpty( CacheItem->uuid )) return false; // uuid's are interesting, let's collect
       if( !isEmpty( CacheItem->name )) return false; // has name, let's collect
       if( CacheItem->appearance !=0 ) return false; // has icon, let's collect
       if( strcmp( CacheItem->ouiname, "[unpopulated]" ) == 0 || strcmp( CacheItem->manufname, "[unpopulated]" ) == 0 ) return false; // don't know yet, let's keep
-      if( strcmp( CacheItem->ouiname, "[private]" ) == 0 || strcmp( CacheItem->ouiname, "[random]" ) == 0 || isEmpty( CacheItem->ouiname ) ) return true; // don't care
+      if( strcmp( CacheItem->ouiname, "[private]" ) == 0 || strcmp( CacheItem->ouiname, "[random]" ) == 0 || strcmp( CacheItem->ouiname, "[static]" ) == 0 || isEmpty( CacheItem->ouiname ) ) return true; // don't care
       if( strcmp( CacheItem->manufname, "[unknown]" ) == 0 || isEmpty( CacheItem->manufname ) ) return true; // don't care
       if( !isEmpty( CacheItem->manufname ) && !isEmpty( CacheItem->ouiname ) ) return false; // anonymous but qualified device, let's collect
       return true;
@@ -438,16 +614,26 @@ class BlueToothDeviceHelper {
           return "BLE_ADDR_TYPE_PUBLIC";
         case BLE_ADDR_RANDOM:
           return "BLE_ADDR_TYPE_RANDOM";
-        /*case BLE_ADDR_RPA_PUBLIC:
+        case BLE_ADDR_PUBLIC_ID:
           return "BLE_ADDR_TYPE_RPA_PUBLIC";
-        case BLE_ADDR_RPA_RANDOM:
-          return "BLE_ADDR_TYPE_RPA_RANDOM";*/
+        case BLE_ADDR_RANDOM_ID:
+          return "BLE_ADDR_TYPE_RPA_RANDOM";
         default:
           log_e("Unknown addrtype : %d", type );
           return "Unknown uint8_t";
       }
     }
 
+    static const char *BLEAddrKindToString( uint8_t kind ) {
+      switch (kind) {
+        case ADDR_KIND_PUBLIC:   return "public";
+        case ADDR_KIND_STATIC:   return "static random";
+        case ADDR_KIND_RPA:      return "resolvable private";
+        case ADDR_KIND_NRPA:     return "non-resolvable private";
+        default:                 return "reserved";
+      }
+    }
+
     static const BLEGATTService gattServiceDescription( const char* serviceUUIDStr ) {
       //const char* serviceUUIDStr = serviceUUID.toString().c_str();
       if( serviceUUIDStr == NULL ) return BLE_unknownService;
@@ -513,7 +699,7 @@ class BlueToothDeviceHelper {
           minCacheValue = CacheItem[tempIndex]->hits;
           outIndex = tempIndex;
         }
-        delay(1);
+        cacheYield();
       }
       return outIndex;
     }
@@ -135,10 +135,8 @@ static int checkVendorResponse = 0;
 static bool checkMacResponded = false;
 static int checkMacResponse = 0;
 
-const char* sizeMarker             = "size:";
 const char* dateTimeMarker         = "dateTime:";
 const char* dateTimeMarkerTpl      = "dateTime:%04d-%02d-%02d %02d:%03d:%03d %d %d %d %d";
-const char* closeMessage           = "close";
 const char* restartMessage         = "restart";
 const char* lsMessage              = "ls";
 const char* lsDoneMessage          = "lsdone";
@@ -389,7 +387,7 @@ static void TimeServerTask( void * param ) {
 
   TimeServerSignalSent = false;
 
-  xTaskCreate( TimeServerTaskNotify, "TimeServerTaskNotify", 2560, NULL, 6, NULL );
+  spawnTask( TimeServerTaskNotify, "TimeServerTaskNotify", 2560, NULL, 6, NULL, tskNO_AFFINITY );
 
   while ( timeServerIsRunning ) {
     if( TimeServerSignalSent ) {
@@ -414,69 +412,387 @@ static void TimeServerTask( void * param ) {
 byte receivedFiles = 0;
 
 
-void FileSharingReceiveFile( const char* filename ) {
+#define FILESHARING_RESUME_EVERY 65536 // bytes between two saves of the resume point
+
+// sidecar of a .part file, what it will be once complete and how much of it was verified
+struct FileSharingResumeInfo {
+  uint8_t  sha256[FT_HASH_LEN];
+  uint32_t verified;
+};
+
+static char     FileReceiverName[FT_NAME_LEN];
+static char     FileReceiverPartPath[FT_NAME_LEN+8];
+static char     FileReceiverResumePath[FT_NAME_LEN+8];
+static uint8_t  FileReceiverSha[FT_HASH_LEN];
+static uint32_t FileReceiverVerified = 0;
+static uint32_t FileReceiverResumeSaved = 0;
+
+
+static void FileSharingSaveResumeInfo( uint32_t verified ) {
+  FileSharingResumeInfo info;
+  memcpy( info.sha256, FileReceiverSha, FT_HASH_LEN );
+  info.verified = verified;
+  File resumeFile = BLE_FS.open( FileReceiverResumePath, FILE_WRITE );
+  if ( !resumeFile ) {
+    log_e("Can't save resume point to %s", FileReceiverResumePath);
+    return;
+  }
+  resumeFile.write( (uint8_t*)&info, sizeof(FileSharingResumeInfo) );
+  resumeFile.close();
+  FileReceiverResumeSaved = verified;
+}
+
+
+static bool FileSharingHashSink( void* ctx, const uint8_t* data, size_t len ) {
+  ((FTHash*)ctx)->update( data, len );
+  return true;
+}
+
+
+#define FILESHARING_PACKED_HASHES 2 // one per reference DB
+
+// packing a reference DB takes seconds, its hash is kept until the file changes
+struct FileSharingPackedHash {
+  char    path[FT_NAME_LEN];
+  size_t  size;
+  time_t  lastWrite;
+  uint8_t sha256[FT_HASH_LEN];
+};
+
+static FileSharingPackedHash FileSharingPackedHashes[FILESHARING_PACKED_HASHES];
+static uint8_t FileSharingPackedHashNext = 0;
+
+
+// SHA-256 of <localFile> once packed, from the cache when its size and mtime didn't change
+static bool FileSharingPackedHashOf( File &localFile, const char* path, uint8_t* sha256 ) {
+  size_t size = localFile.size();
+  time_t lastWrite = localFile.getLastWrite();
+  for ( uint8_t i = 0; i < FILESHARING_PACKED_HASHES; i++ ) {
+    FileSharingPackedHash *cached = &FileSharingPackedHashes[i];
+    if ( strcmp( cached->path, path ) == 0 && cached->size == size && cached->lastWrite == lastWrite ) {
+      memcpy( sha256, cached->sha256, FT_HASH_LEN );
+      return true;
+    }
+  }
+  FTHash packedHash;
+  bool hashed = LZStreamUtils::pack( localFile, size, FileSharingHashSink, &packedHash );
+  packedHash.finish( sha256 );
+  if ( !hashed ) return false;
+  FileSharingPackedHash *slot = &FileSharingPackedHashes[0];
+  for ( uint8_t i = 0; i < FILESHARING_PACKED_HASHES; i++ ) { // same file with an older hash, or round robin
+    if ( strcmp( FileSharingPackedHashes[i].path, path ) == 0 ) {
+      slot = &FileSharingPackedHashes[i];
+      break;
+    }
+    if ( i == FILESHARING_PACKED_HASHES-1 ) {
+      slot = &FileSharingPackedHashes[FileSharingPackedHashNext];
+      FileSharingPackedHashNext = ( FileSharingPackedHashNext + 1 ) % FILESHARING_PACKED_HASHES;
+    }
+  }
+  snprintf( slot->path, sizeof(slot->path), "%s", path );
+  slot->size      = size;
+  slot->lastWrite = lastWrite;
+  memcpy( slot->sha256, sha256, FT_HASH_LEN );
+  return true;
+}
+
+
+// returns the offset to resume from, FT_OPEN_SKIP if the local copy is identical or FT_OPEN_FAIL
+int32_t FileSharingReceiveFile( const char* filename, uint32_t size, const uint8_t* sha256 ) {
+  uint8_t localSha[FT_HASH_LEN];
+  uint32_t offset = 0;
+  snprintf( FileReceiverName,       sizeof(FileReceiverName),       "%s", filename );
+  snprintf( FileReceiverPartPath,   sizeof(FileReceiverPartPath),   "%s.part", filename );
+  snprintf( FileReceiverResumePath, sizeof(FileReceiverResumePath), "%s.resume", filename );
+  memcpy( FileReceiverSha, sha256, FT_HASH_LEN );
+  FileReceiverExpectedSize = size;
   FileReceiverReceivedSize = 0;
   FileReceiverProgress = 0;
-  log_w("Will create %s", filename);
-  FileReceiver = BLE_FS.open( filename, FILE_WRITE );
-  // receivedFiles
-  if( FileReceiverExpectedSize == FileReceiver.size() ) {
-    log_w("Files are identical, transferring is useless");
+
+  isQuerying = true;
+  if ( LZStream.isContainer( filename ) ) {
+    // packing is deterministic, the local copy packs to the same container when identical
+    char target[FT_NAME_LEN];
+    LZStream.targetOf( filename, target, sizeof(target) );
+    File localFile = BLE_FS.open( target );
+    if ( localFile ) {
+      bool hashed = FileSharingPackedHashOf( localFile, target, localSha );
+      localFile.close();
+      if ( hashed && memcmp( localSha, sha256, FT_HASH_LEN ) == 0 ) {
+        log_w("Files are identical, transferring is useless");
+        isQuerying = false;
+        return FT_OPEN_SKIP;
+      }
+    }
+  }
+  File localFile = BLE_FS.open( filename );
+  if ( localFile && localFile.size() == size ) {
+    bool hashed = FTHash::file( localFile, size, localSha );
+    localFile.close();
+    if ( hashed && memcmp( localSha, sha256, FT_HASH_LEN ) == 0 ) {
+      log_w("Files are identical, transferring is useless");
+      isQuerying = false;
+      return FT_OPEN_SKIP;
+    }
+  } else if ( localFile ) {
+    localFile.close();
+  }
+
+  // a previous transfer of the same content was interrupted
+  File resumeFile = BLE_FS.open( FileReceiverResumePath );
+  if ( resumeFile ) {
+    FileSharingResumeInfo info;
+    if ( resumeFile.read( (uint8_t*)&info, sizeof(FileSharingResumeInfo) ) == sizeof(FileSharingResumeInfo)
+      && memcmp( info.sha256, sha256, FT_HASH_LEN ) == 0
+      && info.verified <= size ) {
+      File partFile = BLE_FS.open( FileReceiverPartPath );
+      if ( partFile && partFile.size() >= info.verified ) {
+        offset = info.verified;
+      }
+      if ( partFile ) partFile.close();
+    }
+    resumeFile.close();
+  }
+
+  if ( offset > 0 ) {
+    log_w("Resuming %s at offset %d", FileReceiverPartPath, offset);
+    FileReceiver = BLE_FS.open( FileReceiverPartPath, "r+" );
+    if ( FileReceiver && !FileReceiver.seek( offset ) ) {
+      FileReceiver.close();
+    }
+  } else {
+    log_w("Will create %s", FileReceiverPartPath);
+    FileReceiver = BLE_FS.open( FileReceiverPartPath, FILE_WRITE );
   }
   if ( !FileReceiver ) {
-    log_e("Failed to create %s", filename);
+    log_e("Failed to create %s", FileReceiverPartPath);
+    isQuerying = false;
+    return FT_OPEN_FAIL;
+  }
+  FileSharingSaveResumeInfo( offset );
+  isQuerying = false;
+  FileReceiverVerified = offset;
+  FileReceiverReceivedSize = offset;
+  log_d("Successfully opened %s for writing", FileReceiverPartPath);
+  return offset;
+}
+
+
+// unpacks a received .blz next to its target, then swaps them
+static bool FileSharingUnpack( const char* packedPath, const char* containerName ) {
+  char target[FT_NAME_LEN];
+  char tmpPath[FT_NAME_LEN+8];
+  uint8_t buff[512];
+  LZStream.targetOf( containerName, target, sizeof(target) );
+  snprintf( tmpPath, sizeof(tmpPath), "%s.tmp", target );
+  File in  = BLE_FS.open( packedPath );
+  File out = BLE_FS.open( tmpPath, FILE_WRITE );
+  bool success = in && out;
+  LZStreamDecoder decoder;
+  decoder.begin( LZStreamUtils::fileSink, &out );
+  while ( success && in.available() ) {
+    size_t got = in.read( buff, sizeof(buff) );
+    success = got > 0 && decoder.write( buff, got );
+  }
+  success = success && decoder.finish() && !decoder.passthrough;
+  decoder.end();
+  if ( in ) in.close();
+  if ( out ) out.close();
+  if ( success ) {
+    BLE_FS.remove( target );
+    success = BLE_FS.rename( tmpPath, target );
+    log_w("Unpacked %s to %s (%d bytes)", packedPath, target, decoder.written);
+  } else {
+    log_e("Can't unpack %s", packedPath);
+    BLE_FS.remove( tmpPath );
   }
-  log_d("Successfully opened %s for writing", filename);
+  return success;
 }
 
 
-void FileSharingCloseFile() {
+// returns true if the received file passed the checks and replaced the local one
+bool FileSharingCloseFile( bool complete = true ) {
   if ( !FileReceiver ) {
     log_e("Nothing to close!");
-    return;
+    return false;
   }
+  bool success = false;
   takeMuxSemaphore();
-  const char* filename = FileReceiver.name(); // store filename for reopening
+  isQuerying = true;
   FileReceiver.close();
-  FileReceiver = BLE_FS.open( filename ); // r/w mode gives bogus size, reopen r/o
 
-  if ( FileReceiverReceivedSize != FileReceiverExpectedSize ) {
-    log_e("Total size != expected size ( %d != %d )", FileReceiver.size(), FileReceiverExpectedSize);
-    Out.println( "Copy Failed, please try again." );
-    FileReceiver.close();
-    BLE_FS.remove( filename );
+  if ( !complete ) {
+    // .part and .resume stay for the next attempt
+    FileSharingSaveResumeInfo( FileReceiverVerified );
+    Out.println( "Copy interrupted, will resume." );
   } else {
+    uint8_t receivedSha[FT_HASH_LEN];
+    FileReceiver = BLE_FS.open( FileReceiverPartPath ); // r/w mode gives bogus size, reopen r/o
+    size_t receivedSize = FileReceiver.size();
+    bool hashed = receivedSize == FileReceiverExpectedSize && FTHash::file( FileReceiver, receivedSize, receivedSha );
     FileReceiver.close();
-    Out.println( "Copy successful!" );
+    if ( receivedSize != FileReceiverExpectedSize ) {
+      log_e("Total size != expected size ( %d != %d )", receivedSize, FileReceiverExpectedSize);
+    } else if ( !hashed || memcmp( receivedSha, FileReceiverSha, FT_HASH_LEN ) != 0 ) {
+      log_e("SHA-256 mismatch on %s", FileReceiverPartPath);
+    } else {
+      success = true;
+    }
+    if ( success && LZStream.isContainer( FileReceiverName ) ) {
+      success = FileSharingUnpack( FileReceiverPartPath, FileReceiverName );
+      BLE_FS.remove( FileReceiverPartPath );
+    } else if ( success && LookupTableFor( FileReceiverName ) != NULL ) {
+      success = LookupTableFor( FileReceiverName )->stage( FileReceiverPartPath ); // hot swap
+    } else if ( success ) {
+      BLE_FS.remove( FileReceiverName );
+      success = BLE_FS.rename( FileReceiverPartPath, FileReceiverName );
+    } else {
+      BLE_FS.remove( FileReceiverPartPath );
+    }
+    BLE_FS.remove( FileReceiverResumePath );
+    Out.println( success ? "Copy successful!" : "Copy Failed, please try again." );
   }
+  isQuerying = false;
   giveMuxSemaphore();
-  //TODO: sha256_sum
   FileReceiverExpectedSize = 0;
   FileReceiverReceivedSize = 0;
   FileReceiverProgress = 0;
+  return success;
+}
+
+
+FileTransferReceiver FileTransferRx;
+
+
+// hashing, unpacking and renaming are too slow for the BLE host task,
+// the sink callbacks queue the open/close and FileSharingServerTask runs them
+enum FileSharingJobType {
+  FILESHARING_JOB_NONE = 0,
+  FILESHARING_JOB_OPEN,
+  FILESHARING_JOB_CLOSE
+};
+
+static volatile FileSharingJobType FileSharingJob = FILESHARING_JOB_NONE;
+static char     FileSharingJobName[FT_NAME_LEN];
+static uint32_t FileSharingJobSize = 0;
+static uint8_t  FileSharingJobSha[FT_HASH_LEN];
+
+
+static int32_t FileSharingRxOpen( const char* filename, uint32_t size, const uint8_t* sha256 ) {
+  char target[FT_NAME_LEN];
+  snprintf( target, sizeof(target), "%s", filename );
+  if ( LZStream.isContainer( filename ) ) { // reference DBs come packed
+    LZStream.targetOf( filename, target, sizeof(target) );
+  }
+  bool referenceDB = strcmp( target, BLE_VENDOR_NAMES_DB_FS_PATH ) == 0 || strcmp( target, MAC_OUI_NAMES_DB_FS_PATH ) == 0;
+  bool lookupTable = LookupTableFor( filename ) != NULL;
+  if ( !referenceDB && !lookupTable && !DBSync.isSyncFile( filename ) ) {
+    log_e( "No filename matching %s !", filename );
+    return FT_OPEN_FAIL;
+  }
+  if ( FileSharingJob != FILESHARING_JOB_NONE ) {
+    log_e( "Previous file still being processed, can't open %s", filename );
+    return FT_OPEN_FAIL;
+  }
+  snprintf( FileSharingJobName, sizeof(FileSharingJobName), "%s", filename );
+  FileSharingJobSize = size;
+  memcpy( FileSharingJobSha, sha256, FT_HASH_LEN );
+  FileSharingJob = FILESHARING_JOB_OPEN;
+  return FT_OPEN_PENDING; // answered by FileSharingMaintain()
+}
+
+
+static bool FileSharingRxWrite( const uint8_t* src, size_t len ) {
+  if ( !FileReceiver ) {
+    // file write problem ?
+    log_e("Ignored %d bytes", len);
+    return false;
+  }
+  if ( FileReceiver.write( src, len ) != len ) {
+    return false;
+  }
+  FileReceiverReceivedSize += len;
+  FileReceiverProgress = FileTransferRx.percent();
+  return true;
+}
+
+
+static bool FileSharingRxRewind( uint32_t offset ) {
+  if ( !FileReceiver || !FileReceiver.seek( offset ) ) {
+    return false;
+  }
+  FileReceiverReceivedSize = offset;
+  return true;
+}
+
+
+static void FileSharingRxVerified( uint32_t offset ) {
+  FileReceiverVerified = offset;
+  if ( offset - FileReceiverResumeSaved >= FILESHARING_RESUME_EVERY ) {
+    FileSharingSaveResumeInfo( offset );
+  }
+}
+
+
+static int8_t FileSharingRxClose( bool complete ) {
+  log_w("Closing file (%d frames, %d out of order, %d duplicates, %d acks, %d rewinds, resumed at %d)",
+    FileTransferRx.stats.frames,
+    FileTransferRx.stats.outOfOrder,
+    FileTransferRx.stats.duplicates,
+    FileTransferRx.stats.acks,
+    FileTransferRx.stats.rewinds,
+    FileTransferRx.stats.offset
+  );
+  if ( !complete ) {
+    FileSharingCloseFile( false ); // only saves the resume point
+    return FT_CLOSE_FAIL;
+  }
+  FileSharingJob = FILESHARING_JOB_CLOSE;
+  return FT_CLOSE_PENDING; // answered by FileSharingMaintain()
+}
+
+
+// server task: runs the queued open/close and answers the sender
+static void FileSharingMaintain() {
+  switch ( FileSharingJob ) {
+    case FILESHARING_JOB_OPEN: {
+      log_w( "FileSharingReceiveFile( %s )", FileSharingJobName );
+      int32_t offset = FileSharingReceiveFile( FileSharingJobName, FileSharingJobSize, FileSharingJobSha );
+      FileSharingJob = FILESHARING_JOB_NONE;
+      FileTransferRx.opened( offset );
+    }
+    break;
+    case FILESHARING_JOB_CLOSE: {
+      bool success = FileSharingCloseFile( true );
+      if ( success && DBSync.isSyncFile( FileReceiverName ) ) {
+        DBSync.queueMerge( FileReceiverName ); // merged below by DBSync.maintain()
+      }
+      FileSharingJob = FILESHARING_JOB_NONE;
+      FileTransferRx.closed( success );
+    }
+    break;
+    default:
+    break;
+  }
+}
+
+
+static bool FileSharingRxControl( const uint8_t* frame, size_t len ) {
+  FileSharingRouteChar->setValue( (uint8_t*)frame, len );
+  FileSharingRouteChar->notify();
+  return true;
+}
+
+
+static uint32_t FileSharingNow() {
+  return millis();
 }
 
 
 class FileSharingWriteCallbacks : public BLECharacteristicCallbacks {
     void onWrite( BLECharacteristic* WriterAgent ) {
-      size_t len = WriterAgent->getDataLength();
-      if ( FileReceiverExpectedSize == 0 ) {
-        // no size was previously sent, can't calculate
-        log_e("Ignored %d bytes", len);
-        return;
-      }
-      size_t progress = (((float)FileReceiverReceivedSize / (float)FileReceiverExpectedSize) * 100.00);
-      if ( FileReceiver ) {
-        FileReceiver.write( (const uint8_t*)(WriterAgent->getValue().c_str()), len );
-        log_w("Wrote %d bytes", len);
-        FileReceiverReceivedSize += len;
-      } else {
-        // file write problem ?
-        log_e("Ignored %d bytes", len);
-      }
-      if ( FileReceiverProgress != progress ) {
-        FileReceiverProgress = progress;
-      }
+      std::string value = WriterAgent->getValue();
+      FileTransferRx.onData( (const uint8_t*)value.data(), value.length() );
     }
 };
 
@@ -497,19 +813,23 @@ class FileSharingRouteCallbacks : public BLECharacteristicCallbacks {
       */
       //std::string dscVal((char*)RouterAgent->getValue(), RouterAgent->getDataLength());
 
-      const char* routing = RouterAgent->getValue().c_str();
+      std::string value = RouterAgent->getValue();
+
+      if ( (uint8_t)value[0] >= DBSYNC_FRAME_MIN ) { // daily DB sync frames
+        DBSync.onControl( (const uint8_t*)value.data(), value.length() );
+        return;
+      }
+
+      if ( (uint8_t)value[0] >= FT_FRAME_MIN ) { // binary transfer frames
+        FileTransferRx.onControl( (const uint8_t*)value.data(), value.length() );
+        return;
+      }
+
+      const char* routing = value.c_str();
 
       log_w("Received copy routing query (len=%d): %s", strLenRouting, routing);
 
-      if ( strstr(routing, sizeMarker) ) { // messages starting with "size:"
-        log_w("Received sizeMarker");
-        if ( strLenRouting > strlen( sizeMarker ) ) {
-          char* lenStr = substr( routing, strlen(sizeMarker), strLenRouting - strlen(sizeMarker) );
-          FileReceiverExpectedSize = atoi( lenStr );
-          log_w( "Assigned size_t %d", FileReceiverExpectedSize );
-          free( lenStr );
-        }
-      } else if( strstr(routing, dateTimeMarker ) ) {
+      if( strstr(routing, dateTimeMarker ) ) {
         log_w("Received dateTimeMarker");
         if ( strlen( routing ) > strlen( dateTimeMarker ) ) {
           char* lenStr = substr( routing, strlen(dateTimeMarker), strlen(routing) - strlen(dateTimeMarker) );
@@ -587,9 +907,6 @@ class FileSharingRouteCallbacks : public BLECharacteristicCallbacks {
           setBLETime();
           free( lenStr );
         }
-      } else if ( strcmp( routing, closeMessage ) == 0 ) { // file end
-        log_w("Closing file");
-        FileSharingCloseFile();
       } else if ( strcmp( routing, restartMessage ) == 0 ) { // transfert finished
         ESP.restart();
       } else if ( strcmp( routing, checkVendorFileMessage ) == 0 ) {
@@ -639,16 +956,8 @@ class FileSharingRouteCallbacks : public BLECharacteristicCallbacks {
         }
         RouterAgent->setValue( (uint8_t*)lsDoneMessage, strlen(lsDoneMessage));
         RouterAgent->notify();
-      } else { // filenames
-        if ( strcmp( routing, BLE_VENDOR_NAMES_DB_FS_PATH ) == 0 ) {
-          log_w( "FileSharingReceiveFile( %s )", BLE_VENDOR_NAMES_DB_FS_PATH );
-          FileSharingReceiveFile( BLE_VENDOR_NAMES_DB_FS_PATH );
-        } else  if ( strcmp( routing, MAC_OUI_NAMES_DB_FS_PATH ) == 0 ) {
-          log_w( "FileSharingReceiveFile( %s )", MAC_OUI_NAMES_DB_FS_PATH );
-          FileSharingReceiveFile( MAC_OUI_NAMES_DB_FS_PATH);
-        } else {
-          log_e( "No filename matching !");
-        }
+      } else {
+        log_e( "Unknown routing query !");
       }
       takeMuxSemaphore();
       Out.println( routing );
@@ -677,6 +986,7 @@ class FileSharingCallbacks : public BLEServerCallbacks {
     void onDisconnect(BLEServer* SharingServer) {
       log_w("A client disconnected, restarting advertising");
       isFileSharingClientConnected = false;
+      FileTransferRx.cancel();
       UI.headerStats("Advertising (_x_)");
       takeMuxSemaphore();
       Out.println( "Client disconnected" );
@@ -698,6 +1008,7 @@ void stopFileSharingServer() {
   fileSharingServerTaskShouldStop = false;
   fileDownloadingEnabled = false;
   receivedFiles = 0;
+  FileSharingJob = FILESHARING_JOB_NONE;
 }
 
 // server as a slave service: wait for an upload signal
@@ -738,6 +1049,15 @@ static void FileSharingServerTask(void* p) {
   FileSharingRouteChar->setCallbacks( FileSharingRouteCallback );
   FileSharingWriteChar->setCallbacks( FileSharingWriteCallback );
 
+  FileTransferRx.open     = FileSharingRxOpen;
+  FileTransferRx.write    = FileSharingRxWrite;
+  FileTransferRx.rewind   = FileSharingRxRewind;
+  FileTransferRx.verified = FileSharingRxVerified;
+  FileTransferRx.close    = FileSharingRxClose;
+  FileTransferRx.control  = FileSharingRxControl;
+  FileTransferRx.now      = FileSharingNow;
+  DBSync.control          = FileSharingRxControl;
+
   //BLE2902* pRoute2902 = (BLE2902*)FileSharingRouteChar->createDescriptor("2902", NIMBLE_PROPERTY::NOTIFY/** | NIMBLE_PROPERTY::READ | NIMBLE_PROPERTY::WRITE **/);
   //pRoute2902->setCallbacks(FileSharingRouteCallback);
 
@@ -765,6 +1085,8 @@ static void FileSharingServerTask(void* p) {
       progress = FileReceiverProgress;
       //vTaskDelay(10);
     }
+    FileSharingMaintain(); // file open/close requested by the peer
+    DBSync.maintain(); // summaries and merges requested by the peer
     if ( fileSharingServerTaskShouldStop ) { // stop signal from outside the task
       stopFileSharingServer();
       vTaskDelete( NULL );
@@ -791,127 +1113,171 @@ unsigned long fileSharingClientTimeout = 10000;
 char myDateTimeMarker[50] = {0};
 //char dateTimeAsChar[sizeof(bt_time_t)+1] = {0};
 
-void FileSharingSendFile( BLERemoteCharacteristic* RemoteChar, const char* filename ) {
-  while( fileTransferInProgress ) {
-    log_w("Waiting for current transfert to finish");
-    vTaskDelay( 1000 );
+FileTransferSender FileTransferTx;
+static File FileSender;
+static int  FileSenderPercent = 0;
+
+
+static bool FileSharingTxData( const uint8_t* frame, size_t len ) {
+  // write without response, fails when the outgoing buffers are full
+  return FileSharingReadRemoteChar->writeValue( (uint8_t*)frame, len, false );
+}
+
+
+static bool FileSharingTxControl( const uint8_t* frame, size_t len ) {
+  return FileSharingRouterRemoteChar->writeValue( (uint8_t*)frame, len, true );
+}
+
+
+static size_t FileSharingTxRead( uint32_t offset, uint8_t* dst, size_t len ) {
+  // only retransmits need to seek back
+  if ( FileSender.position() != offset && !FileSender.seek( offset ) ) {
+    return 0;
   }
+  return FileSender.read( dst, len );
+}
 
-  /*
-  // send local datetime as a binary string
-  uint8_t* dateTime = getBLETime();
-  sprintf( myDateTimeMarker, dateTimeMarkerTpl,
-    BLELocalTime.year,
-    BLELocalTime.month,
-    BLELocalTime.day,
-    BLELocalTime.hour,
-    BLELocalTime.minutes,
-    BLELocalTime.seconds,
-    BLELocalTime.wday,
-    BLELocalTime.fraction,
-    BLELocalTime.adjust,
-    BLELocalTime.tz
-  );
-  log_w("RemoteChar->writevalue(%d bytes): \"%s\"", strlen(myDateTimeMarker), myDateTimeMarker );
-  //sprintf( myDateTimeMarker, "%s%s", dateTimeMarker, (const char*)dateTime );
-  //log_w("RemoteChar->writevalue( %s, %d )", (const char*)myDateTimeMarker, strlen(myDateTimeMarker)+1 );
-  if( !RemoteChar->writeValue( (uint8_t*)myDateTimeMarker, strlen(myDateTimeMarker)+1 ) ) {
-    log_e("Failed to send datetime");
-    fileSharingSendFileError = true;
-    return;
+
+static void FileSharingTxIdle() {
+  vTaskDelay(1);
+}
+
+
+static void FileSharingTxProgress( uint32_t done, uint32_t total ) {
+  fileSharingClientLastActivity = millis();
+  int percent = ( done * 100 ) / total;
+  if ( FileSenderPercent != percent ) {
+    UI.PrintProgressBar( (Out.width * percent) / 100 );
+    FileSenderPercent = percent;
   }
-  log_w("Time sent !");
-  vTaskDelay( 200 );
-*/
+}
 
-  log_w("RemoteChar->writeValue( %s,  %d)", filename, strlen(filename)+1 );
-  if ( !RemoteChar->writeValue((uint8_t*)filename, strlen(filename)+1, false) ) {
-    log_e("Remote is unable to comply to %s filename query", filename);
-    return;
+
+void FileSharingSendFile( const char* filename ) {
+  while( fileTransferInProgress ) {
+    log_w("Waiting for current transfert to finish");
+    vTaskDelay( 1000 );
   }
-  log_w("Filename sent !");
-  vTaskDelay( 200 );
 
   fileSharingSendFileError = false;
   fileTransferInProgress = true;
-  File fileToTransfer = BLE_FS.open( filename );
+  FileSender = BLE_FS.open( filename );
 
-  if ( !fileToTransfer ) {
+  if ( !FileSender ) {
     log_e("Can't open %s for reading", filename);
     fileSharingSendFileError = true;
     fileTransferInProgress = false;
     return;
   }
-  size_t totalsize = fileToTransfer.size();
-  size_t progress = totalsize;
 
-  // send file size as string
-  char myTotalSize[32];
-  sprintf( myTotalSize, "%s%d", sizeMarker, totalsize );
-  log_w("RemoteChar->writevalue( myTotalSize: '%s' )", (const char*)myTotalSize);
-  if( !RemoteChar->writeValue((uint8_t*)myTotalSize, strlen(myTotalSize)+1, false) ) {
-    log_e("Failed to send file size");
-    fileSharingSendFileError = true;
-    fileTransferInProgress = false;
-    fileToTransfer.close();
-    return;
-  }
-  log_w("Size sent !");
-
-  //vTaskDelay( 1000 );
+  FileTransferTx.data     = FileSharingTxData;
+  FileTransferTx.control  = FileSharingTxControl;
+  FileTransferTx.read     = FileSharingTxRead;
+  FileTransferTx.idle     = FileSharingTxIdle;
+  FileTransferTx.now      = FileSharingNow;
+  FileTransferTx.progress = FileSharingTxProgress;
 
+  if( !FileSharingReadRemoteChar->canWriteNoResponse() ) {
+    log_w("FileSharingReadRemoteChar can't WRITE_NORESPONSE");
+  }
 
-  #define BLE_FILECOPY_BUFFSIZE 512
-  uint8_t buff[BLE_FILECOPY_BUFFSIZE];
-  uint32_t len = fileToTransfer.read( buff, BLE_FILECOPY_BUFFSIZE ); // fill buffer
   log_w("Starting transfert...");
   UI.headerStats(filename);
   UI.PrintProgressBar( 0 );
-  int lastpercent = 0;
+  FileSenderPercent = 0;
 
-  if( !FileSharingReadRemoteChar->canWriteNoResponse() ) {
-    log_w("FileSharingReadRemoteChar can't WRITE_NORESPONSE");
+  if ( !FileTransferTx.send( filename, FileSender.size(), FileSharingClient->getMTU() ) ) {
+    fileSharingSendFileError = true;
   }
 
-  while ( len > 0 ) {
-    fileSharingClientLastActivity = millis();
-    progress -= len;
-    int percent = 100 - (((float)progress / (float)totalsize) * 100.00);
-    if ( !FileSharingReadRemoteChar->writeValue((uint8_t*)&buff, len, false) ) {
-      // transfert failed !
-      log_e("Failed to send %d bytes (%d percent done) %d / %d", len, percent, progress, totalsize);
-      fileSharingSendFileError = true;
-      break;
-    } else {
-      log_v("SUCCESS sending %d bytes (%d percent done) %d / %d", len, percent, progress, totalsize);
-    }
-    if ( lastpercent != percent ) {
-      UI.PrintProgressBar( (Out.width * percent) / 100 );
-      lastpercent = percent;
-      vTaskDelay(10);
-    }
-    len = fileToTransfer.read( buff, BLE_FILECOPY_BUFFSIZE );
-    vTaskDelay(10);
-  }
   UI.PrintProgressBar( 0 );
-  UI.headerStats("[OK]");
+  UI.headerStats( FileTransferTx.skipped ? "[SKIP]" : "[OK]" );
   if( fileSharingSendFileError ) {
     log_e("Transfer aborted!");
+  } else if( FileTransferTx.skipped ) {
+    log_w("Remote already has %s", filename);
   } else {
-    log_w("Transfer finished!");
+    log_w("Transfer finished! %d bytes from offset %d in %d ms (%d frames, %d retransmits, %d timeouts, %d rewinds)",
+      FileTransferTx.stats.bytes,
+      FileTransferTx.stats.offset,
+      FileTransferTx.stats.elapsedMs,
+      FileTransferTx.stats.frames,
+      FileTransferTx.stats.retransmits,
+      FileTransferTx.stats.timeouts,
+      FileTransferTx.stats.rewinds
+    );
   }
-  fileToTransfer.close();
+  FileSender.close();
 
-  if( !RemoteChar->writeValue((uint8_t*)closeMessage, strlen(closeMessage)+1, true) ) {
-    log_e("Failed to send file close message");
+  fileTransferInProgress = false;
+}
+
+
+// the peer gets <filename>.blz and unpacks it once checked
+void FileSharingSendPacked( const char* filename ) {
+  char packedPath[FT_NAME_LEN];
+  snprintf( packedPath, sizeof(packedPath), "%s%s", filename, LZ_SUFFIX );
+  UI.headerStats("Packing...");
+  size_t packedSize = LZStream.packFile( filename );
+  if ( packedSize == 0 ) {
+    FileSharingSendFile( filename );
+    return;
   }
+  log_w("Packed %s to %d bytes", filename, packedSize);
+  FileSharingSendFile( packedPath );
+  BLE_FS.remove( packedPath );
+}
 
-  fileTransferInProgress = false;
+
+// offers the summary of each recent daily DB, sends the rows the peer doesn't have
+void FileSharingSyncDays() {
+  char days[DBSYNC_MAX_DAYS][DBSYNC_DAY_LEN];
+  char path[DBSYNC_PATH_LEN];
+  uint8_t count = DBSync.listDays( days, DBSYNC_MAX_DAYS );
+  DBSync.control = FileSharingTxControl;
+  fileSharingSendFileError = false;
+
+  for( uint8_t i = 0; i < count; i++ ) {
+    UI.headerStats( days[i] );
+    if ( !DBSync.request( days[i] ) ) {
+      log_e("Failed to send summary of %s", days[i]);
+      continue;
+    }
+    unsigned long started = millis();
+    while( DBSync.reply == DBSYNC_WAITING && millis() - started < DBSYNC_REPLY_TIMEOUT ) {
+      vTaskDelay(100);
+    }
+    if ( DBSync.reply == DBSYNC_WAITING ) {
+      log_e("No summary from the peer for %s", days[i]);
+      break;
+    }
+    if ( DBSync.reply == DBSYNC_SAME ) {
+      log_w("%s already in sync (%d rows)", days[i], DBSync.local.rows);
+      continue;
+    }
+    DBSync.syncPath( days[i], path );
+    int32_t records = DBSync.exportRows( path );
+    log_w("%s: sending %d of %d rows (peer has %d)", days[i], records, DBSync.local.rows, DBSync.remote.rows);
+    if ( records > 0 ) {
+      FileSharingSendFile( path );
+    }
+    BLE_FS.remove( path );
+    if ( fileSharingSendFileError ) break;
+  }
 }
 
 __attribute__((unused))
 static void FileSharingRouterCallbacks( BLERemoteCharacteristic* RemoteChar, uint8_t* pData, size_t length, bool isNotify ) {
   //char routing[512] = {0};
+  if ( length > 0 && pData[0] >= DBSYNC_FRAME_MIN ) { // daily DB sync answers
+    fileSharingClientLastActivity = millis();
+    DBSync.onControl( pData, length );
+    return;
+  }
+  if ( length > 0 && pData[0] >= FT_FRAME_MIN ) { // binary transfer frames (ACK/ABORT)
+    FileTransferTx.onControl( pData, length );
+    return;
+  }
   const char* pRoutingData = (const char*)pData;
   char* blah = substr( pRoutingData, 0, length );
   const char* routing = (const char*)blah;
@@ -922,14 +1288,15 @@ static void FileSharingRouterCallbacks( BLERemoteCharacteristic* RemoteChar, uin
   }
   //memcpy( &routing, pData, length );
   fileSharingClientLastActivity = millis();
+  // the client task does the sending, this runs in the BLE host task which also delivers the ACKs
   if (strcmp(routing, BLE_VENDOR_NAMES_DB_FS_PATH) == 0) {
-    log_w("FileSharingSendFile( %s )", BLE_VENDOR_NAMES_DB_FS_PATH);
-    FileSharingSendFile( RemoteChar, BLE_VENDOR_NAMES_DB_FS_PATH );
+    log_w("Remote wants %s", BLE_VENDOR_NAMES_DB_FS_PATH);
     checkVendorResponded = true;
+    checkVendorResponse = 1;
   } else if (strcmp(routing, MAC_OUI_NAMES_DB_FS_PATH) == 0) {
-    log_w("FileSharingSendFile( %s )", MAC_OUI_NAMES_DB_FS_PATH);
-    FileSharingSendFile( RemoteChar, MAC_OUI_NAMES_DB_FS_PATH );
+    log_w("Remote wants %s", MAC_OUI_NAMES_DB_FS_PATH);
     checkMacResponded = true;
+    checkMacResponse = 1;
   } else if ( strstr(routing, fileMarker ) ) {
     if ( strlen( routing ) > strlen( fileMarker ) ) {
       char* fileNameSize = substr( routing, strlen(fileMarker), strlen(routing) - strlen(fileMarker) );
@@ -1053,8 +1420,8 @@ static void FileSharingClientTask( void * param ) {
     return;
   }
 
-  //FileSharingRouterRemoteChar->registerForNotify( FileSharingRouterCallbacks, true, false );
-  //FileSharingRouterRemoteChar->subscribe( true, false, FileSharingRouterCallbacks );
+  // ACKs and check responses come back as notifications
+  FileSharingRouterRemoteChar->registerForNotify( FileSharingRouterCallbacks );
 
   UI.headerStats("Connected :-)");
 
@@ -1069,8 +1436,8 @@ static void FileSharingClientTask( void * param ) {
   */
   log_w("Sending checkdb query");
   checkVendorResponded = false;
-  if( FileSharingRouterRemoteChar->writeValue((uint8_t*)checkMacFileMessage, strlen(checkMacFileMessage), true) ) {
-    log_w("Sent checkMacFileMessage query");
+  if( FileSharingRouterRemoteChar->writeValue((uint8_t*)checkVendorFileMessage, strlen(checkVendorFileMessage), true) ) {
+    log_w("Sent checkVendorFileMessage query");
     while( !checkVendorResponded ) {
       vTaskDelay(100);
       if( fileSharingClientLastActivity + fileSharingClientTimeout < millis() ) {
@@ -1079,15 +1446,14 @@ static void FileSharingClientTask( void * param ) {
       }
     }
     //log_w("Vendor response: %d", checkVendorResponse);
-    FileSharingSendFile( FileSharingRouterRemoteChar, BLE_VENDOR_NAMES_DB_FS_PATH );
-    log_w("Sent checkMacFileMessage query");
+    FileSharingSendPacked( BLE_VENDOR_NAMES_DB_FS_PATH );
   } else {
     log_e("Failed to send checkdb query");
   }
 
   checkMacResponded = false;
-  if( FileSharingRouterRemoteChar->writeValue((uint8_t*)checkVendorFileMessage, strlen(checkVendorFileMessage), true) ) {
-    log_w("Sent checkVendorFileMessage query");
+  if( FileSharingRouterRemoteChar->writeValue((uint8_t*)checkMacFileMessage, strlen(checkMacFileMessage), true) ) {
+    log_w("Sent checkMacFileMessage query");
     while( !checkMacResponded ) {
       vTaskDelay(100);
       if( fileSharingClientLastActivity + fileSharingClientTimeout < millis() ) {
@@ -1096,11 +1462,22 @@ static void FileSharingClientTask( void * param ) {
       }
     }
     //log_w("Mac response: %d", checkMacResponse);
-    FileSharingSendFile( FileSharingRouterRemoteChar, MAC_OUI_NAMES_DB_FS_PATH );
+    FileSharingSendPacked( MAC_OUI_NAMES_DB_FS_PATH );
   } else {
     log_e("Failed to send checkdb query");
   }
 
+  // generated lookup tables replace the peer's ones without a restart, identical copies are skipped
+  if( OUILookup.isGenerated() ) {
+    FileSharingSendFile( MAC_OUI_NAMES_LOOKUP_FS_PATH );
+  }
+  if( VendorLookup.isGenerated() ) {
+    FileSharingSendFile( BLE_VENDOR_NAMES_LOOKUP_FS_PATH );
+  }
+
+  log_w("Syncing daily DBs");
+  FileSharingSyncDays();
+
   while( fileSharingClientTaskIsRunning ) {
     if( fileSharingClientLastActivity + fileSharingClientTimeout < millis() ) {
       log_e("fileSharingClientTimeout timeout !");
@@ -0,0 +1,167 @@
+/*
+
+  ESP32 BLE Collector - A BLE scanner with sqlite data persistence on the SD Card
+  Source: https://github.com/tobozo/ESP32-BLECollector
+
+  MIT License
+
+  Copyright (c) 2018 tobozo
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  -----------------------------------------------------------------------------
+
+  Synthetic advertisement source for the scan pipeline (#define BLE_SIMULATION true)
+  and input generator for the benchmarks.
+  A fixed population of fake devices is derived from SIM_SEED, regulars show up
+  more often than passers-by, random addresses rotate every SIM_ROTATE_SECONDS.
+  Same seed = same population and pick order, so runs can be compared between builds.
+
+*/
+
+#define SIM_SEED           0x5eed
+#define SIM_POPULATION     256 // distinct simulated devices
+#define SIM_RANDOM_RATIO   60  // percent of the population using random addresses
+#define SIM_ROTATE_SECONDS 900 // random address rotation period
+#define SIM_ADV_PER_SECOND 50  // advertisements fed to the pipeline
+
+
+struct SimVendor {
+  uint8_t     oui[3];
+  uint16_t    companyId; // bluetooth assigned number, see ble-oui.db
+  const char* name;
+};
+
+static const SimVendor SimVendors[] = {
+  { {0x00, 0x1b, 0x63}, 0x004c, "iPhone"     }, // Apple
+  { {0x00, 0x16, 0x32}, 0x0075, "Galaxy"     }, // Samsung
+  { {0x00, 0x50, 0xf2}, 0x0006, "Surface"    }, // Microsoft
+  { {0x3c, 0x5a, 0xb4}, 0x00e0, "Pixel"      }, // Google
+  { {0x00, 0x1d, 0xba}, 0x012d, "WH-1000"    }, // Sony
+  { {0x64, 0x09, 0x80}, 0x038f, "Mi Band"    }, // Xiaomi
+  { {0x00, 0x1b, 0x21}, 0x0002, "Laptop"     }, // Intel
+  { {0x00, 0x12, 0x4b}, 0x000d, "SensorTag"  }, // Texas Instruments
+  { {0x24, 0x0a, 0xc4}, 0x02e5, "ESP32"      }, // Espressif
+};
+
+static const uint16_t SimServices[] = { 0x180f, 0x180d, 0x1812, 0x181a, 0xfeaa, 0xfe9f };
+
+
+class BLESimulatorUtils {
+  public:
+
+    uint32_t generated = 0;
+
+    // ms between two advertisements
+    uint32_t interval() {
+      return 1000 / SIM_ADV_PER_SECOND;
+    }
+
+    // fills a record with the next advertisement of the stream
+    void next( BLEAdvRecord *record ) {
+      uint32_t r = rnd();
+      // product of two uniform picks: low indexes (regulars) come back way more often
+      uint16_t idx = ( (r & 0xffff) % SIM_POPULATION ) * ( (r >> 16) % SIM_POPULATION ) / SIM_POPULATION;
+      build( idx, record );
+      generated++;
+    }
+
+  private:
+
+    uint32_t state = SIM_SEED;
+
+    // xorshift32, deterministic for a given SIM_SEED
+    uint32_t rnd() {
+      state ^= state << 13;
+      state ^= state >> 17;
+      state ^= state << 5;
+      return state;
+    }
+
+    // stateless hash, a device keeps its properties without storing them
+    static uint32_t mix( uint32_t h ) {
+      h ^= h >> 16;
+      h *= 0x85ebca6b;
+      h ^= h >> 13;
+      h *= 0xc2b2ae35;
+      h ^= h >> 16;
+      return h;
+    }
+
+    void addAD( BLEAdvRecord *record, uint8_t type, const uint8_t *data, uint8_t len ) {
+      if( record->payload_len + len + 2 > BLEADV_MAX_PAYLOAD ) return;
+      record->payload[record->payload_len++] = len + 1;
+      record->payload[record->payload_len++] = type;
+      memcpy( &record->payload[record->payload_len], data, len );
+      record->payload_len += len;
+    }
+
+    void build( uint16_t idx, BLEAdvRecord *record ) {
+      uint32_t h = mix( SIM_SEED ^ ( idx * 0x9e3779b9 ) );
+      const SimVendor *vendor = &SimVendors[ (h >> 8) % (sizeof(SimVendors)/sizeof(SimVendors[0])) ];
+      bool isRandom = (h % 100) < SIM_RANDOM_RATIO;
+
+      record->timestamp = millis();
+      record->payload_len = 0;
+      if( isRandom ) {
+        uint32_t a = mix( h ^ ( millis() / (SIM_ROTATE_SECONDS*1000) ) );
+        uint32_t b = mix( a );
+        record->mac[0] = ( (a >> 24) & 0x3f ) | 0x40; // resolvable private address
+        record->mac[1] = a >> 16;
+        record->mac[2] = a >> 8;
+        record->addr_type = BLE_ADDR_RANDOM;
+        record->mac[3] = b >> 16;
+        record->mac[4] = b >> 8;
+        record->mac[5] = b;
+      } else {
+        uint32_t a = mix( h );
+        memcpy( record->mac, vendor->oui, 3 );
+        record->addr_type = BLE_ADDR_PUBLIC;
+        record->mac[3] = a >> 16;
+        record->mac[4] = a >> 8;
+        record->mac[5] = a;
+      }
+      record->rssi = -40 - (int8_t)( (h >> 16) % 50 ) - (int8_t)( rnd() % 6 );
+
+      const uint8_t flags = 0x06; // LE General Discoverable, BR/EDR not supported
+      addAD( record, 0x01, &flags, 1 );
+      if( ( (h >> 4) & 3 ) == 0 ) {
+        char name[MAX_FIELD_LEN+1];
+        snprintf( name, MAX_FIELD_LEN+1, "%s %04x", vendor->name, idx );
+        addAD( record, 0x09, (const uint8_t*)name, strlen(name) );
+      }
+      if( (h >> 6) & 1 ) {
+        uint8_t manuf[4] = { (uint8_t)(vendor->companyId & 0xff), (uint8_t)(vendor->companyId >> 8), (uint8_t)(h >> 24), (uint8_t)idx };
+        addAD( record, 0xff, manuf, 4 );
+      }
+      if( ( (h >> 7) & 7 ) == 0 ) {
+        uint8_t appearance[2] = { (uint8_t)(0x40 + (h >> 12) % 0x40), 0x00 }; // phone .. watch range
+        addAD( record, 0x19, appearance, 2 );
+      }
+      if( ( (h >> 10) & 7 ) == 0 ) {
+        uint16_t service = SimServices[ (h >> 13) % (sizeof(SimServices)/sizeof(SimServices[0])) ];
+        uint8_t uuid[2] = { (uint8_t)(service & 0xff), (uint8_t)(service >> 8) };
+        addAD( record, 0x03, uuid, 2 );
+      }
+    }
+
+};
+
+
+BLESimulatorUtils BLESimulator;
@@ -0,0 +1,305 @@
+/*
+
+  ESP32 BLE Collector - A BLE scanner with sqlite data persistence on the SD Card
+  Source: https://github.com/tobozo/ESP32-BLECollector
+
+  MIT License
+
+  Copyright (c) 2018 tobozo
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  -----------------------------------------------------------------------------
+
+  Advertisement trace record/replay.
+  Recording: the scan callback copies every advertisement into a ram buffer,
+  the scan task appends it to the SD file once the scan is over.
+  Replay: the scan task reads the records back instead of starting the radio
+  and feeds them to onAdvRecord() at 1x, Nx or max speed, the trace clock only
+  runs during scan windows so the after-scan steps don't shift the timings.
+
+  File format: BLETraceHeader followed by raw BLEAdvRecord structs.
+
+*/
+
+#define TRACE_MAGIC           "BLETRACE"
+#define TRACE_VERSION         1
+#define TRACE_DEFAULT_PATH    "/bletrace.bin"
+#define TRACE_PSRAM_RECORDS   512 // records buffered between two SD accesses
+#define TRACE_HEAP_RECORDS    32
+
+struct BLETraceHeader {
+  char     magic[8];
+  uint16_t version;
+  uint16_t recordSize;
+};
+
+
+enum BLETraceMode {
+  TRACE_IDLE,
+  TRACE_RECORDING,
+  TRACE_REPLAYING
+};
+
+
+class BLETraceUtils {
+  public:
+
+    BLETraceMode mode = TRACE_IDLE;
+    uint16_t speed    = 1; // replay speed multiplier, 0 = as fast as possible
+
+    // stats
+    uint32_t recorded = 0;
+    uint32_t dropped  = 0; // ram buffer full during a scan
+    uint32_t replayed = 0;
+
+    bool startRecording( const char* _path ) {
+      if( mode != TRACE_IDLE || !allocBuffer() ) return false;
+      snprintf( path, sizeof(path), "%s", _path );
+      BLETraceHeader header;
+      memcpy( header.magic, TRACE_MAGIC, 8 );
+      header.version    = TRACE_VERSION;
+      header.recordSize = sizeof( BLEAdvRecord );
+      isQuerying = true;
+      File file = BLE_FS.open( path, FILE_WRITE );
+      bool ret = file && file.write( (uint8_t*)&header, sizeof(header) ) == sizeof(header);
+      file.close();
+      isQuerying = false;
+      if( !ret ) {
+        log_e("Can't create trace file %s", path);
+        return false;
+      }
+      buffered = 0;
+      recorded = 0;
+      dropped  = 0;
+      mode = TRACE_RECORDING;
+      Serial.printf("Recording advertisements to %s\n", path);
+      return true;
+    }
+
+    // scan callback context: no SD access here
+    void capture( BLEAdvertisedDevice *advertisedDevice ) {
+      BLEAdvRecord *record = reserve();
+      if( record == NULL ) return;
+      const uint8_t *native = advertisedDevice->getAddress().getNative(); // lsb first
+      for( uint8_t i=0; i<6; i++ ) {
+        record->mac[i] = native[5-i];
+      }
+      record->timestamp   = millis();
+      record->addr_type   = advertisedDevice->getAddressType();
+      record->rssi        = advertisedDevice->getRSSI();
+      record->payload_len = min( advertisedDevice->getPayloadLength(), (size_t)BLEADV_MAX_PAYLOAD );
+      memcpy( record->payload, advertisedDevice->getPayload(), record->payload_len );
+    }
+
+    // same for radio-agnostic sources (simulator), so a synthetic stream can be recorded too
+    void capture( const BLEAdvRecord *source ) {
+      BLEAdvRecord *record = reserve();
+      if( record == NULL ) return;
+      memcpy( record, source, sizeof(BLEAdvRecord) );
+    }
+
+    // scan task context, after the scan
+    void flush() {
+      if( mode != TRACE_RECORDING || buffered == 0 ) return;
+      isQuerying = true;
+      File file = BLE_FS.open( path, FILE_APPEND );
+      if( file ) {
+        file.write( (uint8_t*)buffer, buffered * sizeof(BLEAdvRecord) );
+        file.close();
+        recorded += buffered;
+      } else {
+        log_e("Can't append to trace file %s", path);
+      }
+      isQuerying = false;
+      buffered = 0;
+    }
+
+    void stopRecording() {
+      if( mode != TRACE_RECORDING ) return;
+      flush();
+      mode = TRACE_IDLE;
+      Serial.printf("Recorded %d advertisements to %s (%d dropped)\n", recorded, path, dropped);
+    }
+
+    bool startReplay( const char* _path, uint16_t _speed ) {
+      if( mode != TRACE_IDLE || !allocBuffer() ) return false;
+      snprintf( path, sizeof(path), "%s", _path );
+      BLETraceHeader header;
+      isQuerying = true;
+      File file = BLE_FS.open( path, FILE_READ );
+      bool ret = file && file.read( (uint8_t*)&header, sizeof(header) ) == sizeof(header);
+      fileSize = file ? file.size() : 0;
+      file.close();
+      isQuerying = false;
+      if( !ret || memcmp( header.magic, TRACE_MAGIC, 8 ) != 0 || header.version != TRACE_VERSION || header.recordSize != sizeof( BLEAdvRecord ) ) {
+        log_e("%s is not a valid trace file", path);
+        return false;
+      }
+      speed     = _speed;
+      filePos   = sizeof(header);
+      buffered  = 0;
+      cursor    = 0;
+      replayed  = 0;
+      LatencyStats.reset();
+      startEntries   = entries;
+      startDevices   = sessDevicesCount;
+      startDevHits   = BLEDevCacheHit;
+      startDevLookups= BLEDevCacheLookups;
+      startOuiHits   = OuiCacheHit;
+      startOuiLookups= OuiLookups;
+      startVendorHits= VendorCacheHit;
+      startVendorLookups = VendorLookups;
+      startOuiRejects    = OUILookup.filterRejects;
+      startVendorRejects = VendorLookup.filterRejects;
+      replayStart = millis();
+      mode = TRACE_REPLAYING;
+      Serial.printf("Replaying %d advertisements from %s at %s speed\n", (fileSize - filePos) / sizeof(BLEAdvRecord), path, speed == 0 ? "max" : String( String(speed) + "x" ).c_str() );
+      return true;
+    }
+
+    // opens a scan window of <duration> seconds in trace time, idle time between two recorded scans is skipped
+    void beginWindow( uint32_t duration ) {
+      if( !peek() ) return;
+      windowBase = buffer[cursor].timestamp;
+      windowEnd  = windowBase + duration*1000;
+      wallBase   = millis();
+    }
+
+    // waits for the next record of the window, false when the window or the trace is over
+    bool next( BLEAdvRecord *record ) {
+      if( mode != TRACE_REPLAYING ) return false;
+      if( !peek() ) {
+        stopReplay();
+        return false;
+      }
+      if( buffer[cursor].timestamp > windowEnd ) return false;
+      if( speed > 0 ) {
+        uint32_t due = wallBase + ( buffer[cursor].timestamp - windowBase ) / speed;
+        while( (int32_t)( due - millis() ) > 0 ) {
+          vTaskDelay(1);
+        }
+      }
+      memcpy( record, &buffer[cursor], sizeof(BLEAdvRecord) );
+      cursor++;
+      replayed++;
+      return true;
+    }
+
+    void stopReplay() {
+      if( mode != TRACE_REPLAYING ) return;
+      mode = TRACE_IDLE;
+      printReport();
+    }
+
+    void printReport() {
+      float elapsed = ( millis() - replayStart ) / 1000.0;
+      if( elapsed <= 0 ) elapsed = 0.001;
+      Serial.printf("\nTrace replay report for %s (%d records, %.2fs, speed %d)\n\n", path, replayed, elapsed, speed);
+      Serial.printf("  Advertisements/s : %.2f\n", replayed / elapsed );
+      Serial.printf("  Devices/s        : %.2f\n", ( sessDevicesCount - startDevices ) / elapsed );
+      Serial.printf("  DB inserts/s     : %.2f\n", ( entries - startEntries ) / elapsed );
+      Serial.printf("  BLEDev cache hit : %s\n", ratio( BLEDevCacheHit - startDevHits, BLEDevCacheLookups - startDevLookups ) );
+      Serial.printf("  OUI cache hit    : %s\n", ratio( OuiCacheHit - startOuiHits, OuiLookups - startOuiLookups ) );
+      Serial.printf("  Vendor cache hit : %s\n", ratio( VendorCacheHit - startVendorHits, VendorLookups - startVendorLookups ) );
+      Serial.printf("  OUI filtered     : %s\n", ratio( OUILookup.filterRejects - startOuiRejects, OuiLookups - startOuiLookups ) );
+      Serial.printf("  Vendor filtered  : %s\n\n", ratio( VendorLookup.filterRejects - startVendorRejects, VendorLookups - startVendorLookups ) );
+      LatencyStats.print();
+      Serial.println();
+    }
+
+  private:
+
+    BLEAdvRecord *buffer = NULL;
+    uint16_t bufferSize  = 0;
+    uint16_t buffered    = 0; // records in buffer
+    uint16_t cursor      = 0; // replay position in buffer
+    char     path[32]    = {0};
+    size_t   fileSize    = 0;
+    size_t   filePos     = 0;
+    // replay clock
+    uint32_t windowBase  = 0;
+    uint32_t windowEnd   = 0;
+    uint32_t wallBase    = 0;
+    uint32_t replayStart = 0;
+    // counters snapshot at replay start
+    unsigned int startEntries;
+    int startDevices, startDevHits, startDevLookups, startOuiHits, startOuiLookups, startVendorHits, startVendorLookups;
+    uint32_t startOuiRejects, startVendorRejects;
+
+    bool allocBuffer() {
+      if( buffer != NULL ) return true;
+      if( psramInit() ) {
+        bufferSize = TRACE_PSRAM_RECORDS;
+        buffer = (BLEAdvRecord*)ps_calloc( bufferSize, sizeof(BLEAdvRecord) );
+      } else {
+        bufferSize = TRACE_HEAP_RECORDS;
+        buffer = (BLEAdvRecord*)calloc( bufferSize, sizeof(BLEAdvRecord) );
+      }
+      if( buffer == NULL ) {
+        log_e("Can't allocate trace buffer");
+        bufferSize = 0;
+        return false;
+      }
+      return true;
+    }
+
+    // next free slot of the recording buffer, NULL when not recording or full
+    BLEAdvRecord *reserve() {
+      if( mode != TRACE_RECORDING ) return NULL;
+      if( buffered >= bufferSize ) {
+        dropped++;
+        return NULL;
+      }
+      return &buffer[buffered++];
+    }
+
+    // makes sure buffer[cursor] holds the next record, refills from the SD when needed
+    bool peek() {
+      if( cursor < buffered ) return true;
+      if( filePos + sizeof(BLEAdvRecord) > fileSize ) return false;
+      isQuerying = true;
+      File file = BLE_FS.open( path, FILE_READ );
+      if( file ) {
+        file.seek( filePos );
+        buffered = file.read( (uint8_t*)buffer, bufferSize * sizeof(BLEAdvRecord) ) / sizeof(BLEAdvRecord);
+        file.close();
+      } else {
+        buffered = 0;
+      }
+      isQuerying = false;
+      filePos += buffered * sizeof(BLEAdvRecord);
+      cursor = 0;
+      return buffered > 0;
+    }
+
+    static const char* ratio( int hits, int lookups ) {
+      static char ratioStr[24];
+      if( lookups <= 0 ) {
+        snprintf( ratioStr, sizeof(ratioStr), "n/a" );
+      } else {
+        snprintf( ratioStr, sizeof(ratioStr), "%.1f%% (%d/%d)", hits * 100.0 / lookups, hits, lookups );
+      }
+      return ratioStr;
+    }
+
+};
+
+
+BLETraceUtils BLETrace;
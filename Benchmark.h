@@ -0,0 +1,269 @@
+/*
+
+  ESP32 BLE Collector - A BLE scanner with sqlite data persistence on the SD Card
+  Source: https://github.com/tobozo/ESP32-BLECollector
+
+  MIT License
+
+  Copyright (c) 2018 tobozo
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  -----------------------------------------------------------------------------
+
+  Microbenchmark harness for the lookup and cache hot paths (see the 'bench'
+  serial command and tools/host/bench.cpp, both go through runAll()). Each run
+  is timed call by call into a LatencyHistogram and printed as one JSON object
+  per line, prefixed with "BENCH " so the results can be grepped out of the
+  serial log and compared between builds. The time spent in cacheYield() is
+  not part of the timings, it is reported as "yield_us".
+
+*/
+
+#define BENCH_DEFAULT_ITERATIONS 64
+#define BENCH_POOL_SIZE          32 // distinct devices used as input
+
+
+// lookup/cache counters touched by the benchmarked calls, restored after the run so stats and metrics only show real traffic
+struct BenchCounters {
+  int ouiCacheHit, ouiLookups, vendorCacheHit, vendorLookups;
+  int devCacheHit, devCacheLookups, anonymousCacheHit;
+  uint32_t ouiFilterRejects, vendorFilterRejects;
+  uint32_t ouiPageReads, ouiPageHits, vendorPageReads, vendorPageHits;
+  uint32_t ouiNameHits, ouiNameNegativeHits, ouiNameMisses, ouiNameEvictions;
+  uint32_t vendorNameHits, vendorNameNegativeHits, vendorNameMisses, vendorNameEvictions;
+
+  void save() {
+    ouiCacheHit            = OuiCacheHit;
+    ouiLookups             = OuiLookups;
+    vendorCacheHit         = VendorCacheHit;
+    vendorLookups          = VendorLookups;
+    devCacheHit            = BLEDevCacheHit;
+    devCacheLookups        = BLEDevCacheLookups;
+    anonymousCacheHit      = AnonymousCacheHit;
+    ouiFilterRejects       = OUILookup.filterRejects;
+    vendorFilterRejects    = VendorLookup.filterRejects;
+    ouiPageReads           = OUILookup.pageReads;
+    ouiPageHits            = OUILookup.pageHits;
+    vendorPageReads        = VendorLookup.pageReads;
+    vendorPageHits         = VendorLookup.pageHits;
+    ouiNameHits            = OuiNameCache.hits;
+    ouiNameNegativeHits    = OuiNameCache.negativeHits;
+    ouiNameMisses          = OuiNameCache.misses;
+    ouiNameEvictions       = OuiNameCache.evictions;
+    vendorNameHits         = VendorNameCache.hits;
+    vendorNameNegativeHits = VendorNameCache.negativeHits;
+    vendorNameMisses       = VendorNameCache.misses;
+    vendorNameEvictions    = VendorNameCache.evictions;
+  }
+
+  void restore() {
+    OuiCacheHit                  = ouiCacheHit;
+    OuiLookups                   = ouiLookups;
+    VendorCacheHit               = vendorCacheHit;
+    VendorLookups                = vendorLookups;
+    BLEDevCacheHit               = devCacheHit;
+    BLEDevCacheLookups           = devCacheLookups;
+    AnonymousCacheHit            = anonymousCacheHit;
+    OUILookup.filterRejects      = ouiFilterRejects;
+    VendorLookup.filterRejects   = vendorFilterRejects;
+    OUILookup.pageReads          = ouiPageReads;
+    OUILookup.pageHits           = ouiPageHits;
+    VendorLookup.pageReads       = vendorPageReads;
+    VendorLookup.pageHits        = vendorPageHits;
+    OuiNameCache.hits            = ouiNameHits;
+    OuiNameCache.negativeHits    = ouiNameNegativeHits;
+    OuiNameCache.misses          = ouiNameMisses;
+    OuiNameCache.evictions       = ouiNameEvictions;
+    VendorNameCache.hits         = vendorNameHits;
+    VendorNameCache.negativeHits = vendorNameNegativeHits;
+    VendorNameCache.misses       = vendorNameMisses;
+    VendorNameCache.evictions    = vendorNameEvictions;
+  }
+};
+
+
+class BenchmarkUtils {
+  public:
+
+    BlueToothDevice *pool[BENCH_POOL_SIZE] = { NULL };
+    BlueToothDevice *tmp = NULL;
+    uint32_t iterations  = BENCH_DEFAULT_ITERATIONS;
+    BenchCounters counters;
+
+    // fills the input pool with devices from the simulator population
+    bool init( uint32_t _iterations, bool hasPsram ) {
+      iterations = _iterations > 0 ? _iterations : BENCH_DEFAULT_ITERATIONS;
+      if( !initDone ) {
+        for( uint8_t i=0; i<BENCH_POOL_SIZE; i++ ) {
+          pool[i] = newDevice( hasPsram );
+          if( pool[i] == NULL ) {
+            release();
+            return false;
+          }
+        }
+        tmp = newDevice( hasPsram );
+        if( tmp == NULL ) {
+          release();
+          return false;
+        }
+        initDone = true;
+      }
+      BLESimulatorUtils source; // own instance, same stream on every run
+      BLEAdvRecord record;
+      for( uint8_t i=0; i<BENCH_POOL_SIZE; i++ ) {
+        source.next( &record );
+        BLEDevHelper.store( pool[i], &record );
+      }
+      Serial.printf("BENCH {\"build\":\"%s\",\"psram\":%s,\"iterations\":%d,\"pool\":%d,\"cpu_mhz\":%d}\n",
+        BUILDSIGNATURE,
+        hasPsram ? "true" : "false",
+        iterations,
+        BENCH_POOL_SIZE,
+        getCpuFrequencyMhz()
+      );
+      return true;
+    }
+
+    // calls fn(i) <iterations> times, setup(i) runs before each call and is not timed
+    template<typename F, typename S>
+    void run( const char* name, F fn, S setup ) {
+      LatencyHistogram h;
+      h.name = name;
+      uint64_t yieldTotal = 0;
+      uint32_t heapBefore = ESP.getFreeHeap(); // freeheap is only sampled by the UI tasks
+      for( uint32_t i=0; i<iterations; i++ ) {
+        setup( i );
+        uint32_t yieldBefore = cacheYieldUs;
+        unsigned long start = micros();
+        fn( i );
+        unsigned long elapsed = micros() - start;
+        uint32_t yielded = cacheYieldUs - yieldBefore;
+        yieldTotal += yielded;
+        h.add( elapsed > yielded ? elapsed - yielded : 0 );
+        if( i % 16 == 15 ) vTaskDelay(1); // let the watchdog breathe
+      }
+      int32_t heapDiff = (int32_t)heapBefore - (int32_t)ESP.getFreeHeap();
+      Serial.printf("BENCH {\"name\":\"%s\",\"n\":%d,\"min_us\":%d,\"avg_us\":%d,\"p50_us\":%d,\"p99_us\":%d,\"max_us\":%d,\"total_us\":%llu,\"yield_us\":%llu,\"heap_delta\":%d}\n",
+        name, h.count, h.count ? h.min : 0, h.avg(), h.percentile( 50 ), h.percentile( 99 ), h.max, h.total, yieldTotal, heapDiff
+      );
+    }
+
+    template<typename F>
+    void run( const char* name, F fn ) {
+      run( name, fn, []( uint32_t i ) { } );
+    }
+
+    BlueToothDevice *item( uint32_t i ) {
+      return pool[ i % BENCH_POOL_SIZE ];
+    }
+
+    // the whole suite, scan must be stopped, init() must have succeeded
+    void runAll() {
+      char dest[MAX_FIELD_LEN+1];
+      const char* uuids[] = { "0x180d", "0xfe9f", "cbbfe0e1-f7f3-4206-84e0-84cbb3d09dfc" };
+      counters.save();
+
+      run( "getOUI", [&]( uint32_t i ) {
+        DB.getOUI( item(i)->address, dest );
+      });
+      run( "getVendor", [&]( uint32_t i ) {
+        DB.getVendor( item(i)->manufid > -1 ? item(i)->manufid : 0x004c, dest );
+      });
+      // isAnonymous() needs populated items
+      for( uint8_t i = 0; i < BENCH_POOL_SIZE; i++ ) {
+        ScanPipelineUtils::populate( pool[i] );
+      }
+      run( "isAnonymous", [&]( uint32_t i ) {
+        BLEDevHelper.isAnonymous( item(i) );
+      });
+      run( "gattServiceDescription", [&]( uint32_t i ) {
+        BLEDevHelper.gattServiceDescription( isEmpty( item(i)->uuid ) ? uuids[i%3] : item(i)->uuid );
+      });
+      run( "getDeviceCacheIndex", [&]( uint32_t i ) {
+        // every other lookup targets an address already in cache
+        ScanPipelineUtils::getDeviceCacheIndex( i%2 == 0 ? BLEDevRAMCache[i % BLEDEVCACHE_SIZE]->address : item(i)->address );
+      });
+      run( "getNextCacheIndex", [&]( uint32_t i ) {
+        BLEDevHelper.getNextCacheIndex( BLEDevRAMCache, BLEDevCacheIndex );
+      });
+      run( "copyItem", [&]( uint32_t i ) {
+        BLEDevHelper.copyItem( item(i), tmp );
+      });
+      run( "mergeItems", [&]( uint32_t i ) {
+        BLEDevHelper.mergeItems( item(i), tmp );
+      }, [&]( uint32_t i ) {
+        BLEDevHelper.reset( tmp );
+        BLEDevHelper.set( tmp, "address", item(i)->address );
+      });
+      run( "deviceExists", [&]( uint32_t i ) {
+        DB.deviceExists( item(i)->address );
+      });
+      // the pool addresses may be real devices from the simulated stream, inserts go to a throwaway DB
+      DB.useScratchDB( true );
+      run( "insertBTDevice", [&]( uint32_t i ) {
+        DB.insertBTDevice( tmp );
+      }, [&]( uint32_t i ) {
+        if( i > 0 ) DB.deleteBLEDevice( tmp->address ); // previous insert, not timed
+        BLEDevHelper.copyItem( item(i), tmp );
+      });
+      DB.useScratchDB( false );
+      counters.restore();
+
+      Serial.println("BENCH {\"done\":true}");
+    }
+
+  private:
+
+    bool initDone = false;
+
+    BlueToothDevice *newDevice( bool hasPsram ) {
+      BlueToothDevice *device = (BlueToothDevice*)calloc(1, sizeof( BlueToothDevice ) );
+      if( device == NULL ) return NULL;
+      BLEDevHelper.init( device, hasPsram );
+      if( device->name == NULL || device->address == NULL || device->ouiname == NULL || device->manufname == NULL || device->uuid == NULL ) {
+        freeDevice( device );
+        return NULL;
+      }
+      return device;
+    }
+
+    void freeDevice( BlueToothDevice *device ) {
+      free( device->name );
+      free( device->address );
+      free( device->ouiname );
+      free( device->manufname );
+      free( device->uuid );
+      free( device );
+    }
+
+    // frees a partially allocated pool
+    void release() {
+      for( uint8_t i=0; i<BENCH_POOL_SIZE; i++ ) {
+        if( pool[i] != NULL ) freeDevice( pool[i] );
+        pool[i] = NULL;
+      }
+      if( tmp != NULL ) freeDevice( tmp );
+      tmp = NULL;
+    }
+
+};
+
+
+BenchmarkUtils Benchmark;
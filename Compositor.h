@@ -0,0 +1,152 @@
+/*
+
+  ESP32 BLE Collector - A BLE scanner with sqlite data persistence on the SD Card
+  Source: https://github.com/tobozo/ESP32-BLECollector
+
+  MIT License
+
+  Copyright (c) 2018 tobozo
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  -----------------------------------------------------------------------------
+
+  Frame-paced compositor: widgets only mark their screen region as dirty,
+  the UI task flushes all dirty regions once per frame inside a single
+  mux/SPI transaction. Frames are skipped while the SD card owns the bus.
+
+*/
+
+
+#include <atomic>
+
+enum CompositorRegion {
+  COMPOSITOR_HEADER = 0, // header status text
+  COMPOSITOR_COUNTERS,   // cache percent boxes + footer clock
+  COMPOSITOR_ICONBAR,    // status icons and text counters
+  COMPOSITOR_HEAPGRAPH,  // heap/activity graph sprite
+  COMPOSITOR_HALLOFMAC,  // top seen devices badges
+  COMPOSITOR_SCROLL,     // BLE cards, drawn by the frame owner
+  COMPOSITOR_REGIONS     // keep last
+};
+
+
+struct DirtyRect {
+  int16_t  x = 0;
+  int16_t  y = 0;
+  uint16_t w = 0;
+  uint16_t h = 0;
+};
+
+
+struct CompositorRegionItem {
+  const char* name = "";
+  DirtyRect rect;
+  void (*flush)() = NULL; // NULL = region is drawn by the frame owner
+  std::atomic<uint32_t> marked{0};  // bumped by producers
+  std::atomic<uint32_t> flushed{0}; // last mark pushed to the display
+  uint32_t flushes = 0;
+};
+
+
+class UICompositor {
+  public:
+
+    // stats
+    uint32_t frames  = 0; // flushed frames
+    uint32_t skipped = 0; // frames skipped because of SD access or scroll
+    uint32_t lastFramePixels = 0;
+    DirtyRect lastFrameBounds;
+
+    void setRegion( CompositorRegion id, const char* name, int16_t x, int16_t y, uint16_t w, uint16_t h, void (*flush)() = NULL ) {
+      regions[id].name   = name;
+      regions[id].rect.x = x;
+      regions[id].rect.y = y;
+      regions[id].rect.w = w;
+      regions[id].rect.h = h;
+      regions[id].flush  = flush;
+      log_d("Compositor region '%s' [%d*%d] at [%d, %d]", name, w, h, x, y);
+    }
+
+    void markDirty( CompositorRegion id ) {
+      regions[id].marked.fetch_add( 1, std::memory_order_acq_rel );
+    }
+
+    // stays true until the flush has been pushed, producers must not draw into the region sprite meanwhile
+    bool isDirty( CompositorRegion id ) {
+      return regions[id].marked.load( std::memory_order_acquire ) != regions[id].flushed.load( std::memory_order_acquire );
+    }
+
+    // takes the display for the whole frame, returns false if the frame must be skipped
+    bool beginFrame() {
+      if ( isInScroll() || isInQuery() ) {
+        skipped++;
+        return false;
+      }
+      takeMuxSemaphore();
+      tft.startWrite();
+      inFrame = true;
+      return true;
+    }
+
+    // draw every dirty region, must be called between beginFrame() and endFrame()
+    void flushDirty() {
+      if( !inFrame ) return;
+      int16_t x0 = 0x7fff, y0 = 0x7fff, x1 = -1, y1 = -1;
+      lastFramePixels = 0;
+      for( uint8_t i=0; i<COMPOSITOR_REGIONS; i++ ) {
+        uint32_t mark = regions[i].marked.load( std::memory_order_acquire );
+        if( mark == regions[i].flushed.load( std::memory_order_acquire ) ) continue;
+        if( regions[i].flush != NULL ) {
+          regions[i].flush();
+        }
+        // cleared after the push: a mark received during the flush keeps the region dirty for the next frame
+        regions[i].flushed.store( mark, std::memory_order_release );
+        regions[i].flushes++;
+        lastFramePixels += regions[i].rect.w * regions[i].rect.h;
+        if( regions[i].rect.x < x0 ) x0 = regions[i].rect.x;
+        if( regions[i].rect.y < y0 ) y0 = regions[i].rect.y;
+        if( regions[i].rect.x + regions[i].rect.w > x1 ) x1 = regions[i].rect.x + regions[i].rect.w;
+        if( regions[i].rect.y + regions[i].rect.h > y1 ) y1 = regions[i].rect.y + regions[i].rect.h;
+      }
+      if( x1 > -1 ) {
+        lastFrameBounds.x = x0;
+        lastFrameBounds.y = y0;
+        lastFrameBounds.w = x1 - x0;
+        lastFrameBounds.h = y1 - y0;
+        frames++;
+      }
+    }
+
+    void endFrame() {
+      if( !inFrame ) return;
+      inFrame = false;
+      tft.endWrite();
+      giveMuxSemaphore();
+    }
+
+  private:
+
+    CompositorRegionItem regions[COMPOSITOR_REGIONS];
+    bool inFrame = false;
+
+};
+
+
+UICompositor Compositor;
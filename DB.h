@@ -34,8 +34,6 @@
 
 const char* data = 0; // for some reason sqlite3 db callback needs this
 const char* dataBLE = 0; // for some reason sqlite3 db callback needs this
-const char* dataOUI = 0; // for some reason sqlite3 db callback needs this
-const char* dataVendor = 0;
 char *zErrMsg = 0; // holds DB Error message
 const char BACKSLASH = '\\'; // used to clean() slashes
 static char *colNeedle = 0; // search criteria
@@ -53,7 +51,8 @@ static char colValue[32] = {'\0'}; // search result
   uuid, \
   created_at DATETIME, \
   updated_at DATETIME, \
-  hits INTEGER \
+  hits INTEGER, \
+  rssi_history BLOB \
 "
 #define BLEMAC_INSERT_FIELDNAMES " \
   appearance, \
@@ -92,13 +91,45 @@ static char colValue[32] = {'\0'}; // search result
 #define dropTableQuery   "DROP TABLE IF EXISTS blemacs;"
 #define createTableQuery "CREATE TABLE IF NOT EXISTS blemacs( " BLEMAC_CREATE_FIELDNAMES " )"
 #define pruneTableQuery "DELETE FROM blemacs"
+#define rssiHistoryColumnQuery "SELECT rssi_history FROM blemacs LIMIT 0"
+#define rssiHistoryAddColumnQuery "ALTER TABLE blemacs ADD COLUMN rssi_history BLOB"
+#define rssiHistoryUpdateQuery "UPDATE blemacs SET rssi_history=? WHERE address=?"
+#define SESSIONS_DATETIME "strftime('%Y-%m-%d %H:%M:%S.000000', ?, 'unixepoch')"
+#define createSessionsTableQuery "CREATE TABLE IF NOT EXISTS sessions( address, entity INTEGER, enter_at DATETIME, exit_at DATETIME, duration INTEGER, hits INTEGER, rssi_max INTEGER )"
+#define insertSessionQuery "INSERT INTO sessions(address, entity, enter_at, exit_at, duration, hits, rssi_max) VALUES(?,?," SESSIONS_DATETIME "," SESSIONS_DATETIME ",?,?,?)"
+// hourly/daily rollups, ?1 = 'hour' or 'day', ?2 = bucket format, ?3 = dimension, rows updated in [?4, ?5[
+// a device counts once per day bucket thanks to rollup_seen
+#define createRollupsTableQuery "CREATE TABLE IF NOT EXISTS rollups( period, bucket DATETIME, dimension, value, devices INTEGER DEFAULT 0, events INTEGER DEFAULT 0, rssi_sum INTEGER DEFAULT 0, rssi_count INTEGER DEFAULT 0, PRIMARY KEY( period, bucket, dimension, value ) )"
+#define createRollupSeenTableQuery "CREATE TABLE IF NOT EXISTS rollup_seen( day DATETIME, address, PRIMARY KEY( day, address ) )"
+#define rollupSeenDayColumnQuery "SELECT day FROM rollup_seen LIMIT 0"
+#define dropRollupSeenTableQuery "DROP TABLE IF EXISTS rollup_seen"
+#define ROLLUP_WINDOW "updated_at >= strftime('%Y-%m-%d %H:%M:%S.000000', ?4, 'unixepoch') AND updated_at < strftime('%Y-%m-%d %H:%M:%S.000000', ?5, 'unixepoch')"
+#define rollupQuery "INSERT INTO rollups( period, bucket, dimension, value, devices, rssi_sum, rssi_count ) \
+  SELECT ?1, strftime(?2, updated_at), ?3, CASE ?3 WHEN 'manufid' THEN manufid WHEN 'oui' THEN ouiname WHEN 'appearance' THEN appearance ELSE '' END, \
+    count(DISTINCT CASE WHEN ?1='hour' OR address NOT IN (SELECT address FROM rollup_seen WHERE day=strftime(?2, updated_at)) THEN address END), total(rssi), count(rssi) \
+  FROM blemacs WHERE " ROLLUP_WINDOW " GROUP BY 2, 4 \
+  ON CONFLICT( period, bucket, dimension, value ) DO UPDATE SET devices=devices+excluded.devices, rssi_sum=rssi_sum+excluded.rssi_sum, rssi_count=rssi_count+excluded.rssi_count"
+#define rollupSeenQuery "INSERT OR IGNORE INTO rollup_seen( day, address ) SELECT strftime('" ROLLUP_DAY_FORMAT "', updated_at), address FROM blemacs WHERE " ROLLUP_WINDOW
+#define rollupCounterQuery "INSERT INTO rollups( period, bucket, dimension, value, events ) VALUES( ?1, strftime(?2, ?3, 'unixepoch'), 'counter', ?4, ?5 ) \
+  ON CONFLICT( period, bucket, dimension, value ) DO UPDATE SET events=events+excluded.events"
+#define rollupStateQuery "SELECT events FROM rollups WHERE period='state' AND dimension='rolled_up_to'"
+#define rollupSetStateQuery "INSERT OR REPLACE INTO rollups( period, bucket, dimension, value, events ) VALUES( 'state', 0, 'rolled_up_to', '', ? )"
+#define rollupReportQuery "SELECT bucket, devices, CASE WHEN rssi_count>0 THEN rssi_sum/rssi_count END FROM rollups WHERE period=? AND dimension='all' ORDER BY bucket"
+#define ROLLUP_HOUR_FORMAT "%Y-%m-%d %H:00:00"
+#define ROLLUP_DAY_FORMAT  "%Y-%m-%d 00:00:00"
 #define testVendorNamesQuery "SELECT SUBSTR(vendor,0,32)  FROM 'ble-oui' LIMIT 10"
 #define testOUIQuery "SELECT * FROM 'oui-light' limit 10"
 static char insertQuery[512]; // stack overflow ? pray that 256 is enough :D
 #define searchDeviceTemplate "SELECT " BLEMAC_SELECT_FIELDNAMES " FROM blemacs WHERE address='%s'"
-static char searchDeviceQuery[160];
+static char searchDeviceQuery[256]; // the template alone is ~220 chars
 #define vendorRequestTpl "SELECT vendor FROM 'ble-oui' WHERE id='%d'"
 #define OUIRequestTpl "SELECT * FROM 'oui-light' WHERE Assignment=UPPER('%s');"
+// lookup tables are compiled from these, rows must come sorted by key
+#define OUILookupCountQuery "SELECT count(*) FROM 'oui-light' WHERE assignment!=''"
+#define OUILookupQuery "SELECT assignment, SUBSTR(`Organization Name`, 0, 32) FROM 'oui-light' WHERE assignment!='' ORDER BY assignment, rowid"
+#define vendorLookupCountQuery "SELECT count(*) FROM 'ble-oui' WHERE vendor!=''"
+#define vendorLookupQuery "SELECT id, SUBSTR(vendor, 0, 32) FROM 'ble-oui' WHERE vendor!='' ORDER BY id, rowid"
+static int lookupBuildTotal = 0; // rows to compile, for the progress bar
 
 
 // used by getVendor()
@@ -106,87 +137,40 @@ static char searchDeviceQuery[160];
 #define VENDORCACHE_SIZE 16
 #endif
 
-struct VendorHeapCacheStruct {
-  int devid = -1;
-  char *vendor = NULL;
-  void init( bool hasPsram=false ) {
-    if( hasPsram ) {
-      vendor = (char*)ps_calloc(MAX_FIELD_LEN+1, sizeof(char));
-    } else {
-      vendor = (char*)calloc(MAX_FIELD_LEN+1, sizeof(char));
-    }
-  }
-};
-
-VendorHeapCacheStruct VendorHeapCache[VENDORCACHE_SIZE];
-uint16_t VendorCacheIndex = 0; // index in the circular buffer
 static int VendorCacheHit = 0;
-
-
-struct VendorPsramCacheStruct {
-  uint16_t *devid = NULL;
-  uint16_t hits   = 0; // cache hits
-  char *vendor    = NULL;
-};
-
-
-#define VendorDBSize 1740 // how many entries in the OUI lookup DB
-VendorPsramCacheStruct** VendorPsramCache = NULL;
+static int VendorLookups = 0;
 
 // used by getOUI()
 #ifndef OUICACHE_SIZE // override this from Settings.h
 #define OUICACHE_SIZE 32
 #endif
 
-
-struct OUIHeapCacheStruct {
-  char *mac = NULL;
-  char *assignment = NULL;
-  void init( bool hasPsram=false ) {
-    if( hasPsram ) {
-      mac        = (char*)ps_calloc(SHORT_MAC_LEN+1, sizeof(char));
-      assignment = (char*)ps_calloc(MAX_FIELD_LEN+1, sizeof(char));
-    } else {
-      mac        = (char*)calloc(SHORT_MAC_LEN+1, sizeof(char));
-      assignment = (char*)calloc(MAX_FIELD_LEN+1, sizeof(char));
-    }
-  }
-  void setMac( const char* _mac ) {
-    copy( mac, _mac, SHORT_MAC_LEN );
-  }
-  void setAssignment( const char* _assignment ) {
-    copy( assignment, _assignment, MAX_FIELD_LEN );
-  }
-};
-
-OUIHeapCacheStruct OuiHeapCache[OUICACHE_SIZE];
-uint16_t OuiCacheIndex = 0; // index in the circular buffer
 static int OuiCacheHit = 0;
-
-struct OUIPsramCacheStruct {
-  char *mac = NULL;
-  uint16_t hits    = 0; // cache hits
-  char *assignment = NULL;
-};
-
-#define OUIDBSize 25523 // how many entries in the OUI lookup DB
-OUIPsramCacheStruct** OuiPsramCache = NULL;
+static int OuiLookups = 0;
 
 #define BLE_COLLECTOR_DB_FILE    "blemacs.db" // default filename for storing collected data
 #define MAC_OUI_NAMES_DB_FILE    "mac-oui-light.db" // oui list of known mac addresses
 #define BLE_VENDOR_NAMES_DB_FILE "ble-oui.db" // ble device/service names by mac address
 #define BLE_DB_FILES_URL_PREFIX  "https://github.com/tobozo/ESP32-BLECollector/releases/download/1.0.0/"
-#define MAC_OUI_NAMES_DB_FS_SIZE         933888 // change this according to the file size
-#define BLE_VENDOR_NAMES_DB_FS_SIZE      73728 // change this according to the file size
+#define SQLITE_HEADER_MAGIC              "SQLite format 3" // + null terminator, 16 bytes
+#define SQLITE_HEADER_SIZE               100
 
-#define MAC_OUI_NAMES_DB_URL             BLE_DB_FILES_URL_PREFIX MAC_OUI_NAMES_DB_FILE
-#define BLE_VENDOR_NAMES_DB_URL          BLE_DB_FILES_URL_PREFIX BLE_VENDOR_NAMES_DB_FILE
+#if BLE_DB_FILES_PACKED
+  #define BLE_DB_FILES_URL_SUFFIX        ".blz" // unpacked on the fly by wget()
+#else
+  #define BLE_DB_FILES_URL_SUFFIX        ""
+#endif
+
+#define MAC_OUI_NAMES_DB_URL             BLE_DB_FILES_URL_PREFIX MAC_OUI_NAMES_DB_FILE BLE_DB_FILES_URL_SUFFIX
+#define BLE_VENDOR_NAMES_DB_URL          BLE_DB_FILES_URL_PREFIX BLE_VENDOR_NAMES_DB_FILE BLE_DB_FILES_URL_SUFFIX
 #define BLE_COLLECTOR_DB_SQLITE_PATH     "/" BLE_FS_TYPE "/" BLE_COLLECTOR_DB_FILE
 #define MAC_OUI_NAMES_DB_SQLITE_PATH     "/" BLE_FS_TYPE "/" MAC_OUI_NAMES_DB_FILE
 #define BLE_VENDOR_NAMES_DB_SQLITE_PATH  "/" BLE_FS_TYPE "/" BLE_VENDOR_NAMES_DB_FILE
 #define BLE_COLLECTOR_DB_FS_PATH         "/" BLE_COLLECTOR_DB_FILE
 #define MAC_OUI_NAMES_DB_FS_PATH         "/" MAC_OUI_NAMES_DB_FILE
 #define BLE_VENDOR_NAMES_DB_FS_PATH      "/" BLE_VENDOR_NAMES_DB_FILE
+#define BLE_SCRATCH_DB_SQLITE_PATH       "/" BLE_FS_TYPE "/bench.db" // throwaway copy of the blemacs table, see useScratchDB()
+#define BLE_SCRATCH_DB_FS_PATH           "/bench.db"
 
 
 
@@ -198,6 +182,7 @@ class DBUtils {
 
     char* BLEMacsDbSQLitePath = NULL;//"/sdcard/blemacs.db";
     char* BLEMacsDbFSPath = NULL;// "/blemacs.db";
+    uint32_t BLEMacsDbDayStart = 0; // local midnight of the day BLEMacsDbFSPath belongs to, 0 when undated
 
     sqlite3 *BLECollectorDB; // read/write
     sqlite3 *BLEVendorsDB; // readonly
@@ -273,6 +258,7 @@ class DBUtils {
       } else {
         log_d("%s DB file already exists", BLEMacsDbFSPath);
         sqlite3_initialize();
+        migrateDB();
       }
       isQuerying = false;
 
@@ -297,14 +283,30 @@ class DBUtils {
           epoch.month(),
           epoch.day()
         );
+        BLEMacsDbDayStart = epoch.unixtime() - epoch.unixtime() % 86400;
         log_d("Assigning db path : %s / %s", BLEMacsDbSQLitePath, BLEMacsDbFSPath);
       } else {
+        BLEMacsDbDayStart = 0;
         sprintf(BLEMacsDbSQLitePath, "/%s/blemacs.db", BLE_FS_TYPE);
         sprintf(BLEMacsDbFSPath, "%s", "/blemacs.db");
       }
       dbcollection[BLE_COLLECTOR_DB].sqlitepath = BLEMacsDbSQLitePath;
     }
 
+    // redirects BLE_COLLECTOR_DB to an empty throwaway file (benchmarks), false deletes it and restores the collector DB
+    void useScratchDB( bool enable ) {
+      if( enable ) {
+        BLE_FS.remove( BLE_SCRATCH_DB_FS_PATH );
+        dbcollection[BLE_COLLECTOR_DB].sqlitepath = (char*)BLE_SCRATCH_DB_SQLITE_PATH;
+        open(BLE_COLLECTOR_DB, false);
+        DBExec( BLECollectorDB, createTableQuery );
+        close(BLE_COLLECTOR_DB);
+      } else {
+        dbcollection[BLE_COLLECTOR_DB].sqlitepath = BLEMacsDbSQLitePath;
+        BLE_FS.remove( BLE_SCRATCH_DB_FS_PATH );
+      }
+    }
+
 
     static bool checkDBFiles() {
       bool OUIFileChecksOut    = checkOUIFile();
@@ -314,28 +316,39 @@ class DBUtils {
     }
 
 
+    // a generated lookup table can stand in for a missing or broken DB file
     static bool checkOUIFile() {
-      return checkFile( MAC_OUI_NAMES_DB_FS_PATH, MAC_OUI_NAMES_DB_FS_SIZE );
+      return checkFile( MAC_OUI_NAMES_DB_FS_PATH ) || OUILookup.hasGeneratedFile();
     }
 
 
     static bool checkVendorFile() {
-      return checkFile( BLE_VENDOR_NAMES_DB_FS_PATH, BLE_VENDOR_NAMES_DB_FS_SIZE );
+      return checkFile( BLE_VENDOR_NAMES_DB_FS_PATH ) || VendorLookup.hasGeneratedFile();
     }
 
 
-    static bool checkFile( const char* fileName, const size_t expectedSize ) {
+    // validates the sqlite header (magic, page size * page count) instead of a hardcoded file size
+    static bool checkFile( const char* fileName ) {
       bool ret = true;
       isQuerying = true;
       if( ! BLE_FS.exists( fileName ) ) {
         log_e( "DB file not found: %s", fileName );
         ret = false;
       } else {
+        uint8_t h[SQLITE_HEADER_SIZE] = {0};
         File tmpFile = BLE_FS.open( fileName );
         size_t size = tmpFile.size();
+        size_t headerLen = tmpFile.read( h, SQLITE_HEADER_SIZE );
         tmpFile.close();
-        if( size != expectedSize ) {
-          log_e("Critical DB file %s is corrupted (expected: %d, found: %d), aborting", fileName, expectedSize, size);
+        uint32_t pageSize = ( h[16] << 8 ) | h[17];
+        if( pageSize == 1 ) pageSize = 65536;
+        uint32_t pages = ( h[28] << 24 ) | ( h[29] << 16 ) | ( h[30] << 8 ) | h[31];
+        bool pagesValid = memcmp( h+24, h+92, 4 ) == 0; // change counter == version-valid-for
+        if( headerLen != SQLITE_HEADER_SIZE || memcmp( h, SQLITE_HEADER_MAGIC, 16 ) != 0 ) {
+          log_e("Critical DB file %s is not a sqlite3 file, aborting", fileName);
+          ret = false;
+        } else if( pageSize < 512 || size % pageSize != 0 || ( pagesValid && pages*pageSize != size ) ) {
+          log_e("Critical DB file %s is truncated (page size: %d, pages: %d, found: %d bytes), aborting", fileName, pageSize, pages, size);
           ret = false;
         }
       }
@@ -344,43 +357,14 @@ class DBUtils {
     }
 
 
+    // the name caches front the lookup tables whether they're in PSRAM or on the SD
     void OUICacheWarmup() {
-      if( hasPsram ) {
-        OuiPsramCache = (OUIPsramCacheStruct**)ps_calloc(OUIDBSize, sizeof( OUIPsramCacheStruct ) );
-        for(int i=0; i<OUIDBSize; i++) {
-          OuiPsramCache[i] = (OUIPsramCacheStruct*)ps_calloc(1, sizeof( OUIPsramCacheStruct ));
-          if( OuiPsramCache[i] == NULL ) {
-            log_e("[ERROR][%d][%d][%d] can't allocate", i, freeheap, freepsheap);
-            continue;
-          }
-          OuiPsramCache[i]->mac        = (char*)ps_calloc(SHORT_MAC_LEN+1, sizeof(char));
-          OuiPsramCache[i]->assignment = (char*)ps_calloc(MAX_FIELD_LEN+1, sizeof(char));
-        }
-      } else {
-        for(uint16_t i=0; i<OUICACHE_SIZE; i++) {
-          OuiHeapCache[i].init( false );
-        }
-      }
+      OuiNameCache.init( OUICACHE_SIZE );
     }
 
 
     void VendorCacheWarmup() {
-      if( hasPsram ) {
-        VendorPsramCache = (VendorPsramCacheStruct**)ps_calloc(VendorDBSize, sizeof( VendorPsramCacheStruct ) );
-        for(int i=0; i<VendorDBSize; i++) {
-          VendorPsramCache[i] = (VendorPsramCacheStruct*)ps_calloc(1, sizeof( VendorPsramCacheStruct ));
-          if( VendorPsramCache[i] == NULL ) {
-            log_e("[ERROR][%d][%d][%d] can't allocate", i, freeheap, freepsheap);
-            continue;
-          }
-          VendorPsramCache[i]->devid  = (uint16_t*)ps_malloc(sizeof(uint16_t));
-          VendorPsramCache[i]->vendor = (char*)ps_calloc(MAX_FIELD_LEN+1, sizeof(char));
-        }
-      } else {
-        for(uint16_t i=0; i<VENDORCACHE_SIZE; i++) {
-          VendorHeapCache[i].init( false );
-        }
-      }
+      VendorNameCache.init( VENDORCACHE_SIZE );
     }
 
 
@@ -434,14 +418,16 @@ class DBUtils {
       OUICacheWarmup();
       VendorCacheWarmup();
       BLEDevCacheWarmup();
-
       if( hasPsram ) {
-        loadOUIToPSRam();
-        loadVendorsToPSRam();
-      } else {
-        if( !testOUI() || !testVendorNames() ) {
-          return false;
-        }
+        RSSIHistory.init( BLEDEVCACHE_SIZE ); // slots follow BLEDevRAMCache
+      }
+      RotatingCache.init( hasPsram ? ROTATINGCACHE_PSRAM_SIZE : ROTATINGCACHE_HEAP_SIZE, hasPsram );
+      PresenceSessions.init( hasPsram ? SESSIONS_PSRAM_SIZE : SESSIONS_HEAP_SIZE, hasPsram );
+      PseudoDevices.init( hasPsram ? PSEUDODEVICES_PSRAM_SIZE : PSEUDODEVICES_HEAP_SIZE, hasPsram );
+
+      loadLookupTables();
+      if( !testOUI() || !testVendorNames() ) {
+        return false;
       }
 
       BLEDevTmp = (BlueToothDevice*)calloc(1, sizeof( BlueToothDevice ) );
@@ -473,11 +459,21 @@ class DBUtils {
         needsReset = true;
         resetDB();
       }
+      // staged lookup tables are swapped in between two scans, when no scan callback is running getOUI()/getVendor()
+      if( VendorLookup.maintain() ) {
+        VendorNameCache.clear();
+      }
+      if( OUILookup.maintain() ) {
+        OuiNameCache.clear();
+      }
       if( DayChangeTrigger ) {
         log_w("Day changed, will generate new DB filename");
         DBneedsReplication = true;
         HourChangeTrigger = false;
         DayChangeTrigger = false;
+        // the last hour of the day goes to the DB of that day before switching files
+        updateDBFromCache( BLEDevRAMCache, false, false );
+        updateRollups();
         setBLEDBPath();
         if( !BLE_FS.exists( BLEMacsDbFSPath ) ) {
           log_w("%s DB does not exist, will create", BLEMacsDbFSPath);
@@ -502,6 +498,13 @@ class DBUtils {
         DBneedsReplication = false;
         log_w("Replicating DB");
         updateDBFromCache( BLEDevRAMCache, false, false );
+        if( TimeIsSet ) {
+          PresenceSessions.sweep( nowDateTime.unixtime(), 0xffff ); // devices gone since the last hit anywhere
+        }
+        flushSessions();
+        updateRollups();
+      } else if( PresenceSessions.pending() >= SESSIONS_BATCH_SIZE ) {
+        flushSessions();
       }
       if( needsRestart ) {
         ESP.restart();
@@ -519,27 +522,11 @@ class DBUtils {
           BLEDevCacheUsed++;
         }
       }
-      if( hasPsram ) {
-        VendorCacheUsed = VENDORCACHE_SIZE;
-        OuiCacheUsed = OUICACHE_SIZE;
-      } else {
-        VendorCacheUsed = 0;
-        for( uint16_t i=0; i<VENDORCACHE_SIZE; i++) {
-          if( VendorHeapCache[i].devid > -1 ) {
-            VendorCacheUsed++;
-          }
-        }
-        OuiCacheUsed = 0;
-        for( uint16_t i=0; i<OUICACHE_SIZE; i++) {
-          if( !isEmpty( OuiHeapCache[i].assignment ) ) {
-            OuiCacheUsed++;
-          }
-        }
-      }
       BLEDevCacheUsed = BLEDevCacheUsed*100 / BLEDEVCACHE_SIZE;
-      VendorCacheUsed = VendorCacheUsed*100 / VENDORCACHE_SIZE;
-      OuiCacheUsed = OuiCacheUsed*100 / OUICACHE_SIZE;
-      log_v("Circular-Buffered Cache Fill: BLEDevRAMCache: %d%s, VendorCache: %d%s, OUICache: %d%s", BLEDevCacheUsed, "%", VendorCacheUsed, "%", OuiCacheUsed, "%");
+      // name caches show their hit rate since the last refresh
+      VendorCacheUsed = VendorNameCache.hitRate();
+      OuiCacheUsed = OuiNameCache.hitRate();
+      log_v("BLEDevRAMCache fill: %d%s, VendorCache hits: %d%s, OUICache hits: %d%s", BLEDevCacheUsed, "%", VendorCacheUsed, "%", OuiCacheUsed, "%");
     }
 
 
@@ -625,46 +612,50 @@ class DBUtils {
       return results>0 ? BLEDevCacheIndex : -1;
     }
 
-    // make a copy of the DB to psram to save the SD ^_^
-    void loadVendorsToPSRam() {
-      results = 0;
-      open(BLE_VENDOR_NAMES_DB);
-      //Out.println("Cloning Vendors DB to PSRam...");
-      UI.headerStats("PSRam Cloning...");
-      int rc = sqlite3_exec(BLEVendorsDB, "SELECT id, SUBSTR(vendor, 0, 32) AS vendor FROM 'ble-oui' WHERE vendor!=''", VendorDBCallback, (void*)dataVendor, &zErrMsg);
-      UI.PrintProgressBar( Out.width );
-      if (rc != SQLITE_OK) {
-        error(zErrMsg);
-        sqlite3_free(zErrMsg);
-        close(BLE_VENDOR_NAMES_DB);
-        //return -2;
+    // (re)compiles the lookup tables when missing or older than their DB, falls back to SQLite queries on failure
+    void loadLookupTables() {
+      loadLookupTable( OUILookup, MAC_OUI_NAMES_DB, MAC_OUI_NAMES_DB_FS_PATH, OUILookupCountQuery, OUILookupQuery );
+      loadLookupTable( VendorLookup, BLE_VENDOR_NAMES_DB, BLE_VENDOR_NAMES_DB_FS_PATH, vendorLookupCountQuery, vendorLookupQuery );
+    }
+
+    void loadLookupTable( LookupTable &table, DBName dbName, const char* fsPath, const char* countQuery, const char* query ) {
+      isQuerying = true;
+      File source = BLE_FS.open( fsPath );
+      size_t sourceSize = source.size();
+      source.close();
+      isQuerying = false;
+      if( table.open( sourceSize, hasPsram ) ) return;
+      if( !checkFile( fsPath ) ) return; // nothing to compile from
+      UI.headerStats("Lookup: compiling...");
+      if( buildLookupTable( table, dbName, countQuery, query, sourceSize ) ) {
+        table.open( sourceSize, hasPsram );
       }
-      close(BLE_VENDOR_NAMES_DB);
-      for(byte i=0;i<8;i++) {
-        __attribute__((unused)) uint32_t rnd = random(0, VendorDBSize);
-        log_i("Testing random vendor mac #%d: %d / %s", random(0, VendorDBSize), VendorPsramCache[rnd]->devid[0], VendorPsramCache[rnd]->vendor );
+      UI.headerStats(" ");
+      if( !table.isReady() ) {
+        log_e("Lookup table for %s unavailable, using SQLite queries", fsPath);
       }
     }
 
-    // make a copy of the DB to psram to save the SD ^_^
-    void loadOUIToPSRam() {
+    bool buildLookupTable( LookupTable &table, DBName dbName, const char* countQuery, const char* query, size_t sourceSize ) {
+      if( !table.beginBuild() ) return false;
+      open( dbName );
+      sqlite3* db = dbName == MAC_OUI_NAMES_DB ? OUIVendorsDB : BLEVendorsDB;
+      DBExec( db, countQuery, (char*)"count(*)" );
+      lookupBuildTotal = atoi( colValue );
       results = 0;
-      open(MAC_OUI_NAMES_DB);
-      //Out.println("Cloning Manufacturers DB to PSRam...");
-      UI.headerStats("PSRam Cloning...");
-      int rc = sqlite3_exec(OUIVendorsDB, "SELECT LOWER(assignment) AS mac, SUBSTR(`Organization Name`, 0, 32) AS ouiname FROM 'oui-light' WHERE assignment!=''", OUIDBCallback, (void*)dataOUI, &zErrMsg);
+      int rc = sqlite3_exec( db, query, LookupTableCallback, (void*)&table, &zErrMsg );
       UI.PrintProgressBar( Out.width );
       if (rc != SQLITE_OK) {
         error(zErrMsg);
         sqlite3_free(zErrMsg);
-        close(MAC_OUI_NAMES_DB);
-        //return -2;
       }
-      close(MAC_OUI_NAMES_DB);
-      for(byte i=0;i<8;i++) {
-        __attribute__((unused)) uint32_t rnd = random(0, OUIDBSize);
-        log_i("Testing random mac #%06X: %s / %s", random(0, OUIDBSize), OuiPsramCache[rnd]->mac, OuiPsramCache[rnd]->assignment );
+      close( dbName );
+      if( rc != SQLITE_OK || !table.endBuild( sourceSize ) ) {
+        table.abortBuild();
+        return false;
       }
+      log_w("Compiled lookup table from %d rows", results);
+      return true;
     }
 
     // shit happens
@@ -752,6 +743,17 @@ class DBUtils {
         CacheItem->created_at.minute(),
         CacheItem->created_at.second()
       );
+      // the rollups bucket rows by updated_at, fresh items only have created_at
+      DateTime updated_at = CacheItem->updated_at.unixtime() > 0 ? CacheItem->updated_at : CacheItem->created_at;
+      char updatedAtStr[32];
+      sprintf(updatedAtStr, YYYYMMDD_HHMMSS_Tpl,
+        updated_at.year(),
+        updated_at.month(),
+        updated_at.day(),
+        updated_at.hour(),
+        updated_at.minute(),
+        updated_at.second()
+      );
 
       sprintf(insertQuery, insertQueryTemplate,
         CacheItem->appearance,
@@ -763,7 +765,7 @@ class DBUtils {
         tmpManufname.c_str(), // CacheItem->manufname,
         tmpUuid.c_str(), // CacheItem->uuid,
         YYYYMMDD_HHMMSS_Str,
-        YYYYMMDD_HHMMSS_Str,
+        updatedAtStr,
         CacheItem->hits
       );
       log_d( "[INSERT QUERY] : %s", insertQuery );
@@ -792,19 +794,40 @@ class DBUtils {
     }
 
     void getVendor(uint16_t devid, char *dest) {
-      if( hasPsram ) {
-        getPsramVendor(devid, dest);
-      } else {
-        getHeapVendor(devid, dest);
+      VendorLookups++;
+      if( VendorLookup.isReady() && !VendorLookup.mayContain( devid ) ) { // known absent, keep it out of the cache (counted in filterRejects)
+        memcpy( dest, "[unknown]", 10 ); // sizeof("[unknown]")
+        return;
+      }
+      switch( VendorNameCache.get( devid, dest ) ) {
+        case NAMECACHE_HIT: VendorCacheHit++; return;
+        case NAMECACHE_NEGATIVE: VendorCacheHit++; memcpy( dest, "[unknown]", 10 ); return; // sizeof("[unknown]")
+        case NAMECACHE_MISS: break;
+      }
+      bool found = VendorLookup.isReady() ? VendorLookup.find( devid, dest ) : queryVendor( devid, dest );
+      VendorNameCache.put( devid, found ? dest : NULL );
+      if( !found ) {
+        memcpy( dest, "[unknown]", 10 ); // sizeof("[unknown]")
       }
     }
 
 
     void getOUI(const char* mac, char* dest) {
-      if( hasPsram ) {
-        getPsramOUI(mac, dest);
-      } else {
-        getHeapOUI(mac, dest);
+      OuiLookups++;
+      int32_t key = LookupTable::ouiKey( mac );
+      if( OUILookup.isReady() && !OUILookup.mayContain( key ) ) { // random/private or unassigned prefix (counted in filterRejects)
+        memcpy( dest, "[private]", 10 ); // sizeof("[private]")
+        return;
+      }
+      switch( OuiNameCache.get( key, dest ) ) {
+        case NAMECACHE_HIT: OuiCacheHit++; return;
+        case NAMECACHE_NEGATIVE: OuiCacheHit++; memcpy( dest, "[private]", 10 ); return; // sizeof("[private]")
+        case NAMECACHE_MISS: break;
+      }
+      bool found = OUILookup.isReady() ? OUILookup.find( key, dest ) : queryOUI( mac, dest );
+      OuiNameCache.put( key, found ? dest : NULL );
+      if( !found ) {
+        memcpy( dest, "[private]", 10 ); // sizeof("[private]")
       }
     }
 
@@ -838,10 +861,34 @@ class DBUtils {
       open(BLE_COLLECTOR_DB, false);
       log_d("created %s if no exists:  : %s", BLEMacsDbSQLitePath, createTableQuery);
       DBExec( BLECollectorDB, createTableQuery ) ;
+      DBExec( BLECollectorDB, createSessionsTableQuery );
+      DBExec( BLECollectorDB, createRollupsTableQuery );
+      DBExec( BLECollectorDB, createRollupSeenTableQuery );
       close(BLE_COLLECTOR_DB);
       UI.headerStats(" ");
     }
 
+    // adds the columns missing from DB files created by older builds
+    void migrateDB() {
+      open(BLE_COLLECTOR_DB, false);
+      sqlite3_stmt *stmt = NULL;
+      if( sqlite3_prepare_v2( BLECollectorDB, rssiHistoryColumnQuery, -1, &stmt, NULL ) != SQLITE_OK ) {
+        log_w("Adding rssi_history column to %s", BLEMacsDbSQLitePath);
+        DBExec( BLECollectorDB, rssiHistoryAddColumnQuery );
+      }
+      sqlite3_finalize( stmt );
+      stmt = NULL;
+      if( sqlite3_prepare_v2( BLECollectorDB, rollupSeenDayColumnQuery, -1, &stmt, NULL ) != SQLITE_OK ) {
+        log_w("Recreating rollup_seen in %s, devices already rolled up today may count twice", BLEMacsDbSQLitePath);
+        DBExec( BLECollectorDB, dropRollupSeenTableQuery );
+      }
+      sqlite3_finalize( stmt );
+      DBExec( BLECollectorDB, createSessionsTableQuery );
+      DBExec( BLECollectorDB, createRollupsTableQuery );
+      DBExec( BLECollectorDB, createRollupSeenTableQuery );
+      close(BLE_COLLECTOR_DB);
+    }
+
     void dropDB() {
       UI.headerStats("Dropping DB");
       open(BLE_COLLECTOR_DB, false);
@@ -863,9 +910,11 @@ class DBUtils {
     }
 
     bool testVendorNames() {
-      open(BLE_VENDOR_NAMES_DB);
-      DBExec( BLEVendorsDB, testVendorNamesQuery );
-      close(BLE_VENDOR_NAMES_DB);
+      if( !VendorLookup.isReady() ) {
+        open(BLE_VENDOR_NAMES_DB);
+        DBExec( BLEVendorsDB, testVendorNamesQuery );
+        close(BLE_VENDOR_NAMES_DB);
+      }
       char *vendorname = (char*)calloc(MAX_FIELD_LEN+1, sizeof(char));
       getVendor( 0x001D /*Qualcomm*/, vendorname );
       if (strcmp(vendorname, "Qualcomm")!=0) {
@@ -878,9 +927,11 @@ class DBUtils {
     }
 
     bool testOUI() {
-      open(MAC_OUI_NAMES_DB);
-      DBExec( OUIVendorsDB, testOUIQuery );
-      close(MAC_OUI_NAMES_DB);
+      if( !OUILookup.isReady() ) {
+        open(MAC_OUI_NAMES_DB);
+        DBExec( OUIVendorsDB, testOUIQuery );
+        close(MAC_OUI_NAMES_DB);
+      }
       char *ouiname = (char*)calloc(MAX_FIELD_LEN+1, sizeof(char));
       getOUI( "B499BA" /*Hewlett Packard */, ouiname );
       if ( strcmp(ouiname, "Hewlett Packard")!=0 ) {
@@ -925,6 +976,11 @@ class DBUtils {
           UI.printBLECard( (BlueToothDeviceLink){.cacheIndex=i,.device=BLEDevTmp}/*BLEDevTmp*/ ); // render
         }
         updateItemFromCache( SourceCache[i] );
+        #if RSSI_HISTORY_PERSIST
+          if( SourceCache == BLEDevRAMCache ) {
+            persistRSSIHistory( SourceCache[i]->address, i );
+          }
+        #endif
 
         vTaskDelay(5);
 
@@ -940,200 +996,195 @@ class DBUtils {
     }
 
 
-  private:
-
-    static void VendorHeapCacheSet(uint16_t cacheindex, int devid, const char* manufname) {
-      VendorHeapCache[cacheindex].devid = devid;
-      memset( VendorHeapCache[cacheindex].vendor, '\0', MAX_FIELD_LEN+1);
-      memcpy( VendorHeapCache[cacheindex].vendor, manufname, strlen(manufname) );
-      log_d("[+] VendorHeapCacheSet: %s", manufname );
-    }
-    static uint16_t getNextVendorCacheIndex() {
-      VendorCacheIndex++;
-      VendorCacheIndex = VendorCacheIndex % VENDORCACHE_SIZE;
-      return VendorCacheIndex;
+    // saves the RSSI ring of a BLEDevRAMCache slot in the rssi_history column
+    void persistRSSIHistory( const char* address, uint16_t cacheIndex ) {
+      uint8_t blob[RSSI_HISTORY_BLOB_MAX];
+      size_t len = RSSIHistory.serialize( cacheIndex, blob );
+      if( len == 0 ) return;
+      open(BLE_COLLECTOR_DB, false);
+      sqlite3_stmt *stmt = NULL;
+      if( sqlite3_prepare_v2( BLECollectorDB, rssiHistoryUpdateQuery, -1, &stmt, NULL ) == SQLITE_OK ) {
+        sqlite3_bind_blob( stmt, 1, blob, len, SQLITE_STATIC );
+        sqlite3_bind_text( stmt, 2, address, -1, SQLITE_STATIC );
+        if( sqlite3_step( stmt ) != SQLITE_DONE ) {
+          log_e("Can't save the RSSI history of %s: %s", address, sqlite3_errmsg( BLECollectorDB ));
+        }
+      }
+      sqlite3_finalize( stmt );
+      close(BLE_COLLECTOR_DB);
     }
 
-    // checks for existence in heap cache
-    int vendorHeapExists(uint16_t devid) {
-      // try fast answer first
-      for(int i=0;i<VENDORCACHE_SIZE;i++) {
-        if( VendorHeapCache[i].devid == devid) {
-          VendorCacheHit++;
-          return i;
-        }
+
+    // writes the closed presence sessions in one transaction, they stay queued when it fails
+    void flushSessions() {
+      if( PresenceSessions.pending() == 0 ) return;
+      open(BLE_COLLECTOR_DB, false);
+      sqlite3_stmt *stmt = NULL;
+      uint16_t written = 0;
+      bool ok = sqlite3_exec( BLECollectorDB, "BEGIN", NULL, NULL, NULL ) == SQLITE_OK
+             && sqlite3_prepare_v2( BLECollectorDB, insertSessionQuery, -1, &stmt, NULL ) == SQLITE_OK;
+      while( ok && written < PresenceSessions.pending() ) {
+        PresenceSession *session = PresenceSessions.peek( written );
+        sqlite3_bind_text( stmt, 1, session->address, -1, SQLITE_STATIC );
+        sqlite3_bind_int(  stmt, 2, session->entity );
+        sqlite3_bind_int64( stmt, 3, session->enterAt );
+        sqlite3_bind_int64( stmt, 4, session->lastAt );
+        sqlite3_bind_int(  stmt, 5, session->lastAt - session->enterAt );
+        sqlite3_bind_int(  stmt, 6, session->hits );
+        sqlite3_bind_int(  stmt, 7, session->rssiMax );
+        ok = sqlite3_step( stmt ) == SQLITE_DONE;
+        sqlite3_reset( stmt );
+        if( ok ) written++;
       }
-      return -1;
+      sqlite3_finalize( stmt );
+      if( sqlite3_exec( BLECollectorDB, ok ? "COMMIT" : "ROLLBACK", NULL, NULL, NULL ) == SQLITE_OK && ok ) {
+        while( written-- > 0 ) PresenceSessions.pop();
+      } else {
+        log_e("Can't write %d presence sessions: %s", PresenceSessions.pending(), sqlite3_errmsg( BLECollectorDB ));
+      }
+      close(BLE_COLLECTOR_DB);
     }
 
-    // vendor Heap/DB lookup
-    void getHeapVendor(uint16_t devid, char *dest) {
-      int vendorCacheIdIfExists = vendorHeapExists( devid );
-      if(vendorCacheIdIfExists>-1) {
-        uint16_t vendorCacheLen = strlen( VendorHeapCache[vendorCacheIdIfExists].vendor );
-        memcpy( dest, VendorHeapCache[vendorCacheIdIfExists].vendor, vendorCacheLen );
-        dest[vendorCacheLen] = '\0';
+
+    // adds the rows replicated since the last run to the hourly/daily rollups, complete hours only:
+    // the next replication rewrites the rows of the current hour. Only the hours of the day the DB
+    // file belongs to are rolled up, the cache replicates older and newer rows into it at day change
+    void updateRollups() {
+      if( !TimeIsSet ) return;
+      uint32_t until = nowDateTime.unixtime() - nowDateTime.unixtime() % 3600;
+      if( BLEMacsDbDayStart > 0 && until > BLEMacsDbDayStart + 86400 ) {
+        until = BLEMacsDbDayStart + 86400;
+      }
+      open(BLE_COLLECTOR_DB, false);
+      uint32_t since = BLEMacsDbDayStart;
+      sqlite3_stmt *stmt = NULL;
+      if( sqlite3_prepare_v2( BLECollectorDB, rollupStateQuery, -1, &stmt, NULL ) == SQLITE_OK && sqlite3_step( stmt ) == SQLITE_ROW ) {
+        since = max( since, (uint32_t)sqlite3_column_int64( stmt, 0 ) );
+      }
+      sqlite3_finalize( stmt );
+      stmt = NULL;
+      if( since >= until ) {
+        close(BLE_COLLECTOR_DB);
         return;
-      } else {
-        *dest = {'\0'};
       }
-      uint16_t vendorcacheindex = getNextVendorCacheIndex();
-      open(BLE_VENDOR_NAMES_DB);
-      char vendorRequestStr[64] = {'\0'};
-      sprintf(vendorRequestStr, vendorRequestTpl, devid);
-      DBExec( BLEVendorsDB, vendorRequestStr, (char*)"vendor" );
-      close(BLE_VENDOR_NAMES_DB);
-      uint16_t colValueLen = 10; // sizeof("[unknown]")
-      if ( !isEmpty(colValue) ) {
-        colValueLen = strlen( colValue );
-        if(colValueLen >= MAX_FIELD_LEN) {
-          colValue[MAX_FIELD_LEN-1] = '\0';
-          colValueLen = MAX_FIELD_LEN;
-        } else {
-          colValue[colValueLen] = '\0';
-          colValueLen++;
+      const char* periods[2][2] = { { "hour", ROLLUP_HOUR_FORMAT }, { "day", ROLLUP_DAY_FORMAT } };
+      const char* dimensions[4] = { "all", "manufid", "oui", "appearance" };
+      bool ok = sqlite3_exec( BLECollectorDB, "BEGIN", NULL, NULL, NULL ) == SQLITE_OK
+             && sqlite3_prepare_v2( BLECollectorDB, rollupQuery, -1, &stmt, NULL ) == SQLITE_OK;
+      for( uint8_t p=0; ok && p<2; p++ ) {
+        for( uint8_t d=0; ok && d<4; d++ ) {
+          sqlite3_bind_text(  stmt, 1, periods[p][0], -1, SQLITE_STATIC );
+          sqlite3_bind_text(  stmt, 2, periods[p][1], -1, SQLITE_STATIC );
+          sqlite3_bind_text(  stmt, 3, dimensions[d], -1, SQLITE_STATIC );
+          sqlite3_bind_int64( stmt, 4, since );
+          sqlite3_bind_int64( stmt, 5, until );
+          ok = sqlite3_step( stmt ) == SQLITE_DONE;
+          sqlite3_reset( stmt );
+        }
+      }
+      sqlite3_finalize( stmt );
+      stmt = NULL;
+      // RAM counters: what was counted since the last run goes to the hour that just ended
+      const char* counters[2] = { "scans", "processed" };
+      int scanRounds = scan_rounds; // the scan task keeps counting while the rollups are written
+      uint32_t processedTotal = processedDevicesTotal;
+      int deltas[2] = { scanRounds - rollupScanRounds, (int)( processedTotal - rollupProcessedTotal ) };
+      ok = ok && sqlite3_prepare_v2( BLECollectorDB, rollupCounterQuery, -1, &stmt, NULL ) == SQLITE_OK;
+      for( uint8_t p=0; ok && p<2; p++ ) {
+        for( uint8_t c=0; ok && c<2; c++ ) {
+          sqlite3_bind_text(  stmt, 1, periods[p][0], -1, SQLITE_STATIC );
+          sqlite3_bind_text(  stmt, 2, periods[p][1], -1, SQLITE_STATIC );
+          sqlite3_bind_int64( stmt, 3, until - 1 );
+          sqlite3_bind_text(  stmt, 4, counters[c], -1, SQLITE_STATIC );
+          sqlite3_bind_int(   stmt, 5, deltas[c] );
+          ok = sqlite3_step( stmt ) == SQLITE_DONE;
+          sqlite3_reset( stmt );
         }
-        String vName = String(colValue);
-        vName.replace("'", ""); // escape quotes
-        VendorHeapCacheSet( vendorcacheindex, devid, vName.c_str() );
+      }
+      sqlite3_finalize( stmt );
+      stmt = NULL;
+      ok = ok && sqlite3_prepare_v2( BLECollectorDB, rollupSeenQuery, -1, &stmt, NULL ) == SQLITE_OK;
+      if( ok ) {
+        sqlite3_bind_int64( stmt, 4, since );
+        sqlite3_bind_int64( stmt, 5, until );
+        ok = sqlite3_step( stmt ) == SQLITE_DONE;
+      }
+      sqlite3_finalize( stmt );
+      stmt = NULL;
+      ok = ok && sqlite3_prepare_v2( BLECollectorDB, rollupSetStateQuery, -1, &stmt, NULL ) == SQLITE_OK;
+      if( ok ) {
+        sqlite3_bind_int64( stmt, 1, until );
+        ok = sqlite3_step( stmt ) == SQLITE_DONE;
+      }
+      sqlite3_finalize( stmt );
+      if( sqlite3_exec( BLECollectorDB, ok ? "COMMIT" : "ROLLBACK", NULL, NULL, NULL ) == SQLITE_OK && ok ) {
+        rollupScanRounds = scanRounds;
+        rollupProcessedTotal = processedTotal;
+        log_w("Rollups updated up to %02d:00", DateTime( until ).hour());
       } else {
-        VendorHeapCacheSet(vendorcacheindex, devid, "[unknown]");
+        log_e("Can't update the rollups: %s", sqlite3_errmsg( BLECollectorDB ));
       }
-      memcpy( dest, VendorHeapCache[vendorcacheindex].vendor, colValueLen );
-      delay(1);
+      close(BLE_COLLECTOR_DB);
     }
 
-    // checks for existence in psram cache
-    int vendorPsramExists(uint16_t devid) {
-      // try fast answer first
-      for(int i=0;i<VendorDBSize;i++) {
-        log_v("comparing %d / %s with %d", VendorPsramCache[i]->devid, VendorPsramCache[i]->vendor, devid );
-        if( VendorPsramCache[i]->devid[0] == devid) {
-          VendorCacheHit++;
-          return i;
+    // unique devices and mean RSSI per <period> bucket ("hour" or "day")
+    void printRollups( const char* period ) {
+      open(BLE_COLLECTOR_DB);
+      sqlite3_stmt *stmt = NULL;
+      if( sqlite3_prepare_v2( BLECollectorDB, rollupReportQuery, -1, &stmt, NULL ) == SQLITE_OK ) {
+        sqlite3_bind_text( stmt, 1, period, -1, SQLITE_STATIC );
+        while( sqlite3_step( stmt ) == SQLITE_ROW ) {
+          Serial.printf("%s %6d devices, mean rssi: %s\n", sqlite3_column_text( stmt, 0 ), sqlite3_column_int( stmt, 1 ),
+            sqlite3_column_type( stmt, 2 ) == SQLITE_NULL ? "n/a" : (const char*)sqlite3_column_text( stmt, 2 ) );
         }
       }
-      return -1;
+      sqlite3_finalize( stmt );
+      close(BLE_COLLECTOR_DB);
     }
 
-    // vendor PSRam lookup
-    void getPsramVendor(uint16_t devid, char *dest) {
-      *dest = {'\0'};
-      int VendorCacheIdIfExists = vendorPsramExists( devid );
-      if(VendorCacheIdIfExists>-1) {
-        byte VendorCacheLen = strlen( VendorPsramCache[VendorCacheIdIfExists]->vendor );
-        memcpy( dest, VendorPsramCache[VendorCacheIdIfExists]->vendor, VendorCacheLen );
-        VendorPsramCache[VendorCacheIdIfExists]->hits++;
-        dest[VendorCacheLen] = '\0';
-        return;
-      }
-      memcpy( dest, "[unknown]", 10 ); // sizeof("[unknown]")
-    }
 
-    static void OUIHeapCacheSet(uint16_t cacheindex, const char* shortmac, const char* assignment) {
-      memset( OuiHeapCache[cacheindex].mac, '\0', SHORT_MAC_LEN+1);
-      memcpy( OuiHeapCache[cacheindex].mac, shortmac, strlen(shortmac) );
-      memset( OuiHeapCache[cacheindex].assignment, '\0', MAX_FIELD_LEN+1);
-      memcpy( OuiHeapCache[cacheindex].assignment, assignment, strlen(assignment) );
-      log_d("[+] OUICacheSet: %s", assignment );
-    }
-    static uint16_t getNextOUICacheIndex() {
-      OuiCacheIndex++;
-      OuiCacheIndex = OuiCacheIndex % OUICACHE_SIZE;
-      return OuiCacheIndex;
-    }
+  private:
 
-    // checks for existence in heap cache
-    int OUIHeapExists(const char* shortmac) {
-      // try fast answer first
-      for(int i=0;i<OUICACHE_SIZE;i++) {
-        if( strcmp(OuiHeapCache[i].mac, shortmac)==0 ) {
-          OuiCacheHit++;
-          return i;
-        }
-      }
-      return -1;
+    int rollupScanRounds = 0; // counters already in the rollups
+    uint32_t rollupProcessedTotal = 0; // processedDevicesTotal
+
+    // vendor DB lookup, when the lookup table is unavailable
+    bool queryVendor(uint16_t devid, char *dest) {
+      open(BLE_VENDOR_NAMES_DB);
+      char vendorRequestStr[64] = {'\0'};
+      sprintf(vendorRequestStr, vendorRequestTpl, devid);
+      DBExec( BLEVendorsDB, vendorRequestStr, (char*)"vendor" );
+      close(BLE_VENDOR_NAMES_DB);
+      return copyColValue( dest );
     }
 
-    // OUI heap/DB lookup
-    void getHeapOUI(const char* mac, char *dest) {
-      *dest = {'\0'};
+    // OUI DB lookup, when the lookup table is unavailable
+    bool queryOUI(const char* mac, char *dest) {
       char shortmac[7] = {'\0'};
       byte bytepos =  0;
-      for(byte i=0;i<9;i++) {
+      for(byte i=0;i<9 && mac[i]!='\0' && bytepos<6;i++) {
         if(mac[i]!=':') {
           shortmac[bytepos] = mac[i];
           bytepos++;
         }
       }
-
-      int OUICacheIdIfExists = OUIHeapExists( shortmac );
-      if(OUICacheIdIfExists>-1) {
-        byte OUICacheLen = strlen( OuiHeapCache[OUICacheIdIfExists].assignment );
-        memcpy( dest, OuiHeapCache[OUICacheIdIfExists].assignment, OUICacheLen );
-        dest[OUICacheLen] = '\0';
-        return;
-      }
-      uint16_t assignmentcacheindex = getNextOUICacheIndex();
       open(MAC_OUI_NAMES_DB);
       char OUIRequestStr[76];
       sprintf( OUIRequestStr, OUIRequestTpl, shortmac);
       DBExec( OUIVendorsDB, OUIRequestStr, (char*)"Organization Name" );
       close(MAC_OUI_NAMES_DB);
-      uint16_t colValueLen = 10; // sizeof("[private]")
-      if ( !isEmpty( colValue ) ) {
-        colValueLen = strlen( colValue );
-        if(colValueLen >= MAX_FIELD_LEN) {
-          colValue[MAX_FIELD_LEN-1] = '\0';
-          colValueLen = MAX_FIELD_LEN;
-        } else {
-          colValue[colValueLen] = '\0';
-          colValueLen++;
-        }
-        String oName = String(colValue);
-        oName.replace("'", ""); // escape quotes
-        OUIHeapCacheSet( assignmentcacheindex, shortmac, oName.c_str() );
-      } else {
-        OUIHeapCacheSet( assignmentcacheindex, shortmac, "[private]" );
-      }
-      memcpy( dest, OuiHeapCache[assignmentcacheindex].assignment, colValueLen );
-      delay(1);
+      return copyColValue( dest );
     }
 
-    // checks for existence in PSram cache
-    int OUIPsramExists(const char* shortmac) {
-      // try fast answer first
-      for(int i=0; i<OUIDBSize; i++) {
-        log_v("comparing %s / %s with %s", OuiPsramCache[i]->mac, OuiPsramCache[i]->assignment, shortmac );
-        if( strstr(OuiPsramCache[i]->mac, shortmac) /*==0*/ ) {
-          OuiCacheHit++;
-          return i;
-        }
-      }
-      return -1;
-    }
-
-    // OUI psram lookup
-    void getPsramOUI(const char* mac, char *dest) {
-      *dest = {'\0'};
-      char shortmac[7] = {'\0'};
-      byte bytepos =  0;
-      for(byte i=0;i<9;i++) {
-        if(mac[i]!=':') {
-          shortmac[bytepos] = tolower(mac[i]);
-          bytepos++;
-        }
-      }
-
-      int OUICacheIdIfExists = OUIPsramExists( shortmac );
-      if(OUICacheIdIfExists>-1) {
-        byte OUICacheLen = strlen( OuiPsramCache[OUICacheIdIfExists]->assignment );
-        memcpy( dest, OuiPsramCache[OUICacheIdIfExists]->assignment, OUICacheLen );
-        OuiPsramCache[OUICacheIdIfExists]->hits++;
-        dest[OUICacheLen] = '\0';
-        return;
-      }
-      memcpy( dest, "[private]", 10 ); // sizeof("[private]")
+    static bool copyColValue( char *dest ) {
+      *dest = '\0';
+      if ( isEmpty( colValue ) ) return false;
+      colValue[MAX_FIELD_LEN-1] = '\0';
+      String value = String( colValue );
+      value.replace("'", ""); // escape quotes
+      copy( dest, value.c_str(), MAX_FIELD_LEN );
+      delay(1);
+      return true;
     }
 
     // loads a DB entry into a BLEDevice struct
@@ -1143,7 +1194,7 @@ class DBUtils {
         //BLEDevCacheIndex = BLEDevHelper.getNextCacheIndex(BLEDevRAMCache, BLEDevCacheIndex);
         BLEDevHelper.reset( BLEDevDBCache ); // avoid mixing new and old data
         for (int i = 0; i < argc; i++) {
-          BLEDevHelper.set( BLEDevDBCache, azColName[i], argv[i] ? argv[i] : '\0' );
+          BLEDevHelper.set( BLEDevDBCache, azColName[i], argv[i] ? argv[i] : "" );
         }
         BLEDevHelper.set( BLEDevDBCache, "in_db", true );
         BLEDevHelper.set( BLEDevDBCache, "is_anonymous", false );
@@ -1156,44 +1207,16 @@ class DBUtils {
       return 0;
     }
 
-    // loads a DB entry into a VendorPsramCache struct
-    static int VendorDBCallback(void *dataVendor, int argc, char **argv, char **azColName) {
-      results++;
-      for (int i = 0; i < argc; i++) {
-        if( strcmp( azColName[i], "id" ) == 0 ) {
-          log_v("[%d] Attempting to copy result # %d %s, %d", freepsheap, results, argv[i], atoi( argv[i] ) );
-          VendorPsramCache[results-1]->devid[0] = atoi( argv[i] );
-          //copy( VendorPsramCache[results-1]->devid, atoi( argv[i] ) );
-        }
-        if( strcmp( azColName[i], "vendor" ) == 0 ) {
-          log_v("[%d] Attempting to copy result # %d %s", freepsheap, results, argv[i] );
-          copy( VendorPsramCache[results-1]->vendor, argv[i], MAX_FIELD_LEN+1);
-        }
-      }
-      VendorPsramCache[results-1]->hits = 0;
-      if(results%100==0) {
-        float percent = results*100 / VendorDBSize;
-        UI.PrintProgressBar( (Out.width * percent) / 100 );
-      }
-      return 0;
-    }
-
-    // loads a DB entry into a OuiPsramCache struct
-    static int OUIDBCallback(void *dataOUI, int argc, char **argv, char **azColName) {
+    // feeds a lookup table with (key, name) rows
+    static int LookupTableCallback(void *table, int argc, char **argv, char **azColName) {
       results++;
-      for (int i = 0; i < argc; i++) {
-        if( strcmp( azColName[i], "mac" ) == 0 ) {
-          copy( OuiPsramCache[results-1]->mac, argv[i], SHORT_MAC_LEN+1 );
-        }
-        if( strcmp( azColName[i], "ouiname" ) == 0 ) {
-          copy( OuiPsramCache[results-1]->assignment, argv[i], MAX_FIELD_LEN+1);
-        }
-      }
-      OuiPsramCache[results-1]->hits = 0;
-      if(results%100==0) {
-        float percent = results*100 / OUIDBSize;
+      if( argc < 2 || argv[0] == NULL || argv[1] == NULL ) return 0;
+      LookupTable* lookup = (LookupTable*)table;
+      int32_t key = lookup == &OUILookup ? LookupTable::ouiKey( argv[0] ) : atoi( argv[0] );
+      if( !lookup->add( key, argv[1] ) ) return 1; // aborts sqlite3_exec
+      if(results%100==0 && lookupBuildTotal > 0) {
+        float percent = results*100 / lookupBuildTotal;
         UI.PrintProgressBar( (Out.width * percent) / 100 );
-        log_v("[Copied %d as %s / %s]", results, OuiPsramCache[results-1]->mac, OuiPsramCache[results-1]->assignment );
       }
       return 0;
     }
@@ -0,0 +1,580 @@
+/*
+
+  ESP32 BLE Collector - A BLE scanner with sqlite data persistence on the SD Card
+  Source: https://github.com/tobozo/ESP32-BLECollector
+
+  MIT License
+
+  Copyright (c) 2018 tobozo
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  -----------------------------------------------------------------------------
+
+  Delta sync of the daily collector DBs (ble-YYYY-MM-DD.db) between two peers.
+
+  A day is summarized by its row count, its last updated_at and a two level
+  hash tree: rows are spread in DBSYNC_BUCKETS buckets by the last octet of
+  their address, each bucket is hashed over (address, updated_at, hits) in
+  address order, and the root is the SHA-256 of all the bucket digests.
+
+  The client sends the summary of each of its recent days, the server answers
+  with its own summary and, when the roots differ, with its bucket digests.
+  The client then writes the rows of the buckets that differ as compact binary
+  records in /sync-YYYY-MM-DD.bin and sends that file with the windowed file
+  transfer. The server merges the records into the matching daily DB:
+  unknown addresses are inserted, known ones keep the newest fields, the
+  earliest created_at and the highest hits, so merging is idempotent and two
+  collectors converge once each one has synced with the other.
+
+  File format: DBSyncFileHeader followed by DBSyncRecord structs, each one
+  followed by its DBSYNC_TEXT_FIELDS strings (no null terminator).
+
+*/
+
+#define DBSYNC_BUCKETS        256  // address buckets, one per value of the last octet
+#define DBSYNC_LEAVES_FRAME   32   // bucket digests per DBSYNC_LEAVES frame
+#define DBSYNC_MAX_DAYS       7    // most recent daily DBs offered by the client
+#define DBSYNC_REPLY_TIMEOUT  10000 // ms, the server has to scan its DB first
+#define DBSYNC_DAY_LEN        11   // "YYYY-MM-DD"
+#define DBSYNC_PATH_LEN       32
+#define DBSYNC_TEXT_FIELDS    4    // name, ouiname, manufname, uuid
+#define DBSYNC_MAGIC          "BSYN"
+#define DBSYNC_VERSION        1
+
+// sync frames share the route characteristic with the file transfer frames
+#define DBSYNC_FRAME_MIN      0xfb
+
+enum DBSyncFrameType {
+  DBSYNC_SUMMARY = 0xfb, // client -> server (route char), DBSyncSummaryFrame
+  DBSYNC_PEER    = 0xfc, // server -> client (route char notification), DBSyncSummaryFrame
+  DBSYNC_LEAVES  = 0xfd  // server -> client, only when the roots differ
+};
+
+enum DBSyncReply {
+  DBSYNC_WAITING,
+  DBSYNC_SAME,    // same root, nothing to send
+  DBSYNC_DIFFERS  // all the peer bucket digests were received
+};
+
+
+struct __attribute__((packed)) DBSyncSummaryFrame {
+  uint8_t  type;
+  char     day[DBSYNC_DAY_LEN];
+  uint32_t rows;
+  uint32_t maxUpdated;
+  uint8_t  root[FT_HASH_LEN];
+};
+
+struct __attribute__((packed)) DBSyncLeavesFrame {
+  uint8_t  type;
+  char     day[DBSYNC_DAY_LEN];
+  uint8_t  first; // bucket index
+  uint8_t  count;
+  uint32_t leaves[DBSYNC_LEAVES_FRAME];
+};
+
+struct __attribute__((packed)) DBSyncFileHeader {
+  char     magic[4];
+  uint8_t  version;
+  char     day[DBSYNC_DAY_LEN];
+  uint32_t records;
+};
+
+struct __attribute__((packed)) DBSyncRecord {
+  uint8_t  mac[6];
+  uint16_t appearance;
+  int8_t   rssi;
+  int32_t  manufid;
+  uint32_t createdAt;
+  uint32_t updatedAt;
+  uint32_t hits;
+  uint8_t  len[DBSYNC_TEXT_FIELDS];
+};
+
+
+struct DBSyncSummary {
+  char     day[DBSYNC_DAY_LEN];
+  uint32_t rows       = 0;
+  uint32_t maxUpdated = 0;
+  uint32_t leaves[DBSYNC_BUCKETS]; // first 4 bytes of each bucket SHA-256, 0 = empty bucket
+  uint8_t  root[FT_HASH_LEN];
+};
+
+
+// stored dates are "YYYY-MM-DD HH:MM:SS.000000", records carry unix times
+#define DBSYNC_DATETIME "strftime('%Y-%m-%d %H:%M:%S.000000', ?, 'unixepoch')"
+#define DBSYNC_SUMMARY_QUERY "SELECT address, strftime('%s', updated_at), hits FROM blemacs ORDER BY SUBSTR(address, 16, 2), address"
+#define DBSYNC_EXPORT_QUERY "SELECT " BLEMAC_SELECT_FIELDNAMES " FROM blemacs"
+#define DBSYNC_FIND_QUERY "SELECT strftime('%s', created_at), strftime('%s', updated_at), hits FROM blemacs WHERE address=?"
+#define DBSYNC_INSERT_QUERY "INSERT INTO blemacs(" BLEMAC_INSERT_FIELDNAMES ") VALUES(?,?,?,?,?,?,?,?," DBSYNC_DATETIME "," DBSYNC_DATETIME ",?)"
+#define DBSYNC_UPDATE_QUERY "UPDATE blemacs SET appearance=?, name=?, ouiname=?, rssi=?, manufid=?, manufname=?, uuid=?, created_at=" DBSYNC_DATETIME ", updated_at=" DBSYNC_DATETIME ", hits=? WHERE address=?"
+#define DBSYNC_COUNTERS_QUERY "UPDATE blemacs SET created_at=" DBSYNC_DATETIME ", hits=? WHERE address=?"
+#define DBSYNC_INDEX_QUERY "CREATE INDEX IF NOT EXISTS blemacs_address ON blemacs(address)"
+
+
+class DBSyncUtils {
+  public:
+
+    // sends a frame over the route characteristic (write on the client, notify on the server)
+    bool (*control)( const uint8_t* frame, size_t len ) = nullptr;
+
+    DBSyncSummary local;
+    DBSyncSummary remote;
+    volatile DBSyncReply reply = DBSYNC_WAITING;
+
+    // stats of the last merge
+    uint32_t inserted = 0;
+    uint32_t updated  = 0;
+    uint32_t kept     = 0;
+
+    static bool validDay( const char* day ) {
+      int y, m, d;
+      return strnlen( day, DBSYNC_DAY_LEN ) == DBSYNC_DAY_LEN-1
+          && sscanf( day, "%4d-%2d-%2d", &y, &m, &d ) == 3;
+    }
+
+    static void dbPaths( const char* day, char* fsPath, char* sqlitePath ) {
+      snprintf( fsPath,     DBSYNC_PATH_LEN, "/ble-%s.db", day );
+      snprintf( sqlitePath, DBSYNC_PATH_LEN, "/%s/ble-%s.db", BLE_FS_TYPE, day );
+    }
+
+    static void syncPath( const char* day, char* path ) {
+      snprintf( path, DBSYNC_PATH_LEN, "/sync-%s.bin", day );
+    }
+
+    static bool isSyncFile( const char* path ) {
+      return strncmp( path, "/sync-", 6 ) == 0
+          && strlen( path ) == 6 + DBSYNC_DAY_LEN-1 + 4
+          && strcmp( path + 6 + DBSYNC_DAY_LEN-1, ".bin" ) == 0;
+    }
+
+    // fills <days> with the most recent daily DBs, newest first
+    uint8_t listDays( char days[][DBSYNC_DAY_LEN], uint8_t max ) {
+      uint8_t count = 0;
+      isQuerying = true;
+      File root = BLE_FS.open("/");
+      if( root && root.isDirectory() ) {
+        File file = root.openNextFile();
+        while( file ) {
+          const char* name = file.name();
+          const char* base = strrchr( name, '/' );
+          base = base ? base+1 : name;
+          char day[DBSYNC_DAY_LEN];
+          if( !file.isDirectory() && strlen( base ) == 17 && strncmp( base, "ble-", 4 ) == 0 && strcmp( base+14, ".db" ) == 0 ) {
+            snprintf( day, sizeof(day), "%s", base+4 );
+            if( validDay( day ) ) {
+              uint8_t pos = 0;
+              while( pos < count && strcmp( days[pos], day ) > 0 ) pos++;
+              if( pos < max ) {
+                for( uint8_t i = min( count, (uint8_t)(max-1) ); i > pos; i-- ) {
+                  memcpy( days[i], days[i-1], DBSYNC_DAY_LEN );
+                }
+                memcpy( days[pos], day, DBSYNC_DAY_LEN );
+                if( count < max ) count++;
+              }
+            }
+          }
+          file.close();
+          file = root.openNextFile();
+        }
+      }
+      isQuerying = false;
+      return count;
+    }
+
+    // a missing DB gives an empty summary
+    bool summarize( const char* day, DBSyncSummary* s ) {
+      char fsPath[DBSYNC_PATH_LEN], sqlitePath[DBSYNC_PATH_LEN];
+      snprintf( s->day, DBSYNC_DAY_LEN, "%s", day );
+      s->rows = 0;
+      s->maxUpdated = 0;
+      memset( s->leaves, 0, sizeof(s->leaves) );
+      dbPaths( day, fsPath, sqlitePath );
+
+      isQuerying = true;
+      bool ok = true;
+      if( BLE_FS.exists( fsPath ) ) {
+        sqlite3 *db = NULL;
+        sqlite3_stmt *stmt = NULL;
+        ok = sqlite3_open( sqlitePath, &db ) == SQLITE_OK
+          && sqlite3_prepare_v2( db, DBSYNC_SUMMARY_QUERY, -1, &stmt, NULL ) == SQLITE_OK;
+        if( ok ) {
+          FTHash bucketHash;
+          int bucket = -1;
+          int rc;
+          while( ( rc = sqlite3_step( stmt ) ) == SQLITE_ROW ) {
+            const char* address = (const char*)sqlite3_column_text( stmt, 0 );
+            uint32_t updatedAt  = sqlite3_column_int64( stmt, 1 );
+            uint32_t hits       = sqlite3_column_int64( stmt, 2 );
+            int rowBucket = bucketOf( address );
+            if( rowBucket < 0 ) continue;
+            if( rowBucket != bucket ) {
+              if( bucket > -1 ) s->leaves[bucket] = leaf( bucketHash );
+              bucket = rowBucket;
+            }
+            bucketHash.update( (const uint8_t*)address, MAC_LEN );
+            bucketHash.update( (const uint8_t*)&updatedAt, sizeof(updatedAt) );
+            bucketHash.update( (const uint8_t*)&hits, sizeof(hits) );
+            s->rows++;
+            if( updatedAt > s->maxUpdated ) s->maxUpdated = updatedAt;
+          }
+          if( bucket > -1 ) s->leaves[bucket] = leaf( bucketHash );
+          ok = rc == SQLITE_DONE;
+        }
+        if( !ok ) log_e("Can't summarize %s: %s", sqlitePath, db ? sqlite3_errmsg( db ) : "no db");
+        sqlite3_finalize( stmt );
+        sqlite3_close( db );
+      }
+      isQuerying = false;
+
+      FTHash rootHash;
+      rootHash.update( (const uint8_t*)s->leaves, sizeof(s->leaves) );
+      rootHash.finish( s->root );
+      return ok;
+    }
+
+    // client: summarizes the day and asks the peer for its own summary
+    bool request( const char* day ) {
+      if( control == nullptr || !summarize( day, &local ) ) return false;
+      DBSyncSummaryFrame frame;
+      fillFrame( &frame, DBSYNC_SUMMARY, &local );
+      memset( &remote, 0, sizeof(remote) );
+      memcpy( remote.day, local.day, DBSYNC_DAY_LEN );
+      leavesReceived = 0;
+      reply = DBSYNC_WAITING;
+      return control( (const uint8_t*)&frame, sizeof(frame) );
+    }
+
+    // client: writes the rows of the buckets that differ from the peer, returns the record count
+    int32_t exportRows( const char* path ) {
+      char fsPath[DBSYNC_PATH_LEN], sqlitePath[DBSYNC_PATH_LEN];
+      dbPaths( local.day, fsPath, sqlitePath );
+      DBSyncFileHeader header;
+      memcpy( header.magic, DBSYNC_MAGIC, 4 );
+      header.version = DBSYNC_VERSION;
+      memcpy( header.day, local.day, DBSYNC_DAY_LEN );
+      header.records = 0;
+
+      isQuerying = true;
+      File file = BLE_FS.open( path, FILE_WRITE );
+      if( !file ) {
+        log_e("Can't create %s", path);
+        isQuerying = false;
+        return -1;
+      }
+      file.write( (uint8_t*)&header, sizeof(header) );
+
+      sqlite3 *db = NULL;
+      sqlite3_stmt *stmt = NULL;
+      bool ok = sqlite3_open( sqlitePath, &db ) == SQLITE_OK
+             && sqlite3_prepare_v2( db, DBSYNC_EXPORT_QUERY, -1, &stmt, NULL ) == SQLITE_OK;
+      if( ok ) {
+        int rc;
+        while( ( rc = sqlite3_step( stmt ) ) == SQLITE_ROW ) {
+          const char* address = (const char*)sqlite3_column_text( stmt, 2 );
+          int bucket = bucketOf( address );
+          if( bucket < 0 || local.leaves[bucket] == remote.leaves[bucket] ) continue;
+          DBSyncRecord record;
+          const char* text[DBSYNC_TEXT_FIELDS] = {
+            (const char*)sqlite3_column_text( stmt, 1 ), // name
+            (const char*)sqlite3_column_text( stmt, 3 ), // ouiname
+            (const char*)sqlite3_column_text( stmt, 6 ), // manufname
+            (const char*)sqlite3_column_text( stmt, 7 )  // uuid
+          };
+          macToBytes( address, record.mac );
+          record.appearance = sqlite3_column_int( stmt, 0 );
+          record.rssi       = sqlite3_column_int( stmt, 4 );
+          record.manufid    = sqlite3_column_int( stmt, 5 );
+          record.createdAt  = sqlite3_column_int64( stmt, 8 );
+          record.updatedAt  = sqlite3_column_int64( stmt, 9 );
+          record.hits       = sqlite3_column_int64( stmt, 10 );
+          for( uint8_t i = 0; i < DBSYNC_TEXT_FIELDS; i++ ) {
+            record.len[i] = text[i] ? min( strlen( text[i] ), (size_t)255 ) : 0;
+          }
+          if( file.write( (uint8_t*)&record, sizeof(record) ) != sizeof(record) ) { ok = false; break; }
+          for( uint8_t i = 0; i < DBSYNC_TEXT_FIELDS; i++ ) {
+            if( record.len[i] > 0 ) file.write( (uint8_t*)text[i], record.len[i] );
+          }
+          header.records++;
+        }
+        ok = ok && rc == SQLITE_DONE;
+      }
+      if( !ok ) log_e("Can't export %s: %s", sqlitePath, db ? sqlite3_errmsg( db ) : "no db");
+      sqlite3_finalize( stmt );
+      sqlite3_close( db );
+
+      file.seek( 0 );
+      file.write( (uint8_t*)&header, sizeof(header) );
+      file.close();
+      isQuerying = false;
+      return ok ? header.records : -1;
+    }
+
+    // server: UPSERTs the records of a sync file into the matching daily DB
+    bool merge( const char* path ) {
+      inserted = updated = kept = 0;
+      isQuerying = true;
+      File file = BLE_FS.open( path );
+      DBSyncFileHeader header;
+      if( !file || file.read( (uint8_t*)&header, sizeof(header) ) != sizeof(header)
+       || memcmp( header.magic, DBSYNC_MAGIC, 4 ) != 0 || header.version != DBSYNC_VERSION ) {
+        log_e("Bad sync file %s", path);
+        if( file ) file.close();
+        isQuerying = false;
+        return false;
+      }
+      header.day[DBSYNC_DAY_LEN-1] = '\0';
+      if( !validDay( header.day ) ) {
+        log_e("Bad day in %s", path);
+        file.close();
+        isQuerying = false;
+        return false;
+      }
+
+      char fsPath[DBSYNC_PATH_LEN], sqlitePath[DBSYNC_PATH_LEN];
+      dbPaths( header.day, fsPath, sqlitePath );
+      sqlite3 *db = NULL;
+      sqlite3_stmt *findStmt = NULL, *insertStmt = NULL, *updateStmt = NULL, *countersStmt = NULL;
+      bool ok = sqlite3_open( sqlitePath, &db ) == SQLITE_OK
+             && sqlite3_exec( db, createTableQuery, NULL, NULL, NULL ) == SQLITE_OK
+             && sqlite3_exec( db, DBSYNC_INDEX_QUERY, NULL, NULL, NULL ) == SQLITE_OK
+             && sqlite3_prepare_v2( db, DBSYNC_FIND_QUERY,    -1, &findStmt,    NULL ) == SQLITE_OK
+             && sqlite3_prepare_v2( db, DBSYNC_INSERT_QUERY,  -1, &insertStmt,  NULL ) == SQLITE_OK
+             && sqlite3_prepare_v2( db, DBSYNC_UPDATE_QUERY,  -1, &updateStmt,  NULL ) == SQLITE_OK
+             && sqlite3_prepare_v2( db, DBSYNC_COUNTERS_QUERY, -1, &countersStmt, NULL ) == SQLITE_OK
+             && sqlite3_exec( db, "BEGIN", NULL, NULL, NULL ) == SQLITE_OK;
+
+      for( uint32_t n = 0; ok && n < header.records; n++ ) {
+        DBSyncRecord record;
+        char text[DBSYNC_TEXT_FIELDS][256];
+        char address[MAC_LEN+1];
+        if( file.read( (uint8_t*)&record, sizeof(record) ) != sizeof(record) ) { ok = false; break; }
+        for( uint8_t i = 0; i < DBSYNC_TEXT_FIELDS; i++ ) {
+          if( record.len[i] > 0 && file.read( (uint8_t*)text[i], record.len[i] ) != record.len[i] ) { ok = false; break; }
+          text[i][record.len[i]] = '\0';
+        }
+        if( !ok ) break;
+        macToString( record.mac, address );
+
+        sqlite3_reset( findStmt );
+        sqlite3_bind_text( findStmt, 1, address, -1, SQLITE_STATIC );
+        int rc = sqlite3_step( findStmt );
+        if( rc == SQLITE_DONE ) {
+          sqlite3_stmt* s = insertStmt;
+          sqlite3_reset( s );
+          sqlite3_bind_int(  s, 1,  record.appearance );
+          sqlite3_bind_text( s, 2,  text[0], -1, SQLITE_STATIC );
+          sqlite3_bind_text( s, 3,  address, -1, SQLITE_STATIC );
+          sqlite3_bind_text( s, 4,  text[1], -1, SQLITE_STATIC );
+          sqlite3_bind_int(  s, 5,  record.rssi );
+          sqlite3_bind_int(  s, 6,  record.manufid );
+          sqlite3_bind_text( s, 7,  text[2], -1, SQLITE_STATIC );
+          sqlite3_bind_text( s, 8,  text[3], -1, SQLITE_STATIC );
+          sqlite3_bind_int64( s, 9,  record.createdAt );
+          sqlite3_bind_int64( s, 10, record.updatedAt );
+          sqlite3_bind_int64( s, 11, record.hits );
+          ok = sqlite3_step( s ) == SQLITE_DONE;
+          inserted++;
+        } else if( rc == SQLITE_ROW ) {
+          uint32_t createdAt = sqlite3_column_int64( findStmt, 0 );
+          uint32_t updatedAt = sqlite3_column_int64( findStmt, 1 );
+          uint32_t hits      = sqlite3_column_int64( findStmt, 2 );
+          uint32_t recordCreatedAt = record.createdAt, recordHits = record.hits;
+          sqlite3_reset( findStmt );
+          // newest row wins, ties go to the highest hits
+          bool newer = record.updatedAt > updatedAt || ( record.updatedAt == updatedAt && recordHits > hits );
+          if( newer ) {
+            sqlite3_stmt* s = updateStmt;
+            sqlite3_reset( s );
+            sqlite3_bind_int(  s, 1,  record.appearance );
+            sqlite3_bind_text( s, 2,  text[0], -1, SQLITE_STATIC );
+            sqlite3_bind_text( s, 3,  text[1], -1, SQLITE_STATIC );
+            sqlite3_bind_int(  s, 4,  record.rssi );
+            sqlite3_bind_int(  s, 5,  record.manufid );
+            sqlite3_bind_text( s, 6,  text[2], -1, SQLITE_STATIC );
+            sqlite3_bind_text( s, 7,  text[3], -1, SQLITE_STATIC );
+            sqlite3_bind_int64( s, 8,  min( createdAt, recordCreatedAt ) );
+            sqlite3_bind_int64( s, 9,  record.updatedAt );
+            sqlite3_bind_int64( s, 10, max( hits, recordHits ) );
+            sqlite3_bind_text( s, 11, address, -1, SQLITE_STATIC );
+            ok = sqlite3_step( s ) == SQLITE_DONE;
+            updated++;
+          } else if( recordCreatedAt < createdAt || recordHits > hits ) {
+            // older row, still the earliest sighting or the highest count
+            sqlite3_stmt* s = countersStmt;
+            sqlite3_reset( s );
+            sqlite3_bind_int64( s, 1, min( createdAt, recordCreatedAt ) );
+            sqlite3_bind_int64( s, 2, max( hits, recordHits ) );
+            sqlite3_bind_text(  s, 3, address, -1, SQLITE_STATIC );
+            ok = sqlite3_step( s ) == SQLITE_DONE;
+            updated++;
+          } else {
+            kept++;
+          }
+        } else {
+          ok = false;
+        }
+      }
+
+      if( db ) {
+        if( !ok ) log_e("Merge of %s failed: %s", path, sqlite3_errmsg( db ));
+        sqlite3_exec( db, ok ? "COMMIT" : "ROLLBACK", NULL, NULL, NULL );
+      }
+      sqlite3_finalize( findStmt );
+      sqlite3_finalize( insertStmt );
+      sqlite3_finalize( updateStmt );
+      sqlite3_finalize( countersStmt );
+      sqlite3_close( db );
+      file.close();
+      isQuerying = false;
+      log_w("Merged %s into %s: %d inserted, %d updated, %d kept", path, fsPath, inserted, updated, kept);
+      return ok;
+    }
+
+    // server: the received sync file is merged from maintain()
+    void queueMerge( const char* path ) {
+      snprintf( mergePath, sizeof(mergePath), "%s", path );
+      mergePending = true;
+    }
+
+    // both roles, called with the frames >= DBSYNC_FRAME_MIN from the route characteristic
+    void onControl( const uint8_t* frame, size_t len ) {
+      switch( frame[0] ) {
+        case DBSYNC_SUMMARY: // server
+          if( len < sizeof(DBSyncSummaryFrame) ) return;
+          if( requestPending ) {
+            log_w("Summary request ignored, still busy");
+            return;
+          }
+          memcpy( &pendingRequest, frame, sizeof(DBSyncSummaryFrame) );
+          pendingRequest.day[DBSYNC_DAY_LEN-1] = '\0';
+          requestPending = true;
+        break;
+        case DBSYNC_PEER: { // client
+          if( len < sizeof(DBSyncSummaryFrame) ) return;
+          const DBSyncSummaryFrame* peer = (const DBSyncSummaryFrame*)frame;
+          if( strncmp( peer->day, remote.day, DBSYNC_DAY_LEN ) != 0 ) return;
+          remote.rows       = peer->rows;
+          remote.maxUpdated = peer->maxUpdated;
+          memcpy( remote.root, peer->root, FT_HASH_LEN );
+          if( memcmp( remote.root, local.root, FT_HASH_LEN ) == 0 ) {
+            reply = DBSYNC_SAME;
+          }
+        }
+        break;
+        case DBSYNC_LEAVES: { // client
+          const DBSyncLeavesFrame* leaves = (const DBSyncLeavesFrame*)frame;
+          size_t headerSize = sizeof(DBSyncLeavesFrame) - sizeof(leaves->leaves);
+          if( len < headerSize || leaves->count > DBSYNC_LEAVES_FRAME
+           || len < headerSize + leaves->count * sizeof(uint32_t)
+           || leaves->first + leaves->count > DBSYNC_BUCKETS
+           || strncmp( leaves->day, remote.day, DBSYNC_DAY_LEN ) != 0 ) return;
+          memcpy( &remote.leaves[leaves->first], leaves->leaves, leaves->count * sizeof(uint32_t) );
+          leavesReceived += leaves->count;
+          if( leavesReceived >= DBSYNC_BUCKETS ) {
+            reply = DBSYNC_DIFFERS;
+          }
+        }
+        break;
+        default:
+          log_w("Unknown sync frame 0x%02x", frame[0]);
+      }
+    }
+
+    // server: heavy work stays out of the BLE host task
+    void maintain() {
+      if( mergePending ) {
+        merge( mergePath );
+        BLE_FS.remove( mergePath );
+        mergePending = false;
+      }
+      if( requestPending ) {
+        answer();
+        requestPending = false;
+      }
+    }
+
+  private:
+
+    DBSyncSummaryFrame pendingRequest;
+    volatile bool requestPending = false;
+    volatile bool mergePending = false;
+    char mergePath[DBSYNC_PATH_LEN];
+    uint16_t leavesReceived = 0;
+
+    static int bucketOf( const char* address ) {
+      if( address == NULL || strlen( address ) != MAC_LEN ) return -1;
+      return strtol( address + MAC_LEN - 2, NULL, 16 ) & 0xff;
+    }
+
+    static uint32_t leaf( FTHash &bucketHash ) {
+      uint8_t digest[FT_HASH_LEN];
+      uint32_t value;
+      bucketHash.finish( digest );
+      memcpy( &value, digest, sizeof(value) );
+      return value == 0 ? 1 : value; // 0 is reserved to empty buckets
+    }
+
+    static void macToBytes( const char* address, uint8_t* mac ) {
+      unsigned int b[6] = {0};
+      sscanf( address, "%x:%x:%x:%x:%x:%x", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5] );
+      for( uint8_t i = 0; i < 6; i++ ) mac[i] = b[i];
+    }
+
+    static void macToString( const uint8_t* mac, char* address ) {
+      snprintf( address, MAC_LEN+1, "%02x:%02x:%02x:%02x:%02x:%02x", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5] );
+    }
+
+    static void fillFrame( DBSyncSummaryFrame* frame, uint8_t type, const DBSyncSummary* s ) {
+      frame->type       = type;
+      memcpy( frame->day, s->day, DBSYNC_DAY_LEN );
+      frame->rows       = s->rows;
+      frame->maxUpdated = s->maxUpdated;
+      memcpy( frame->root, s->root, FT_HASH_LEN );
+    }
+
+    // server: own summary, then the bucket digests if the roots differ
+    void answer() {
+      if( control == nullptr ) return;
+      if( !validDay( pendingRequest.day ) ) {
+        log_e("Bad day in summary request");
+        return;
+      }
+      summarize( pendingRequest.day, &local );
+      log_w("Sync %s: peer has %d rows, %d here", local.day, pendingRequest.rows, local.rows);
+      DBSyncSummaryFrame frame;
+      fillFrame( &frame, DBSYNC_PEER, &local );
+      control( (const uint8_t*)&frame, sizeof(frame) );
+      if( memcmp( pendingRequest.root, local.root, FT_HASH_LEN ) == 0 ) return;
+      DBSyncLeavesFrame leaves;
+      leaves.type  = DBSYNC_LEAVES;
+      memcpy( leaves.day, local.day, DBSYNC_DAY_LEN );
+      leaves.count = DBSYNC_LEAVES_FRAME;
+      for( uint16_t first = 0; first < DBSYNC_BUCKETS; first += DBSYNC_LEAVES_FRAME ) {
+        leaves.first = first;
+        memcpy( leaves.leaves, &local.leaves[first], sizeof(leaves.leaves) );
+        control( (const uint8_t*)&leaves, sizeof(leaves) );
+      }
+    }
+
+};
+
+
+DBSyncUtils DBSync;
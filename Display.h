@@ -201,6 +201,8 @@ static const int AMIGABALL_YPOS = 50;
 static TFT_eSprite gradientSprite( &tft );  // gradient background
 static TFT_eSprite heapGraphSprite( &tft ); // activity graph
 static TFT_eSprite hallOfMacSprite( &tft ); // mac address badge holder
+static TFT_eSprite scrollBgSprite( &tft );  // precomputed scroll background line
+static TFT_eSprite BLECardSprite( &tft );   // off-screen BLE card
 
 
 // TODO: make this SD-driver dependant rather than platform dependant
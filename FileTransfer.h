@@ -0,0 +1,1082 @@
+/*
+
+  ESP32 BLE Collector - A BLE scanner with sqlite data persistence on the SD Card
+  Source: https://github.com/tobozo/ESP32-BLECollector
+
+  MIT License
+
+  Copyright (c) 2018 tobozo
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  -----------------------------------------------------------------------------
+
+  Binary windowed file transfer used by the BLE file sharing.
+
+  Data frames go through write-without-response, a sliding window of up to
+  FT_WINDOW frames is kept in flight. The receiver writes in-order chunks
+  straight to the sink, buffers out-of-order ones and answers over the route
+  characteristic with ACK frames: next expected sequence number + a bitmap of
+  the frames already received after it. Holes reported by an ACK are resent
+  selectively, a silent link is resent after FT_RTO.
+
+  The transfer header carries the SHA-256 of the whole file, the receiver
+  answers with FT_SKIP when its copy is identical, or with FT_READY and the
+  offset to resume from. Every FT_BLOCK_SIZE bytes the sender also sends the
+  SHA-256 of the block, a block that doesn't match on the receiver side is
+  requested again with FT_REWIND. The transfer only succeeds once the receiver
+  has checked the whole file and answered FT_END with FT_DONE.
+
+  Both ends only know about function pointers, so the protocol can also run
+  between two simulated endpoints (see FileTransferLoopback and 'ftbench').
+  The receiver sink may defer the open and the final close (FT_OPEN_PENDING,
+  FT_CLOSE_PENDING) to keep hashing out of the BLE host task, and answers
+  later with opened() / closed().
+
+*/
+
+#include "mbedtls/sha256.h"
+
+#define FT_WINDOW          32  // frames in flight, max 32 (ACK bitmap width)
+#define FT_ACK_EVERY       8   // in-order frames between two ACKs
+#define FT_RTO             250 // ms without ACK progress before resending the window
+#define FT_MAX_RETRIES     20  // consecutive timeouts before giving up
+#define FT_READY_TIMEOUT   10000 // ms, the receiver may have to hash its copy first (and last)
+#define FT_BLOCK_SIZE      8192 // bytes covered by a block hash, rounded down to whole chunks
+#define FT_HASH_SLOTS      8   // block hashes kept by the receiver, must cover the window
+#define FT_MAX_REWINDS     8   // times in a row a block can come out corrupted before giving up
+#define FT_ATT_OVERHEAD    3   // ATT opcode + handle
+#define FT_MAX_FRAME       512 // max attribute value length
+#define FT_MIN_CHUNK       16
+#define FT_NAME_LEN        32
+#define FT_HASH_LEN        32
+
+// control frame types start at 0xf0, ASCII routing messages never do
+#define FT_FRAME_MIN       0xf0
+
+// FileTransferReceiver::open() return values besides the resume offset
+#define FT_OPEN_SKIP       -1 // identical file, nothing to transfer
+#define FT_OPEN_FAIL       -2
+#define FT_OPEN_PENDING    -3 // the sink answers later with opened()
+
+// FileTransferReceiver::close() return values
+#define FT_CLOSE_FAIL      0 // the file didn't pass the final check
+#define FT_CLOSE_OK        1
+#define FT_CLOSE_PENDING   2 // the sink answers later with closed()
+
+enum FTFrameType {
+  FT_DATA   = 0xf1, // sender -> receiver (write char), FTDataHeader + payload
+  FT_BEGIN  = 0xf2, // sender -> receiver (route char)
+  FT_ACK    = 0xf3, // receiver -> sender (route char notification)
+  FT_END    = 0xf4, // sender -> receiver, all chunks acknowledged
+  FT_ABORT  = 0xf5, // either way
+  FT_READY  = 0xf6, // receiver -> sender, start at the given offset
+  FT_SKIP   = 0xf7, // receiver -> sender, same content already there
+  FT_BLOCK  = 0xf8, // sender -> receiver, hash of a block
+  FT_REWIND = 0xf9, // receiver -> sender, block hash mismatch, resend from seq
+  FT_DONE   = 0xfa  // receiver -> sender, file checked and in place
+};
+
+
+struct __attribute__((packed)) FTDataHeader {
+  uint8_t  type;
+  uint32_t seq;
+};
+
+struct __attribute__((packed)) FTBegin {
+  uint8_t  type;
+  uint32_t size;
+  uint16_t chunkSize;
+  uint8_t  window;
+  char     name[FT_NAME_LEN];
+  uint8_t  sha256[FT_HASH_LEN]; // whole file
+};
+
+struct __attribute__((packed)) FTReady {
+  uint8_t  type;
+  uint32_t offset; // sequence numbers start there
+};
+
+struct __attribute__((packed)) FTBlockHash {
+  uint8_t  type;
+  uint32_t block;
+  uint8_t  sha256[FT_HASH_LEN];
+};
+
+struct __attribute__((packed)) FTAck {
+  uint8_t  type;
+  uint32_t base;   // next expected sequence number
+  uint32_t bitmap; // bit n = frame base+1+n received
+};
+
+struct __attribute__((packed)) FTRewind {
+  uint8_t  type;
+  uint32_t seq;
+};
+
+struct __attribute__((packed)) FTEnd {
+  uint8_t  type;
+  uint32_t chunks;
+  uint32_t size;
+};
+
+#define FT_MAX_CHUNK ( FT_MAX_FRAME - sizeof(FTDataHeader) )
+
+
+struct FTStats {
+  uint32_t frames      = 0; // data frames sent or received
+  uint32_t bytes       = 0; // payload bytes
+  uint32_t retransmits = 0; // sender: resent frames
+  uint32_t timeouts    = 0; // sender: RTO expirations
+  uint32_t acks        = 0; // ACK frames sent or processed
+  uint32_t duplicates  = 0; // receiver: frames already received
+  uint32_t outOfOrder  = 0; // receiver: frames buffered ahead of base
+  uint32_t rewinds     = 0; // blocks sent again after a hash mismatch
+  uint32_t offset      = 0; // resumed from
+  uint32_t startMs     = 0;
+  uint32_t elapsedMs   = 0;
+};
+
+
+class FTHash {
+  public:
+
+    FTHash() {
+      mbedtls_sha256_init( &ctx );
+      mbedtls_sha256_starts_ret( &ctx, 0 );
+    }
+
+    ~FTHash() {
+      mbedtls_sha256_free( &ctx );
+    }
+
+    void update( const uint8_t* data, size_t len ) {
+      mbedtls_sha256_update_ret( &ctx, data, len );
+    }
+
+    // writes the digest and starts over
+    void finish( uint8_t* out ) {
+      mbedtls_sha256_finish_ret( &ctx, out );
+      mbedtls_sha256_starts_ret( &ctx, 0 );
+    }
+
+    void reset() {
+      mbedtls_sha256_starts_ret( &ctx, 0 );
+    }
+
+    // hashes <len> bytes from the current position
+    static bool file( File &f, size_t len, uint8_t* out ) {
+      FTHash h;
+      uint8_t buff[512];
+      while( len > 0 ) {
+        size_t got = f.read( buff, min( len, sizeof(buff) ) );
+        if( got == 0 ) return false;
+        h.update( buff, got );
+        len -= got;
+      }
+      h.finish( out );
+      return true;
+    }
+
+  private:
+
+    mbedtls_sha256_context ctx;
+
+};
+
+
+class FileTransferSender {
+  public:
+
+    // transport, set by the owner before calling send()
+    bool     (*data)( const uint8_t* frame, size_t len ) = NULL;    // unacknowledged write
+    bool     (*control)( const uint8_t* frame, size_t len ) = NULL; // acknowledged write
+    size_t   (*read)( uint32_t offset, uint8_t* dst, size_t len ) = NULL;
+    void     (*idle)() = NULL; // nothing to send, wait a bit
+    uint32_t (*now)() = NULL;  // ms
+    void     (*progress)( uint32_t done, uint32_t total ) = NULL;
+
+    FTStats stats;
+    uint16_t chunkSize = 0;
+    uint32_t chunks = 0;
+    bool skipped = false; // the receiver already had the file
+
+    // blocking, returns when every chunk is acknowledged, the receiver skipped the file or the transfer failed
+    bool send( const char* name, uint32_t size, uint16_t mtu, uint8_t window = FT_WINDOW ) {
+      fileSize  = size;
+      chunkSize = constrain( (int)mtu - FT_ATT_OVERHEAD - (int)sizeof(FTDataHeader), FT_MIN_CHUNK, (int)FT_MAX_CHUNK );
+      win       = constrain( window, 1, FT_WINDOW );
+      chunks    = 0;
+      base = 0; nextSeq = 0; acked = 0; txCount = 0; deliveredTx = 0;
+      portENTER_CRITICAL( &ackMux );
+      ackPending = false;
+      rewindPending = false;
+      aborted = false;
+      ready = false;
+      skipped = false;
+      done = false;
+      portEXIT_CRITICAL( &ackMux );
+      stats = FTStats();
+      stats.startMs = now();
+
+      FTBegin begin;
+      begin.type      = FT_BEGIN;
+      begin.size      = size;
+      begin.chunkSize = chunkSize;
+      begin.window    = win;
+      snprintf( begin.name, FT_NAME_LEN, "%s", name );
+      if( !digest( begin.sha256 ) ) {
+        log_e("Failed to hash %s", name);
+        return false;
+      }
+      if( !control( (uint8_t*)&begin, sizeof(FTBegin) ) ) {
+        log_e("Failed to send the transfer header");
+        return false;
+      }
+
+      // the receiver compares with its own copy first
+      uint32_t waitStart = now();
+      while( !ready ) {
+        if( aborted ) {
+          log_e("Transfer refused by the receiver");
+          return false;
+        }
+        if( skipped ) {
+          log_w("%s is identical on the receiver side, skipping", name);
+          stats.elapsedMs = now() - stats.startMs;
+          return true;
+        }
+        if( now() - waitStart > FT_READY_TIMEOUT ) {
+          log_e("No answer to the transfer header");
+          return false;
+        }
+        idle();
+      }
+      if( readyOffset > size ) {
+        log_e("Bogus resume offset %d", readyOffset);
+        sendAbort();
+        return false;
+      }
+      startOffset = readyOffset;
+      stats.offset = startOffset;
+      chunks = ( size - startOffset + chunkSize - 1 ) / chunkSize;
+      blockChunks = max( 1, FT_BLOCK_SIZE / chunkSize );
+      hashedSeq = 0;
+      blockHash.reset();
+      log_w("Sending %s from offset %d: %d bytes, %d chunks of %d bytes, window=%d", name, startOffset, size, chunks, chunkSize, win);
+
+      uint32_t lastProgress = now();
+      uint8_t  retries = 0;
+      bool     endSent = false;
+
+      while( !done ) {
+        if( aborted ) {
+          log_e("Transfer aborted by the receiver");
+          return false;
+        }
+        if( processRewind() ) {
+          endSent = false;
+        }
+        if( processAck() ) {
+          lastProgress = now();
+          retries = 0;
+          if( progress != NULL ) progress( base, chunks );
+        }
+        if( base == chunks ) {
+          // everything acknowledged, the receiver still has to check it
+          if( !endSent ) {
+            FTEnd end;
+            end.type   = FT_END;
+            end.chunks = chunks;
+            end.size   = size;
+            if( !control( (uint8_t*)&end, sizeof(FTEnd) ) ) {
+              log_e("Failed to send the transfer end");
+              return false;
+            }
+            endSent = true;
+            lastProgress = now();
+          } else if( now() - lastProgress > FT_READY_TIMEOUT ) {
+            log_e("No answer to the transfer end");
+            return false;
+          } else {
+            idle();
+          }
+          continue;
+        }
+        bool busy = false;
+        // selective retransmit: holes sent before a frame the receiver already got
+        for( uint32_t seq = base; seq < nextSeq; seq++ ) {
+          if( isAcked( seq ) || txOrder[seq % FT_WINDOW] >= deliveredTx ) continue;
+          if( !sendFrame( seq ) ) return false;
+          stats.retransmits++;
+          busy = true;
+        }
+        if( nextSeq < chunks && nextSeq < base + win ) {
+          if( !sendFrame( nextSeq ) ) return false;
+          nextSeq++;
+          busy = true;
+        }
+        if( busy ) continue;
+        if( now() - lastProgress > FT_RTO ) {
+          if( ++retries > FT_MAX_RETRIES ) {
+            log_e("Giving up after %d timeouts at chunk %d/%d", FT_MAX_RETRIES, base, chunks);
+            sendAbort();
+            return false;
+          }
+          stats.timeouts++;
+          for( uint32_t seq = base; seq < nextSeq; seq++ ) {
+            if( isAcked( seq ) ) continue;
+            if( !sendFrame( seq ) ) return false;
+            stats.retransmits++;
+          }
+          lastProgress = now();
+        } else {
+          idle();
+        }
+      }
+
+      stats.elapsedMs = now() - stats.startMs;
+      return true;
+    }
+
+    // route notifications, may be called from another task
+    void onControl( const uint8_t* frame, size_t len ) {
+      if( len < 1 ) return;
+      portENTER_CRITICAL( &ackMux );
+      switch( frame[0] ) {
+        case FT_ABORT:
+          aborted = true;
+        break;
+        case FT_SKIP:
+          skipped = true;
+        break;
+        case FT_DONE:
+          done = true;
+        break;
+        case FT_READY:
+          if( len < sizeof(FTReady) ) break;
+          readyOffset = ((FTReady*)frame)->offset;
+          ready = true;
+        break;
+        case FT_REWIND:
+          if( len < sizeof(FTRewind) ) break;
+          // ACKs received so far describe what is being thrown away
+          rewindSeq = ((FTRewind*)frame)->seq;
+          rewindPending = true;
+          ackPending = false;
+        break;
+        case FT_ACK: {
+          if( len < sizeof(FTAck) ) break;
+          FTAck ack;
+          memcpy( &ack, frame, sizeof(FTAck) );
+          // ACKs only grow, the latest one carries everything the previous ones did
+          if( !ackPending || ack.base >= pendingAck.base ) {
+            pendingAck = ack;
+            ackPending = true;
+          }
+        }
+        break;
+      }
+      portEXIT_CRITICAL( &ackMux );
+    }
+
+  private:
+
+    uint8_t  frame[FT_MAX_FRAME];
+    uint32_t fileSize    = 0;
+    uint32_t startOffset = 0;
+    uint8_t  win         = FT_WINDOW;
+    uint32_t base        = 0; // oldest unacknowledged chunk
+    uint32_t nextSeq     = 0; // next chunk never sent
+    uint32_t acked       = 0; // bit n = chunk base+n acknowledged
+    uint32_t txCount     = 0;
+    uint32_t txOrder[FT_WINDOW]; // per slot: value of txCount when last sent
+    uint32_t deliveredTx = 0;    // highest txOrder the receiver confirmed
+    uint32_t blockChunks = 1;
+    uint32_t hashedSeq   = 0;    // chunks already fed to blockHash
+    FTHash   blockHash;
+
+    portMUX_TYPE ackMux = portMUX_INITIALIZER_UNLOCKED;
+    FTAck    pendingAck;
+    bool     ackPending    = false;
+    bool     rewindPending = false;
+    uint32_t rewindSeq     = 0;
+    bool     aborted       = false;
+    bool     ready         = false;
+    uint32_t readyOffset   = 0;
+    bool     done          = false;
+
+    bool isAcked( uint32_t seq ) {
+      return seq < base || ( seq - base < 32 && ( acked & ( 1UL << ( seq - base ) ) ) );
+    }
+
+    bool digest( uint8_t* out ) {
+      FTHash h;
+      for( uint32_t offset = 0; offset < fileSize; ) {
+        size_t len = min( (uint32_t)FT_MAX_FRAME, fileSize - offset );
+        if( read( offset, frame, len ) != len ) return false;
+        h.update( frame, len );
+        offset += len;
+      }
+      h.finish( out );
+      return true;
+    }
+
+    // merges the last ACK into the window, returns true if it brought news
+    bool processAck() {
+      FTAck ack;
+      portENTER_CRITICAL( &ackMux );
+      bool hasAck = ackPending;
+      ackPending = false;
+      ack = pendingAck;
+      portEXIT_CRITICAL( &ackMux );
+      if( !hasAck || ack.base < base || ack.base > nextSeq ) return false;
+      stats.acks++;
+      uint32_t newlyAcked = 0;
+      for( uint32_t seq = base; seq < nextSeq; seq++ ) {
+        if( isAcked( seq ) ) continue;
+        bool got = seq < ack.base || ( seq > ack.base && seq - ack.base - 1 < 32 && ( ack.bitmap & ( 1UL << ( seq - ack.base - 1 ) ) ) );
+        if( !got ) continue;
+        newlyAcked++;
+        if( txOrder[seq % FT_WINDOW] > deliveredTx ) deliveredTx = txOrder[seq % FT_WINDOW];
+        if( seq - base < 32 ) acked |= 1UL << ( seq - base );
+      }
+      uint32_t shift = ack.base - base;
+      acked = shift >= 32 ? 0 : acked >> shift;
+      base  = ack.base;
+      return newlyAcked > 0;
+    }
+
+    // the receiver dropped everything from rewindSeq on
+    bool processRewind() {
+      portENTER_CRITICAL( &ackMux );
+      bool hasRewind = rewindPending;
+      rewindPending = false;
+      uint32_t seq = rewindSeq;
+      portEXIT_CRITICAL( &ackMux );
+      if( !hasRewind || seq > nextSeq ) return false;
+      log_w("Receiver asked for chunk %d again", seq);
+      base    = seq;
+      nextSeq = seq;
+      acked   = 0;
+      deliveredTx = txCount; // frames in flight are no proof of loss anymore
+      stats.rewinds++;
+      return true;
+    }
+
+    // zero copy: the chunk is read straight behind the frame header
+    bool sendFrame( uint32_t seq ) {
+      uint32_t offset = startOffset + seq * chunkSize;
+      size_t len = min( (uint32_t)chunkSize, fileSize - offset );
+      FTDataHeader *header = (FTDataHeader*)frame;
+      header->type = FT_DATA;
+      header->seq  = seq;
+      if( read( offset, frame + sizeof(FTDataHeader), len ) != len ) {
+        log_e("Failed to read chunk %d", seq);
+        sendAbort();
+        return false;
+      }
+      while( !data( frame, sizeof(FTDataHeader) + len ) ) {
+        // outgoing buffers are full
+        if( aborted ) return false;
+        idle();
+      }
+      txOrder[seq % FT_WINDOW] = ++txCount;
+      stats.frames++;
+      stats.bytes += len;
+      if( seq == hashedSeq ) {
+        // first time this chunk goes out, resends after a rewind are already hashed
+        blockHash.update( frame + sizeof(FTDataHeader), len );
+        hashedSeq++;
+        if( hashedSeq % blockChunks == 0 || hashedSeq == chunks ) {
+          return sendBlockHash( ( hashedSeq - 1 ) / blockChunks );
+        }
+      }
+      return true;
+    }
+
+    bool sendBlockHash( uint32_t block ) {
+      FTBlockHash hash;
+      hash.type  = FT_BLOCK;
+      hash.block = block;
+      blockHash.finish( hash.sha256 );
+      if( !control( (uint8_t*)&hash, sizeof(FTBlockHash) ) ) {
+        log_e("Failed to send the hash of block %d", block);
+        return false;
+      }
+      return true;
+    }
+
+    void sendAbort() {
+      uint8_t abortFrame = FT_ABORT;
+      control( &abortFrame, 1 );
+    }
+
+};
+
+
+struct FTBlockCheck {
+  uint32_t expectedBlock = 0;
+  uint32_t computedBlock = 0;
+  bool     hasExpected   = false;
+  bool     hasComputed   = false;
+  uint8_t  expected[FT_HASH_LEN]; // from the sender
+  uint8_t  computed[FT_HASH_LEN]; // from what was written
+};
+
+
+class FileTransferReceiver {
+  public:
+
+    // sink, set by the owner before the first frame arrives
+    int32_t (*open)( const char* name, uint32_t size, const uint8_t* sha256 ) = NULL; // offset to resume from, FT_OPEN_SKIP, FT_OPEN_FAIL or FT_OPEN_PENDING
+    bool (*write)( const uint8_t* src, size_t len ) = NULL;
+    bool (*rewind)( uint32_t offset ) = NULL;   // next write goes there
+    void (*verified)( uint32_t offset ) = NULL; // everything before offset matched the block hashes
+    int8_t (*close)( bool complete ) = NULL;    // FT_CLOSE_OK, FT_CLOSE_FAIL or FT_CLOSE_PENDING
+    bool (*control)( const uint8_t* frame, size_t len ) = NULL; // notifications back to the sender
+    uint32_t (*now)() = NULL;
+
+    FTStats stats;
+    bool active = false;
+    volatile bool opening = false; // waiting for opened()
+    volatile bool closing = false; // waiting for closed()
+    uint32_t size = 0;
+    uint32_t chunks = 0;
+    uint32_t base = 0; // next expected chunk
+
+    // route writes (BEGIN/BLOCK/END/ABORT)
+    void onControl( const uint8_t* frame, size_t len ) {
+      if( len < 1 ) return;
+      switch( frame[0] ) {
+        case FT_BEGIN: {
+          if( len < sizeof(FTBegin) ) return;
+          FTBegin begin;
+          memcpy( &begin, frame, sizeof(FTBegin) );
+          begin.name[FT_NAME_LEN-1] = '\0';
+          if( opening || closing ) {
+            log_w("Still busy with the previous file, ignoring %s", begin.name);
+            return; // the sender times out and tries again
+          }
+          if( active ) finish( false );
+          if( begin.chunkSize < FT_MIN_CHUNK || begin.chunkSize > FT_MAX_CHUNK || begin.window < 1 || begin.window > FT_WINDOW ) {
+            log_e("Bad transfer header (chunk=%d, window=%d)", begin.chunkSize, begin.window);
+            sendAbort();
+            return;
+          }
+          if( !allocSlots( begin.window * begin.chunkSize ) ) {
+            sendAbort();
+            return;
+          }
+          size      = begin.size;
+          chunkSize = begin.chunkSize;
+          win       = begin.window;
+          opening   = true;
+          openCancelled = false;
+          int32_t offset = open( begin.name, begin.size, begin.sha256 );
+          if( offset != FT_OPEN_PENDING ) {
+            opened( offset );
+          }
+        }
+        break;
+        case FT_BLOCK: {
+          if( !active || len < sizeof(FTBlockHash) ) return;
+          FTBlockHash hash;
+          memcpy( &hash, frame, sizeof(FTBlockHash) );
+          if( hash.block >= blocks ) return;
+          FTBlockCheck *check = &checks[hash.block % FT_HASH_SLOTS];
+          memcpy( check->expected, hash.sha256, FT_HASH_LEN );
+          check->expectedBlock = hash.block;
+          check->hasExpected = true;
+          verify( hash.block );
+        }
+        break;
+        case FT_END: {
+          // a rewind may still be on its way to the sender, it will end again
+          if( !active || base != chunks || verifiedBlocks != blocks ) return;
+          int8_t result = finish( true );
+          if( result != FT_CLOSE_PENDING ) {
+            closed( result == FT_CLOSE_OK );
+          }
+        }
+        break;
+        case FT_ABORT:
+          if( opening ) openCancelled = true;
+          if( !active ) return;
+          log_e("Transfer aborted by the sender");
+          finish( false );
+        break;
+      }
+    }
+
+    // answer to the transfer header, right after open() or later from the sink when it returned FT_OPEN_PENDING
+    void opened( int32_t offset ) {
+      if( !opening ) return;
+      opening = false;
+      if( openCancelled ) {
+        // the link went away meanwhile
+        if( offset >= 0 ) close( false );
+        return;
+      }
+      if( offset == FT_OPEN_SKIP ) {
+        uint8_t skipFrame = FT_SKIP;
+        control( &skipFrame, 1 );
+        return;
+      }
+      if( offset < 0 || (uint32_t)offset > size ) {
+        sendAbort();
+        return;
+      }
+      startOffset    = offset;
+      chunks         = ( size - startOffset + chunkSize - 1 ) / chunkSize;
+      blockChunks    = max( 1, FT_BLOCK_SIZE / chunkSize );
+      blocks         = ( chunks + blockChunks - 1 ) / blockChunks;
+      verifiedBlocks = 0;
+      rewindsInARow  = 0;
+      base           = 0;
+      received       = 0;
+      sinceAck       = 0;
+      gapAcked       = false;
+      blockHash.reset();
+      for( uint8_t i=0; i<FT_HASH_SLOTS; i++ ) {
+        checks[i].hasExpected = false;
+        checks[i].hasComputed = false;
+      }
+      stats = FTStats();
+      stats.startMs = now();
+      stats.offset  = startOffset;
+      active = true;
+      log_w("Receiving from offset %d: %d bytes, %d chunks of %d bytes, window=%d", startOffset, size, chunks, chunkSize, win);
+      FTReady readyFrame;
+      readyFrame.type   = FT_READY;
+      readyFrame.offset = startOffset;
+      control( (uint8_t*)&readyFrame, sizeof(FTReady) );
+      if( chunks == 0 ) sendAck();
+    }
+
+    // answer to the transfer end, right after close() or later from the sink when it returned FT_CLOSE_PENDING
+    void closed( bool success ) {
+      closing = false;
+      if( success ) {
+        uint8_t doneFrame = FT_DONE;
+        control( &doneFrame, 1 );
+      } else {
+        sendAbort();
+      }
+    }
+
+    // write-without-response frames
+    void onData( const uint8_t* frame, size_t len ) {
+      if( !active || len < sizeof(FTDataHeader) || frame[0] != FT_DATA ) return;
+      FTDataHeader header;
+      memcpy( &header, frame, sizeof(FTDataHeader) );
+      const uint8_t* payload = frame + sizeof(FTDataHeader);
+      size_t payloadLen = len - sizeof(FTDataHeader);
+      stats.frames++;
+      if( header.seq < base ) {
+        // the ACK covering it got lost
+        stats.duplicates++;
+        sendAck();
+        return;
+      }
+      if( header.seq >= chunks || header.seq >= base + win || payloadLen != chunkLen( header.seq ) ) {
+        return;
+      }
+      if( header.seq > base ) {
+        uint32_t bit = 1UL << ( header.seq - base - 1 );
+        if( received & bit ) {
+          stats.duplicates++;
+          return;
+        }
+        memcpy( slots + ( header.seq % win ) * chunkSize, payload, payloadLen );
+        received |= bit;
+        stats.outOfOrder++;
+        if( !gapAcked ) {
+          // tell the sender about the hole right away
+          gapAcked = true;
+          sendAck();
+        }
+        return;
+      }
+      // in order: written in place, then drain what was buffered behind it
+      if( !commit( payload, payloadLen ) ) return;
+      while( received & 1 ) {
+        if( !commit( slots + ( base % win ) * chunkSize, chunkLen( base ) ) ) return;
+        received >>= 1;
+      }
+      received >>= 1;
+      gapAcked = false;
+      if( sinceAck >= min( FT_ACK_EVERY, max( 1, win/2 ) ) || base == chunks ) {
+        sendAck();
+      }
+    }
+
+    uint8_t percent() {
+      if( size == 0 ) return 100;
+      return ( (uint64_t)min( startOffset + base * chunkSize, size ) * 100 ) / size;
+    }
+
+    // link lost in the middle of a transfer
+    void cancel() {
+      if( opening ) openCancelled = true;
+      if( active ) finish( false );
+    }
+
+  private:
+
+    uint8_t* slots       = NULL; // out-of-order chunks, one per window slot
+    size_t   slotsSize   = 0;
+    uint16_t chunkSize   = 0;
+    uint8_t  win         = FT_WINDOW;
+    uint32_t startOffset = 0;
+    volatile bool openCancelled = false;
+    uint32_t received    = 0; // bit n = chunk base+1+n buffered
+    uint32_t sinceAck    = 0;
+    bool     gapAcked    = false;
+    uint32_t blockChunks = 1;
+    uint32_t blocks      = 0;
+    uint32_t verifiedBlocks = 0;
+    uint8_t  rewindsInARow  = 0;
+    FTHash   blockHash;
+    FTBlockCheck checks[FT_HASH_SLOTS];
+
+    size_t chunkLen( uint32_t seq ) {
+      return min( (uint32_t)chunkSize, size - startOffset - seq * chunkSize );
+    }
+
+    // returns false when the transfer was rewound or aborted
+    bool commit( const uint8_t* src, size_t len ) {
+      if( !write( src, len ) ) {
+        log_e("Failed to write chunk %d", base);
+        sendAbort();
+        finish( false );
+        return false;
+      }
+      blockHash.update( src, len );
+      stats.bytes += len;
+      base++;
+      sinceAck++;
+      if( base % blockChunks == 0 || base == chunks ) {
+        uint32_t block = ( base - 1 ) / blockChunks;
+        FTBlockCheck *check = &checks[block % FT_HASH_SLOTS];
+        blockHash.finish( check->computed );
+        check->computedBlock = block;
+        check->hasComputed = true;
+        return verify( block );
+      }
+      return true;
+    }
+
+    // compares a block once both hashes are known, returns false if it had to be rewound
+    bool verify( uint32_t block ) {
+      FTBlockCheck *check = &checks[block % FT_HASH_SLOTS];
+      if( !check->hasExpected || !check->hasComputed || check->expectedBlock != block || check->computedBlock != block ) {
+        return true; // not yet
+      }
+      if( memcmp( check->expected, check->computed, FT_HASH_LEN ) == 0 ) {
+        check->hasComputed = false;
+        rewindsInARow = 0;
+        if( block == verifiedBlocks ) {
+          verifiedBlocks++;
+          if( verified != NULL ) verified( min( startOffset + verifiedBlocks * blockChunks * chunkSize, size ) );
+        }
+        return true;
+      }
+      stats.rewinds++;
+      if( ++rewindsInARow > FT_MAX_REWINDS ) {
+        log_e("Too many corrupted blocks, giving up");
+        sendAbort();
+        finish( false );
+        return false;
+      }
+      uint32_t seq = block * blockChunks;
+      log_w("Block %d is corrupted, asking for chunk %d again", block, seq);
+      for( uint8_t i=0; i<FT_HASH_SLOTS; i++ ) {
+        if( checks[i].computedBlock >= block ) checks[i].hasComputed = false;
+      }
+      base     = seq;
+      received = 0;
+      sinceAck = 0;
+      gapAcked = false;
+      blockHash.reset();
+      if( !rewind( startOffset + seq * chunkSize ) ) {
+        sendAbort();
+        finish( false );
+        return false;
+      }
+      FTRewind rewindFrame;
+      rewindFrame.type = FT_REWIND;
+      rewindFrame.seq  = seq;
+      control( (uint8_t*)&rewindFrame, sizeof(FTRewind) );
+      return false;
+    }
+
+    void sendAck() {
+      FTAck ack;
+      ack.type   = FT_ACK;
+      ack.base   = base;
+      ack.bitmap = received;
+      control( (uint8_t*)&ack, sizeof(FTAck) );
+      stats.acks++;
+      sinceAck = 0;
+    }
+
+    void sendAbort() {
+      uint8_t abortFrame = FT_ABORT;
+      control( &abortFrame, 1 );
+    }
+
+    int8_t finish( bool complete ) {
+      active = false;
+      stats.elapsedMs = now() - stats.startMs;
+      int8_t result = close( complete );
+      if( result == FT_CLOSE_PENDING ) closing = true;
+      if( slots != NULL ) {
+        free( slots );
+        slots = NULL;
+        slotsSize = 0;
+      }
+      return result;
+    }
+
+    bool allocSlots( size_t len ) {
+      if( slots != NULL && slotsSize >= len ) return true;
+      if( slots != NULL ) free( slots );
+      slots = (uint8_t*)malloc( len );
+      if( slots == NULL && psramInit() ) {
+        slots = (uint8_t*)ps_malloc( len );
+      }
+      if( slots == NULL ) {
+        log_e("Can't allocate %d bytes for the receive window", len);
+        slotsSize = 0;
+        return false;
+      }
+      slotsSize = len;
+      return true;
+    }
+
+};
+
+
+
+/******************************************************
+  Loopback link between two simulated endpoints
+******************************************************/
+
+#define FT_SIM_SEED      0x5eed
+#define FT_SIM_LINK_KBPS 700  // sustained write-without-response rate of a good connection
+#define FT_SIM_ACK_US    7500 // one connection interval for a notification to come back
+#define FT_SIM_QUEUE     16   // notifications in flight
+
+struct FTSimNotification {
+  uint8_t  frame[sizeof(FTAck)]; // largest receiver -> sender frame
+  size_t   len   = 0;
+  uint64_t dueUs = 0;
+};
+
+class FileTransferLoopbackUtils {
+  public:
+
+    // sends <size> bytes of a known pattern through a lossy in-memory link, <corrupt>
+    // per mille of the delivered frames get a flipped bit. Frame and timing counts
+    // only depend on the arguments so runs can be compared between builds
+    static bool run( uint32_t size, uint16_t lossPermille, uint16_t mtu, uint8_t window, uint16_t corruptPermille = 0 ) {
+      static FileTransferSender   tx;
+      static FileTransferReceiver rx;
+      seed       = FT_SIM_SEED;
+      loss       = lossPermille;
+      corrupt    = corruptPermille;
+      clockUs    = 0;
+      sinkOffset = 0;
+      sinkFirstBad = UINT32_MAX;
+      sinkComplete = false;
+      queueHead  = 0;
+      queueTail  = 0;
+      sender     = &tx;
+      receiver   = &rx;
+
+      tx.data     = txData;
+      tx.control  = txControl;
+      tx.read     = sourceRead;
+      tx.idle     = simIdle;
+      tx.now      = simNow;
+      tx.progress = NULL;
+      rx.open     = sinkOpen;
+      rx.write    = sinkWrite;
+      rx.rewind   = sinkRewind;
+      rx.verified = NULL;
+      rx.close    = sinkClose;
+      rx.control  = rxControl;
+      rx.now      = simNow;
+
+      unsigned long wallStart = millis();
+      bool ok = tx.send( "/loopback.bin", size, mtu, window );
+      uint32_t wallMs = millis() - wallStart;
+      ok = ok && sinkComplete && sinkFirstBad == UINT32_MAX && sinkOffset == size;
+      uint32_t simMs = tx.stats.elapsedMs > 0 ? tx.stats.elapsedMs : 1;
+
+      Serial.printf("BENCH {\"name\":\"filetransfer\",\"bytes\":%d,\"mtu\":%d,\"chunk\":%d,\"window\":%d,\"loss_permille\":%d,\"corrupt_permille\":%d,\"seed\":%d,\"frames\":%d,\"retransmits\":%d,\"timeouts\":%d,\"rewinds\":%d,\"acks_rx\":%d,\"acks_tx\":%d,\"out_of_order\":%d,\"duplicates\":%d,\"sim_ms\":%d,\"sim_kbps\":%d,\"cpu_ms\":%d,\"ok\":%s}\n",
+        size, mtu, tx.chunkSize, window, lossPermille, corruptPermille, FT_SIM_SEED,
+        tx.stats.frames, tx.stats.retransmits, tx.stats.timeouts, tx.stats.rewinds, tx.stats.acks, rx.stats.acks,
+        rx.stats.outOfOrder, rx.stats.duplicates,
+        simMs, ( size * 8 ) / simMs, wallMs,
+        ok ? "true" : "false"
+      );
+      return ok;
+    }
+
+    // stop-and-wait baseline, then the full window on a clean and on lossy links
+    static bool runSuite( uint32_t size, uint16_t mtu, uint8_t window ) {
+      bool ok = run( size, 0, mtu, 1 );
+      ok = run( size, 0, mtu, window ) && ok;
+      ok = run( size, 10, mtu, window ) && ok;
+      ok = run( size, 50, mtu, window ) && ok;
+      ok = run( size, 10, mtu, window, 5 ) && ok;
+      return ok;
+    }
+
+  private:
+
+    static FileTransferSender   *sender;
+    static FileTransferReceiver *receiver;
+    static uint32_t seed;
+    static uint16_t loss;
+    static uint16_t corrupt;
+    static uint64_t clockUs;
+    static uint32_t sinkOffset;
+    static uint32_t sinkFirstBad;
+    static bool     sinkComplete;
+    static FTSimNotification queue[FT_SIM_QUEUE];
+    static uint8_t  queueHead;
+    static uint8_t  queueTail;
+    static uint8_t  corrupted[FT_MAX_FRAME];
+
+    static uint32_t nextRandom() {
+      seed ^= seed << 13;
+      seed ^= seed >> 17;
+      seed ^= seed << 5;
+      return seed;
+    }
+
+    static uint8_t pattern( uint32_t offset ) {
+      return ( offset * 31 ) ^ ( offset >> 9 );
+    }
+
+    // notifications land in order once their connection interval has elapsed
+    static void deliverNotifications() {
+      while( queueTail != queueHead && clockUs >= queue[queueTail % FT_SIM_QUEUE].dueUs ) {
+        FTSimNotification *n = &queue[queueTail % FT_SIM_QUEUE];
+        queueTail++;
+        sender->onControl( n->frame, n->len );
+      }
+    }
+
+    static bool txData( const uint8_t* frame, size_t len ) {
+      clockUs += ( (uint64_t)( len + FT_ATT_OVERHEAD ) * 8000 ) / FT_SIM_LINK_KBPS;
+      if( sender->stats.frames % 64 == 63 ) vTaskDelay(1); // let the watchdog breathe
+      if( nextRandom() % 1000 >= loss ) {
+        if( len > sizeof(FTDataHeader) && nextRandom() % 1000 < corrupt ) {
+          memcpy( corrupted, frame, len );
+          corrupted[ sizeof(FTDataHeader) + nextRandom() % ( len - sizeof(FTDataHeader) ) ] ^= 0x10;
+          receiver->onData( corrupted, len );
+        } else {
+          receiver->onData( frame, len );
+        }
+      }
+      deliverNotifications();
+      return true;
+    }
+
+    static bool txControl( const uint8_t* frame, size_t len ) {
+      clockUs += FT_SIM_ACK_US; // acknowledged write: one round trip
+      receiver->onControl( frame, len );
+      deliverNotifications();
+      return true;
+    }
+
+    static bool rxControl( const uint8_t* frame, size_t len ) {
+      if( frame[0] == FT_ACK && nextRandom() % 1000 < loss ) return true;
+      if( uint8_t( queueHead - queueTail ) >= FT_SIM_QUEUE || len > sizeof(FTAck) ) {
+        log_e("Dropped notification 0x%02x", frame[0]);
+        return false;
+      }
+      FTSimNotification *n = &queue[queueHead % FT_SIM_QUEUE];
+      memcpy( n->frame, frame, len );
+      n->len   = len;
+      n->dueUs = clockUs + FT_SIM_ACK_US;
+      queueHead++;
+      return true;
+    }
+
+    static void simIdle() {
+      clockUs += 1000;
+      deliverNotifications();
+    }
+
+    static uint32_t simNow() {
+      return clockUs / 1000;
+    }
+
+    static size_t sourceRead( uint32_t offset, uint8_t* dst, size_t len ) {
+      for( size_t i=0; i<len; i++ ) dst[i] = pattern( offset + i );
+      return len;
+    }
+
+    static int32_t sinkOpen( const char* name, uint32_t size, const uint8_t* sha256 ) {
+      sinkOffset = 0;
+      return 0;
+    }
+
+    static bool sinkWrite( const uint8_t* src, size_t len ) {
+      for( size_t i=0; i<len; i++ ) {
+        if( src[i] != pattern( sinkOffset + i ) && sinkOffset + i < sinkFirstBad ) sinkFirstBad = sinkOffset + i;
+      }
+      sinkOffset += len;
+      return true;
+    }
+
+    static bool sinkRewind( uint32_t offset ) {
+      // everything from offset on gets written again
+      if( offset <= sinkFirstBad ) sinkFirstBad = UINT32_MAX;
+      sinkOffset = offset;
+      return true;
+    }
+
+    static int8_t sinkClose( bool complete ) {
+      sinkComplete = complete;
+      return complete && sinkFirstBad == UINT32_MAX ? FT_CLOSE_OK : FT_CLOSE_FAIL;
+    }
+
+};
+
+FileTransferSender   *FileTransferLoopbackUtils::sender   = NULL;
+FileTransferReceiver *FileTransferLoopbackUtils::receiver = NULL;
+uint32_t FileTransferLoopbackUtils::seed         = FT_SIM_SEED;
+uint16_t FileTransferLoopbackUtils::loss         = 0;
+uint16_t FileTransferLoopbackUtils::corrupt      = 0;
+uint64_t FileTransferLoopbackUtils::clockUs      = 0;
+uint32_t FileTransferLoopbackUtils::sinkOffset   = 0;
+uint32_t FileTransferLoopbackUtils::sinkFirstBad = UINT32_MAX;
+bool     FileTransferLoopbackUtils::sinkComplete = false;
+FTSimNotification FileTransferLoopbackUtils::queue[FT_SIM_QUEUE];
+uint8_t  FileTransferLoopbackUtils::queueHead    = 0;
+uint8_t  FileTransferLoopbackUtils::queueTail    = 0;
+uint8_t  FileTransferLoopbackUtils::corrupted[FT_MAX_FRAME];
+
+FileTransferLoopbackUtils FileTransferLoopback;
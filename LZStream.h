@@ -0,0 +1,395 @@
+/*
+
+  ESP32 BLE Collector - A BLE scanner with sqlite data persistence on the SD Card
+  Source: https://github.com/tobozo/ESP32-BLECollector
+
+  MIT License
+
+  Copyright (c) 2018 tobozo
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  -----------------------------------------------------------------------------
+
+  Block compressed container for the reference DBs (mac-oui-light.db, ble-oui.db).
+
+  The file is cut in LZ_BLOCK_SIZE blocks compressed with a byte oriented
+  LZ77: a control byte below 0x80 is followed by that many + 1 literals,
+  above it is a match of (c & 0x7f) + LZ_MIN_MATCH bytes followed by the 16
+  bits distance back in the block or in the previous one. Blocks that don't
+  shrink are stored as is. Decoding only needs one block of input and two of
+  output (the previous block is the history), so a download or a BLE copy can
+  be unpacked while it's written to BLE_FS.
+
+  Plain byte matches without entropy coding, mac-oui-light.db (933888 bytes)
+  packs to 677653 bytes (72.6%), where lz4 gets 67% and gzip 49%.
+
+  The encoder is deterministic: packing the same file twice gives the same
+  bytes, a receiver can pack its local copy to tell if it's up to date.
+
+  File format: LZHeader followed by LZBlockHeader + block data, in order.
+
+*/
+
+#define LZ_MAGIC          "BLZ1"
+#define LZ_VERSION        2 // 1 had no history between blocks
+#define LZ_SUFFIX         ".blz" // container of <file> is <file>.blz
+#define LZ_BLOCK_SIZE     4096 // bytes, two blocks must fit the 16 bits distance
+#define LZ_MIN_MATCH      4
+#define LZ_MAX_MATCH      ( 0x7f + LZ_MIN_MATCH )
+#define LZ_MAX_LITERALS   0x80
+#define LZ_HASH_BITS      13
+#define LZ_STORED         0x8000 // LZBlockHeader::packedLen flag, block isn't compressed
+
+struct __attribute__((packed)) LZHeader {
+  char     magic[4];
+  uint8_t  version;
+  uint8_t  flags;
+  uint16_t blockSize;
+  uint32_t rawSize;
+};
+
+struct __attribute__((packed)) LZBlockHeader {
+  uint16_t packedLen; // | LZ_STORED
+  uint16_t rawLen;
+};
+
+// where packed or unpacked bytes go, returns false to abort
+typedef bool (*LZSink)( void* ctx, const uint8_t* data, size_t len );
+
+
+class LZStreamUtils {
+  public:
+
+    static bool isContainer( const char* path ) {
+      size_t len = strlen( path );
+      return len > strlen( LZ_SUFFIX ) && strcmp( path + len - strlen( LZ_SUFFIX ), LZ_SUFFIX ) == 0;
+    }
+
+    // <file>.blz -> <file>
+    static void targetOf( const char* path, char* target, size_t size ) {
+      snprintf( target, size, "%.*s", (int)( strlen( path ) - strlen( LZ_SUFFIX ) ), path );
+    }
+
+    static bool fileSink( void* ctx, const uint8_t* data, size_t len ) {
+      return ((File*)ctx)->write( data, len ) == len;
+    }
+
+    static void* alloc( size_t len ) {
+      void* ptr = malloc( len );
+      if( ptr == NULL && psramInit() ) {
+        ptr = ps_malloc( len );
+      }
+      if( ptr == NULL ) {
+        log_e("Can't allocate %d bytes", len);
+      }
+      return ptr;
+    }
+
+    // packs <len> bytes from the current position of <in>
+    static bool pack( File &in, size_t len, LZSink sink, void* ctx ) {
+      uint8_t  *raw    = (uint8_t*)alloc( LZ_BLOCK_SIZE*2 ); // previous block + current one
+      uint8_t  *packed = (uint8_t*)alloc( LZ_BLOCK_SIZE );
+      uint16_t *table  = (uint16_t*)alloc( sizeof(uint16_t) << LZ_HASH_BITS );
+      bool ok = raw != NULL && packed != NULL && table != NULL;
+      if( ok ) {
+        LZHeader header;
+        memcpy( header.magic, LZ_MAGIC, 4 );
+        header.version   = LZ_VERSION;
+        header.flags     = 0;
+        header.blockSize = LZ_BLOCK_SIZE;
+        header.rawSize   = len;
+        ok = sink( ctx, (uint8_t*)&header, sizeof(header) );
+      }
+      uint16_t history = 0;
+      while( ok && len > 0 ) {
+        LZBlockHeader block;
+        block.rawLen = in.read( raw + history, min( len, (size_t)LZ_BLOCK_SIZE ) );
+        if( block.rawLen == 0 ) { ok = false; break; }
+        len -= block.rawLen;
+        block.packedLen = packBlock( raw, history, block.rawLen, packed, table );
+        const uint8_t* payload = packed;
+        if( block.packedLen == 0 ) {
+          block.packedLen = block.rawLen | LZ_STORED;
+          payload = raw + history;
+        }
+        ok = sink( ctx, (uint8_t*)&block, sizeof(block) )
+          && sink( ctx, payload, block.packedLen & ~LZ_STORED );
+        memmove( raw, raw + history, block.rawLen );
+        history = block.rawLen;
+      }
+      free( raw );
+      free( packed );
+      free( table );
+      return ok;
+    }
+
+    // writes <path>.blz, returns the container size or 0
+    static size_t packFile( const char* path ) {
+      char packedPath[64];
+      snprintf( packedPath, sizeof(packedPath), "%s%s", path, LZ_SUFFIX );
+      isQuerying = true;
+      File in = BLE_FS.open( path );
+      File out = BLE_FS.open( packedPath, FILE_WRITE );
+      size_t packedSize = 0;
+      if( in && out && pack( in, in.size(), fileSink, &out ) ) {
+        packedSize = out.position();
+      } else {
+        log_e("Can't pack %s", path);
+      }
+      if( in ) in.close();
+      if( out ) out.close();
+      if( packedSize == 0 ) BLE_FS.remove( packedPath );
+      isQuerying = false;
+      return packedSize;
+    }
+
+    // packs the <len> bytes following <history> bytes of the previous block in <src>,
+    // returns the packed length, 0 when the block doesn't shrink
+    static uint16_t packBlock( const uint8_t* src, uint16_t history, uint16_t len, uint8_t* dst, uint16_t* table ) {
+      memset( table, 0xff, sizeof(uint16_t) << LZ_HASH_BITS );
+      for( uint16_t i = 0; i + LZ_MIN_MATCH <= history; i++ ) {
+        table[hash( src + i )] = i;
+      }
+      uint16_t ip = history, op = 0, literals = history;
+      uint16_t end = history + len;
+      while( ip + LZ_MIN_MATCH <= end ) {
+        uint16_t h = hash( src + ip );
+        uint16_t candidate = table[h];
+        table[h] = ip;
+        if( candidate == 0xffff || memcmp( src + candidate, src + ip, LZ_MIN_MATCH ) != 0 ) {
+          ip++;
+          continue;
+        }
+        uint16_t matchLen = LZ_MIN_MATCH;
+        while( ip + matchLen < end && matchLen < LZ_MAX_MATCH && src[candidate + matchLen] == src[ip + matchLen] ) {
+          matchLen++;
+        }
+        if( !putLiterals( src + literals, ip - literals, dst, op, len ) || op + 3 >= len ) return 0;
+        uint16_t distance = ip - candidate;
+        dst[op++] = 0x80 | ( matchLen - LZ_MIN_MATCH );
+        dst[op++] = distance & 0xff;
+        dst[op++] = distance >> 8;
+        for( uint16_t i = 1; i < matchLen && ip + i + LZ_MIN_MATCH <= end; i++ ) {
+          table[hash( src + ip + i )] = ip + i;
+        }
+        ip += matchLen;
+        literals = ip;
+      }
+      if( !putLiterals( src + literals, end - literals, dst, op, len ) ) return 0;
+      return op;
+    }
+
+    // unpacks after the <history> bytes of the previous block already in <dst>, at most <size> bytes,
+    // returns the unpacked length, 0 on malformed input
+    static uint16_t unpackBlock( const uint8_t* src, uint16_t len, uint8_t* dst, uint16_t history, uint16_t size ) {
+      uint16_t ip = 0, op = history;
+      size += history;
+      while( ip < len ) {
+        uint8_t c = src[ip++];
+        if( c < 0x80 ) {
+          uint16_t count = c + 1;
+          if( ip + count > len || op + count > size ) return 0;
+          memcpy( dst + op, src + ip, count );
+          ip += count;
+          op += count;
+        } else {
+          uint16_t count = ( c & 0x7f ) + LZ_MIN_MATCH;
+          if( ip + 2 > len ) return 0;
+          uint16_t distance = src[ip] | ( src[ip+1] << 8 );
+          ip += 2;
+          if( distance == 0 || distance > op || op + count > size ) return 0;
+          for( uint16_t i = 0; i < count; i++, op++ ) { // may overlap
+            dst[op] = dst[op - distance];
+          }
+        }
+      }
+      return op - history;
+    }
+
+  private:
+
+    static uint16_t hash( const uint8_t* p ) {
+      uint32_t v;
+      memcpy( &v, p, sizeof(v) );
+      return (uint32_t)( v * 2654435761u ) >> ( 32 - LZ_HASH_BITS );
+    }
+
+    static bool putLiterals( const uint8_t* src, uint16_t count, uint8_t* dst, uint16_t &op, uint16_t limit ) {
+      while( count > 0 ) {
+        uint16_t run = min( count, (uint16_t)LZ_MAX_LITERALS );
+        if( op + 1 + run >= limit ) return false;
+        dst[op++] = run - 1;
+        memcpy( dst + op, src, run );
+        op    += run;
+        src   += run;
+        count -= run;
+      }
+      return true;
+    }
+
+};
+
+
+// push based, the input can be cut anywhere. Without the magic the bytes are passed as is.
+class LZStreamDecoder {
+  public:
+
+    bool     passthrough = false;
+    uint32_t rawSize     = 0;
+    uint32_t written     = 0;
+
+    bool begin( LZSink _sink, void* _ctx ) {
+      sink = _sink;
+      ctx  = _ctx;
+      passthrough = false;
+      failed  = false;
+      rawSize = 0;
+      written = 0;
+      history = 0;
+      expect( LZ_HEADER, (uint8_t*)&header, sizeof(header) );
+      return true;
+    }
+
+    bool write( const uint8_t* data, size_t len ) {
+      if( failed ) return false;
+      if( passthrough ) return out( data, len );
+      while( len > 0 ) {
+        if( state == LZ_HEADER && !matchesMagic( data, len ) ) {
+          // not a container, give back what was held
+          passthrough = true;
+          return out( (uint8_t*)&header, have ) && out( data, len );
+        }
+        size_t take = min( len, need - have );
+        memcpy( target + have, data, take );
+        have += take;
+        data += take;
+        len  -= take;
+        if( have == need && !advance() ) {
+          failed = true;
+          return false;
+        }
+      }
+      return true;
+    }
+
+    // true once the whole container was unpacked (or passed through)
+    bool finish() {
+      if( passthrough ) return !failed;
+      if( state == LZ_HEADER && have > 0 ) { // too short to tell, was raw
+        return out( (uint8_t*)&header, have );
+      }
+      if( !failed && written != rawSize ) {
+        log_e("Container truncated at %d/%d bytes", written, rawSize);
+      }
+      return !failed && state == LZ_BLOCK && written == rawSize;
+    }
+
+    void end() {
+      free( packed );
+      free( raw );
+      packed = NULL;
+      raw = NULL;
+    }
+
+  private:
+
+    enum LZState { LZ_HEADER, LZ_BLOCK, LZ_DATA };
+
+    LZSink   sink = nullptr;
+    void*    ctx  = nullptr;
+    LZState  state;
+    LZHeader header;
+    LZBlockHeader block;
+    uint8_t* target = NULL; // what is being filled
+    size_t   need = 0;
+    size_t   have = 0;
+    bool     failed = false;
+    uint8_t* packed = NULL;
+    uint8_t* raw    = NULL; // previous block + current one
+    uint16_t history = 0;
+
+    void expect( LZState _state, uint8_t* _target, size_t _need ) {
+      state  = _state;
+      target = _target;
+      need   = _need;
+      have   = 0;
+    }
+
+    bool matchesMagic( const uint8_t* data, size_t len ) {
+      for( size_t i = have; i < 4 && i - have < len; i++ ) {
+        if( data[i - have] != LZ_MAGIC[i] ) return false;
+      }
+      return true;
+    }
+
+    bool out( const uint8_t* data, size_t len ) {
+      if( len == 0 ) return true;
+      written += len;
+      if( !sink( ctx, data, len ) ) {
+        failed = true;
+        return false;
+      }
+      return true;
+    }
+
+    bool advance() {
+      switch( state ) {
+        case LZ_HEADER:
+          if( header.version != LZ_VERSION || header.blockSize == 0 || header.blockSize > LZ_BLOCK_SIZE ) {
+            log_e("Unsupported container v%d, %d bytes blocks", header.version, header.blockSize);
+            return false;
+          }
+          rawSize = header.rawSize;
+          if( packed == NULL ) packed = (uint8_t*)LZStreamUtils::alloc( LZ_BLOCK_SIZE );
+          if( raw == NULL )    raw    = (uint8_t*)LZStreamUtils::alloc( LZ_BLOCK_SIZE*2 );
+          if( packed == NULL || raw == NULL ) return false;
+          expect( LZ_BLOCK, (uint8_t*)&block, sizeof(block) );
+        return true;
+        case LZ_BLOCK: {
+          uint16_t packedLen = block.packedLen & ~LZ_STORED;
+          if( written >= rawSize || packedLen == 0 || packedLen > header.blockSize
+           || block.rawLen == 0 || block.rawLen > header.blockSize || block.rawLen > rawSize - written ) {
+            log_e("Bad block header at %d", written);
+            return false;
+          }
+          expect( LZ_DATA, packed, packedLen );
+        }
+        return true;
+        case LZ_DATA:
+          if( block.packedLen & LZ_STORED ) {
+            if( need != block.rawLen ) return false;
+            memcpy( raw + history, packed, need );
+          } else if( LZStreamUtils::unpackBlock( packed, need, raw, history, header.blockSize ) != block.rawLen ) {
+            log_e("Corrupted block at %d", written);
+            return false;
+          }
+          if( !out( raw + history, block.rawLen ) ) return false;
+          memmove( raw, raw + history, block.rawLen );
+          history = block.rawLen;
+          expect( LZ_BLOCK, (uint8_t*)&block, sizeof(block) );
+        return true;
+      }
+      return false;
+    }
+
+};
+
+
+LZStreamUtils LZStream;
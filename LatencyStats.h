@@ -0,0 +1,169 @@
+/*
+
+  ESP32 BLE Collector - A BLE scanner with sqlite data persistence on the SD Card
+  Source: https://github.com/tobozo/ESP32-BLECollector
+
+  MIT License
+
+  Copyright (c) 2018 tobozo
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  -----------------------------------------------------------------------------
+
+  Fixed-memory latency histograms for the scan pipeline stages.
+  Samples go in log2 buckets, so min/avg/max are exact and percentiles are
+  rounded up to the bucket boundary. Pipeline stages are timed with the CPU
+  cycle counter, the radio scan (seconds long) in µs since the counter wraps.
+
+*/
+
+#define LATENCY_BUCKETS 33 // bucket n holds [2^(n-1), 2^n), covers the whole uint32_t range
+
+struct LatencyHistogram {
+  const char* name = "";
+  bool     cycles = false; // samples are CPU cycles instead of µs
+  uint32_t count = 0;
+  uint32_t min   = 0xffffffff;
+  uint32_t max   = 0;
+  uint64_t total = 0;
+  uint32_t buckets[LATENCY_BUCKETS] = {0};
+
+  void add( uint32_t us ) {
+    count++;
+    total += us;
+    if( us < min ) min = us;
+    if( us > max ) max = us;
+    uint8_t bucket = us == 0 ? 0 : 32 - __builtin_clz( us );
+    if( bucket >= LATENCY_BUCKETS ) bucket = LATENCY_BUCKETS - 1;
+    buckets[bucket]++;
+  }
+
+  uint32_t avg() {
+    return count > 0 ? total / count : 0;
+  }
+
+  // 64 bits: a TOTAL in cycles at 240MHz exceeds 32 bits of µs after ~71 minutes
+  uint64_t toUs( uint64_t value ) {
+    return cycles ? value / getCpuFrequencyMhz() : value;
+  }
+
+  // upper bound of the bucket holding the p-th percentile, capped by max
+  uint32_t percentile( uint8_t p ) {
+    if( count == 0 ) return 0;
+    uint32_t target = ( (uint64_t)count * p + 99 ) / 100;
+    uint32_t seen = 0;
+    for( uint8_t i=0; i<LATENCY_BUCKETS; i++ ) {
+      seen += buckets[i];
+      if( seen >= target ) {
+        uint32_t upper = i == 0 ? 0 : i >= 32 ? 0xffffffff : ( (uint32_t)1 << i ) - 1;
+        return upper < max ? upper : max;
+      }
+    }
+    return max;
+  }
+
+  void reset() {
+    count = 0;
+    min   = 0xffffffff;
+    max   = 0;
+    total = 0;
+    memset( buckets, 0, sizeof(buckets) );
+  }
+};
+
+
+enum ScanStage {
+  STAGE_STORE = 0, // advertisement stored in the scan cache (scan callback)
+  STAGE_POPULATE,  // OUI / vendor / isanonymous
+  STAGE_IFEXISTS,  // cache + DB lookup
+  STAGE_RENDER,    // render queue push
+  STAGE_PROPAGATE, // DB insert / cache release
+  STAGE_SCAN,      // radio scan window, pBLEScan->start()
+  SCAN_STAGES      // keep last
+};
+
+
+class LatencyStatsUtils {
+  public:
+
+    LatencyHistogram stages[SCAN_STAGES];
+    bool graph = false; // draw the stage shares in the heap graph
+
+    LatencyStatsUtils() {
+      stages[STAGE_STORE].name     = "store";
+      stages[STAGE_POPULATE].name  = "populate";
+      stages[STAGE_IFEXISTS].name  = "ifexists";
+      stages[STAGE_RENDER].name    = "render";
+      stages[STAGE_PROPAGATE].name = "propagate";
+      stages[STAGE_SCAN].name      = "scan";
+      for( uint8_t i=0; i<STAGE_SCAN; i++ ) {
+        stages[i].cycles = true;
+      }
+    }
+
+    // cycle counter is per core, begin() and end() must run in the same (pinned) task
+    uint32_t begin() {
+      return ESP.getCycleCount();
+    }
+
+    void end( ScanStage stage, uint32_t start ) {
+      stages[stage].add( ESP.getCycleCount() - start );
+    }
+
+    void add( ScanStage stage, uint32_t value ) {
+      stages[stage].add( value );
+    }
+
+    void reset() {
+      for( uint8_t i=0; i<SCAN_STAGES; i++ ) {
+        stages[i].reset();
+      }
+    }
+
+    void print() {
+      Serial.println("    STAGE        |   COUNT |  MIN(µs) |  AVG(µs) |  P99(µs) |  MAX(µs) | TOTAL(ms)");
+      Serial.println("-----------------------------------------------------------------------------------");
+      for( uint8_t i=0; i<SCAN_STAGES; i++ ) {
+        LatencyHistogram *h = &stages[i];
+        Serial.printf("    %-12s | %7d | %8llu | %8llu | %8llu | %8llu | %9llu\n",
+          h->name,
+          h->count,
+          h->toUs( h->count ? h->min : 0 ),
+          h->toUs( h->avg() ),
+          h->toUs( h->percentile( 99 ) ),
+          h->toUs( h->max ),
+          h->toUs( h->total ) / 1000
+        );
+      }
+    }
+
+    // per mille of the pipeline time spent in a stage (radio scan excluded)
+    uint16_t share( ScanStage stage ) {
+      uint64_t pipeline = 0;
+      for( uint8_t i=0; i<STAGE_SCAN; i++ ) {
+        pipeline += stages[i].total;
+      }
+      return pipeline > 0 ? stages[stage].total * 1000 / pipeline : 0;
+    }
+
+};
+
+
+LatencyStatsUtils LatencyStats;
@@ -0,0 +1,864 @@
+/*
+
+  ESP32 BLE Collector - A BLE scanner with sqlite data persistence on the SD Card
+  Source: https://github.com/tobozo/ESP32-BLECollector
+
+  MIT License
+
+  Copyright (c) 2018 tobozo
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  -----------------------------------------------------------------------------
+
+  Sorted binary lookup tables for the reference data (OUI names, BLE company
+  identifiers), so lookups don't need a query. Tables are either generated
+  offline from the Wireshark manuf and Bluetooth SIG lists by
+  tools/BLELookupGen/lookupgen.py, or compiled on the device from the SQLite
+  reference DBs when no generated table is present.
+
+  File format: LookupHeader, then <entries> records sorted by key, then the
+  string pool. A record is the key (little endian, <keyBytes> long: 3 for a
+  MAC OUI, 2 for a company ID) followed by the 24 bits offset of its name in
+  the pool. Names are null terminated and at most MAX_FIELD_LEN-1 long.
+  The header checksum is the CRC32 of everything after the header.
+
+  With PSRAM the whole file is loaded with a single read and searched in
+  place. Without PSRAM a paged index (<table>.idx) is derived from the table:
+  LOOKUP_PAGE_SIZE pages of sorted (key, length, name) entries, and a fence
+  array holding the first key of each page which stays in RAM. A lookup
+  picks its page from the fences and costs at most one sector read, recently
+  used pages are kept in an LRU cache sized from the free heap.
+
+  Index file: LookupIndexHeader padded to a page, the pages, then the fences.
+
+  Every table also keeps a presence bitset over the top <filterBits> of its
+  keys: a clear bit means no entry can match, so random or unassigned
+  prefixes are answered without touching the table. With PSRAM the OUI bitset
+  covers the whole 24 bits space (2MB, exact), on the heap it's down to
+  LOOKUP_FILTER_HEAP_BITS (512 bytes, still rejects ~3/4 of unknown OUIs).
+
+  Updated tables can be swapped in while running: stage() checks the new
+  file and sets it aside as <table>.new, maintain() renames it over the
+  current one and reloads it between two scans (DB.maintain()), so the live
+  file is never replaced under find(). A table that fails the checks never
+  replaces the running one.
+
+*/
+
+#define LOOKUP_MAGIC       "BLKP"
+#define LOOKUP_VERSION     2
+#define LOOKUP_GENERATED   0x01 // LookupHeader::flags, built offline from the source lists
+#define LOOKUP_OFFSET_LEN  3 // bytes, string pool offsets are 24 bits
+#define LOOKUP_MAX_RECORD  8
+#define LOOKUP_POOL_SUFFIX ".pool" // string pool is written aside while building
+#define LOOKUP_STAGED_SUFFIX ".new" // checked replacement, waiting for maintain()
+
+#define LOOKUP_PAGE_SIZE        512 // one SD sector
+#define LOOKUP_INDEX_MAGIC      "BLKI"
+#define LOOKUP_INDEX_SUFFIX     ".idx"
+#define LOOKUP_PAGE_CACHE_MIN   2
+#define LOOKUP_PAGE_CACHE_MAX   16
+#define LOOKUP_PAGE_HEAP_SHARE  32 // the page cache takes at most 1/32 of the free heap
+#define LOOKUP_FILTER_HEAP_BITS 12 // presence bitset size on the heap, 2^12 bits
+#define LOOKUP_FILTER_MIN_BITS  8 // smallest PSRAM bitset before giving up on the filter
+#define LOOKUP_INDEX_POOL_SHARE 4 // building the index reads the whole pool when it takes at most 1/4 of the free heap
+#define LOOKUP_INDEX_WINDOW     4096 // or reads it by windows of that size
+#define LOOKUP_INDEX_NAMES      256 // plus the names already seen, generated tables share them between records
+
+struct __attribute__((packed)) LookupIndexHeader {
+  char     magic[4];
+  uint8_t  version;
+  uint8_t  keyBytes;
+  uint16_t pageSize;
+  uint32_t pages;
+  uint32_t entries;
+  uint32_t tableChecksum; // index is rebuilt when its table changes
+};
+
+// page layout: entry count, then <count> x ( key, name length, name )
+struct LookupPage {
+  int32_t  index = -1;
+  uint32_t lastUsed = 0;
+  uint8_t  data[LOOKUP_PAGE_SIZE];
+};
+
+// name kept while building the index
+struct LookupName {
+  uint32_t offset = UINT32_MAX;
+  uint8_t  len = 0;
+  char     name[MAX_FIELD_LEN];
+};
+
+struct __attribute__((packed)) LookupHeader {
+  char     magic[4];
+  uint8_t  version;
+  uint8_t  keyBytes;
+  uint8_t  recordSize; // keyBytes + LOOKUP_OFFSET_LEN
+  uint8_t  flags;
+  uint32_t entries;
+  uint32_t poolSize;
+  uint32_t sourceSize; // size of the DB file the table was compiled from, 0 when generated
+  uint32_t created; // unix time the source lists were read, 0 when compiled on the device
+  uint32_t checksum; // CRC32 of records + pool
+};
+
+
+class LookupTable {
+  public:
+
+    LookupTable( const char* _path, uint8_t _keyBytes ) : path( _path ), keyBytes( _keyBytes ) {
+      snprintf( stagedPath, sizeof(stagedPath), "%s%s", path, LOOKUP_STAGED_SUFFIX );
+    }
+
+    // "b4:99:ba:xx:xx:xx" or "B499BA" -> 0xb499ba, -1 when not an OUI
+    static int32_t ouiKey( const char* mac ) {
+      int32_t key = 0;
+      uint8_t digits = 0;
+      for( const char* p = mac; *p != '\0' && digits < 6; p++ ) {
+        if( *p == ':' ) continue;
+        if( !isxdigit( *p ) ) return -1;
+        key = ( key << 4 ) | ( isdigit( *p ) ? *p - '0' : ( tolower( *p ) - 'a' ) + 10 );
+        digits++;
+      }
+      return digits == 6 ? key : -1;
+    }
+
+    bool isReady() {
+      return ready;
+    }
+
+    bool inPsram() {
+      return buffer != NULL;
+    }
+
+    uint32_t size() {
+      return ready ? header.entries : 0;
+    }
+
+    bool isGenerated() {
+      return ready && ( header.flags & LOOKUP_GENERATED );
+    }
+
+    const LookupHeader& info() {
+      return header;
+    }
+
+    // validates the table (header, checksum, source DB size) and loads it into PSRAM when asked,
+    // the current table stays in use when the file doesn't check out
+    bool open( size_t sourceSize, bool toPsram ) {
+      openedSourceSize = sourceSize;
+      openedToPsram = toPsram;
+      swapStaged();
+      LookupHeader candidate;
+      uint8_t* candidateBuffer = NULL;
+      if( !load( path, sourceSize, toPsram, candidate, &candidateBuffer ) ) {
+        log_w("Lookup table %s is missing, stale or corrupted", path);
+        return false;
+      }
+      close();
+      header = candidate;
+      buffer = candidateBuffer;
+      ready = true;
+      if( !inPsram() && !openIndex() ) {
+        log_w("No paged index for %s, binary searching the table", path);
+      }
+      buildFilter( toPsram );
+      log_i("Lookup table %s: %d entries, %d bytes pool, %s (%s)", path, header.entries, header.poolSize, isGenerated() ? "generated" : "compiled", inPsram() ? "psram" : BLE_FS_TYPE);
+      return true;
+    }
+
+    // header + checksum of a table file, without loading it
+    bool verify( const char* filePath, LookupHeader &fileHeader ) {
+      return load( filePath, 0, false, fileHeader, NULL, true );
+    }
+
+    // a generated table file is usable without the DB it replaces
+    bool hasGeneratedFile() {
+      LookupHeader fileHeader;
+      return verify( path, fileHeader ) && ( fileHeader.flags & LOOKUP_GENERATED );
+    }
+
+    // checks a new table file and sets it aside, swapped in by the next maintain()
+    bool stage( const char* newPath ) {
+      LookupHeader candidate;
+      if( !verify( newPath, candidate ) || !( candidate.flags & LOOKUP_GENERATED ) ) {
+        log_e("Lookup table %s rejected, keeping %s", newPath, path);
+        isQuerying = true;
+        BLE_FS.remove( newPath );
+        isQuerying = false;
+        return false;
+      }
+      isQuerying = true;
+      BLE_FS.remove( stagedPath );
+      bool ok = BLE_FS.rename( newPath, stagedPath );
+      isQuerying = false;
+      if( ok ) {
+        reloadRequested = true;
+        log_w("Lookup table %s staged: %d entries", path, candidate.entries);
+      }
+      return ok;
+    }
+
+    // call while no find() can run (scan stopped), so the swap doesn't pull the table from under it,
+    // returns true when a new table was swapped in
+    bool maintain() {
+      if( !reloadRequested ) return false;
+      reloadRequested = false;
+      return open( openedSourceSize, openedToPsram );
+    }
+
+    void close() {
+      ready = false;
+      free( buffer );
+      buffer = NULL;
+      free( fences );
+      fences = NULL;
+      free( pageCache );
+      pageCache = NULL;
+      pages = 0;
+      cachedPages = 0;
+      free( filter );
+      filter = NULL;
+      filterBits = 0;
+    }
+
+    // false when no entry can match <key>, without touching the table
+    bool mayContain( int32_t key ) {
+      if( !ready || key < 0 ) return false;
+      if( filter == NULL ) return true;
+      uint32_t bit = (uint32_t)key >> ( keyBytes*8 - filterBits );
+      if( filter[bit >> 3] & ( 1 << ( bit & 7 ) ) ) return true;
+      filterRejects++;
+      return false;
+    }
+
+    uint8_t filterSize() {
+      return filterBits;
+    }
+
+    uint32_t filterRejects = 0;
+
+    bool isPaged() {
+      return fences != NULL;
+    }
+
+    uint32_t pageCount() {
+      return pages;
+    }
+
+    uint8_t pageCacheSize() {
+      return cachedPages;
+    }
+
+    uint32_t pageHits = 0;
+    uint32_t pageReads = 0;
+
+    // copies the name for <key> into dest (at least MAX_FIELD_LEN long), false when unknown
+    bool find( int32_t key, char* dest ) {
+      *dest = '\0';
+      if( !ready || key < 0 || header.entries == 0 ) return false;
+      if( !mayContain( key ) ) return false;
+      if( inPsram() ) {
+        int32_t index = search( key, NULL );
+        if( index < 0 ) return false;
+        copy( dest, (const char*)buffer + poolStart() + recordOffset( buffer + recordsStart() + index*header.recordSize ), MAX_FIELD_LEN-1 );
+        return true;
+      }
+      if( isPaged() ) {
+        return findPaged( key, dest );
+      }
+      isQuerying = true;
+      File file = BLE_FS.open( path );
+      bool found = false;
+      if( file && file.size() != poolStart() + header.poolSize ) {
+        reloadRequested = true; // replaced behind our back
+      } else if( file ) {
+        int32_t index = search( key, &file );
+        if( index >= 0 ) {
+          uint8_t record[LOOKUP_MAX_RECORD];
+          file.seek( recordsStart() + index*header.recordSize );
+          file.read( record, header.recordSize );
+          file.seek( poolStart() + recordOffset( record ) );
+          size_t len = file.read( (uint8_t*)dest, MAX_FIELD_LEN-1 );
+          dest[len] = '\0';
+          found = true;
+        }
+        file.close();
+      }
+      isQuerying = false;
+      return found;
+    }
+
+    // compiling: beginBuild(), add() in increasing key order, endBuild()
+    bool beginBuild() {
+      close();
+      snprintf( poolPath, sizeof(poolPath), "%s%s", path, LOOKUP_POOL_SUFFIX );
+      memcpy( header.magic, LOOKUP_MAGIC, 4 );
+      header.version    = LOOKUP_VERSION;
+      header.keyBytes   = keyBytes;
+      header.recordSize = keyBytes + LOOKUP_OFFSET_LEN;
+      header.flags      = 0;
+      header.entries    = 0;
+      header.poolSize   = 0;
+      header.sourceSize = 0;
+      header.created    = 0;
+      header.checksum   = 0;
+      isQuerying = true;
+      out  = BLE_FS.open( path, FILE_WRITE );
+      pool = BLE_FS.open( poolPath, FILE_WRITE );
+      bool ok = out && pool && out.write( (uint8_t*)&header, sizeof(header) ) == sizeof(header);
+      isQuerying = false;
+      if( !ok ) {
+        log_e("Can't create lookup table %s", path);
+        abortBuild();
+      }
+      return ok;
+    }
+
+    // duplicate keys keep the first name, keys going backwards abort the build
+    bool add( int32_t key, const char* name ) {
+      if( key < 0 || key >= ( 1L << ( keyBytes*8 ) ) ) return true; // not a key of this table, skip
+      if( header.entries > 0 ) {
+        if( key == lastKey ) return true;
+        if( key < lastKey ) {
+          log_e("Lookup table %s: key %06x after %06x, source isn't sorted", path, (unsigned int)key, (unsigned int)lastKey);
+          return false;
+        }
+      }
+      char value[MAX_FIELD_LEN] = {'\0'};
+      copy( value, name, MAX_FIELD_LEN-1 );
+      size_t len = strlen( value );
+      if( len < strlen( name ) ) {
+        // don't leave half an UTF-8 sequence at the end of a truncated name
+        size_t lead = len;
+        while( lead > 0 && ( value[lead-1] & 0xc0 ) == 0x80 ) lead--;
+        if( lead > 0 && ( value[lead-1] & 0x80 ) ) {
+          uint8_t seqLen = ( value[lead-1] & 0xe0 ) == 0xc0 ? 2 : ( value[lead-1] & 0xf0 ) == 0xe0 ? 3 : 4;
+          if( len - ( lead-1 ) < seqLen ) len = lead-1;
+        }
+        value[len] = '\0';
+      }
+      len++;
+      if( header.poolSize + len >= ( 1UL << ( LOOKUP_OFFSET_LEN*8 ) ) ) {
+        log_e("Lookup table %s: string pool overflow", path);
+        return false;
+      }
+      uint8_t record[LOOKUP_MAX_RECORD];
+      writeLE( record, key, keyBytes );
+      writeLE( record + keyBytes, header.poolSize, LOOKUP_OFFSET_LEN );
+      isQuerying = true;
+      bool ok = out.write( record, header.recordSize ) == header.recordSize
+             && pool.write( (uint8_t*)value, len ) == len;
+      isQuerying = false;
+      if( !ok ) {
+        log_e("Lookup table %s: write failed", path);
+        return false;
+      }
+      header.checksum = crc32_le( header.checksum, record, header.recordSize );
+      header.poolSize += len;
+      header.entries++;
+      lastKey = key;
+      return true;
+    }
+
+    // appends the string pool, then stamps the header
+    bool endBuild( size_t sourceSize ) {
+      header.sourceSize = sourceSize;
+      isQuerying = true;
+      pool.close();
+      pool = BLE_FS.open( poolPath );
+      bool ok = (bool)pool;
+      uint8_t chunk[256];
+      size_t copied = 0;
+      while( ok && copied < header.poolSize ) {
+        size_t len = pool.read( chunk, sizeof(chunk) );
+        ok = len > 0 && out.write( chunk, len ) == len;
+        header.checksum = crc32_le( header.checksum, chunk, len );
+        copied += len;
+      }
+      pool.close();
+      BLE_FS.remove( poolPath );
+      if( ok ) {
+        out.seek( 0 );
+        ok = out.write( (uint8_t*)&header, sizeof(header) ) == sizeof(header);
+      }
+      out.close();
+      if( !ok ) {
+        log_e("Lookup table %s: can't write the string pool", path);
+        BLE_FS.remove( path );
+      }
+      isQuerying = false;
+      return ok;
+    }
+
+    void abortBuild() {
+      isQuerying = true;
+      if( out ) out.close();
+      if( pool ) pool.close();
+      BLE_FS.remove( path );
+      BLE_FS.remove( poolPath );
+      isQuerying = false;
+    }
+
+  private:
+
+    const char*  path;
+    uint8_t      keyBytes;
+    LookupHeader header;
+    bool         ready = false;
+    uint8_t*     buffer = NULL; // whole file when in PSRAM
+    File         out, pool;
+    char         poolPath[40];
+    char         stagedPath[40];
+    int32_t      lastKey = 0;
+    size_t       openedSourceSize = 0;
+    bool         openedToPsram = false;
+    volatile bool reloadRequested = false;
+    uint8_t*     filter = NULL; // presence bitset
+    uint8_t      filterBits = 0;
+    char         indexPath[40];
+    uint32_t*    fences = NULL; // first key of each index page
+    uint32_t     pages = 0;
+    LookupPage*  pageCache = NULL;
+    uint8_t      cachedPages = 0;
+    uint32_t     pageTick = 0;
+
+    // renames a staged table over the live one, only from open() so find() never sees the swap
+    void swapStaged() {
+      isQuerying = true;
+      if( BLE_FS.exists( stagedPath ) ) {
+        BLE_FS.remove( path );
+        if( BLE_FS.rename( stagedPath, path ) ) {
+          log_w("Lookup table %s swapped in", path);
+        } else {
+          log_e("Can't swap in %s", stagedPath);
+        }
+      }
+      isQuerying = false;
+    }
+
+    size_t pageOffset( uint32_t page ) {
+      return ( page + 1 ) * LOOKUP_PAGE_SIZE; // page 0 is the header
+    }
+
+    // loads the fences of <table>.idx, (re)builds the index when it doesn't match the table
+    bool openIndex() {
+      snprintf( indexPath, sizeof(indexPath), "%s%s", path, LOOKUP_INDEX_SUFFIX );
+      if( !loadIndex() ) {
+        log_w("Building paged index %s", indexPath);
+        if( !buildIndex() || !loadIndex() ) {
+          free( fences );
+          fences = NULL;
+          pages = 0;
+          isQuerying = true;
+          BLE_FS.remove( indexPath );
+          isQuerying = false;
+          return false;
+        }
+      }
+      cachedPages = constrain( freeheap / LOOKUP_PAGE_HEAP_SHARE / sizeof(LookupPage), LOOKUP_PAGE_CACHE_MIN, LOOKUP_PAGE_CACHE_MAX );
+      cachedPages = min( (uint32_t)cachedPages, pages );
+      pageCache = (LookupPage*)calloc( cachedPages, sizeof(LookupPage) );
+      if( pageCache == NULL ) {
+        cachedPages = 0;
+      }
+      for( uint8_t i=0; i<cachedPages; i++ ) {
+        pageCache[i].index = -1;
+      }
+      log_i("Paged index %s: %d pages, %d bytes of fences, %d cached pages", indexPath, pages, (int)( pages*sizeof(uint32_t) ), cachedPages);
+      return true;
+    }
+
+    bool loadIndex() {
+      LookupIndexHeader h;
+      isQuerying = true;
+      File file = BLE_FS.open( indexPath );
+      bool ok = file && file.read( (uint8_t*)&h, sizeof(h) ) == sizeof(h)
+        && memcmp( h.magic, LOOKUP_INDEX_MAGIC, 4 ) == 0
+        && h.version       == LOOKUP_VERSION
+        && h.keyBytes      == keyBytes
+        && h.pageSize      == LOOKUP_PAGE_SIZE
+        && h.entries       == header.entries
+        && h.tableChecksum == header.checksum
+        && file.size()     == pageOffset( h.pages ) + h.pages*sizeof(uint32_t);
+      if( ok ) {
+        fences = (uint32_t*)malloc( h.pages*sizeof(uint32_t) );
+        ok = fences != NULL && file.seek( pageOffset( h.pages ) )
+          && file.read( (uint8_t*)fences, h.pages*sizeof(uint32_t) ) == h.pages*sizeof(uint32_t);
+        pages = h.pages;
+      }
+      if( file ) file.close();
+      isQuerying = false;
+      if( !ok ) {
+        free( fences );
+        fences = NULL;
+        pages = 0;
+      }
+      return ok;
+    }
+
+    // streams the records and their names into pages, the pool is read through a one page window
+    bool buildIndex() {
+      uint8_t*  page   = (uint8_t*)malloc( LOOKUP_PAGE_SIZE );
+      // pool offsets jump back and forth when names are shared, so avoid seeking for each record
+      size_t    windowSize = header.poolSize;
+      uint8_t*  window = (uint8_t*)ps_malloc( windowSize );
+      if( window == NULL && windowSize <= freeheap / LOOKUP_INDEX_POOL_SHARE ) {
+        window = (uint8_t*)malloc( windowSize );
+      }
+      LookupName* nameCache = NULL;
+      if( window == NULL ) {
+        windowSize = LOOKUP_INDEX_WINDOW;
+        window = (uint8_t*)malloc( windowSize );
+        nameCache = (LookupName*)calloc( LOOKUP_INDEX_NAMES, sizeof(LookupName) ); // optional
+        for( uint16_t i=0; nameCache != NULL && i<LOOKUP_INDEX_NAMES; i++ ) {
+          nameCache[i].offset = UINT32_MAX;
+        }
+      }
+      uint32_t  capacity = header.entries / 16 + 1;
+      uint32_t* fenceList = (uint32_t*)malloc( capacity*sizeof(uint32_t) );
+      isQuerying = true;
+      File records = BLE_FS.open( path );
+      File names   = BLE_FS.open( path );
+      File out     = BLE_FS.open( indexPath, FILE_WRITE );
+      bool ok = page != NULL && window != NULL && fenceList != NULL && records && names && out;
+      uint32_t pageCount = 0, windowStart = 0, windowLen = 0;
+      size_t used = 1;
+      if( ok ) {
+        memset( page, 0, LOOKUP_PAGE_SIZE );
+        ok = out.write( page, LOOKUP_PAGE_SIZE ) == LOOKUP_PAGE_SIZE // header placeholder
+          && records.seek( recordsStart() );
+      }
+      for( uint32_t i=0; ok && i<header.entries; i++ ) {
+        uint8_t record[LOOKUP_MAX_RECORD];
+        if( records.read( record, header.recordSize ) != header.recordSize ) { ok = false; break; }
+        uint32_t offset = recordOffset( record );
+        uint32_t windowEnd = windowStart + windowLen;
+        bool inWindow = offset >= windowStart && offset < windowEnd && ( offset + MAX_FIELD_LEN <= windowEnd || windowEnd >= header.poolSize );
+        LookupName* known = nameCache != NULL ? &nameCache[offset % LOOKUP_INDEX_NAMES] : NULL;
+        const char* name;
+        size_t len;
+        if( !inWindow && known != NULL && known->offset == offset ) {
+          name = known->name;
+          len  = known->len;
+        } else {
+          if( !inWindow ) {
+            windowStart = windowSize >= header.poolSize ? 0 : offset;
+            names.seek( poolStart() + windowStart );
+            windowLen = names.read( window, windowSize );
+            if( offset >= windowStart + windowLen ) { ok = false; break; }
+            if( known != NULL ) {
+              known->offset = offset;
+              known->len = strnlen( (const char*)window + ( offset - windowStart ), min( (size_t)MAX_FIELD_LEN-1, (size_t)( windowStart + windowLen - offset ) ) );
+              memcpy( known->name, window + ( offset - windowStart ), known->len );
+            }
+          }
+          name = (const char*)window + ( offset - windowStart );
+          len = strnlen( name, min( (size_t)MAX_FIELD_LEN-1, (size_t)( windowLen - ( offset - windowStart ) ) ) );
+        }
+        if( i % 512 == 0 ) {
+          UI.PrintProgressBar( (Out.width * i) / header.entries );
+        }
+        size_t entryLen = keyBytes + 1 + len;
+        if( used + entryLen > LOOKUP_PAGE_SIZE ) {
+          ok = out.write( page, LOOKUP_PAGE_SIZE ) == LOOKUP_PAGE_SIZE;
+          pageCount++;
+          memset( page, 0, LOOKUP_PAGE_SIZE );
+          used = 1;
+        }
+        if( page[0] == 0 ) {
+          if( pageCount == capacity ) {
+            capacity *= 2;
+            uint32_t* grown = (uint32_t*)realloc( fenceList, capacity*sizeof(uint32_t) );
+            if( grown == NULL ) { ok = false; break; }
+            fenceList = grown;
+          }
+          fenceList[pageCount] = readLE( record, keyBytes );
+        }
+        memcpy( page + used, record, keyBytes );
+        page[used + keyBytes] = len;
+        memcpy( page + used + keyBytes + 1, name, len );
+        used += entryLen;
+        page[0]++;
+      }
+      if( ok && page[0] > 0 ) {
+        ok = out.write( page, LOOKUP_PAGE_SIZE ) == LOOKUP_PAGE_SIZE;
+        pageCount++;
+      }
+      if( ok ) {
+        ok = out.write( (uint8_t*)fenceList, pageCount*sizeof(uint32_t) ) == pageCount*sizeof(uint32_t);
+      }
+      if( ok ) {
+        LookupIndexHeader h;
+        memcpy( h.magic, LOOKUP_INDEX_MAGIC, 4 );
+        h.version       = LOOKUP_VERSION;
+        h.keyBytes      = keyBytes;
+        h.pageSize      = LOOKUP_PAGE_SIZE;
+        h.pages         = pageCount;
+        h.entries       = header.entries;
+        h.tableChecksum = header.checksum;
+        ok = out.seek( 0 ) && out.write( (uint8_t*)&h, sizeof(h) ) == sizeof(h);
+      }
+      if( records ) records.close();
+      if( names ) names.close();
+      if( out ) out.close();
+      isQuerying = false;
+      UI.PrintProgressBar( Out.width );
+      free( page );
+      free( window );
+      free( nameCache );
+      free( fenceList );
+      if( !ok ) {
+        log_e("Can't build paged index %s", indexPath);
+      }
+      return ok;
+    }
+
+    // sets the presence bits from the records, in RAM or streamed from the table file
+    void buildFilter( bool toPsram ) {
+      uint8_t bits = keyBytes*8;
+      if( !toPsram ) {
+        bits = min( bits, (uint8_t)LOOKUP_FILTER_HEAP_BITS );
+      }
+      while( filter == NULL && bits >= LOOKUP_FILTER_MIN_BITS ) {
+        size_t len = ( (size_t)1 << bits ) / 8;
+        filter = (uint8_t*)( toPsram ? ps_calloc( 1, len ) : calloc( 1, len ) );
+        if( filter == NULL ) bits -= 4;
+      }
+      if( filter == NULL ) {
+        log_w("No presence filter for %s", path);
+        return;
+      }
+      filterBits = bits;
+      uint8_t shift = keyBytes*8 - filterBits;
+      if( inPsram() ) {
+        for( uint32_t i=0; i<header.entries; i++ ) {
+          uint32_t bit = readLE( buffer + recordsStart() + i*header.recordSize, keyBytes ) >> shift;
+          filter[bit >> 3] |= 1 << ( bit & 7 );
+        }
+      } else {
+        uint8_t chunk[LOOKUP_MAX_RECORD*64];
+        size_t chunkRecords = sizeof(chunk) / header.recordSize;
+        isQuerying = true;
+        File file = BLE_FS.open( path );
+        bool ok = file && file.seek( recordsStart() );
+        for( uint32_t i=0; ok && i<header.entries; i+=chunkRecords ) {
+          size_t count = min( (size_t)( header.entries - i ), chunkRecords );
+          ok = file.read( chunk, count*header.recordSize ) == count*header.recordSize;
+          for( size_t j=0; ok && j<count; j++ ) {
+            uint32_t bit = readLE( chunk + j*header.recordSize, keyBytes ) >> shift;
+            filter[bit >> 3] |= 1 << ( bit & 7 );
+          }
+        }
+        if( file ) file.close();
+        isQuerying = false;
+        if( !ok ) {
+          log_e("Can't read the records of %s, no presence filter", path);
+          free( filter );
+          filter = NULL;
+          filterBits = 0;
+          return;
+        }
+      }
+      log_i("Presence filter for %s: %d bits keys, %d bytes", path, filterBits, ( 1 << filterBits ) / 8);
+    }
+
+    // LRU page cache in front of the index file
+    const uint8_t* loadPage( uint32_t index ) {
+      LookupPage* slot = NULL;
+      for( uint8_t i=0; i<cachedPages; i++ ) {
+        if( pageCache[i].index == (int32_t)index ) {
+          pageCache[i].lastUsed = ++pageTick;
+          pageHits++;
+          return pageCache[i].data;
+        }
+        if( slot == NULL || pageCache[i].lastUsed < slot->lastUsed ) {
+          slot = &pageCache[i];
+        }
+      }
+      static uint8_t uncached[LOOKUP_PAGE_SIZE]; // no cache: single page, lookups come from one task
+      uint8_t* dest = slot != NULL ? slot->data : uncached;
+      isQuerying = true;
+      File file = BLE_FS.open( indexPath );
+      bool ok = file && file.seek( pageOffset( index ) ) && file.read( dest, LOOKUP_PAGE_SIZE ) == LOOKUP_PAGE_SIZE;
+      if( file ) file.close();
+      isQuerying = false;
+      pageReads++;
+      if( !ok ) {
+        if( slot != NULL ) slot->index = -1;
+        return NULL;
+      }
+      if( slot != NULL ) {
+        slot->index = index;
+        slot->lastUsed = ++pageTick;
+      }
+      return dest;
+    }
+
+    // last page whose first key <= key, then a scan of its entries
+    bool findPaged( int32_t key, char* dest ) {
+      int32_t lo = 0, hi = pages - 1, index = -1;
+      while( lo <= hi ) {
+        int32_t mid = ( lo + hi ) / 2;
+        if( fences[mid] <= (uint32_t)key ) {
+          index = mid;
+          lo = mid + 1;
+        } else {
+          hi = mid - 1;
+        }
+      }
+      if( index < 0 ) return false;
+      const uint8_t* page = loadPage( index );
+      if( page == NULL ) return false;
+      size_t pos = 1;
+      for( uint8_t i=0; i<page[0] && pos + keyBytes + 1 <= LOOKUP_PAGE_SIZE; i++ ) {
+        uint32_t entryKey = readLE( page + pos, keyBytes );
+        uint8_t len = page[pos + keyBytes];
+        if( entryKey == (uint32_t)key ) {
+          memcpy( dest, page + pos + keyBytes + 1, len );
+          dest[len] = '\0';
+          return true;
+        }
+        if( entryKey > (uint32_t)key ) break;
+        pos += keyBytes + 1 + len;
+      }
+      return false;
+    }
+
+    size_t recordsStart() {
+      return sizeof(LookupHeader);
+    }
+
+    size_t poolStart() {
+      return poolStart( header );
+    }
+
+    size_t poolStart( const LookupHeader &h ) {
+      return sizeof(LookupHeader) + h.entries*h.recordSize;
+    }
+
+    // generated tables don't depend on the DB files, compiled ones must match the DB they came from
+    bool checkHeader( const LookupHeader &h, size_t fileSize, size_t sourceSize, bool anySource ) {
+      return memcmp( h.magic, LOOKUP_MAGIC, 4 ) == 0
+          && h.version    == LOOKUP_VERSION
+          && h.keyBytes   == keyBytes
+          && h.recordSize == keyBytes + LOOKUP_OFFSET_LEN
+          && ( anySource || ( h.flags & LOOKUP_GENERATED ) || h.sourceSize == sourceSize )
+          && fileSize     == poolStart( h ) + h.poolSize;
+    }
+
+    // reads and checks <filePath>, into a PSRAM buffer when <dest> is given and toPsram is set
+    bool load( const char* filePath, size_t sourceSize, bool toPsram, LookupHeader &h, uint8_t** dest, bool anySource=false ) {
+      isQuerying = true;
+      File file = BLE_FS.open( filePath );
+      if( !file ) {
+        isQuerying = false;
+        return false;
+      }
+      size_t fileSize = file.size();
+      bool ok = file.read( (uint8_t*)&h, sizeof(h) ) == sizeof(h) && checkHeader( h, fileSize, sourceSize, anySource );
+      uint8_t* data = NULL;
+      if( ok && toPsram && dest != NULL ) {
+        data = (uint8_t*)ps_malloc( fileSize );
+        if( data == NULL ) {
+          log_w("Can't allocate %d bytes of PSRAM for %s, searching on %s", (int)fileSize, filePath, BLE_FS_TYPE);
+        }
+      }
+      uint32_t crc = 0;
+      if( ok && data != NULL ) {
+        memcpy( data, &h, sizeof(h) );
+        ok = file.read( data + sizeof(h), fileSize - sizeof(h) ) == fileSize - sizeof(h);
+        crc = crc32_le( 0, data + sizeof(h), fileSize - sizeof(h) );
+      } else if( ok ) {
+        uint8_t chunk[512];
+        size_t len;
+        while( ( len = file.read( chunk, sizeof(chunk) ) ) > 0 ) {
+          crc = crc32_le( crc, chunk, len );
+        }
+      }
+      file.close();
+      isQuerying = false;
+      if( ok && crc != h.checksum ) {
+        log_e("Lookup table %s: checksum mismatch (%08x != %08x)", filePath, crc, h.checksum);
+        ok = false;
+      }
+      if( !ok ) {
+        free( data );
+        return false;
+      }
+      if( dest != NULL ) *dest = data;
+      return true;
+    }
+
+    static void writeLE( uint8_t* dest, uint32_t value, uint8_t len ) {
+      for( uint8_t i=0; i<len; i++ ) {
+        dest[i] = value >> ( i*8 );
+      }
+    }
+
+    static uint32_t readLE( const uint8_t* src, uint8_t len ) {
+      uint32_t value = 0;
+      for( uint8_t i=0; i<len; i++ ) {
+        value |= (uint32_t)src[i] << ( i*8 );
+      }
+      return value;
+    }
+
+    uint32_t recordOffset( const uint8_t* record ) {
+      return readLE( record + keyBytes, LOOKUP_OFFSET_LEN );
+    }
+
+    // binary search over the records, in PSRAM or in <file>, returns the record index or -1
+    int32_t search( int32_t key, File* file ) {
+      int32_t lo = 0, hi = header.entries - 1;
+      uint8_t record[LOOKUP_MAX_RECORD];
+      while( lo <= hi ) {
+        int32_t mid = ( lo + hi ) / 2;
+        const uint8_t* ptr;
+        if( file == NULL ) {
+          ptr = buffer + recordsStart() + mid*header.recordSize;
+        } else {
+          file->seek( recordsStart() + mid*header.recordSize );
+          if( file->read( record, header.recordSize ) != header.recordSize ) return -1;
+          ptr = record;
+        }
+        int32_t midKey = readLE( ptr, keyBytes );
+        if( midKey == key ) return mid;
+        if( midKey < key ) lo = mid + 1;
+        else hi = mid - 1;
+      }
+      return -1;
+    }
+
+};
+
+
+#define MAC_OUI_NAMES_LOOKUP_FS_PATH    "/mac-oui-light.lkp"
+#define BLE_VENDOR_NAMES_LOOKUP_FS_PATH "/ble-oui.lkp"
+
+LookupTable OUILookup( MAC_OUI_NAMES_LOOKUP_FS_PATH, 3 );
+LookupTable VendorLookup( BLE_VENDOR_NAMES_LOOKUP_FS_PATH, 2 );
+
+// table served from <path>, or NULL
+LookupTable* LookupTableFor( const char* path ) {
+  if( strcmp( path, MAC_OUI_NAMES_LOOKUP_FS_PATH ) == 0 ) return &OUILookup;
+  if( strcmp( path, BLE_VENDOR_NAMES_LOOKUP_FS_PATH ) == 0 ) return &VendorLookup;
+  return NULL;
+}
@@ -0,0 +1,115 @@
+/*
+
+  ESP32 BLE Collector - A BLE scanner with sqlite data persistence on the SD Card
+  Source: https://github.com/tobozo/ESP32-BLECollector
+
+  MIT License
+
+  Copyright (c) 2018 tobozo
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  -----------------------------------------------------------------------------
+
+  Periodic metrics export in InfluxDB line protocol over serial.
+  One line per period, all counters are cumulative since boot so the
+  collector side computes rates (e.g. Telegraf + derivative()), a reboot
+  shows up as a counter reset. Lines start with the measurement name and
+  can be told apart from the logs with a simple prefix match.
+
+*/
+
+#define METRICS_MEASUREMENT "blecollector"
+
+static uint32_t advertisementsCount = 0; // every advertisement received, monotonic
+static uint32_t droppedDevicesCount = 0; // advertisements not stored because the scan cache was full
+
+
+class MetricsUtils {
+  public:
+
+    uint16_t period = 0; // seconds, 0 = disabled (persistent)
+    LatencyHistogram dbInsert;
+
+    MetricsUtils() {
+      dbInsert.name   = "db insert";
+      dbInsert.cycles = true;
+    }
+
+    // scan duty cycle bookkeeping, called by the scan task around the scan window
+    void scanStarted() {
+      scanStart = micros();
+    }
+    void scanEnded() {
+      scanTotal += micros() - scanStart;
+      scanStart = 0;
+    }
+
+    // called from the serial task loop
+    void loop() {
+      if( period == 0 ) return;
+      if( millis() - lastEmit < period * 1000 ) return;
+      emit();
+    }
+
+    void emit() {
+      unsigned long now = millis();
+      uint64_t busy = scanTotal;
+      if( scanStart != 0 ) busy += micros() - scanStart; // scan in progress
+      float duty = 0;
+      if( now > lastEmit ) {
+        duty = float( busy - lastBusy ) / ( ( now - lastEmit ) * 1000.0 );
+        if( duty > 1.0 ) duty = 1.0;
+      }
+      lastBusy = busy;
+      lastEmit = now;
+
+      char timestamp[24] = {0};
+      if( TimeIsSet ) {
+        // nowDateTime is local time, InfluxDB expects UTC (ns precision)
+        unsigned long utc = nowDateTime.unixtime() - (int(timeZone*100)*36) - (summerTime ? 3600 : 0);
+        snprintf( timestamp, sizeof(timestamp), " %lu000000000", utc );
+      }
+      Serial.printf( METRICS_MEASUREMENT ",host=%012llx "
+        "adv=%ui,processed=%ui,dropped=%ui,scans=%ii,entries=%ui,"
+        "bledev_hits=%ii,oui_hits=%ii,vendor_hits=%ii,anon_hits=%ii,oui_filtered=%ui,vendor_filtered=%ui,"
+        "rotating_addrs=%ui,entities=%ui,"
+        "insert_count=%ui,insert_avg_us=%llui,insert_p99_us=%llui,"
+        "heap=%ui,psram=%ui,duty=%.3f%s\n",
+        ESP.getEfuseMac(),
+        advertisementsCount, processedDevicesTotal, droppedDevicesCount, scan_rounds, entries,
+        BLEDevCacheHit, OuiCacheHit, VendorCacheHit, AnonymousCacheHit, OUILookup.filterRejects, VendorLookup.filterRejects,
+        RotatingCache.inserts, PseudoDevices.used(),
+        dbInsert.count, dbInsert.toUs( dbInsert.avg() ), dbInsert.toUs( dbInsert.percentile( 99 ) ),
+        (unsigned int)freeheap, (unsigned int)freepsheap, duty,
+        timestamp
+      );
+    }
+
+  private:
+
+    unsigned long lastEmit = 0;
+    volatile unsigned long scanStart = 0; // 0 = no scan running
+    uint64_t scanTotal = 0; // µs spent scanning
+    uint64_t lastBusy  = 0;
+
+};
+
+
+MetricsUtils Metrics;
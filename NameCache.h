@@ -0,0 +1,186 @@
+/*
+
+  ESP32 BLE Collector - A BLE scanner with sqlite data persistence on the SD Card
+  Source: https://github.com/tobozo/ESP32-BLECollector
+
+  MIT License
+
+  Copyright (c) 2018 tobozo
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  -----------------------------------------------------------------------------
+
+  Small hashed caches in front of the OUI and vendor lookups.
+
+  Slots are chained from a power of two bucket array and evicted with CLOCK:
+  a hit sets the slot's reference bit, the hand clears reference bits until it
+  finds a slot that wasn't used since its last pass. Popular prefixes (Apple,
+  Samsung...) survive bursts of one-off ones, unlike the round-robin buffers
+  this replaces. Misses are cached too ("[private]", "[unknown]"), so random
+  prefixes don't go back to the lookup table on every advertisement.
+
+*/
+
+enum NameCacheResult {
+  NAMECACHE_MISS,
+  NAMECACHE_HIT,
+  NAMECACHE_NEGATIVE // known to have no name
+};
+
+struct NameCacheSlot {
+  int32_t key = -1; // -1 = free
+  int16_t next = -1; // bucket chain
+  bool    referenced = false;
+  bool    negative = false;
+  char    name[MAX_FIELD_LEN+1];
+};
+
+
+class NameCache {
+  public:
+
+    uint32_t hits = 0; // includes negative hits
+    uint32_t negativeHits = 0;
+    uint32_t misses = 0;
+    uint32_t evictions = 0;
+
+    bool init( uint16_t _capacity ) {
+      capacity = _capacity;
+      bucketMask = 1;
+      while( bucketMask < capacity*2 ) bucketMask <<= 1;
+      bucketMask--;
+      slots   = (NameCacheSlot*)calloc( capacity, sizeof( NameCacheSlot ) );
+      buckets = (int16_t*)malloc( ( bucketMask + 1 ) * sizeof( int16_t ) );
+      if( slots == NULL || buckets == NULL ) {
+        log_e("Can't allocate a %d slots name cache", capacity);
+        capacity = 0;
+        return false;
+      }
+      clear();
+      return true;
+    }
+
+    void clear() {
+      for( uint16_t i=0; i<capacity; i++ ) {
+        slots[i].key = -1;
+        slots[i].next = -1;
+        slots[i].referenced = false;
+      }
+      for( uint16_t i=0; i<=bucketMask; i++ ) {
+        buckets[i] = -1;
+      }
+      used = 0;
+      hand = 0;
+    }
+
+    // copies the cached name into dest (at least MAX_FIELD_LEN+1 long) on NAMECACHE_HIT
+    NameCacheResult get( int32_t key, char* dest ) {
+      int16_t index = capacity > 0 ? find( key ) : -1;
+      if( index < 0 ) {
+        misses++;
+        return NAMECACHE_MISS;
+      }
+      slots[index].referenced = true;
+      hits++;
+      if( slots[index].negative ) {
+        negativeHits++;
+        return NAMECACHE_NEGATIVE;
+      }
+      strcpy( dest, slots[index].name );
+      return NAMECACHE_HIT;
+    }
+
+    // name = NULL caches a miss
+    void put( int32_t key, const char* name ) {
+      if( capacity == 0 || key < 0 || find( key ) >= 0 ) return;
+      int16_t index = used < capacity ? used++ : evict();
+      NameCacheSlot &slot = slots[index];
+      slot.key = key;
+      slot.negative = name == NULL;
+      slot.referenced = false; // has to earn its second chance
+      *slot.name = '\0';
+      if( name != NULL ) {
+        copy( slot.name, name, MAX_FIELD_LEN );
+      }
+      uint16_t bucket = hash( key );
+      slot.next = buckets[bucket];
+      buckets[bucket] = index;
+    }
+
+    uint16_t size() {
+      return capacity;
+    }
+
+    // hit rate (%) over the lookups since the previous call, or the previous rate when idle
+    uint16_t hitRate() {
+      uint32_t lookups = hits + misses - lastLookups;
+      if( lookups > 0 ) {
+        lastRate = ( hits - lastHits ) * 100 / lookups;
+      }
+      lastHits = hits;
+      lastLookups = hits + misses;
+      return lastRate;
+    }
+
+  private:
+
+    NameCacheSlot* slots = NULL;
+    int16_t*  buckets = NULL;
+    uint16_t  capacity = 0;
+    uint16_t  bucketMask = 0;
+    uint16_t  used = 0;
+    uint16_t  hand = 0;
+    uint32_t  lastHits = 0;
+    uint32_t  lastLookups = 0;
+    uint16_t  lastRate = 0;
+
+    uint16_t hash( int32_t key ) {
+      return ( (uint32_t)key * 2654435761u ) >> 16 & bucketMask;
+    }
+
+    int16_t find( int32_t key ) {
+      for( int16_t index = buckets[hash( key )]; index >= 0; index = slots[index].next ) {
+        if( slots[index].key == key ) return index;
+      }
+      return -1;
+    }
+
+    // CLOCK: second chance for referenced slots, unlinks and returns the victim
+    int16_t evict() {
+      while( slots[hand].referenced ) {
+        slots[hand].referenced = false;
+        hand = ( hand + 1 ) % capacity;
+      }
+      int16_t victim = hand;
+      hand = ( hand + 1 ) % capacity;
+      int16_t* link = &buckets[hash( slots[victim].key )];
+      while( *link != victim ) {
+        link = &slots[*link].next;
+      }
+      *link = slots[victim].next;
+      evictions++;
+      return victim;
+    }
+
+};
+
+
+NameCache OuiNameCache;
+NameCache VendorNameCache;
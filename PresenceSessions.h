@@ -0,0 +1,213 @@
+/*
+
+  ESP32 BLE Collector - A BLE scanner with sqlite data persistence on the SD Card
+  Source: https://github.com/tobozo/ESP32-BLECollector
+
+  MIT License
+
+  Copyright (c) 2018 tobozo
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  -----------------------------------------------------------------------------
+
+
+  Presence sessions: when a device entered and left the scanner's range.
+
+  created_at/updated_at only tell the first and last time a device was
+  seen, a session starts with the first hit and ends when the device wasn't
+  seen for <timeout> seconds (see the "sessions" serial command). Devices
+  with a rotating address are tracked per entity (see PseudoDevices.h).
+
+  Open sessions live in a fixed size table probed over a bounded window, so
+  a hit costs the same whatever the number of devices around: the window is
+  scanned for the device, a free slot, or the least recently seen session
+  which is then closed early. Every hit also advances a sweep cursor over a
+  few slots to close the timed out sessions. Closed sessions are queued and
+  written to the sessions table in batches by DB.flushSessions(), when the
+  queue is full (DB busy or missing) the oldest closed session is dropped.
+
+*/
+
+#define SESSIONS_PROBES 8 // slots visited per hit
+#define SESSIONS_SWEEP_STEP 4 // slots checked for timeouts per hit
+
+struct PresenceSession {
+  uint64_t key     = 0; // mac address + 1, or entity id | 1<<48, 0 = free
+  uint32_t enterAt = 0; // unix time
+  uint32_t lastAt  = 0; // unix time
+  uint32_t entity  = 0;
+  uint16_t hits    = 0;
+  int8_t   rssiMax = -128;
+  char     address[MAC_LEN+1]; // last address
+};
+
+
+class PresenceSessionTracker {
+  public:
+
+    uint16_t timeout = SESSIONS_ABSENCE_TIMEOUT; // seconds (persistent)
+    uint32_t opened = 0;
+    uint32_t closed = 0;
+    uint32_t evicted = 0; // closed early to make room
+    uint32_t dropped = 0; // lost before reaching the DB
+
+    bool init( uint16_t _capacity, bool hasPsram ) {
+      mask = 1;
+      while( mask < _capacity ) mask <<= 1;
+      slots = (PresenceSession*)( hasPsram ? ps_calloc( mask, sizeof( PresenceSession ) ) : calloc( mask, sizeof( PresenceSession ) ) );
+      queue = (PresenceSession*)( hasPsram ? ps_calloc( SESSIONS_QUEUE_SIZE, sizeof( PresenceSession ) ) : calloc( SESSIONS_QUEUE_SIZE, sizeof( PresenceSession ) ) );
+      if( slots == NULL || queue == NULL ) {
+        log_e("Can't allocate a %d slots session tracker", mask);
+        free( slots );
+        free( queue );
+        slots = NULL;
+        queue = NULL;
+        mask = 0;
+        return false;
+      }
+      mask--;
+      return true;
+    }
+
+    // records a hit at <now> (unix time), opens a session when none is running
+    void hit( BlueToothDevice *CacheItem, int rssi, uint32_t now ) {
+      if( slots == NULL ) return;
+      sweep( now, SESSIONS_SWEEP_STEP );
+      uint64_t key = keyOf( CacheItem );
+      if( key == 0 ) return;
+      uint32_t start = (uint32_t)( key ^ ( key >> 29 ) ) * 2654435761u;
+      start = ( start >> 16 ) & mask;
+      PresenceSession *freeSlot = NULL;
+      PresenceSession *oldest = NULL;
+      for( uint16_t probe=0; probe<SESSIONS_PROBES && probe<=mask; probe++ ) {
+        PresenceSession *slot = &slots[( start + probe ) & mask];
+        if( slot->key == key ) {
+          if( now - slot->lastAt > timeout ) {
+            close( slot ); // timed out before the sweep got there
+            freeSlot = slot;
+            break;
+          }
+          update( slot, CacheItem, rssi, now );
+          return;
+        }
+        if( slot->key == 0 ) {
+          if( freeSlot == NULL ) freeSlot = slot;
+        } else if( oldest == NULL || slot->lastAt < oldest->lastAt ) {
+          oldest = slot;
+        }
+      }
+      if( freeSlot == NULL ) {
+        close( oldest );
+        evicted++;
+        freeSlot = oldest;
+      }
+      freeSlot->key     = key;
+      freeSlot->enterAt = now;
+      freeSlot->hits    = 0;
+      freeSlot->rssiMax = -128;
+      update( freeSlot, CacheItem, rssi, now );
+      opened++;
+    }
+
+    // closes the sessions timed out at <now> in the next <count> slots
+    void sweep( uint32_t now, uint16_t count ) {
+      if( slots == NULL ) return;
+      for( uint16_t i=0; i<count && i<=mask; i++ ) {
+        PresenceSession *slot = &slots[sweepCursor];
+        if( slot->key != 0 && now - slot->lastAt > timeout ) {
+          close( slot );
+        }
+        sweepCursor = ( sweepCursor + 1 ) & mask;
+      }
+    }
+
+    // closed sessions waiting for the DB
+    uint16_t pending() {
+      return queued;
+    }
+
+    // <index>th oldest closed session, NULL past the end of the queue
+    PresenceSession* peek( uint16_t index = 0 ) {
+      return index < queued ? &queue[( queueHead + index ) % SESSIONS_QUEUE_SIZE] : NULL;
+    }
+
+    void pop() {
+      if( queued == 0 ) return;
+      queueHead = ( queueHead + 1 ) % SESSIONS_QUEUE_SIZE;
+      queued--;
+    }
+
+    uint16_t openCount() {
+      uint16_t count = 0;
+      for( uint16_t i=0; slots && i<=mask; i++ ) {
+        if( slots[i].key != 0 ) count++;
+      }
+      return count;
+    }
+
+  private:
+
+    PresenceSession* slots = NULL;
+    PresenceSession* queue = NULL; // ring of closed sessions
+    uint16_t mask = 0;
+    uint16_t sweepCursor = 0;
+    uint16_t queueHead = 0;
+    uint16_t queued = 0;
+
+    static uint64_t keyOf( BlueToothDevice *CacheItem ) {
+      if( CacheItem->entity != 0 ) {
+        return ( 1ULL << 48 ) | CacheItem->entity;
+      }
+      uint64_t mac = 0;
+      uint8_t digits = 0;
+      for( const char* c = CacheItem->address; *c != '\0'; c++ ) {
+        if( *c == ':' ) continue;
+        if( !isxdigit( *c ) ) return 0;
+        mac = ( mac << 4 ) | ( isdigit( *c ) ? *c - '0' : ( *c | 0x20 ) - 'a' + 10 );
+        digits++;
+      }
+      return digits == 12 ? mac + 1 : 0;
+    }
+
+    void update( PresenceSession *slot, BlueToothDevice *CacheItem, int rssi, uint32_t now ) {
+      slot->lastAt = now;
+      slot->entity = CacheItem->entity;
+      slot->hits++;
+      if( rssi > slot->rssiMax ) {
+        slot->rssiMax = rssi;
+      }
+      copy( slot->address, CacheItem->address, MAC_LEN );
+    }
+
+    void close( PresenceSession *slot ) {
+      if( queued == SESSIONS_QUEUE_SIZE ) { // DB is late, lose the oldest
+        pop();
+        dropped++;
+      }
+      queue[( queueHead + queued ) % SESSIONS_QUEUE_SIZE] = *slot;
+      queued++;
+      closed++;
+      slot->key = 0;
+    }
+
+};
+
+
+PresenceSessionTracker PresenceSessions;
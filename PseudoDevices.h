@@ -0,0 +1,183 @@
+/*
+
+  ESP32 BLE Collector - A BLE scanner with sqlite data persistence on the SD Card
+  Source: https://github.com/tobozo/ESP32-BLECollector
+
+  MIT License
+
+  Copyright (c) 2018 tobozo
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  -----------------------------------------------------------------------------
+
+
+  Links rotating random addresses to pseudo-devices (entities).
+
+  A phone advertising with a resolvable private address shows up as a new
+  device every ~15mn, but most of what it advertises doesn't change across
+  rotations: BLEDevHelper.fingerprint() hashes that part into a 64 bits
+  signature. This table maps signatures to entity ids, so devices are counted
+  per entity instead of per address.
+
+  A signature is often shared by devices advertising at the same time (two
+  identical earbuds, all the iPhones around), but a device only holds one
+  address at a time: a new address takes over an entity with its signature
+  only when the current address of that entity wasn't seen during this scan,
+  else it gets an entity of its own. Several entities can share a signature.
+
+  Open addressing in PSRAM (heap when missing), entries expire after
+  PSEUDODEVICES_TTL seconds without an advertisement, a full probe window
+  recycles its least recently seen entry. A device rotating its address in
+  the middle of a scan gets a new entity, which errs on the high side.
+
+*/
+
+#define PSEUDODEVICES_PROBES 16 // max slots visited per lookup
+
+struct PseudoDevice {
+  uint64_t signature = 0; // 0 = free
+  uint32_t id        = 0;
+  uint32_t lastSeen  = 0; // millis()
+  uint32_t hits      = 0; // advertisements
+  uint32_t address   = 0; // hash of the current address
+  uint32_t lastScan  = 0; // scan_rounds when the current address was last seen
+  uint16_t addresses = 0; // distinct addresses linked to this entity
+};
+
+
+class PseudoDeviceTable {
+  public:
+
+    uint32_t entities = 0; // created since boot
+    uint32_t linked = 0; // new addresses attached to an existing entity
+    uint32_t evictions = 0;
+
+    bool init( uint16_t _capacity, bool hasPsram ) {
+      mask = 1;
+      while( mask < _capacity ) mask <<= 1;
+      slots = (PseudoDevice*)( hasPsram ? ps_calloc( mask, sizeof( PseudoDevice ) ) : calloc( mask, sizeof( PseudoDevice ) ) );
+      if( slots == NULL ) {
+        log_e("Can't allocate a %d slots pseudo-device table", mask);
+        mask = 0;
+        return false;
+      }
+      mask--;
+      return true;
+    }
+
+    // entity id for an advertisement from <address>, 0 when the signature is empty, <entity> is the id
+    // already given to that address (0 when not seen before): a new address takes over the most recently
+    // seen entity with the same signature whose current address went quiet during this scan, else it
+    // gets a new entity
+    uint32_t link( uint64_t signature, const char* address, uint32_t entity ) {
+      if( slots == NULL || signature == 0 ) return 0;
+      uint32_t now = millis();
+      uint32_t addressHash = hashOf( address );
+      uint32_t start = (uint32_t)( signature ^ ( signature >> 32 ) ) & mask;
+      int16_t freeSlot = -1;
+      int16_t oldestSlot = -1;
+      int16_t handoverSlot = -1;
+      uint32_t oldestAge = 0;
+      for( uint16_t probe=0; probe<PSEUDODEVICES_PROBES && probe<=mask; probe++ ) {
+        uint16_t i = ( start + probe ) & mask;
+        PseudoDevice *slot = &slots[i];
+        if( slot->signature == 0 ) {
+          if( freeSlot == -1 ) freeSlot = i;
+          break; // end of the probe chain
+        }
+        bool expired = now - slot->lastSeen > PSEUDODEVICES_TTL*1000;
+        if( slot->signature == signature && !expired ) {
+          if( entity != 0 ? slot->id == entity : slot->address == addressHash ) {
+            slot->lastSeen = now;
+            slot->hits++;
+            if( slot->address == addressHash ) {
+              slot->lastScan = scan_rounds;
+            }
+            return slot->id;
+          }
+          if( entity == 0 && slot->lastScan != (uint32_t)scan_rounds && ( handoverSlot == -1 || slot->lastSeen > slots[handoverSlot].lastSeen ) ) {
+            handoverSlot = i;
+          }
+        }
+        if( expired && freeSlot == -1 ) {
+          freeSlot = i; // reusable, but keep probing for a live match
+        }
+        if( now - slot->lastSeen >= oldestAge ) {
+          oldestAge = now - slot->lastSeen;
+          oldestSlot = i;
+        }
+      }
+      if( handoverSlot != -1 ) {
+        PseudoDevice *slot = &slots[handoverSlot];
+        slot->lastSeen = now;
+        slot->hits++;
+        slot->address  = addressHash;
+        slot->lastScan = scan_rounds;
+        slot->addresses++;
+        linked++;
+        return slot->id;
+      }
+      if( freeSlot == -1 ) {
+        freeSlot = oldestSlot;
+        evictions++;
+      }
+      PseudoDevice *slot = &slots[freeSlot];
+      slot->signature = signature;
+      slot->id        = ++lastId;
+      slot->lastSeen  = now;
+      slot->hits      = 1;
+      slot->address   = addressHash;
+      slot->lastScan  = scan_rounds;
+      slot->addresses = 1;
+      entities++;
+      return slot->id;
+    }
+
+    uint16_t size() {
+      return slots ? mask + 1 : 0;
+    }
+
+    uint16_t used() {
+      uint16_t count = 0;
+      uint32_t now = millis();
+      for( uint16_t i=0; slots && i<=mask; i++ ) {
+        if( slots[i].signature != 0 && now - slots[i].lastSeen <= PSEUDODEVICES_TTL*1000 ) count++;
+      }
+      return count;
+    }
+
+  private:
+
+    static uint32_t hashOf( const char* address ) {
+      uint32_t hash = 0x811c9dc5;
+      for( const char* c = address; *c != '\0'; c++ ) {
+        hash = ( hash ^ (uint8_t)*c ) * 0x01000193;
+      }
+      return hash;
+    }
+
+    PseudoDevice* slots = NULL;
+    uint16_t mask = 0;
+    uint32_t lastId = 0;
+
+};
+
+
+PseudoDeviceTable PseudoDevices;
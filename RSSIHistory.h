@@ -0,0 +1,158 @@
+/*
+
+  ESP32 BLE Collector - A BLE scanner with sqlite data persistence on the SD Card
+  Source: https://github.com/tobozo/ESP32-BLECollector
+
+  MIT License
+
+  Copyright (c) 2018 tobozo
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  -----------------------------------------------------------------------------
+
+
+  Per-device RSSI history, one fixed size ring per BLEDevRAMCache slot.
+
+  BlueToothDevice::rssi only holds the last value, this keeps the last
+  RSSI_HISTORY_SAMPLES ones so proximity/dwell time can be computed without
+  a DB row per sample. Each sample is 3 bytes: the time offset from the ring
+  base (created_at, or the uptime of the first sample when the time isn't
+  set) in RSSI_HISTORY_RESOLUTION seconds units, and the RSSI delta from the
+  previous sample. The oldest sample's delta is folded into the base RSSI
+  when the ring wraps.
+
+  Serialized (rssi_history BLOB column, see DB.persistRSSIHistory()):
+    version, base (uint32 LE), resolution, base rssi, count,
+    then count * { offset (uint16 LE), rssi delta (int8) }, oldest first
+
+  PSRAM only, the calls are no-ops when init() wasn't called.
+
+*/
+
+#define RSSI_HISTORY_VERSION 1
+#define RSSI_HISTORY_BLOB_HEADER 8
+#define RSSI_HISTORY_BLOB_MAX ( RSSI_HISTORY_BLOB_HEADER + RSSI_HISTORY_SAMPLES*3 )
+
+struct __attribute__((packed)) RSSISample {
+  uint16_t offset; // since base, in RSSI_HISTORY_RESOLUTION units
+  int8_t   delta;  // from the previous sample
+};
+
+struct RSSIRing {
+  uint32_t base; // seconds, unix time or uptime
+  int8_t   first; // rssi of the oldest sample
+  int8_t   last; // rssi of the newest sample
+  uint8_t  head; // oldest sample
+  uint8_t  count;
+  RSSISample samples[RSSI_HISTORY_SAMPLES];
+};
+
+
+class RSSIHistoryStore {
+  public:
+
+    bool init( uint16_t _capacity ) {
+      capacity = _capacity;
+      rings = (RSSIRing*)ps_calloc( capacity, sizeof( RSSIRing ) );
+      if( rings == NULL ) {
+        log_e("Can't allocate %d RSSI rings", capacity);
+        capacity = 0;
+        return false;
+      }
+      return true;
+    }
+
+    // slot was given to another device
+    void reset( uint16_t slot, uint32_t base ) {
+      if( slot >= capacity ) return;
+      rings[slot].base  = base;
+      rings[slot].head  = 0;
+      rings[slot].count = 0;
+    }
+
+    void add( uint16_t slot, uint32_t now, int8_t rssi ) {
+      if( slot >= capacity ) return;
+      RSSIRing *ring = &rings[slot];
+      if( now < ring->base || ( now - ring->base ) / RSSI_HISTORY_RESOLUTION > 0xffff ) {
+        reset( slot, now ); // out of range, e.g. the clock was set after the first sample
+      }
+      uint16_t offset = ( now - ring->base ) / RSSI_HISTORY_RESOLUTION;
+      if( ring->count == 0 ) {
+        ring->first = rssi;
+        ring->last  = rssi;
+        ring->samples[ring->head] = { offset, 0 };
+        ring->count = 1;
+        return;
+      }
+      int16_t delta = constrain( (int16_t)rssi - ring->last, -127, 127 );
+      ring->last += delta; // the decoded value, even when clamped
+      if( ring->count == RSSI_HISTORY_SAMPLES ) { // drop the oldest sample
+        ring->head = ( ring->head + 1 ) % RSSI_HISTORY_SAMPLES;
+        ring->first += ring->samples[ring->head].delta;
+        ring->count--;
+      }
+      ring->samples[( ring->head + ring->count ) % RSSI_HISTORY_SAMPLES] = { offset, (int8_t)delta };
+      ring->count++;
+    }
+
+    uint8_t count( uint16_t slot ) {
+      return slot < capacity ? rings[slot].count : 0;
+    }
+
+    // decodes the <index>th oldest sample
+    bool get( uint16_t slot, uint8_t index, uint32_t &time, int8_t &rssi ) {
+      if( index >= count( slot ) ) return false;
+      RSSIRing *ring = &rings[slot];
+      rssi = ring->first;
+      for( uint8_t i=1; i<=index; i++ ) {
+        rssi += ring->samples[( ring->head + i ) % RSSI_HISTORY_SAMPLES].delta;
+      }
+      time = ring->base + ring->samples[( ring->head + index ) % RSSI_HISTORY_SAMPLES].offset * RSSI_HISTORY_RESOLUTION;
+      return true;
+    }
+
+    // blob for the DB, returns the used length or 0 when there's nothing to save
+    size_t serialize( uint16_t slot, uint8_t *out ) {
+      if( count( slot ) == 0 ) return 0;
+      RSSIRing *ring = &rings[slot];
+      out[0] = RSSI_HISTORY_VERSION;
+      for( uint8_t i=0; i<4; i++ ) out[1+i] = ring->base >> ( 8*i );
+      out[5] = RSSI_HISTORY_RESOLUTION;
+      out[6] = (uint8_t)ring->first;
+      out[7] = ring->count;
+      size_t len = RSSI_HISTORY_BLOB_HEADER;
+      for( uint8_t i=0; i<ring->count; i++ ) {
+        RSSISample *sample = &ring->samples[( ring->head + i ) % RSSI_HISTORY_SAMPLES];
+        out[len++] = sample->offset & 0xff;
+        out[len++] = sample->offset >> 8;
+        out[len++] = (uint8_t)( i == 0 ? 0 : sample->delta );
+      }
+      return len;
+    }
+
+  private:
+
+    RSSIRing* rings = NULL;
+    uint16_t capacity = 0;
+
+};
+
+
+RSSIHistoryStore RSSIHistory;
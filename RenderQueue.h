@@ -0,0 +1,186 @@
+/*
+
+  ESP32 BLE Collector - A BLE scanner with sqlite data persistence on the SD Card
+  Source: https://github.com/tobozo/ESP32-BLECollector
+
+  MIT License
+
+  Copyright (c) 2018 tobozo
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  -----------------------------------------------------------------------------
+
+  Single producer (scan task) / single consumer (UI task) ring of render events.
+  The scan task never touches the display, it only pushes events and moves on,
+  the UI task drains them at UI_FPS and coalesces header/counter updates.
+  Headers are latest-value state: when the ring is full the newest message
+  goes to a single pending slot instead of being dropped.
+
+*/
+
+#include <atomic>
+
+#define RENDERQUEUE_SIZE 8 // must be a power of two
+#define RENDERQUEUE_MAX_WAIT 100 // ms, how long the scan task may wait for a free slot before dropping a card
+#define RENDERQUEUE_TEXT_LEN 24
+
+enum RenderEventType {
+  RENDER_EVENT_CARD,     // print a BLE card
+  RENDER_EVENT_HEADER,   // header status message
+  RENDER_EVENT_COUNTERS  // cache and footer stats
+};
+
+
+struct RenderEvent {
+  RenderEventType type;
+  uint16_t cacheIndex = 0;
+  BlueToothDevice *device = NULL; // own copy, the scan cache slot is reset before the card is drawn
+  char text[RENDERQUEUE_TEXT_LEN] = {0};
+};
+
+
+class RenderQueueUtils {
+  public:
+
+    // stats
+    uint32_t pushed    = 0;
+    uint32_t dropped   = 0;
+    uint32_t coalesced = 0;
+
+    void init() {
+      if( initDone ) return;
+      for( uint8_t i=0; i<RENDERQUEUE_SIZE; i++ ) {
+        events[i].device = (BlueToothDevice*)calloc(1, sizeof( BlueToothDevice ) );
+        BLEDevHelper.init( events[i].device, false ); // false = keep it out of SPI ram, it's read while pushing pixels
+      }
+      initDone = true;
+    }
+
+    // producer side (scan task)
+
+    bool pushCard( BlueToothDeviceLink BleLink ) {
+      unsigned long waitstart = millis();
+      while( isFull() ) {
+        // the card is the only event worth waiting for
+        if( millis() - waitstart > RENDERQUEUE_MAX_WAIT ) {
+          dropped++;
+          log_w("Render queue full, dropping card %s", BleLink.device->address);
+          return false;
+        }
+        vTaskDelay(1);
+      }
+      RenderEvent *evt = &events[ head.load( std::memory_order_relaxed ) & (RENDERQUEUE_SIZE-1) ];
+      evt->type = RENDER_EVENT_CARD;
+      evt->cacheIndex = BleLink.cacheIndex;
+      BLEDevHelper.reset( evt->device );
+      BLEDevHelper.copyItem( BleLink.device, evt->device );
+      commit();
+      return true;
+    }
+
+    bool pushHeader( const char* text ) {
+      if( isFull() ) {
+        // keep the newest message, it replaces any pending one
+        portENTER_CRITICAL( &headerMux );
+        if( headerPending ) coalesced++;
+        snprintf( pendingHeader, RENDERQUEUE_TEXT_LEN, "%s", text );
+        headerPending = true;
+        portEXIT_CRITICAL( &headerMux );
+        return false;
+      }
+      portENTER_CRITICAL( &headerMux );
+      if( headerPending ) coalesced++;
+      headerPending = false; // older than this one
+      portEXIT_CRITICAL( &headerMux );
+      RenderEvent *evt = &events[ head.load( std::memory_order_relaxed ) & (RENDERQUEUE_SIZE-1) ];
+      evt->type = RENDER_EVENT_HEADER;
+      snprintf( evt->text, RENDERQUEUE_TEXT_LEN, "%s", text );
+      commit();
+      return true;
+    }
+
+    bool pushCounters() {
+      if( isFull() ) {
+        countersPending = true; // picked up on next drain
+        coalesced++;
+        return false;
+      }
+      RenderEvent *evt = &events[ head.load( std::memory_order_relaxed ) & (RENDERQUEUE_SIZE-1) ];
+      evt->type = RENDER_EVENT_COUNTERS;
+      commit();
+      return true;
+    }
+
+    // consumer side (UI task): peek() then release() once the event is rendered
+
+    RenderEvent* peek() {
+      uint16_t _tail = tail.load( std::memory_order_relaxed );
+      if( _tail == head.load( std::memory_order_acquire ) ) return NULL;
+      return &events[ _tail & (RENDERQUEUE_SIZE-1) ];
+    }
+
+    void release() {
+      tail.store( tail.load( std::memory_order_relaxed ) + 1, std::memory_order_release );
+    }
+
+    uint16_t size() {
+      return head.load( std::memory_order_acquire ) - tail.load( std::memory_order_acquire );
+    }
+
+    bool takeCountersPending() {
+      return countersPending.exchange( false );
+    }
+
+    // header pushed while the ring was full, newer than anything in the ring, to apply after draining
+    bool takeHeaderPending( char* dest ) {
+      portENTER_CRITICAL( &headerMux );
+      bool pending = headerPending;
+      if( pending ) {
+        memcpy( dest, pendingHeader, RENDERQUEUE_TEXT_LEN );
+        headerPending = false;
+      }
+      portEXIT_CRITICAL( &headerMux );
+      return pending;
+    }
+
+  private:
+
+    RenderEvent events[RENDERQUEUE_SIZE];
+    std::atomic<uint16_t> head{0}; // only written by the producer
+    std::atomic<uint16_t> tail{0}; // only written by the consumer
+    std::atomic<bool> countersPending{false};
+    portMUX_TYPE headerMux = portMUX_INITIALIZER_UNLOCKED;
+    bool headerPending = false; // guarded by headerMux
+    char pendingHeader[RENDERQUEUE_TEXT_LEN] = {0};
+    bool initDone = false;
+
+    bool isFull() {
+      return uint16_t( head.load( std::memory_order_relaxed ) - tail.load( std::memory_order_acquire ) ) >= RENDERQUEUE_SIZE;
+    }
+
+    void commit() {
+      head.store( head.load( std::memory_order_relaxed ) + 1, std::memory_order_release );
+      pushed++;
+    }
+
+};
+
+
+RenderQueueUtils RenderQueue;
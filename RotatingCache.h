@@ -0,0 +1,140 @@
+/*
+
+  ESP32 BLE Collector - A BLE scanner with sqlite data persistence on the SD Card
+  Source: https://github.com/tobozo/ESP32-BLECollector
+
+  MIT License
+
+  Copyright (c) 2018 tobozo
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  -----------------------------------------------------------------------------
+
+
+  Short-lived cache for devices advertising with a rotating address
+  (resolvable or non-resolvable private, see BLEDevHelper.classify()).
+
+  Those addresses change every ~15mn so they never come back as the same
+  device: keeping them in BLEDevRAMCache would evict real returning devices,
+  and looking them up in the DB is a guaranteed miss. They stay here instead,
+  for the lifetime of the address, and never reach the DB.
+
+  Entries expire after ROTATINGCACHE_TTL seconds without an advertisement,
+  a full cache recycles the least recently seen entry.
+
+*/
+
+
+class RotatingDevCache {
+  public:
+
+    uint32_t hits = 0;
+    uint32_t inserts = 0;
+    uint32_t expirations = 0;
+
+    bool init( uint16_t _capacity, bool hasPsram ) {
+      capacity = _capacity;
+      items    = (BlueToothDevice*)( hasPsram ? ps_calloc( capacity, sizeof( BlueToothDevice ) ) : calloc( capacity, sizeof( BlueToothDevice ) ) );
+      lastSeen = (uint32_t*)calloc( capacity, sizeof( uint32_t ) );
+      if( items == NULL || lastSeen == NULL ) {
+        log_e("Can't allocate a %d slots rotating address cache", capacity);
+        capacity = 0;
+        return false;
+      }
+      for( uint16_t i=0; i<capacity; i++ ) {
+        BLEDevHelper.init( &items[i], hasPsram );
+      }
+      return true;
+    }
+
+    // index of a live entry for <address>, or -1
+    int find( const char* address ) {
+      for( uint16_t i=0; i<capacity; i++ ) {
+        if( isEmpty( items[i].address ) ) continue;
+        if( expired( i ) ) {
+          BLEDevHelper.reset( &items[i] );
+          expirations++;
+          continue;
+        }
+        if( strcmp( address, items[i].address ) == 0 ) {
+          hits++;
+          return i;
+        }
+      }
+      return -1;
+    }
+
+    // refreshes the entry after an advertisement
+    BlueToothDevice* touch( int index ) {
+      lastSeen[index] = millis();
+      return &items[index];
+    }
+
+    // stores a copy of <CacheItem> in a free, expired or least recently seen slot
+    BlueToothDevice* put( BlueToothDevice *CacheItem ) {
+      if( capacity == 0 ) return NULL;
+      uint16_t slot = 0;
+      uint32_t oldest = 0;
+      for( uint16_t i=0; i<capacity; i++ ) {
+        if( isEmpty( items[i].address ) ) {
+          slot = i;
+          break;
+        }
+        uint32_t age = millis() - lastSeen[i];
+        if( age >= oldest ) {
+          oldest = age;
+          slot = i;
+        }
+      }
+      if( !isEmpty( items[slot].address ) && expired( slot ) ) {
+        expirations++;
+      }
+      BLEDevHelper.reset( &items[slot] );
+      BLEDevHelper.copyItem( CacheItem, &items[slot] );
+      inserts++;
+      return touch( slot );
+    }
+
+    uint16_t size() {
+      return capacity;
+    }
+
+    uint16_t used() {
+      uint16_t count = 0;
+      for( uint16_t i=0; i<capacity; i++ ) {
+        if( !isEmpty( items[i].address ) && !expired( i ) ) count++;
+      }
+      return count;
+    }
+
+  private:
+
+    BlueToothDevice* items = NULL;
+    uint32_t* lastSeen = NULL; // millis()
+    uint16_t capacity = 0;
+
+    bool expired( uint16_t index ) {
+      return millis() - lastSeen[index] > ROTATINGCACHE_TTL*1000;
+    }
+
+};
+
+
+RotatingDevCache RotatingCache;
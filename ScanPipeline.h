@@ -0,0 +1,459 @@
+/*
+
+  ESP32 BLE Collector - A BLE scanner with sqlite data persistence on the SD Card
+  Source: https://github.com/tobozo/ESP32-BLECollector
+
+  MIT License
+
+  Copyright (c) 2018 tobozo
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  -----------------------------------------------------------------------------
+
+  Radio-agnostic part of the scan pipeline: advertisements stored in
+  BLEDevScanCache by the scan callback (or by the simulator/trace replay) go
+  through the after-scan steps populate -> ifexists -> render -> propagate
+  one device at a time. Nothing in here touches NimBLE, so the same steps run
+  in the sketch (see BLEScanUtils in BLE.h) and in the host build (tools/host).
+
+*/
+
+const char* processTemplateLong = "%s%d%s%d";
+const char* processTemplateShort = "%s%d";
+static char processMessage[20];
+
+bool onScanProcessed = true;
+bool onScanPopulated = true;
+bool onScanPropagated = true;
+bool onScanPostPopulated = true;
+bool onScanRendered = true;
+bool onScanDone = true;
+bool scanTaskRunning = false;
+bool scanTaskStopped = true;
+
+static uint16_t processedDevicesCount = 0;
+bool foundDeviceToggler = true;
+
+
+enum AfterScanSteps {
+  POPULATE  = 0,
+  IFEXISTS  = 1,
+  RENDER    = 2,
+  PROPAGATE = 3
+};
+
+
+// radio-agnostic part of the scan callback, BLEDevScanCache[scan_cursor] has just been stored
+// returns true when the scan should stop
+static bool onScanResult() {
+  if ( scan_cursor < MAX_DEVICES_PER_SCAN ) {
+    //bool is_random = strcmp( BLEDevScanCache[scan_cursor]->ouiname, "[random]" ) == 0;
+    bool is_random = (BLEDevScanCache[scan_cursor]->addr_type == BLE_ADDR_RANDOM );
+    //bool is_blacklisted = isBlackListed( BLEDevScanCache[scan_cursor]->address );
+    if ( UI.filterVendors && is_random ) {
+      //TODO: scan_cursor++
+      log_i( "Filtering %s", BLEDevScanCache[scan_cursor]->address );
+    } else {
+      if ( DB.hasPsram ) {
+        if ( !is_random ) {
+          DB.getOUI( BLEDevScanCache[scan_cursor]->address, BLEDevScanCache[scan_cursor]->ouiname );
+        }
+        if ( BLEDevScanCache[scan_cursor]->manufid > -1 ) {
+          DB.getVendor( BLEDevScanCache[scan_cursor]->manufid, BLEDevScanCache[scan_cursor]->manufname );
+        }
+        BLEDevScanCache[scan_cursor]->is_anonymous = BLEDevHelper.isAnonymous( BLEDevScanCache[scan_cursor] );
+        log_i(  "  stored and populated #%02d : %s", scan_cursor, BLEDevScanCache[scan_cursor]->name );
+      } else {
+        log_i(  "  stored #%02d : %s", scan_cursor, BLEDevScanCache[scan_cursor]->name );
+      }
+      scan_cursor++;
+      processedDevicesCount++;
+      processedDevicesTotal++;
+    }
+    if ( scan_cursor == MAX_DEVICES_PER_SCAN ) {
+      onScanDone = true;
+    }
+  } else {
+    droppedDevicesCount++;
+    onScanDone = true;
+  }
+  if ( onScanDone ) {
+    scan_cursor = 0;
+    if ( SCAN_DURATION - 1 >= MIN_SCAN_DURATION ) {
+      SCAN_DURATION--;
+    }
+  }
+  foundDeviceToggler = !foundDeviceToggler;
+  if (foundDeviceToggler) {
+    //UI.BLEStateIconSetColor(BLE_GREEN);
+    BLEActivityIcon.setStatus( ICON_STATUS_ADV_WHITELISTED );
+  } else {
+    //UI.BLEStateIconSetColor(BLE_DARKGREEN);
+    BLEActivityIcon.setStatus( ICON_STATUS_ADV_SCAN );
+  }
+  return onScanDone;
+}
+
+
+// same as FoundDeviceCallbacks::onResult() for sources without a radio (e.g. BLESimulator)
+static void onAdvRecord( const BLEAdvRecord *record ) {
+  devicesStatCount++; // raw stats for heapgraph
+  advertisementsCount++;
+  BLETrace.capture( record ); // only when recording
+  if ( onScanDone  ) {
+    droppedDevicesCount++;
+    return;
+  }
+  uint32_t stageStart = LatencyStats.begin();
+  if ( scan_cursor < MAX_DEVICES_PER_SCAN ) {
+    log_i("will store advertisement record in cache #%d", scan_cursor);
+    BLEDevHelper.store( BLEDevScanCache[scan_cursor], record );
+  }
+  onScanResult();
+  LatencyStats.end( STAGE_STORE, stageStart );
+}
+
+
+class ScanPipelineUtils {
+
+  public:
+
+
+    // clears the per-scan counters and re-arms the after-scan steps, the scan source runs next
+    static void beginScan() {
+      processedDevicesCount = 0;
+      devicesCount = 0;
+      scan_cursor = 0;
+      onScanProcessed = false;
+      onScanDone = false;
+      onScanPopulated = false;
+      onScanPropagated = false;
+      onScanPostPopulated = false;
+      onScanRendered = false;
+    }
+
+
+    // the scan source is done: devicesCount is what the after-scan steps will go through
+    static void endScan() {
+      devicesCount = processedDevicesCount;
+      if ( devicesCount < MAX_DEVICES_PER_SCAN ) {
+        if ( SCAN_DURATION + 1 < MAX_SCAN_DURATION ) {
+          SCAN_DURATION++;
+        }
+      } else if ( devicesCount > MAX_DEVICES_PER_SCAN ) {
+        if ( SCAN_DURATION - 1 >= MIN_SCAN_DURATION ) {
+          SCAN_DURATION--;
+        }
+        log_w("Cache overflow (%d results vs %d slots), truncating results...", devicesCount, MAX_DEVICES_PER_SCAN);
+        devicesCount = MAX_DEVICES_PER_SCAN;
+      } else {
+        // same amount
+      }
+      sessDevicesCount += devicesCount;
+      notInCacheCount = 0;
+      inCacheCount = 0;
+      onScanDone = true;
+      scan_cursor = 0;
+    }
+
+
+    // stands in for pBLEScan->start() while a trace is replayed
+    static void replayScan( uint32_t duration ) {
+      BLEAdvRecord record;
+      BLETrace.beginWindow( duration );
+      while( !onScanDone && scanTaskRunning && BLETrace.next( &record ) ) {
+        onAdvRecord( &record );
+      }
+    }
+
+
+    #if BLE_SIMULATION
+    // stands in for pBLEScan->start(), the radio stays idle and the pipeline is fed with synthetic advertisements
+    static void simulateScan( uint32_t duration ) {
+      unsigned long scanEnd = millis() + duration*1000;
+      BLEAdvRecord record;
+      while( !onScanDone && scanTaskRunning && millis() < scanEnd ) {
+        BLESimulator.next( &record );
+        onAdvRecord( &record );
+        vTaskDelay( BLESimulator.interval() );
+      }
+    }
+    #endif
+
+
+    static bool onAfterScanSteps( byte &onAfterScanStep, uint16_t &scan_cursor ) {
+      uint32_t stageStart = LatencyStats.begin();
+      switch ( onAfterScanStep ) {
+        case POPULATE: // 0
+          if ( onScanPopulate( scan_cursor ) ) { // OUI / vendorname / isanonymous
+            LatencyStats.end( STAGE_POPULATE, stageStart );
+          }
+          onAfterScanStep++;
+          return true;
+          break;
+        case IFEXISTS: // 1
+          if ( onScanIfExists( scan_cursor ) ) { // exists + hits
+            LatencyStats.end( STAGE_IFEXISTS, stageStart );
+          }
+          onAfterScanStep++;
+          return true;
+          break;
+        case RENDER: // 2
+          if ( onScanRender( scan_cursor ) ) { // ui work
+            LatencyStats.end( STAGE_RENDER, stageStart );
+          }
+          onAfterScanStep++;
+          return true;
+          break;
+        case PROPAGATE: // 3
+          onAfterScanStep = 0;
+          if ( onScanPropagate( scan_cursor ) ) { // copy to DB / cache
+            LatencyStats.end( STAGE_PROPAGATE, stageStart );
+            scan_cursor++;
+            return true;
+          }
+          break;
+        default:
+          log_w("Exit flat loop on afterScanStep value : %d", onAfterScanStep);
+          onAfterScanStep = 0;
+          break;
+      }
+      return false;
+    }
+
+
+    static bool onScanPopulate( uint16_t _scan_cursor ) {
+      if ( onScanPopulated ) {
+        log_v("%s", " onScanPopulated = true ");
+        return false;
+      }
+      if ( _scan_cursor >= devicesCount) {
+        onScanPopulated = true;
+        log_d("%s", "done all");
+        return false;
+      }
+      if ( isEmpty( BLEDevScanCache[_scan_cursor]->address ) ) {
+        log_w("empty addess");
+        return true; // end of cache
+      }
+      populate( BLEDevScanCache[_scan_cursor] );
+      return true;
+    }
+
+
+    static bool onScanIfExists( int _scan_cursor ) {
+      if ( onScanPostPopulated ) {
+        log_v("onScanPostPopulated = true");
+        return false;
+      }
+      if ( _scan_cursor >= devicesCount) {
+        log_d("done all");
+        onScanPostPopulated = true;
+        return false;
+      }
+      int scannedRSSI = BLEDevScanCache[_scan_cursor]->rssi; // merging keeps the cached one
+      if ( BLEDevHelper.isRotating( BLEDevScanCache[_scan_cursor] ) ) {
+        onScanIfRotating( _scan_cursor );
+        trackPresence( BLEDevScanCache[_scan_cursor], scannedRSSI );
+        return true;
+      }
+      int deviceIndexIfExists = -1;
+      deviceIndexIfExists = getDeviceCacheIndex( BLEDevScanCache[_scan_cursor]->address );
+      if ( deviceIndexIfExists > -1 ) {
+        inCacheCount++;
+        BLEDevRAMCache[deviceIndexIfExists]->hits++;
+        if ( TimeIsSet ) {
+          if ( BLEDevRAMCache[deviceIndexIfExists]->created_at.year() <= 1970 ) {
+            BLEDevRAMCache[deviceIndexIfExists]->created_at = nowDateTime;
+          }
+          BLEDevRAMCache[deviceIndexIfExists]->updated_at = nowDateTime;
+        }
+        BLEDevHelper.mergeItems( BLEDevScanCache[_scan_cursor], BLEDevRAMCache[deviceIndexIfExists] ); // merge scan data into existing psram cache
+        BLEDevHelper.copyItem( BLEDevRAMCache[deviceIndexIfExists], BLEDevScanCache[_scan_cursor] ); // copy back merged data for rendering
+        recordRSSI( deviceIndexIfExists, scannedRSSI, false );
+        log_i( "Device %d / %s exists in cache, increased hits to %d", _scan_cursor, BLEDevScanCache[_scan_cursor]->address, BLEDevScanCache[_scan_cursor]->hits );
+      } else {
+        if ( BLEDevScanCache[_scan_cursor]->is_anonymous ) {
+          // won't land in DB (won't be checked either) but will land in cache
+          uint16_t nextCacheIndex = BLEDevHelper.getNextCacheIndex( BLEDevRAMCache, BLEDevCacheIndex );
+          BLEDevHelper.reset( BLEDevRAMCache[nextCacheIndex] );
+          BLEDevScanCache[_scan_cursor]->hits++;
+          BLEDevHelper.copyItem( BLEDevScanCache[_scan_cursor], BLEDevRAMCache[nextCacheIndex] );
+          recordRSSI( nextCacheIndex, scannedRSSI, true );
+          log_v( "Device %d / %s is anonymous, won't be inserted", _scan_cursor, BLEDevScanCache[_scan_cursor]->address, BLEDevScanCache[_scan_cursor]->hits );
+        } else {
+          deviceIndexIfExists = DB.deviceExists( BLEDevScanCache[_scan_cursor]->address ); // will load returning devices from DB if necessary
+          if (deviceIndexIfExists > -1) {
+            uint16_t nextCacheIndex = BLEDevHelper.getNextCacheIndex( BLEDevRAMCache, BLEDevCacheIndex );
+            BLEDevHelper.reset( BLEDevRAMCache[nextCacheIndex] );
+            BLEDevDBCache->hits++;
+            if ( TimeIsSet ) {
+              if ( BLEDevDBCache->created_at.year() <= 1970 ) {
+                BLEDevDBCache->created_at = nowDateTime;
+              }
+              BLEDevDBCache->updated_at = nowDateTime;
+            }
+            BLEDevHelper.mergeItems( BLEDevScanCache[_scan_cursor], BLEDevDBCache ); // merge scan data into BLEDevDBCache
+            BLEDevHelper.copyItem( BLEDevDBCache, BLEDevRAMCache[nextCacheIndex] ); // copy merged data to assigned psram cache
+            recordRSSI( nextCacheIndex, scannedRSSI, true );
+            BLEDevHelper.copyItem( BLEDevDBCache, BLEDevScanCache[_scan_cursor] ); // copy back merged data for rendering
+
+            log_v( "Device %d / %s is already in DB, increased hits to %d", _scan_cursor, BLEDevScanCache[_scan_cursor]->address, BLEDevScanCache[_scan_cursor]->hits );
+          } else {
+            // will be inserted after rendering
+            BLEDevScanCache[_scan_cursor]->in_db = false;
+            log_v( "Device %d / %s is not in DB", _scan_cursor, BLEDevScanCache[_scan_cursor]->address );
+          }
+        }
+      }
+      trackPresence( BLEDevScanCache[_scan_cursor], scannedRSSI );
+      return true;
+    }
+
+
+    // appends a scanned RSSI to the history of a BLEDevRAMCache slot, a slot given to another device starts over
+    static void recordRSSI( uint16_t cacheIndex, int rssi, bool newSlot ) {
+      uint32_t now = TimeIsSet ? nowDateTime.unixtime() : millis()/1000;
+      if ( newSlot ) {
+        DateTime created_at = BLEDevRAMCache[cacheIndex]->created_at;
+        RSSIHistory.reset( cacheIndex, TimeIsSet && created_at.year() > 1970 ? created_at.unixtime() : now );
+      }
+      RSSIHistory.add( cacheIndex, now, rssi );
+    }
+
+    // sessions need the wall clock, like created_at/updated_at
+    static void trackPresence( BlueToothDevice *CacheItem, int rssi ) {
+      if ( TimeIsSet ) {
+        PresenceSessions.hit( CacheItem, rssi, nowDateTime.unixtime() );
+      }
+    }
+
+    // rotating addresses only live in RotatingCache, they never evict returning devices from BLEDevRAMCache
+    static void onScanIfRotating( int _scan_cursor ) {
+      BlueToothDevice *ScanItem = BLEDevScanCache[_scan_cursor];
+      int rotatingIndex = RotatingCache.find( ScanItem->address );
+      if ( rotatingIndex > -1 ) {
+        BlueToothDevice *RotatingItem = RotatingCache.touch( rotatingIndex );
+        RotatingItem->hits++;
+        RotatingItem->entity = PseudoDevices.link( RotatingItem->fingerprint, RotatingItem->address, RotatingItem->entity );
+        if ( TimeIsSet ) {
+          RotatingItem->updated_at = nowDateTime;
+        }
+        BLEDevHelper.mergeItems( ScanItem, RotatingItem );
+        BLEDevHelper.copyItem( RotatingItem, ScanItem ); // copy back merged data for rendering
+        log_v( "Device %d / %s (%s) seen again, hits: %d", _scan_cursor, ScanItem->address, BLEDevHelper.BLEAddrKindToString( ScanItem->addr_kind ), ScanItem->hits );
+      } else {
+        ScanItem->entity = PseudoDevices.link( ScanItem->fingerprint, ScanItem->address, 0 ); // a new address may take over a known entity
+        RotatingCache.put( ScanItem );
+        log_v( "Device %d / %s (%s) won't be inserted, entity #%d", _scan_cursor, ScanItem->address, BLEDevHelper.BLEAddrKindToString( ScanItem->addr_kind ), ScanItem->entity );
+      }
+    }
+
+
+    static bool onScanRender( uint16_t _scan_cursor ) {
+      if ( onScanRendered ) {
+        log_v("onScanRendered = true");
+        return false;
+      }
+      if ( _scan_cursor >= devicesCount) {
+        log_v("done all");
+        onScanRendered = true;
+        return false;
+      }
+      // the UI task does the actual rendering, see RenderQueue.h
+      RenderQueue.pushCard( (BlueToothDeviceLink){.cacheIndex=_scan_cursor,.device=BLEDevScanCache[_scan_cursor]} );
+      sprintf( processMessage, processTemplateLong, "Rendered ", _scan_cursor + 1, " / ", devicesCount );
+      RenderQueue.pushHeader( processMessage );
+      RenderQueue.pushCounters();
+      return true;
+    }
+
+
+    static bool onScanPropagate( uint16_t &_scan_cursor ) {
+      if ( onScanPropagated ) {
+        log_v("onScanPropagated = true");
+        return false;
+      }
+      if ( _scan_cursor >= devicesCount) {
+        log_v("done all");
+        onScanPropagated = true;
+        _scan_cursor = 0;
+        return false;
+      }
+      //BLEDevScanCacheIndex = _scan_cursor;
+      if ( isEmpty( BLEDevScanCache[_scan_cursor]->address ) ) {
+        return true;
+      }
+      if ( BLEDevScanCache[_scan_cursor]->is_anonymous || BLEDevScanCache[_scan_cursor]->in_db || BLEDevHelper.isRotating( BLEDevScanCache[_scan_cursor] ) ) { // don't DB-insert anon, duplicates or rotating addresses
+        sprintf( processMessage, processTemplateLong, "Released ", _scan_cursor + 1, " / ", devicesCount );
+        if ( BLEDevScanCache[_scan_cursor]->is_anonymous ) AnonymousCacheHit++;
+      } else {
+        uint32_t insertStart = LatencyStats.begin();
+        DBUtils::DBMessage insertResult = DB.insertBTDevice( BLEDevScanCache[_scan_cursor] );
+        Metrics.dbInsert.add( ESP.getCycleCount() - insertStart );
+        if ( insertResult == DBUtils::INSERTION_SUCCESS ) {
+          sprintf( processMessage, processTemplateLong, "Saved ", _scan_cursor + 1, " / ", devicesCount );
+          log_d( "Device %d successfully inserted in DB", _scan_cursor );
+          entries++;
+        } else {
+          log_e( "  [!!! BD INSERT FAIL !!!] Device %d could not be inserted", _scan_cursor );
+          sprintf( processMessage, processTemplateLong, "Failed ", _scan_cursor + 1, " / ", devicesCount );
+        }
+      }
+      BLEDevHelper.reset( BLEDevScanCache[_scan_cursor] ); // discard
+      RenderQueue.pushHeader( processMessage );
+      return true;
+    }
+
+
+    static int getDeviceCacheIndex(const char* address) {
+      if ( isEmpty( address ) )  return -1;
+      BLEDevCacheLookups++;
+      for (int i = 0; i < BLEDEVCACHE_SIZE; i++) {
+        if ( strcmp(address, BLEDevRAMCache[i]->address ) == 0  ) {
+          BLEDevCacheHit++;
+          log_v("[CACHE HIT] BLEDevCache ID #%s has %d cache hits", address, BLEDevRAMCache[i]->hits);
+          return i;
+        }
+        cacheYield();
+      }
+      return -1;
+    }
+
+
+    // completes unpopulated fields of a given entry by performing DB oui/vendor lookups
+    static void populate( BlueToothDevice *CacheItem ) {
+      if ( strcmp( CacheItem->ouiname, "[unpopulated]" ) == 0 ) {
+        log_d("  [populating OUI for %s]", CacheItem->address);
+        DB.getOUI( CacheItem->address, CacheItem->ouiname );
+      }
+      if ( strcmp( CacheItem->manufname, "[unpopulated]" ) == 0 ) {
+        if ( CacheItem->manufid != -1 ) {
+          log_d("  [populating Vendor for :%d]", CacheItem->manufid );
+          DB.getVendor( CacheItem->manufid, CacheItem->manufname );
+        } else {
+          BLEDevHelper.set( CacheItem, "manufname", '\0');
+        }
+      }
+      CacheItem->is_anonymous = BLEDevHelper.isAnonymous( CacheItem );
+      log_v("[populated :%s]", CacheItem->address);
+    }
+
+};
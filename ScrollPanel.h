@@ -30,6 +30,8 @@
 */
 
 #define SPACE " "
+#define SCROLL_STEP_MS 3 // scroll_slow() speed, ms per line
+#define SCROLL_ROWS_PER_FRAME 4 // hardware scroll animation speed, rows uncovered per compositor frame
 static bool isScrolling = false;
 static bool isInScroll() {
   return isScrolling;
@@ -55,6 +57,7 @@ class ScrollableOutput {
     int scrollPosY = -1;
     int scrollPosX = -1;
     bool serialEcho = true;
+    bool scrollAnimated = false; // pushed blocks are uncovered by scrollStep() from the compositor frames, drawn at once otherwise
     //uint16_t BgColor;
     RGBColor BGColorStart;
     RGBColor BGColorEnd;
@@ -96,6 +99,14 @@ class ScrollableOutput {
 
       tft_setupHScrollArea(0, 0, 0); // reset ?
       tft_setupHScrollArea(TFA, VSA, BFA);
+
+      // render the background gradient once, every new line is a copy of it
+      scrollBgSprite.deleteSprite();
+      scrollBgSprite.setPsram( false );
+      scrollBgSprite.setColorDepth( 16 );
+      scrollBgSprite.createSprite( width, 1 );
+      scrollBgSprite.drawGradientHLine( 0, 0, width/2, BGColorStart, BGColorEnd );
+      scrollBgSprite.drawGradientHLine( width/2, 0, width - width/2, BGColorEnd, BGColorStart );
       s_x_tmp = 0;
       s_y_tmp = scrollTopFixedArea;
       s_w_tmp = width;
@@ -122,6 +133,7 @@ class ScrollableOutput {
 
     // draw rounded corners boxes inside the scroll view, with scroll limit overlap support
     void drawScrollableRoundRect(uint16_t x, uint16_t y, uint16_t _width, uint16_t _height, uint16_t radius, uint16_t bordercolor, bool fill = false ) {
+      scrollFinish(); // the box may sit on rows not uncovered yet
       int yStart = translate(y, 0); // get the scrollview-translated y position
       if ( yStart >= scrollTopFixedArea && (yStart+_height)<(height-scrollBottomFixedArea) ) {
         // no scroll loop point overlap, just render the translated box using the native method
@@ -165,8 +177,106 @@ class ScrollableOutput {
       }
     }
 
+    // push the first blockHeight lines of a sprite as the next block of the scroll area
+    int pushBlock( TFT_eSprite *block, uint16_t blockHeight ) {
+      isScrolling = true;
+      if (scrollPosY == -1) {
+        scrollPosY = tft.getCursorY();
+      }
+      uint16_t scrollBottom = height - scrollBottomFixedArea;
+      if( scrollType == SCROLL_SOFTWARE ) {
+        scroll_slow(blockHeight, SCROLL_STEP_MS);
+        scrollPosY = scrollBottom - blockHeight;
+        drawBlockRows( block, scrollPosY, 0, blockHeight );
+      } else {
+        if (scrollPosY >= scrollBottom) {
+          scrollPosY = (scrollPosY % scrollBottom) + scrollTopFixedArea;
+        }
+        scrollFinish(); // one block at a time
+        pendingBlock = block;
+        pendingPosY  = scrollPosY;
+        pendingRows  = blockHeight;
+        revealedRows = 0;
+        if( !scrollAnimated ) {
+          scrollFinish();
+        }
+      }
+      scrollPosY = translate( scrollPosY, blockHeight );
+      tft.setCursor(0, scrollPosY);
+      isScrolling = false;
+      return blockHeight;
+    }
+
+    // rows of the last pushed block still waiting to be uncovered
+    uint16_t scrollPending() {
+      return pendingBlock != NULL ? pendingRows - revealedRows : 0;
+    }
+
+    // scrolls up to <rows> rows and draws the block rows they uncover at the bottom, returns the rows left
+    uint16_t scrollStep( uint16_t rows ) {
+      if( pendingBlock == NULL ) return 0;
+      if( rows > pendingRows - revealedRows ) rows = pendingRows - revealedRows;
+      takeMuxSemaphore();
+      commitScroll( rows ); // the uncovered rows are the ones that just left the top
+      drawBlockRows( pendingBlock, pendingPosY, revealedRows, rows );
+      revealedRows += rows;
+      if( revealedRows >= pendingRows ) {
+        pendingBlock = NULL; // the sprite can be drawn again
+      }
+      giveMuxSemaphore();
+      return scrollPending();
+    }
+
+    // uncovers what's left of the last pushed block at once, before anything else is drawn in the scroll area
+    void scrollFinish() {
+      if( pendingBlock != NULL ) {
+        scrollStep( pendingRows );
+      }
+    }
+
   private:
 
+    TFT_eSprite *pendingBlock = NULL; // block pushed but not fully uncovered yet
+    uint16_t pendingPosY  = 0; // scroll area row of the first block row
+    uint16_t pendingRows  = 0;
+    uint16_t revealedRows = 0;
+
+    // pushes <rows> rows of a block starting at block row <firstRow>, with scroll loop point support
+    void drawBlockRows( TFT_eSprite *block, uint16_t blockPosY, uint16_t firstRow, uint16_t rows ) {
+      uint16_t scrollBottom = height - scrollBottomFixedArea;
+      int y = translate( blockPosY, firstRow );
+      tft.startWrite();
+      if( y + rows <= scrollBottom ) {
+        tft.setClipRect( 0, y, width, rows );
+        block->pushSprite( 0, y - firstRow );
+      } else {
+        // rows overlap the scroll loop point, split them in two chunks
+        uint16_t upperRows = scrollBottom - y;
+        tft.setClipRect( 0, y, width, upperRows );
+        block->pushSprite( 0, y - firstRow );
+        tft.setClipRect( 0, scrollTopFixedArea, width, rows - upperRows );
+        block->pushSprite( 0, scrollTopFixedArea - firstRow - upperRows );
+      }
+      tft.clearClipRect();
+      tft.endWrite();
+    }
+
+    // moves the hardware scroll pointer at once, so the lines about to be drawn are already off the top
+    void commitScroll( uint16_t lines ) {
+      takeMuxSemaphore();
+      yRef = translate( yRef, lines );
+      tft_hScrollTo( yRef );
+      giveMuxSemaphore();
+    }
+
+    void fillBackground( uint16_t y, uint16_t lines ) {
+      tft.startWrite();
+      for( uint16_t h = 0; h < lines; h++ ) {
+        scrollBgSprite.pushSprite( 0, y+h );
+      }
+      tft.endWrite();
+    }
+
     int scroll(const char* str) {
       //tft.drawFastHLine( 0, scrollTopFixedArea, 8, BLE_RED );
       isScrolling = true;
@@ -188,10 +298,14 @@ class ScrollableOutput {
       }
 
 
-      tft_fillGradientHRect( 0, scrollPosY, width/2, h_tmp, BGColorStart, BGColorEnd );
-      tft_fillGradientHRect( width/2, scrollPosY, width/2, h_tmp, BGColorEnd, BGColorStart );
+      if( scrollType == SCROLL_HARDWARE ) {
+        scrollFinish(); // keep the output order
+        commitScroll( h_tmp ); // scroll first, then draw into the exposed lines
+      } else {
+        scroll_slow(h_tmp, SCROLL_STEP_MS);
+      }
+      fillBackground( scrollPosY, h_tmp );
       tft.setCursor(scrollPosX, scrollPosY);
-      scroll_slow(h_tmp, 3); // Scroll lines, 3ms per line
       //tft.print(str);
       if( strcmp(str, " \n")!=0 ) {
         tft.drawString( str, tft.getCursorX(), tft.getCursorY());
@@ -48,6 +48,8 @@
 #define HAS_EXTERNAL_RTC   false // uses I2C, search this file for RTC_SDA or RTC_SCL to change pins
 #define HAS_GPS            false // uses hardware serial, search this file for GPS_RX and GPS_TX to change pins
 #define TIME_UPDATE_SOURCE TIME_UPDATE_GPS // TIME_UPDATE_GPS // soon deprecated, will be implicit
+#define BLE_SIMULATION     false // feed the scan pipeline with synthetic advertisements instead of the radio, see BLESimulator.h
+#define BLE_DB_FILES_PACKED false // download the .blz containers of the oui databases instead of the raw files, see LZStream.h
 
 // Timezone is using a float because Newfoundland, India, Iran, Afghanistan, Myanmar, Sri Lanka, the Marquesas,
 // as well as parts of Australia use half-hour deviations from standard time, and some nations,
@@ -60,8 +62,8 @@ bool summerTime = false;
 byte SCAN_DURATION = 20; // seconds, will be adjusted upon scan results
 #define MIN_SCAN_DURATION 10 // seconds min
 #define MAX_SCAN_DURATION 120 // seconds max
-#define VENDORCACHE_SIZE 16 // use some heap to cache vendor query responses, min = 5, max = 256
-#define OUICACHE_SIZE 8 // use some heap to cache mac query responses, min = 16, max = 4096
+#define VENDORCACHE_SIZE 16 // use some heap to cache vendor query responses, min = 1, max = 256
+#define OUICACHE_SIZE 32 // use some heap to cache mac query responses, min = 1, max = 4096
 #define MAX_FIELD_LEN 32 // max chars returned by field
 #define MAC_LEN 17 // chars used by a mac address
 #define SHORT_MAC_LEN 7 // chars used by the oui part of a mac address
@@ -112,7 +114,23 @@ byte SCAN_DURATION = 20; // seconds, will be adjusted upon scan results
 #define MAX_BLECARDS_WITHOUT_TIMESTAMPS_ON_SCREEN 5
 #define BLEDEVCACHE_PSRAM_SIZE 1024 // use PSram to cache BLECards
 #define BLEDEVCACHE_HEAP_SIZE 32 // use some heap to cache BLECards. min = 5, max = 64, higher value = less SD/SD_MMC sollicitation
+#define ROTATINGCACHE_PSRAM_SIZE 256 // devices with a rotating random address, kept apart from BLEDevRAMCache
+#define ROTATINGCACHE_HEAP_SIZE 8
+#define ROTATINGCACHE_TTL 900 // seconds without advertisement before a rotating address is dropped, RPAs rotate every ~15mn
+#define PSEUDODEVICES_PSRAM_SIZE 512 // entities linking rotating addresses by advertisement fingerprint
+#define PSEUDODEVICES_HEAP_SIZE 16
+#define PSEUDODEVICES_TTL 3600 // seconds without advertisement before an entity is forgotten
+#define FINGERPRINT_MANUF_PREFIX 4 // manufacturer data bytes in the fingerprint: company id + frame type/length
+#define RSSI_HISTORY_SAMPLES 32 // per BLEDevRAMCache slot, 3 bytes each, PSRAM only
+#define RSSI_HISTORY_RESOLUTION 2 // seconds, the offsets from created_at cover 36h
+#define RSSI_HISTORY_PERSIST 1 // save the history in the rssi_history column on replication
+#define SESSIONS_PSRAM_SIZE 512 // open presence sessions
+#define SESSIONS_HEAP_SIZE 32
+#define SESSIONS_QUEUE_SIZE 64 // closed sessions waiting for the DB
+#define SESSIONS_BATCH_SIZE 16 // closed sessions written per transaction
+#define SESSIONS_ABSENCE_TIMEOUT 300 // seconds without a hit before a session is closed, default for the "sessions" command
 #define MAX_DEVICES_PER_SCAN MAX_BLECARDS_WITH_TIMESTAMPS_ON_SCREEN // also max displayed devices on the screen, affects initial scan duration
+#define BLECARD_MAX_LINES 16 // height of the off-screen BLE card sprite (PSRAM only), in text lines
 
 #define MENU_FILENAME "/" BUILD_TYPE ".bin"
 #define BLE_MENU_FILENAME "/" BLE_MENU_NAME ".bin"
@@ -154,14 +172,16 @@ int strpos(const char *hay, const char *needle, int offset) {
 
 // used to get the resetReason
 #include <rom/rtc.h>
+#include <rom/crc.h> // crc32_le()
 #include <Preferences.h>
 Preferences preferences;
 // use the primitive because ESP.getFreeHeap() is inconsistent across SDK versions
 #define freeheap heap_caps_get_free_size(MALLOC_CAP_INTERNAL)
 #define freepsheap ESP.getFreePsram()
 #define resetReason (int)rtc_get_reset_reason(0)
-#define takeMuxSemaphore() if( mux ) { xSemaphoreTake(mux, portMAX_DELAY); log_v("Took Semaphore"); }
-#define giveMuxSemaphore() if( mux ) { xSemaphoreGive(mux); log_v("Gave Semaphore"); }
+// recursive so the compositor can hold it for a whole frame while widgets take it again
+#define takeMuxSemaphore() if( mux ) { xSemaphoreTakeRecursive(mux, portMAX_DELAY); log_v("Took Semaphore"); }
+#define giveMuxSemaphore() if( mux ) { xSemaphoreGiveRecursive(mux); log_v("Gave Semaphore"); }
 
 // core affinity
 #define SCANTASK_CORE       0
@@ -175,6 +195,9 @@ Preferences preferences;
 #define STATUSBAR_CORE      1
 #define HEAPGRAPH_CORE      1
 #define SCROLLINTRO_CORE    0
+#define COMPOSITOR_CORE     1
+
+#define UI_FPS 20 // frame rate of the compositor, also drains the render queue
 
 static void destroyTaskNow( TaskHandle_t &task ) {
   vTaskSuspendAll();
@@ -187,6 +210,7 @@ static void destroyTaskNow( TaskHandle_t &task ) {
   xTaskResumeAll();
 }
 
+#include "TaskMonitor.h" // spawnTask()
 
 #include "Display.h" // some config settings are forced here
 #include "DateTime.h"
@@ -268,6 +292,7 @@ static void destroyTaskNow( TaskHandle_t &task ) {
 // statistical values
 static int devicesCount     = 0; // devices count per scan
 static int sessDevicesCount = 0; // total devices count per session
+static uint32_t processedDevicesTotal = 0; // devices stored by the scan callback since boot (processedDevicesCount is per scan)
 //static int newDevicesCount  = 0; // total devices count per session
 static int results          = 0; // total results during last query
 static unsigned int entries = 0; // total entries in database
@@ -275,9 +300,24 @@ static byte prune_trigger   = 0; // incremented on every insertion, reset on pru
 
 // load application stack
 #include "BLECache.h" // data struct
+#include "LatencyStats.h"
 #include "ScrollPanel.h" // scrolly methods
 #include "TimeUtils.h"
 #include "UI.h"
+#include "LookupTable.h" // compiled reference data
+#include "NameCache.h" // OUI/vendor name caches
+#include "RotatingCache.h" // devices with rotating random addresses
+#include "PseudoDevices.h" // rotating addresses linked by fingerprint
+#include "RSSIHistory.h" // per device RSSI rings
+#include "PresenceSessions.h" // enter/exit sessions
 #include "DB.h"
+#include "LZStream.h"
+#include "FileTransfer.h"
+#include "DBSync.h"
 #include "BLEFileSharing.h"
+#include "BLESimulator.h" // also feeds the benchmarks
+#include "BLETrace.h"
+#include "Metrics.h"
+#include "ScanPipeline.h" // radio-agnostic after-scan steps
+#include "Benchmark.h" // also covers ScanPipelineUtils
 #include "BLE.h"
@@ -0,0 +1,199 @@
+/*
+
+  ESP32 BLE Collector - A BLE scanner with sqlite data persistence on the SD Card
+  Source: https://github.com/tobozo/ESP32-BLECollector
+
+  MIT License
+
+  Copyright (c) 2018 tobozo
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  -----------------------------------------------------------------------------
+
+  Keeps track of every task spawned by the collector (see spawnTask()) and
+  prints a 'top'-like table: core, priority, configured stack, stack
+  high-water mark and CPU share since the previous call.
+  The handle created by spawnTask() is kept, and only used once the task is
+  found alive (in the system state, or under its name truncated the way
+  FreeRTOS stores it), so a task that has already deleted itself is reported
+  as gone instead of dereferencing a stale handle.
+  CPU share needs configGENERATE_RUN_TIME_STATS, it shows as n/a otherwise.
+
+*/
+
+#define TASKMONITOR_SIZE 40
+
+#if ( configUSE_TRACE_FACILITY == 1 ) && ( configGENERATE_RUN_TIME_STATS == 1 )
+  #define TASKMONITOR_RUNTIME_STATS
+#endif
+
+struct TaskMonitorItem {
+  const char* name      = NULL;
+  uint32_t    stackSize = 0;
+  uint8_t     priority  = 0;
+  BaseType_t  core      = tskNO_AFFINITY;
+  uint32_t    spawned   = 0; // how many times this task was created
+  uint32_t    lastRunTime = 0;
+  TaskHandle_t handle   = NULL; // last created instance
+};
+
+
+class TaskMonitorUtils {
+  public:
+
+    void add( const char* name, uint32_t stackSize, uint8_t priority, BaseType_t core ) {
+      for( uint8_t i=0; i<count; i++ ) {
+        if( strcmp( items[i].name, name ) == 0 ) {
+          items[i].stackSize = stackSize;
+          items[i].priority  = priority;
+          items[i].core      = core;
+          items[i].spawned++;
+          items[i].handle    = NULL;
+          return;
+        }
+      }
+      if( count >= TASKMONITOR_SIZE ) {
+        log_w("Task monitor full, not tracking %s", name);
+        return;
+      }
+      items[count].name      = name;
+      items[count].stackSize = stackSize;
+      items[count].priority  = priority;
+      items[count].core      = core;
+      items[count].spawned   = 1;
+      items[count].handle    = NULL;
+      count++;
+    }
+
+    void setHandle( const char* name, TaskHandle_t handle ) {
+      for( uint8_t i=0; i<count; i++ ) {
+        if( strcmp( items[i].name, name ) == 0 ) {
+          items[i].handle = handle;
+          return;
+        }
+      }
+    }
+
+    void print() {
+      #ifdef TASKMONITOR_RUNTIME_STATS
+        UBaseType_t tasksCount = uxTaskGetNumberOfTasks();
+        TaskStatus_t *tasks = (TaskStatus_t*)calloc( tasksCount, sizeof(TaskStatus_t) );
+        uint32_t totalRunTime = 0;
+        if( tasks != NULL ) {
+          tasksCount = uxTaskGetSystemState( tasks, tasksCount, &totalRunTime );
+        } else {
+          tasksCount = 0;
+        }
+        uint32_t elapsed = totalRunTime - lastTotalRunTime;
+        lastTotalRunTime = totalRunTime;
+      #endif
+
+      Serial.println("\n    TASK                       | CORE | PRIO |  STACK | MIN FREE | USED |   CPU | SPAWNED");
+      Serial.println("-----------------------------------------------------------------------------------------");
+      for( uint8_t i=0; i<count; i++ ) {
+        TaskMonitorItem *item = &items[i];
+        #ifdef TASKMONITOR_RUNTIME_STATS
+          TaskHandle_t handle = isAlive( item, tasks, tasksCount ) ? item->handle : NULL;
+        #else
+          TaskHandle_t handle = isAlive( item ) ? item->handle : NULL;
+        #endif
+        char coreStr[5], cpuStr[8] = "n/a";
+        if( item->core == tskNO_AFFINITY ) {
+          snprintf( coreStr, sizeof(coreStr), "any" );
+        } else {
+          snprintf( coreStr, sizeof(coreStr), "%d", item->core );
+        }
+        if( handle == NULL ) {
+          Serial.printf("    %-26s | %4s | %4d | %6d | %8s | %4s | %5s | %7d\n", item->name, coreStr, item->priority, item->stackSize, "gone", "", "", item->spawned );
+          continue;
+        }
+        uint32_t minFree = uxTaskGetStackHighWaterMark( handle ); // bytes on ESP32
+        #ifdef TASKMONITOR_RUNTIME_STATS
+          for( UBaseType_t t=0; t<tasksCount; t++ ) {
+            if( tasks[t].xHandle != handle ) continue;
+            uint32_t runTime = tasks[t].ulRunTimeCounter - item->lastRunTime;
+            item->lastRunTime = tasks[t].ulRunTimeCounter;
+            if( elapsed > 0 ) {
+              // two cores: 100% = one core fully busy
+              snprintf( cpuStr, sizeof(cpuStr), "%.1f%%", runTime * 100.0 / elapsed );
+            }
+            break;
+          }
+        #endif
+        Serial.printf("    %-26s | %4s | %4d | %6d | %8d | %3d%% | %5s | %7d\n",
+          item->name,
+          coreStr,
+          item->priority,
+          item->stackSize,
+          minFree,
+          item->stackSize > 0 ? ( item->stackSize - minFree ) * 100 / item->stackSize : 0,
+          cpuStr,
+          item->spawned
+        );
+      }
+      #ifdef TASKMONITOR_RUNTIME_STATS
+        free( tasks );
+      #endif
+      Serial.printf("\n  Free heap: %d, min free heap: %d\n\n", freeheap, esp_get_minimum_free_heap_size() );
+    }
+
+  private:
+
+    #ifdef TASKMONITOR_RUNTIME_STATS
+      bool isAlive( TaskMonitorItem *item, TaskStatus_t *tasks, UBaseType_t tasksCount ) {
+        if( item->handle == NULL ) return false;
+        for( UBaseType_t t=0; t<tasksCount; t++ ) {
+          if( tasks[t].xHandle == item->handle ) return true;
+        }
+        return false;
+      }
+    #else
+      // FreeRTOS keeps configMAX_TASK_NAME_LEN-1 chars and asserts on longer names in xTaskGetHandle()
+      bool isAlive( TaskMonitorItem *item ) {
+        if( item->handle == NULL ) return false;
+        char name[configMAX_TASK_NAME_LEN];
+        snprintf( name, sizeof(name), "%s", item->name );
+        return xTaskGetHandle( name ) == item->handle;
+      }
+    #endif
+
+    TaskMonitorItem items[TASKMONITOR_SIZE];
+    uint8_t count = 0;
+    #ifdef TASKMONITOR_RUNTIME_STATS
+      uint32_t lastTotalRunTime = 0;
+    #endif
+
+};
+
+
+TaskMonitorUtils TaskMonitor;
+
+
+// same as xTaskCreatePinnedToCore, but the task shows up in the 'top' command
+static BaseType_t spawnTask( TaskFunction_t task, const char* name, uint32_t stackSize, void* param, UBaseType_t priority, TaskHandle_t* handle, BaseType_t core ) {
+  TaskMonitor.add( name, stackSize, priority, core );
+  TaskHandle_t created = NULL;
+  if( handle == NULL ) handle = &created; // the caller's handle is filled before the task starts, keep it that way
+  BaseType_t ret = xTaskCreatePinnedToCore( task, name, stackSize, param, priority, handle, core );
+  if( ret == pdPASS ) {
+    TaskMonitor.setHandle( name, *handle );
+  }
+  return ret;
+}
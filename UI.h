@@ -93,7 +93,7 @@ struct MacAddressColors {
     sprite->pushSprite( x, y );
   }
   // vertical blitter for upscaled rendering
-  void chopDraw( int32_t posx, int32_t posy, uint16_t _height ) {
+  void chopDraw( int32_t posx, int32_t posy, uint16_t _height, lgfx::LovyanGFX *gfx = &tft ) {
     if( width==-1 && height==-1 ) {
       width  = scaleX*8;
       height = scaleY*8;
@@ -107,20 +107,20 @@ struct MacAddressColors {
       log_e("Bad height request ( i=%d; i<%d; i++)", choplevel, choplevel+amount );
       return;
     }
-    tft.startWrite();
-    tft.setAddrWindow( posx, posy, width, _height );
+    gfx->startWrite();
+    gfx->setAddrWindow( posx, posy, width, _height );
     for( uint8_t i = choplevel; i < choplevel + amount; i++ ) {
       for( uint8_t sy = 0; sy < scaleY; sy++ ) {
         for( uint8_t j = 0; j < 8; j++ ) {
           if( bitRead( MACBytes[j], i ) == 1 ) {
-            tft.pushColor( color, scaleX );
+            gfx->pushColor( color, scaleX );
           } else {
-            tft.pushColor( BLE_WHITE, scaleX );
+            gfx->pushColor( BLE_WHITE, scaleX );
           }
         }
       }
     }
-    tft.endWrite();
+    gfx->endWrite();
     choplevel += amount;
   }
 };
@@ -156,19 +156,84 @@ struct MacSwap {
 
 
 
+// BLE cards are composed in BLECardSprite when it could be allocated,
+// otherwise they're printed line by line in the scroll area
+struct BLECardCanvas {
+  lgfx::LovyanGFX *gfx = &tft;
+  bool offscreen = false;
+  int16_t cursorY = 0;
+  int16_t height = 0;
+  void begin() {
+    offscreen = BLECardSprite.getBuffer() != nullptr;
+    if( !offscreen ) {
+      gfx = &tft;
+      return;
+    }
+    Out.scrollFinish(); // the previous card may still be uncovering from this sprite
+    gfx = &BLECardSprite;
+    cursorY = 0;
+    height = BLECardSprite.height();
+    for( int16_t y = 0; y < height; y++ ) { // same background as the scroll area
+      scrollBgSprite.pushSprite( &BLECardSprite, 0, y );
+    }
+  }
+  uint16_t println( const char* str ) {
+    if( !offscreen ) return Out.println( str );
+    bool isSpace = strcmp( str, SPACE ) == 0;
+    if( !isSpace && Out.serialEcho ) {
+      Serial.println( str );
+    }
+    uint16_t h = gfx->fontHeight();
+    if( cursorY + h > height ) {
+      log_w("BLE card overflow, increase BLECARD_MAX_LINES");
+      return h;
+    }
+    if( !isSpace ) {
+      gfx->drawString( str, 0, cursorY );
+    }
+    cursorY += h;
+    return h;
+  }
+  // y position of the line printed 'hop' pixels ago
+  int16_t lineY( uint16_t hop ) {
+    return offscreen ? cursorY - hop : Out.scrollPosY - hop;
+  }
+};
+
+// per card render time
+static uint32_t BLECardRenderCount   = 0;
+static uint32_t BLECardRenderTotalUs = 0;
+static uint32_t BLECardRenderMaxUs   = 0;
+
+
 // load icons panel
 #include "UI_Icons.h"
 // then load SDutils as it uses the icons panel
 #include "SDUtils.h"
+// scan task => UI task events
+#include "RenderQueue.h"
+// dirty regions flushed once per frame
+#include "Compositor.h"
 
 
 TaskHandle_t ClockSyncTaskHandle;
 TaskHandle_t DrawableItemsTaskHandle;
 TaskHandle_t HeapGraphTaskHandle;
+TaskHandle_t CompositorTaskHandle;
 
 static bool ClockSyncTaskIsRunning = false;
 static bool DrawableItemsTaskIsRunning = false;
 static bool HeapGraphTaskIsRunning = false;
+static bool CompositorTaskIsRunning = false;
+
+static char compositorHeaderText[RENDERQUEUE_TEXT_LEN] = {0};
+
+struct HallOfMacSlot {
+  bool changed = false;
+  bool empty   = true;
+  char address[MAC_LEN+1] = {0};
+};
+static HallOfMacSlot *hallOfMacSlots = NULL; // filled by clockSync, drawn by the compositor
 
 
 class UIUtils {
@@ -223,7 +288,7 @@ class UIUtils {
       tft_setBrightness( brightness );
 
       // start heap graph
-      xTaskCreatePinnedToCore(taskHeapGraph, "taskHeapGraph", 1024, (void*)this, 0, &HeapGraphTaskHandle, HEAPGRAPH_CORE );
+      spawnTask(taskHeapGraph, "taskHeapGraph", 1024, (void*)this, 0, &HeapGraphTaskHandle, HEAPGRAPH_CORE );
 
       // make sure non-printable chars aren't printed (also disables utf8)
       tft.setAttribute( lgfx::cp437_switch, true );
@@ -231,7 +296,9 @@ class UIUtils {
       Out.init();
       setUISizePos(); // set position/dimensions for widgets and other UI items
 
+      IconAtlas.build(); // decode all jpeg icons once, IconRender() then only pushes pixels
       setIconBar(); // setup icon bar
+      setCompositorRegions(); // needs the icon bar dimensions
 /*
       // test icons from the icon bar
       struct DrawSet {
@@ -327,6 +394,19 @@ class UIUtils {
 
       Out.setupScrollArea( headerHeight, footerHeight, colorstart, colorend );
 
+      // off-screen BLE card, PSRAM only: on internal heap it would pin ~80KB for the whole session,
+      // printBLECard() falls back to line by line rendering without it
+      if( psramInit() ) {
+        BLECardSprite.setPsram( true );
+        BLECardSprite.setColorDepth( 16 );
+        BLECardSprite.setAttribute( lgfx::cp437_switch, true );
+        if( !BLECardSprite.createSprite( Out.width, BLECARD_MAX_LINES * tft.fontHeight() ) ) {
+          log_w("Not enough memory for the BLE card sprite, cards will be rendered line by line");
+        }
+      } else {
+        log_d("No PSRAM, BLE cards will be rendered line by line");
+      }
+
       //uint32_t tftstatus = tft.readCommand( 0x09 );
       //log_n("TFT Status = 0x%08X", tftstatus ); // 0x00245384 before setup scroll and 0x00A45284 after
 
@@ -389,7 +469,7 @@ class UIUtils {
       takeMuxSemaphore();
       Out.scrollNextPage();
       giveMuxSemaphore();
-      xTaskCreatePinnedToCore(introUntilScroll, "introUntilScroll", 2048, NULL, 8, NULL, SCROLLINTRO_CORE );
+      spawnTask(introUntilScroll, "introUntilScroll", 2048, NULL, 8, NULL, SCROLLINTRO_CORE );
     }
 
 
@@ -397,12 +477,18 @@ class UIUtils {
       if( ClockSyncTaskIsRunning )     destroyTaskNow( ClockSyncTaskHandle );
       if( DrawableItemsTaskIsRunning ) destroyTaskNow( DrawableItemsTaskHandle );
       if( HeapGraphTaskIsRunning )     destroyTaskNow( HeapGraphTaskHandle );
+      if( CompositorTaskIsRunning )    destroyTaskNow( CompositorTaskHandle );
+      takeMuxSemaphore();
+      Out.scrollAnimated = false; // nobody left to uncover the cards
+      Out.scrollFinish();
+      giveMuxSemaphore();
     }
 
 
     static void screenShot() {
 
       takeMuxSemaphore();
+      Out.scrollFinish(); // capture the last card whole
       isQuerying = true;
 
       /*
@@ -533,7 +619,7 @@ class UIUtils {
     }
 
 
-    void footerStats() {
+    static void footerStats() {
       if ( isInScroll() || isInQuery() ) return;
       takeMuxSemaphore();
       int16_t posX = tft.getCursorX();
@@ -548,7 +634,7 @@ class UIUtils {
     }
 
 
-    void cacheStats() {
+    static void cacheStats() {
       takeMuxSemaphore();
       percentBox( percentBoxX, percentBoxY - 3*(percentBoxSize+2), percentBoxSize, percentBoxSize, BLEDevCacheUsed, BLE_CYAN,        BLE_BLACK);
       percentBox( percentBoxX, percentBoxY - 2*(percentBoxSize+2), percentBoxSize, percentBoxSize, VendorCacheUsed, BLE_ORANGE,      BLE_BLACK);
@@ -673,7 +759,7 @@ class UIUtils {
     // spawn subtasks and leave
     static void taskHeapGraph( void * param = NULL ) { // always running
       HeapGraphTaskIsRunning = true;
-      mux = xSemaphoreCreateMutex();
+      mux = xSemaphoreCreateRecursiveMutex();
       takeMuxSemaphore();
       for( uint16_t i = 0; i < hallOfMacSize; i++ ) {
         uint16_t x = hallOfMacPosX + (i%hallofMacCols) * hallOfMacItemWidth;
@@ -685,8 +771,11 @@ class UIUtils {
       heapGraphSprite.createSprite( graphLineWidth, graphLineHeight );
       giveMuxSemaphore();
 
-      xTaskCreatePinnedToCore(clockSync, "clockSync", 2048, param, 2, &ClockSyncTaskHandle, CLOCKSYNC_CORE ); // RTC wants to run on core 1 or it fails
-      xTaskCreatePinnedToCore(drawableItems, "drawableItems", 6144, param, 2, &DrawableItemsTaskHandle, STATUSBAR_CORE );
+      RenderQueue.init();
+
+      spawnTask(clockSync, "clockSync", 2048, param, 2, &ClockSyncTaskHandle, CLOCKSYNC_CORE ); // RTC wants to run on core 1 or it fails
+      spawnTask(drawableItems, "drawableItems", 6144, param, 2, &DrawableItemsTaskHandle, STATUSBAR_CORE );
+      spawnTask(compositorTask, "compositorTask", 6144, param, 3, &CompositorTaskHandle, COMPOSITOR_CORE );
       HeapGraphTaskIsRunning = false;
       vTaskDelete(NULL);
     }
@@ -719,15 +808,109 @@ class UIUtils {
         }
 
         PrintBlinkableWidgets();
-        BLECollectorIconBar.draw( BLECollectorIconBarX, BLECollectorIconBarY );
+        if( BLECollectorIconBar.isDirty() ) {
+          Compositor.markDirty( COMPOSITOR_ICONBAR );
+        }
         vTaskDelay( 100 );
       }
     }
 
+    // one frame = drain the render queue + flush dirty regions, all in a single SPI transaction
+    static void compositorTask( void * param ) {
+      CompositorTaskIsRunning = true;
+      UIUtils *_UI = (UIUtils*)param;
+      TickType_t lastWaketime = xTaskGetTickCount();
+      Out.scrollAnimated = true;
+
+      while(1) {
+        if( Compositor.beginFrame() ) {
+          if( RenderQueue.takeCountersPending() ) {
+            Compositor.markDirty( COMPOSITOR_COUNTERS );
+          }
+          if( Out.scrollPending() > 0 ) {
+            // a few rows per frame, faster when more events are waiting
+            Out.scrollStep( SCROLL_ROWS_PER_FRAME * ( 1 + RenderQueue.size() ) );
+            Compositor.markDirty( COMPOSITOR_SCROLL );
+          }
+          uint8_t batchSize = RenderQueue.size(); // don't chase the producer, leftovers go to the next frame
+          RenderEvent *evt;
+          while( batchSize-- > 0 && ( evt = RenderQueue.peek() ) != NULL ) {
+            if( evt->type == RENDER_EVENT_CARD && Out.scrollPending() > 0 ) break; // next card once the last one is uncovered
+            switch( evt->type ) {
+              case RENDER_EVENT_CARD:
+                _UI->printBLECard( (BlueToothDeviceLink){.cacheIndex=evt->cacheIndex,.device=evt->device} ); // render
+                Compositor.markDirty( COMPOSITOR_SCROLL );
+              break;
+              case RENDER_EVENT_HEADER: // only the last message of the batch is visible
+                if( Compositor.isDirty( COMPOSITOR_HEADER ) ) RenderQueue.coalesced++;
+                memcpy( compositorHeaderText, evt->text, RENDERQUEUE_TEXT_LEN );
+                Compositor.markDirty( COMPOSITOR_HEADER );
+              break;
+              case RENDER_EVENT_COUNTERS:
+                if( Compositor.isDirty( COMPOSITOR_COUNTERS ) ) RenderQueue.coalesced++;
+                Compositor.markDirty( COMPOSITOR_COUNTERS );
+              break;
+            }
+            RenderQueue.release();
+          }
+          if( RenderQueue.takeHeaderPending( compositorHeaderText ) ) {
+            Compositor.markDirty( COMPOSITOR_HEADER );
+          }
+          Compositor.flushDirty();
+          Compositor.endFrame();
+        }
+        vTaskDelayUntil(&lastWaketime, (1000 / UI_FPS) / portTICK_PERIOD_MS);
+      }
+    }
+
+    static void compositorHeaderFlush() {
+      headerStats( compositorHeaderText );
+    }
+
+    static void compositorCountersFlush() {
+      cacheStats();
+      footerStats();
+    }
+
+    static void compositorIconBarFlush() {
+      BLECollectorIconBar.draw( BLECollectorIconBarX, BLECollectorIconBarY );
+    }
+
+    static void compositorHeapGraphFlush() {
+      heapGraphSprite.pushSprite( graphX, graphY );
+    }
+
+    static void compositorHallOfMacFlush() {
+      for( uint16_t i = 0; i < hallOfMacSize; i++ ) {
+        if( !hallOfMacSlots[i].changed ) continue;
+        hallOfMacSlots[i].changed = false;
+        uint16_t x = hallOfMacPosX + (i%hallofMacCols) * hallOfMacItemWidth;
+        uint16_t y = hallOfMacPosY + ((i/hallofMacCols)%hallofMacRows) * hallOfMacItemHeight;
+        // no clearing animation here, it would stall the frame
+        tft.fillRect( x, y, hallOfMacItemWidth, hallOfMacItemHeight, FOOTER_BGCOLOR );
+        if( !hallOfMacSlots[i].empty ) {
+          MacAddressColors AvatarizedMAC( hallOfMacSlots[i].address, 2, 1 );
+          AvatarizedMAC.spriteDraw( &hallOfMacSprite, hallOfMacHmargin + x, hallOfMacVmargin + y );
+        }
+      }
+    }
+
+    void setCompositorRegions() {
+      Compositor.setRegion( COMPOSITOR_HEADER,    "header",    0, headerStatsIconsY + headerLineHeight, iconAppX, 8, &compositorHeaderFlush );
+      Compositor.setRegion( COMPOSITOR_COUNTERS,  "counters",  percentBoxX, percentBoxY - 3*(percentBoxSize+2), percentBoxSize, 3*(percentBoxSize+2), &compositorCountersFlush );
+      Compositor.setRegion( COMPOSITOR_ICONBAR,   "iconbar",   BLECollectorIconBarX, BLECollectorIconBarY, BLECollectorIconBar.width, BLECollectorIconBar.height, &compositorIconBarFlush );
+      Compositor.setRegion( COMPOSITOR_HEAPGRAPH, "heapgraph", graphX, graphY, graphLineWidth, graphLineHeight, &compositorHeapGraphFlush );
+      Compositor.setRegion( COMPOSITOR_HALLOFMAC, "hallofmac", hallOfMacPosX, hallOfMacPosY, hallofMacCols*hallOfMacItemWidth, hallofMacRows*hallOfMacItemHeight, &compositorHallOfMacFlush );
+      Compositor.setRegion( COMPOSITOR_SCROLL,    "scroll",    0, headerHeight, Out.width, scrollHeight );
+    }
+
     static void hallOfMac( int32_t * sorted, int32_t * lastsorted ) {
 
 
       if( !RamCacheReady ) return;
+      if( Compositor.isDirty( COMPOSITOR_HALLOFMAC ) ) {
+        return; // previous ranking not drawn yet, slots are still in use
+      }
 
       // get the n top hits in the cache ( n=hallOfMacSize )
       size_t macFound = 0;
@@ -763,32 +946,30 @@ class UIUtils {
           }
         }
       }
+      bool changed = false;
       if( macFound > 0 ) {
+        // only copy the changed slots, the compositor draws them
         for( uint16_t i = 0; i < hallOfMacSize; i++ ) {
-          uint16_t x = hallOfMacPosX + (i%hallofMacCols) * hallOfMacItemWidth;
-          uint16_t y = hallOfMacPosY + ((i/hallofMacCols)%hallofMacRows) * hallOfMacItemHeight;
           if( i<macFound ) {
             if( lastsorted[i] != sorted[i] ) {
-              //takeMuxSemaphore();
-              // cleanup current slot
-              animClear( x, y, hallOfMacItemWidth, hallOfMacItemHeight, FOOTER_BGCOLOR, BLE_WHITE );
-              // draw current slot
-              MacAddressColors AvatarizedMAC( BLEDevRAMCache[sorted[i]]->address, 2, 1 );
-              AvatarizedMAC.spriteDraw( &hallOfMacSprite, hallOfMacHmargin + x, hallOfMacVmargin + y );
-              //giveMuxSemaphore();
+              memcpy( hallOfMacSlots[i].address, BLEDevRAMCache[sorted[i]]->address, MAC_LEN+1 );
+              hallOfMacSlots[i].empty   = false;
+              hallOfMacSlots[i].changed = true;
+              changed = true;
             }
           } else {
             if( lastsorted[i] > 0 ) {
-              //takeMuxSemaphore();
-              //tft.fillRect( hallOfMacHmargin + x, hallOfMacVmargin + y, hallOfMacItemWidth, hallOfMacItemHeight, FOOTER_BGCOLOR );
-              animClear( x, y, hallOfMacItemWidth, hallOfMacItemHeight, FOOTER_BGCOLOR, BLE_WHITE );
-              //giveMuxSemaphore();
+              hallOfMacSlots[i].empty   = true;
+              hallOfMacSlots[i].changed = true;
+              changed = true;
             }
           }
         }
-        //Serial.println();
       }
       giveMuxSemaphore();
+      if( changed ) {
+        Compositor.markDirty( COMPOSITOR_HALLOFMAC );
+      }
     }
 
     static void textCounters() {
@@ -880,6 +1061,7 @@ class UIUtils {
 
       int32_t *sorted     = new int32_t[hallOfMacSize+1];
       int32_t *lastsorted = new int32_t[hallOfMacSize+1];
+      hallOfMacSlots      = new HallOfMacSlot[hallOfMacSize];
 
       for( uint16_t i = 0; i< hallOfMacSize; i++ ) {
         sorted[i]     = -1;
@@ -894,6 +1076,7 @@ class UIUtils {
           takeMuxSemaphore();
           timeHousekeeping();
           giveMuxSemaphore();
+          Compositor.markDirty( COMPOSITOR_COUNTERS ); // footer clock
         } else {
           uptimeSet();
         }
@@ -916,6 +1099,9 @@ class UIUtils {
       if( ! devCountWasUpdated ) {
         return;
       }
+      if( Compositor.isDirty( COMPOSITOR_HEAPGRAPH ) ) {
+        return; // previous frame not flushed yet, sprite is still in use
+      }
       devCountWasUpdated = false;
 
       // render heatmap
@@ -1036,14 +1222,22 @@ class UIUtils {
         // join last/first
         heapGraphSprite.drawLine( dcpmLastX, dcpmLastY, graphLineWidth, dcpmFirstY, BLE_DARKBLUE );
       }
-      takeMuxSemaphore();
-      heapGraphSprite.pushSprite( graphX, graphY );
-      giveMuxSemaphore();
+      if( LatencyStats.graph ) {
+        // share of the pipeline time per scan stage: store, populate, ifexists, render, propagate
+        const uint16_t stageColors[STAGE_SCAN] = { BLE_GREEN, BLE_YELLOW, BLE_ORANGE, BLUETOOTH_COLOR, BLE_RED };
+        uint16_t stageX = 0;
+        for( uint8_t i=0; i<STAGE_SCAN; i++ ) {
+          uint16_t stageWidth = LatencyStats.share( (ScanStage)i ) * graphLineWidth / 1000;
+          heapGraphSprite.fillRect( stageX, graphLineHeight-3, stageWidth, 3, stageColors[i] );
+          stageX += stageWidth;
+        }
+      }
+      Compositor.markDirty( COMPOSITOR_HEAPGRAPH );
     }
 
 
     void printBLECard( BlueToothDeviceLink BleLink /*BlueToothDevice *BleCard*/ ) {
-      //unsigned long renderstart = millis();
+      unsigned long renderstart = micros();
       BlueToothDevice *BleCard = BleLink.device;
       // don't render if already on screen
       if( BLECardIsOnScreen( BleCard->address ) ) {
@@ -1067,6 +1261,10 @@ class UIUtils {
 
       takeMuxSemaphore();
 
+      BLECardCanvas Card;
+      Card.begin();
+      lgfx::LovyanGFX *gfx = Card.gfx;
+
       //MacScrollView
       uint16_t blockHeight = 0;
       uint16_t hop;
@@ -1091,36 +1289,38 @@ class UIUtils {
           BLECardTheme.setTheme( NOT_IN_CACHE_ANON );
         }
       }
-      tft.setTextColor( BLECardTheme.textColor, BLECardTheme.bgColor );
+      gfx->setTextColor( BLECardTheme.textColor, BLECardTheme.bgColor );
 
       BGCOLOR = BLECardTheme.bgColor;
-      hop = Out.println( SPACE );
+      hop = Card.println( SPACE );
       blockHeight += hop;
 
-      hop = Out.println( addressStr );
+      hop = Card.println( addressStr );
       blockHeight += hop;
 
-      alignTextAt( dbmStr, 0, Out.scrollPosY - hop, BLECardTheme.textColor, BLECardTheme.bgColor, ALIGN_RIGHT );
-      tft.setCursor( 0, Out.scrollPosY );
-      drawRSSIBar( Out.width - 18, Out.scrollPosY - hop - 1, BleCard->rssi, BLECardTheme.textColor );
+      gfx->drawString( dbmStr, Out.width - gfx->textWidth( dbmStr ), Card.lineY( hop ) ); // right aligned
+      if( !Card.offscreen ) {
+        tft.setCursor( 0, Out.scrollPosY );
+      }
+      drawRSSIBar( Out.width - 18, Card.lineY( hop ) - 1, BleCard->rssi, BLECardTheme.textColor, 1.0, gfx );
       if ( BleCard->in_db ) { // 'already seen this' icon
-        IconRender( Icon8x8_update_src, 138, Out.scrollPosY - hop );
+        IconRender( Icon8x8_update_src, 138, Card.lineY( hop ), gfx );
       } else { // 'just inserted this' icon
-        IconRender( TextCounters_seen_src, 138, Out.scrollPosY - hop );
+        IconRender( TextCounters_seen_src, 138, Card.lineY( hop ), gfx );
       }
       if ( !isEmpty( BleCard->uuid ) ) { // 'has service UUID' Icon
-        IconRender( Icon8x8_service_src, 128, Out.scrollPosY - hop );
+        IconRender( Icon8x8_service_src, 128, Card.lineY( hop ), gfx );
       }
 
       switch( BleCard->hits ) {
         case 0:
-          IconRender( TextCounters_entries_src, 118, Out.scrollPosY - hop );
+          IconRender( TextCounters_entries_src, 118, Card.lineY( hop ), gfx );
         break;
         case 1:
-          IconRender( TextCounters_scans_src, 118, Out.scrollPosY - hop );
+          IconRender( TextCounters_scans_src, 118, Card.lineY( hop ), gfx );
         break;
         default:
-          IconRender( TextCounters_heap_src, 118, Out.scrollPosY - hop );
+          IconRender( TextCounters_heap_src, 118, Card.lineY( hop ), gfx );
         break;
       }
 
@@ -1149,7 +1349,7 @@ class UIUtils {
           }
 
           if( BleCard->created_at.year() > 1970 ) {
-            blockHeight += Out.println(SPACE);
+            blockHeight += Card.println(SPACE);
             *hitsTimeStampStr = {'\0'};
             sprintf(hitsTimeStampStr, hitsTimeStampTpl,
               BleCard->created_at.year(),
@@ -1160,9 +1360,9 @@ class UIUtils {
               BleCard->created_at.second(),
               hitsStr
             );
-            hop = Out.println( hitsTimeStampStr );
+            hop = Card.println( hitsTimeStampStr );
             blockHeight += hop;
-            IconRender( TimeIcon_SET_src, 12, Out.scrollPosY - hop );
+            IconRender( TimeIcon_SET_src, 12, Card.lineY( hop ), gfx );
           }
         }
       }
@@ -1176,93 +1376,100 @@ class UIUtils {
 
         // TODO: icon render
         if( strcmp( srv.name, "Unknown" ) != 0 ) {
-          blockHeight += Out.println( SPACE );
+          blockHeight += Card.println( SPACE );
           *ouiStr = {'\0'};
           sprintf( ouiStr, ouiTpl, srv.name );
-          hop = Out.println( ouiStr );
+          hop = Card.println( ouiStr );
           blockHeight += hop;
         }
       }
 
       if ( !isEmpty( BleCard->ouiname ) ) {
-        blockHeight += Out.println( SPACE );
+        blockHeight += Card.println( SPACE );
         *ouiStr = {'\0'};
         sprintf( ouiStr, ouiTpl, BleCard->ouiname );
-        hop = Out.println( ouiStr );
+        hop = Card.println( ouiStr );
         blockHeight += hop;
         if ( strstr( BleCard->ouiname, "Espressif" ) ) {
-          IconRender( Icon8x8_espressif_src, 11, Out.scrollPosY - hop );
+          IconRender( Icon8x8_espressif_src, 11, Card.lineY( hop ), gfx );
         } else {
-          IconRender( Icon8h_nic16_src, 10, Out.scrollPosY - hop );
+          IconRender( Icon8h_nic16_src, 10, Card.lineY( hop ), gfx );
         }
       }
 
       bool jumpNext = true;
-      if( macAddrColorsSizeY <= Out.h_tmp ) {
-        AvatarizedMAC.chopDraw( macAddrColorsPosX, Out.scrollPosY - hop, macAddrColorsSizeY );
+      uint16_t lineHeight = gfx->fontHeight();
+      if( macAddrColorsSizeY <= lineHeight ) {
+        AvatarizedMAC.chopDraw( macAddrColorsPosX, Card.lineY( hop ), macAddrColorsSizeY, gfx );
       } else {
         // chop-chop!
         int16_t sizeY = macAddrColorsSizeY;
-        while( sizeY >= Out.h_tmp ) {
-          sizeY -= Out.h_tmp;
-          AvatarizedMAC.chopDraw( macAddrColorsPosX, Out.scrollPosY - hop, Out.h_tmp );
-          if( sizeY >= Out.h_tmp ) {
-            blockHeight += Out.println(SPACE);
+        while( sizeY >= lineHeight ) {
+          sizeY -= lineHeight;
+          AvatarizedMAC.chopDraw( macAddrColorsPosX, Card.lineY( hop ), lineHeight, gfx );
+          if( sizeY >= lineHeight ) {
+            blockHeight += Card.println(SPACE);
           }
         }
         jumpNext = false;
       }
       if ( BleCard->appearance != 0 ) {
         if( jumpNext ) {
-          blockHeight += Out.println(SPACE);
+          blockHeight += Card.println(SPACE);
         } else {
           jumpNext = true;
         }
         *appearanceStr = {'\0'};
         sprintf( appearanceStr, appearanceTpl, BleCard->appearance );
-        hop = Out.println( appearanceStr );
+        hop = Card.println( appearanceStr );
         blockHeight += hop;
       }
       if ( !isEmpty( BleCard->manufname ) ) {
         if( jumpNext ) {
-          blockHeight += Out.println(SPACE);
+          blockHeight += Card.println(SPACE);
         } else {
           jumpNext = true;
         }
         *manufStr = {'\0'};
         sprintf( manufStr, manufTpl, BleCard->manufname );
-        hop = Out.println( manufStr );
+        hop = Card.println( manufStr );
         blockHeight += hop;
         if ( strstr( BleCard->manufname, "Apple" ) ) {
-          IconRender( Icon8x8_apple16_src, 12, Out.scrollPosY - hop );
+          IconRender( Icon8x8_apple16_src, 12, Card.lineY( hop ), gfx );
         } else if ( strstr( BleCard->manufname, "IBM" ) ) {
-          IconRender( Icon8h_ibm8_src, 10, Out.scrollPosY - hop );
+          IconRender( Icon8h_ibm8_src, 10, Card.lineY( hop ), gfx );
         } else if ( strstr (BleCard->manufname, "Microsoft" ) ) {
-          IconRender( Icon8x8_crosoft_src, 12, Out.scrollPosY - hop );
+          IconRender( Icon8x8_crosoft_src, 12, Card.lineY( hop ), gfx );
         } else if ( strstr( BleCard->manufname, "Bose" ) ) {
-          IconRender( Icon8h_speaker_src, 12, Out.scrollPosY - hop );
+          IconRender( Icon8h_speaker_src, 12, Card.lineY( hop ), gfx );
         } else {
-          IconRender( Icon8x8_generic_src, 12, Out.scrollPosY - hop );
+          IconRender( Icon8x8_generic_src, 12, Card.lineY( hop ), gfx );
         }
       }
       if ( !isEmpty( BleCard->name ) ) {
         *nameStr = {'\0'};
         sprintf(nameStr, nameTpl, BleCard->name);
         if( jumpNext ) {
-          blockHeight += Out.println(SPACE);
+          blockHeight += Card.println(SPACE);
         } else {
           jumpNext = true;
         }
-        hop = Out.println( nameStr );
+        hop = Card.println( nameStr );
         blockHeight += hop;
-        IconRender( Icon8h_name_src, 12, Out.scrollPosY - hop );
+        IconRender( Icon8h_name_src, 12, Card.lineY( hop ), gfx );
       }
-      hop = Out.println( SPACE) ;
+      hop = Card.println( SPACE) ;
       blockHeight += hop;
       uint16_t boxHeight = blockHeight-2;
       uint16_t boxWidth  = Out.width - 2;
       uint16_t boxPosY   = initialPosY + 1;
-      Out.drawScrollableRoundRect( 1, boxPosY, boxWidth, boxHeight, 4, BLECardTheme.borderColor );
+      if( Card.offscreen ) {
+        BLECardSprite.drawRoundRect( 1, 1, boxWidth, boxHeight, 4, BLECardTheme.borderColor );
+        Out.pushBlock( &BLECardSprite, blockHeight ); // single transfer
+        boxPosY = Out.translate( Out.scrollPosY, -blockHeight ) + 1;
+      } else {
+        Out.drawScrollableRoundRect( 1, boxPosY, boxWidth, boxHeight, 4, BLECardTheme.borderColor );
+      }
       lastPrintedMacIndex++;
       lastPrintedMacIndex = lastPrintedMacIndex % BLECARD_MAC_CACHE_SIZE;
       memcpy( MacScrollView[lastPrintedMacIndex].address, BleCard->address, MAC_LEN+1 );
@@ -1272,9 +1479,11 @@ class UIUtils {
       MacScrollView[lastPrintedMacIndex].cacheIndex = BleLink.cacheIndex;
       giveMuxSemaphore();
 
-      //unsigned long rendertime = millis() - renderstart;
-      //log_w("Rendered %s in %d ms", BleCard->address, rendertime );
-
+      uint32_t rendertime = micros() - renderstart;
+      BLECardRenderCount++;
+      BLECardRenderTotalUs += rendertime;
+      if( rendertime > BLECardRenderMaxUs ) BLECardRenderMaxUs = rendertime;
+      log_i("Rendered %s in %d us (%s, avg: %d us, max: %d us)", BleCard->address, rendertime, Card.offscreen ? "sprite" : "direct", BLECardRenderTotalUs / BLECardRenderCount, BLECardRenderMaxUs );
     }
 
 
@@ -1381,6 +1590,10 @@ class UIUtils {
 
     // draws a RSSI Bar for the BLECard
     static void drawRSSIBar(int16_t x, int16_t y, int16_t rssi, uint16_t bgcolor, float size=1.0) {
+      drawRSSIBar( x, y, rssi, bgcolor, size, &tft );
+    }
+
+    static void drawRSSIBar(int16_t x, int16_t y, int16_t rssi, uint16_t bgcolor, float size, lgfx::LovyanGFX *gfx) {
       uint16_t barColors[4] = { bgcolor, bgcolor, bgcolor, bgcolor };
       switch(rssi%6) {
       case 5:
@@ -1411,10 +1624,10 @@ class UIUtils {
           barColors[0] = BLE_RED; // want: RAINBOW
         break;
       }
-      tft.fillRect(x,          y + 4*size, 2*size, 4*size, barColors[0]);
-      tft.fillRect(x + 3*size, y + 3*size, 2*size, 5*size, barColors[1]);
-      tft.fillRect(x + 6*size, y + 2*size, 2*size, 6*size, barColors[2]);
-      tft.fillRect(x + 9*size, y + 1*size, 2*size, 7*size, barColors[3]);
+      gfx->fillRect(x,          y + 4*size, 2*size, 4*size, barColors[0]);
+      gfx->fillRect(x + 3*size, y + 3*size, 2*size, 5*size, barColors[1]);
+      gfx->fillRect(x + 6*size, y + 2*size, 2*size, 6*size, barColors[2]);
+      gfx->fillRect(x + 9*size, y + 1*size, 2*size, 7*size, barColors[3]);
     }
 
   private:
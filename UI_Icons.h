@@ -99,6 +99,7 @@ struct IconBar;
 
 bool IconRender( Icon *icon, uint16_t offsetX, uint16_t offsetY );
 void IconRender( const IconSrc* src, uint16_t x, uint16_t y );
+void IconRender( const IconSrc* src, uint16_t x, uint16_t y, lgfx::LovyanGFX *gfx );
 void IconRender( IconWidget* widget, uint16_t posX, uint16_t posY, uint16_t width, uint16_t height, uint16_t offsetX, uint16_t offsetY, uint16_t bgcolor );
 void IconRender( IconShape *shape, uint16_t posX, uint16_t posY, uint16_t width, uint16_t height, uint16_t offsetX, uint16_t offsetY );
 
@@ -138,9 +139,74 @@ struct IconSrc {
   size_t   jpeg_len;
   uint16_t width;
   uint16_t height;
-  IconSrc(const unsigned char *j, size_t l, uint16_t w, uint16_t h) : jpeg{j}, jpeg_len{l}, width{w}, height{h} { };
+  const lgfx::swap565_t *pixels = nullptr; // decoded copy in the icon atlas, nullptr until IconAtlas.build()
+  IconSrc  *next = nullptr; // registry link, every IconSrc is known to the atlas
+  static IconSrc *first;
+  IconSrc(const unsigned char *j, size_t l, uint16_t w, uint16_t h) : jpeg{j}, jpeg_len{l}, width{w}, height{h} {
+    next  = first;
+    first = this;
+  };
 };
 
+IconSrc *IconSrc::first = nullptr;
+
+
+// Decodes every registered IconSrc once into a single RGB565 buffer so that
+// rendering an icon is a plain pixel push instead of a JPEG decode.
+struct IconAtlasUtils {
+  lgfx::swap565_t *buffer = nullptr;
+  size_t pixels = 0;
+  uint16_t icons = 0;
+
+  bool build() {
+    if( buffer != nullptr ) return true;
+    uint16_t maxw = 0, maxh = 0;
+    pixels = 0;
+    for( IconSrc *src = IconSrc::first; src != nullptr; src = src->next ) {
+      pixels += src->width * src->height;
+      if( src->width  > maxw ) maxw = src->width;
+      if( src->height > maxh ) maxh = src->height;
+    }
+    if( pixels == 0 ) return false;
+    // icons are pushed to the display/sprites, keep them in internal ram when possible
+    buffer = (lgfx::swap565_t*)malloc( pixels * sizeof(lgfx::swap565_t) );
+    if( buffer == nullptr && psramInit() ) {
+      buffer = (lgfx::swap565_t*)ps_malloc( pixels * sizeof(lgfx::swap565_t) );
+    }
+    if( buffer == nullptr ) {
+      log_e("Not enough memory for the icon atlas (%d bytes), icons will be decoded on render", pixels * sizeof(lgfx::swap565_t));
+      return false;
+    }
+    TFT_eSprite decoder = TFT_eSprite( &tft );
+    decoder.setColorDepth( 16 );
+    if( !decoder.createSprite( maxw, maxh ) ) {
+      log_e("Can't create icon decoder sprite [%d*%d]", maxw, maxh);
+      free( buffer );
+      buffer = nullptr;
+      return false;
+    }
+    lgfx::swap565_t *decoded = (lgfx::swap565_t*)decoder.getBuffer();
+    size_t offset = 0;
+    icons = 0;
+    for( IconSrc *src = IconSrc::first; src != nullptr; src = src->next ) {
+      decoder.fillSprite( HEADER_BGCOLOR );
+      decoder.drawJpg( src->jpeg, src->jpeg_len, 0, 0 );
+      // sprite rows are maxw wide, atlas rows are src->width wide
+      for( uint16_t row=0; row<src->height; row++ ) {
+        memcpy( &buffer[offset + row*src->width], &decoded[row*maxw], src->width * sizeof(lgfx::swap565_t) );
+      }
+      src->pixels = &buffer[offset];
+      offset += src->width * src->height;
+      icons++;
+    }
+    decoder.deleteSprite();
+    log_d("Icon atlas: %d icons decoded into %d bytes", icons, pixels * sizeof(lgfx::swap565_t));
+    return true;
+  }
+};
+
+IconAtlasUtils IconAtlas;
+
 
 struct IconWidget {
   IconWidgetType type;
@@ -275,6 +341,12 @@ struct IconBar {
   void setMargin( uint8_t _margin ) {
     margin = _margin;
   }
+  bool isDirty() {
+    for( byte i=0; i<totalIcons; i++ ) {
+      if( icons[i]->render ) return true;
+    }
+    return false;
+  }
   void draw(uint16_t x, uint16_t y ) {
     uint16_t posx = 0;
     uint8_t rendered = 0;
@@ -290,7 +362,20 @@ struct IconBar {
 
 // renderers
 void IconRender( const IconSrc* src, uint16_t x, uint16_t y ) {
-  tft_drawJpg( src->jpeg, src->jpeg_len, x, y );
+  if( src->pixels != nullptr ) {
+    tft.pushImage( x, y, src->width, src->height, src->pixels );
+  } else { // atlas not built (yet)
+    tft_drawJpg( src->jpeg, src->jpeg_len, x, y );
+  }
+}
+
+// same as above, on a sprite
+void IconRender( const IconSrc* src, uint16_t x, uint16_t y, lgfx::LovyanGFX *gfx ) {
+  if( src->pixels != nullptr ) {
+    gfx->pushImage( x, y, src->width, src->height, src->pixels );
+  } else {
+    gfx->drawJpg( src->jpeg, src->jpeg_len, x, y );
+  }
 }
 
 void IconRender( IconWidget* widget, uint16_t posX, uint16_t posY, uint16_t width, uint16_t height, uint16_t offsetX, uint16_t offsetY, uint16_t bgcolor ) {
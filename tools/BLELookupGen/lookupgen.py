@@ -0,0 +1,242 @@
+#!/usr/bin/env python3
+"""
+  ESP32 BLE Collector - lookup table generator
+
+  Builds the OUI and BLE company ID lookup tables (mac-oui-light.lkp and
+  ble-oui.lkp, see LookupTable.h) from the upstream lists:
+
+    - Wireshark manuf: https://www.wireshark.org/download/automated/data/manuf
+    - Bluetooth SIG company identifiers (assigned_numbers/company_identifiers/
+      company_identifiers.yaml from https://bitbucket.org/bluetooth-SIG/public)
+
+  Copy the generated files to the root of the SD card, or swap them in on a
+  running device with the 'lookups' serial command or a BLE file copy.
+
+  Usage:
+    lookupgen.py build --manuf manuf --companies company_identifiers.yaml --out SD/
+    lookupgen.py verify SD/mac-oui-light.lkp SD/ble-oui.lkp
+    lookupgen.py find SD/mac-oui-light.lkp B4:99:BA
+
+  MIT License, Copyright (c) 2018 tobozo
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+import time
+import urllib.request
+import zlib
+
+MAGIC        = b"BLKP"
+VERSION      = 2
+GENERATED    = 0x01
+OFFSET_LEN   = 3   # string pool offsets are 24 bits
+MAX_NAME_LEN = 31  # MAX_FIELD_LEN-1 in the firmware
+HEADER       = struct.Struct("<4sBBBBIIIII")  # LookupHeader
+
+OUI_FILE    = "mac-oui-light.lkp"
+VENDOR_FILE = "ble-oui.lkp"
+
+
+def read_source(source):
+    if re.match(r"^https?://", source):
+        with urllib.request.urlopen(source) as response:
+            return response.read().decode("utf-8")
+    with open(source, encoding="utf-8") as f:
+        return f.read()
+
+
+def truncate(name):
+    """ cuts to MAX_NAME_LEN bytes without splitting an UTF-8 sequence """
+    raw = name.strip().encode("utf-8")
+    while len(raw) > MAX_NAME_LEN:
+        name = name[:-1]
+        raw = name.encode("utf-8")
+    return raw
+
+
+def parse_manuf(text):
+    """ 24 bits prefixes only, the long name when there is one """
+    entries = {}
+    for line in text.splitlines():
+        line = line.split("#", 1)[0].rstrip()
+        if not line:
+            continue
+        fields = [f.strip() for f in line.split("\t") if f.strip()]
+        if len(fields) < 2:
+            continue
+        prefix = fields[0]
+        if "/" in prefix:
+            prefix, bits = prefix.split("/", 1)
+            if int(bits) != 24:
+                continue
+        digits = prefix.replace(":", "").replace("-", "").replace(".", "")
+        if len(digits) != 6 or not re.match(r"^[0-9A-Fa-f]{6}$", digits):
+            continue
+        key = int(digits, 16)
+        if key not in entries:  # first one wins, like the device compiler
+            entries[key] = fields[2] if len(fields) > 2 else fields[1]
+    return entries
+
+
+def parse_companies(text):
+    """ the SIG yaml is flat enough for a regex: '- value: 0x001D' then 'name: ...' """
+    entries = {}
+    value = None
+    for line in text.splitlines():
+        m = re.match(r"^\s*-?\s*value:\s*(0x[0-9A-Fa-f]+|\d+)\s*$", line)
+        if m:
+            value = int(m.group(1), 0)
+            continue
+        m = re.match(r"^\s*name:\s*(.*)$", line)
+        if m and value is not None:
+            name = m.group(1).strip()
+            if len(name) > 1 and name[0] == name[-1] and name[0] in "'\"":
+                quote = name[0]
+                name = name[1:-1]
+                if quote == "'":
+                    name = name.replace("''", "'")
+            if 0 <= value <= 0xffff and value not in entries and name:
+                entries[value] = name
+            value = None
+    return entries
+
+
+def build_table(entries, key_bytes, created):
+    """ returns the table bytes, identical names share their pool slot """
+    records = bytearray()
+    pool = bytearray()
+    offsets = {}
+    for key in sorted(entries):
+        name = truncate(entries[key])
+        if name not in offsets:
+            offsets[name] = len(pool)
+            pool += name + b"\0"
+        if len(pool) >= 1 << (OFFSET_LEN * 8):
+            raise ValueError("string pool overflow")
+        records += key.to_bytes(key_bytes, "little") + offsets[name].to_bytes(OFFSET_LEN, "little")
+    body = bytes(records + pool)
+    header = HEADER.pack(MAGIC, VERSION, key_bytes, key_bytes + OFFSET_LEN, GENERATED,
+                         len(entries), len(pool), 0, created, zlib.crc32(body))
+    return header + body
+
+
+def parse_table(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    if len(data) < HEADER.size:
+        raise ValueError("%s: too short" % path)
+    (magic, version, key_bytes, record_size, flags, entries, pool_size,
+     source_size, created, checksum) = HEADER.unpack_from(data)
+    if magic != MAGIC or version != VERSION:
+        raise ValueError("%s: not a v%d lookup table" % (path, VERSION))
+    if record_size != key_bytes + OFFSET_LEN:
+        raise ValueError("%s: bad record size" % path)
+    if len(data) != HEADER.size + entries * record_size + pool_size:
+        raise ValueError("%s: size mismatch" % path)
+    if zlib.crc32(data[HEADER.size:]) != checksum:
+        raise ValueError("%s: checksum mismatch" % path)
+    pool_start = HEADER.size + entries * record_size
+    previous = -1
+    for i in range(entries):
+        record = data[HEADER.size + i * record_size:HEADER.size + (i + 1) * record_size]
+        key = int.from_bytes(record[:key_bytes], "little")
+        offset = int.from_bytes(record[key_bytes:], "little")
+        if key <= previous:
+            raise ValueError("%s: records not sorted at #%d" % (path, i))
+        if offset >= pool_size:
+            raise ValueError("%s: bad pool offset at #%d" % (path, i))
+        previous = key
+    if pool_size and data[-1] != 0:
+        raise ValueError("%s: unterminated string pool" % path)
+    return {
+        "data": data, "key_bytes": key_bytes, "record_size": record_size, "flags": flags,
+        "entries": entries, "pool_size": pool_size, "source_size": source_size,
+        "created": created, "checksum": checksum, "pool_start": pool_start,
+    }
+
+
+def find(table, key):
+    data, size, kb = table["data"], table["record_size"], table["key_bytes"]
+    lo, hi = 0, table["entries"] - 1
+    while lo <= hi:
+        mid = (lo + hi) // 2
+        start = HEADER.size + mid * size
+        mid_key = int.from_bytes(data[start:start + kb], "little")
+        if mid_key == key:
+            offset = table["pool_start"] + int.from_bytes(data[start + kb:start + size], "little")
+            return data[offset:data.index(b"\0", offset)].decode("utf-8")
+        if mid_key < key:
+            lo = mid + 1
+        else:
+            hi = mid - 1
+    return None
+
+
+def cmd_build(args):
+    created = int(os.environ.get("SOURCE_DATE_EPOCH", time.time()))
+    os.makedirs(args.out, exist_ok=True)
+    outputs = []
+    if args.manuf:
+        outputs.append((OUI_FILE, parse_manuf(read_source(args.manuf)), 3))
+    if args.companies:
+        outputs.append((VENDOR_FILE, parse_companies(read_source(args.companies)), 2))
+    if not outputs:
+        sys.exit("nothing to build, give --manuf and/or --companies")
+    for filename, entries, key_bytes in outputs:
+        if not entries:
+            sys.exit("%s: no entries found in the source list" % filename)
+        path = os.path.join(args.out, filename)
+        with open(path, "wb") as f:
+            f.write(build_table(entries, key_bytes, created))
+        table = parse_table(path)
+        print("%s: %d entries, %d bytes pool, crc %08x" % (path, table["entries"], table["pool_size"], table["checksum"]))
+
+
+def cmd_verify(args):
+    failed = False
+    for path in args.tables:
+        try:
+            table = parse_table(path)
+        except (OSError, ValueError) as e:
+            print("FAIL %s" % e)
+            failed = True
+            continue
+        kind = "generated" if table["flags"] & GENERATED else "compiled from a %d bytes DB" % table["source_size"]
+        print("OK   %s: %d bytes keys, %d entries, %d bytes pool, crc %08x, %s" % (
+            path, table["key_bytes"], table["entries"], table["pool_size"], table["checksum"], kind))
+    sys.exit(1 if failed else 0)
+
+
+def cmd_find(args):
+    table = parse_table(args.table)
+    key = args.key.replace(":", "").replace("-", "")
+    key = int(key[:6], 16) if table["key_bytes"] == 3 else int(key, 0)
+    name = find(table, key)
+    print(name if name is not None else ("[private]" if table["key_bytes"] == 3 else "[unknown]"))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="BLECollector lookup table generator")
+    sub = parser.add_subparsers(dest="command")
+    build = sub.add_parser("build", help="generate the lookup tables from the source lists")
+    build.add_argument("--manuf", help="Wireshark manuf file or url")
+    build.add_argument("--companies", help="Bluetooth SIG company_identifiers.yaml file or url")
+    build.add_argument("--out", default=".", help="output directory")
+    verify = sub.add_parser("verify", help="check header, checksum and ordering of tables")
+    verify.add_argument("tables", nargs="+")
+    lookup = sub.add_parser("find", help="look up a MAC prefix or a company ID")
+    lookup.add_argument("table")
+    lookup.add_argument("key")
+    args = parser.parse_args()
+    commands = {"build": cmd_build, "verify": cmd_verify, "find": cmd_find}
+    if args.command not in commands:
+        parser.print_help()
+        sys.exit(1)
+    commands[args.command](args)
+
+
+if __name__ == "__main__":
+    main()
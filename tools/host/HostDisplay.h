@@ -0,0 +1,77 @@
+/*
+
+  Headless stand-ins for the display side (Display.h, UI.h, RenderQueue.h,
+  UI_Icons.h): what the compiled headers call on the UI either goes to the
+  log or is counted, nothing is drawn.
+
+*/
+#pragma once
+
+#define BLE_RED 0xf800
+
+// Display.h globals used outside of the UI
+static uint32_t initial_free_heap = 0;
+size_t devicesStatCount = 0;
+static bool foundTimeServer = false;
+static bool foundFileServer = false;
+static bool ForceBleTime = false;
+const char* YYYYMMDD_HHMMSS_Tpl = "%04d-%02d-%02d %02d:%02d:%02d";
+static char YYYYMMDD_HHMMSS_Str[32] = "YYYY-MM-DD HH:MM:SS";
+static char hhmmssString[13] = "--:--:--";
+static char unitOutput[16] = {'\0'};
+static bool DayChangeTrigger = false;
+static bool HourChangeTrigger = false;
+
+static bool SDSetup() { return true; }
+
+
+struct HostTFT {
+  void setTextColor( uint16_t ) { }
+};
+
+static HostTFT tft;
+
+
+struct HostOut {
+  uint16_t width = 320;
+  bool serialEcho = false;
+  void println( const char* str = "" ) { log_i( "%s", str ); }
+};
+
+static HostOut Out;
+
+
+struct HostUI {
+  bool filterVendors = false;
+  void headerStats( const char* status ) { if( status[0] != ' ' ) log_i( "[header] %s", status ); }
+  void footerStats() { }
+  void cacheStats() { }
+  void SetDBStateIcon( int ) { }
+  void PrintProgressBar( uint16_t ) { }
+  template<typename T> void printBLECard( T ) { }
+};
+
+static HostUI UI;
+
+
+enum HostIconStatus {
+  ICON_STATUS_ADV_SCAN,
+  ICON_STATUS_ADV_WHITELISTED
+};
+
+struct HostIcon {
+  void setStatus( HostIconStatus ) { }
+};
+
+static HostIcon BLEActivityIcon;
+
+
+// counts what the scan task would hand over to the UI task
+struct HostRenderQueue {
+  uint32_t cards = 0;
+  template<typename T> void pushCard( T ) { cards++; }
+  void pushHeader( const char* text ) { log_d( "[header] %s", text ); }
+  void pushCounters() { }
+};
+
+static HostRenderQueue RenderQueue;
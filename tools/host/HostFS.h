@@ -0,0 +1,114 @@
+/*
+
+  Host stand-in for the SD card: BLE_FS paths ("/blemacs.db") and SQLite paths
+  ("/sd/blemacs.db") both resolve under hostFSRoot, a plain directory.
+
+*/
+#pragma once
+
+#include <memory>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sqlite3.h>
+
+#define FILE_READ   "r"
+#define FILE_WRITE  "w"
+#define FILE_APPEND "a"
+
+static char hostFSRoot[256] = "."; // set by the host programs
+
+// "/x" => "<hostFSRoot>/x"
+static const char* hostPath( const char* path, char* out, size_t outlen ) {
+  snprintf( out, outlen, "%s%s%s", hostFSRoot, path[0] == '/' ? "" : "/", path );
+  return out;
+}
+
+
+class File {
+  public:
+    File() { }
+    File( FILE* f ) : fp( f, fclose ) { }
+    operator bool() const { return fp != nullptr; }
+    size_t read( uint8_t* buf, size_t len ) { return fp ? fread( buf, 1, len, fp.get() ) : 0; }
+    int read() { return fp ? fgetc( fp.get() ) : -1; }
+    size_t write( const uint8_t* buf, size_t len ) { return fp ? fwrite( buf, 1, len, fp.get() ) : 0; }
+    size_t write( uint8_t c ) { return write( &c, 1 ); }
+    bool seek( uint32_t pos ) { return fp && fseek( fp.get(), pos, SEEK_SET ) == 0; }
+    size_t position() { return fp ? ftell( fp.get() ) : 0; }
+    size_t size() {
+      if( !fp ) return 0;
+      struct stat st;
+      fflush( fp.get() );
+      return fstat( fileno( fp.get() ), &st ) == 0 ? st.st_size : 0;
+    }
+    int available() { return fp ? size() - position() : 0; }
+    void flush() { if( fp ) fflush( fp.get() ); }
+    void close() { fp.reset(); }
+  private:
+    std::shared_ptr<FILE> fp; // copies share the handle, like fs::File
+};
+
+
+class HostFS {
+  public:
+    bool begin() { return true; }
+    File open( const char* path, const char* mode = FILE_READ ) {
+      char full[512];
+      hostPath( path, full, sizeof(full) );
+      // "w" truncates like FILE_WRITE, read-write so LookupTable can seek back and patch the header
+      FILE* f = fopen( full, strcmp( mode, FILE_WRITE ) == 0 ? "w+b" : strcmp( mode, FILE_APPEND ) == 0 ? "ab" : "rb" );
+      return f ? File( f ) : File();
+    }
+    bool exists( const char* path ) {
+      char full[512];
+      return access( hostPath( path, full, sizeof(full) ), F_OK ) == 0;
+    }
+    bool remove( const char* path ) {
+      char full[512];
+      return ::remove( hostPath( path, full, sizeof(full) ) ) == 0;
+    }
+    bool rename( const char* from, const char* to ) {
+      char fullFrom[512], fullTo[512];
+      return ::rename( hostPath( from, fullFrom, sizeof(fullFrom) ), hostPath( to, fullTo, sizeof(fullTo) ) ) == 0;
+    }
+};
+
+static HostFS BLE_FS;
+#define BLE_FS_TYPE "sd"
+
+#ifndef HOST_SD_SEED
+  #define HOST_SD_SEED "SD"
+#endif
+
+// copies a file of the repository SD folder (reference DBs) into hostFSRoot when missing
+static bool hostSeedFile( const char* name ) {
+  if( BLE_FS.exists( name ) ) return true;
+  char seedPath[512];
+  snprintf( seedPath, sizeof(seedPath), "%s%s", HOST_SD_SEED, name );
+  FILE* in = fopen( seedPath, "rb" );
+  if( in == NULL ) {
+    log_e("Can't seed %s from %s", name, seedPath);
+    return false;
+  }
+  File out = BLE_FS.open( name, FILE_WRITE );
+  uint8_t chunk[4096];
+  size_t len;
+  while( ( len = fread( chunk, 1, sizeof(chunk), in ) ) > 0 ) {
+    out.write( chunk, len );
+  }
+  fclose( in );
+  out.close();
+  return true;
+}
+
+
+// DB.h opens "/" BLE_FS_TYPE "/<file>", the card mount point maps to hostFSRoot too
+static int hostSqliteOpen( const char* path, sqlite3** db ) {
+  const char* mountPoint = "/" BLE_FS_TYPE "/";
+  char full[512];
+  if( strncmp( path, mountPoint, strlen( mountPoint ) ) == 0 ) {
+    path = hostPath( path + strlen( mountPoint ) - 1, full, sizeof(full) );
+  }
+  return sqlite3_open( path, db );
+}
+#define sqlite3_open hostSqliteOpen
@@ -0,0 +1,106 @@
+/*
+
+  Host counterpart of Settings.h: same application headers, same order, with
+  the radio, the display and the SD card replaced by the stand-ins in this
+  directory (stubs/ shadows the Arduino, NimBLE, TimeLib, ROM and mbedtls
+  headers). Only the settings the compiled headers need are repeated here,
+  keep them in sync with Settings.h.
+
+*/
+#pragma once
+
+#include <Arduino.h>
+#include <sys/time.h>
+
+#define BLE_SIMULATION     true // simulateScan() is the radio on the host
+#define BLE_DB_FILES_PACKED false
+
+float timeZone = 0; // the host clock is UTC
+bool summerTime = false;
+
+byte SCAN_DURATION = 20; // seconds, will be adjusted upon scan results
+#define MIN_SCAN_DURATION 10 // seconds min
+#define MAX_SCAN_DURATION 120 // seconds max
+#define VENDORCACHE_SIZE 16
+#define OUICACHE_SIZE 32
+#define MAX_FIELD_LEN 32 // max chars returned by field
+#define MAC_LEN 17 // chars used by a mac address
+#define SHORT_MAC_LEN 7 // chars used by the oui part of a mac address
+
+#define MAX_BLECARDS_WITH_TIMESTAMPS_ON_SCREEN 4
+#define BLEDEVCACHE_PSRAM_SIZE 1024
+#define BLEDEVCACHE_HEAP_SIZE 32
+#define ROTATINGCACHE_PSRAM_SIZE 256
+#define ROTATINGCACHE_HEAP_SIZE 8
+#define ROTATINGCACHE_TTL 900
+#define PSEUDODEVICES_PSRAM_SIZE 512
+#define PSEUDODEVICES_HEAP_SIZE 16
+#define PSEUDODEVICES_TTL 3600
+#define FINGERPRINT_MANUF_PREFIX 4
+#define RSSI_HISTORY_SAMPLES 32
+#define RSSI_HISTORY_RESOLUTION 2
+#define RSSI_HISTORY_PERSIST 1
+#define SESSIONS_PSRAM_SIZE 512
+#define SESSIONS_HEAP_SIZE 32
+#define SESSIONS_QUEUE_SIZE 64
+#define SESSIONS_BATCH_SIZE 16
+#define SESSIONS_ABSENCE_TIMEOUT 300
+#define MAX_DEVICES_PER_SCAN MAX_BLECARDS_WITH_TIMESTAMPS_ON_SCREEN
+
+#define BUILD_SIGNATURE __DATE__ " - " __TIME__ " - host"
+const char* BUILDSIGNATURE = BUILD_SIGNATURE;
+
+static xSemaphoreHandle mux = NULL;
+static bool DBneedsReplication = false;
+static bool isQuerying = false;
+
+#include <rom/crc.h> // crc32_le()
+#define freeheap heap_caps_get_free_size(MALLOC_CAP_INTERNAL)
+#define freepsheap ESP.getFreePsram()
+#define takeMuxSemaphore()
+#define giveMuxSemaphore()
+
+// str helpers, same as Settings.h
+char *substr(const char *src, int pos, int len) {
+  char* dest = NULL;
+  if (len > 0) {
+    dest = (char*)calloc(len + 1, 1);
+    if (NULL != dest) {
+      strncat(dest, src + pos, len);
+    }
+  }
+  return dest;
+}
+
+#include "HostDisplay.h" // instead of Display.h, ScrollPanel.h, TimeUtils.h and UI.h
+#include "../../DateTime.h"
+#include "HostFS.h" // BLE_FS, sqlite3_open
+
+#include <NimBLEDevice.h>
+#include <sqlite3.h>
+
+// statistical values
+static int devicesCount     = 0; // devices count per scan
+static int sessDevicesCount = 0; // total devices count per session
+static uint32_t processedDevicesTotal = 0; // devices stored by the scan callback since boot (processedDevicesCount is per scan)
+static int results          = 0; // total results during last query
+static unsigned int entries = 0; // total entries in database
+static byte prune_trigger   = 0; // incremented on every insertion, reset on prune()
+
+// load application stack
+#include "../../BLECache.h" // data struct
+#include "../../LatencyStats.h"
+#include "../../LookupTable.h" // compiled reference data
+#include "../../NameCache.h" // OUI/vendor name caches
+#include "../../RotatingCache.h" // devices with rotating random addresses
+#include "../../PseudoDevices.h" // rotating addresses linked by fingerprint
+#include "../../RSSIHistory.h" // per device RSSI rings
+#include "../../PresenceSessions.h" // enter/exit sessions
+#include "../../DB.h"
+#include "../../LZStream.h"
+#include "../../FileTransfer.h"
+#include "../../BLESimulator.h" // also feeds the benchmarks
+#include "../../BLETrace.h"
+#include "../../Metrics.h"
+#include "../../ScanPipeline.h" // radio-agnostic after-scan steps
+#include "../../Benchmark.h" // also covers ScanPipelineUtils
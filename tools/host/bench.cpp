@@ -0,0 +1,70 @@
+/*
+
+  blecollector-bench: the lookup/cache microbenchmarks of the 'bench' serial
+  command (Benchmark.runAll()) built for the host, against the reference DBs
+  of the SD folder. Output is the same "BENCH {...}" JSON lines on stdout.
+
+  A few simulated scans run first so the device cache and the collector DB
+  hold the same kind of content as on a device that has been scanning.
+  Timings are host timings, the cacheYield() time is virtual (1ms per call,
+  as on the device) and shows up apart as "yield_us".
+
+  Usage: blecollector-bench [-d dir] [-i iterations] [-n scans]
+    -d  working directory, stands for the SD card root (default: ./sd)
+    -i  calls per benchmark, default BENCH_DEFAULT_ITERATIONS
+    -n  simulated scans before the benchmarks, default 20
+
+*/
+
+#include "HostSettings.h"
+
+#include <getopt.h>
+#include <sys/stat.h>
+
+
+int main( int argc, char** argv ) {
+  const char* dir = "./sd";
+  uint32_t iterations = 0;
+  uint32_t scans = 20;
+  int opt;
+  while( ( opt = getopt( argc, argv, "d:i:n:" ) ) != -1 ) {
+    switch( opt ) {
+      case 'd': dir = optarg; break;
+      case 'i': iterations = strtoul( optarg, NULL, 10 ); break;
+      case 'n': scans = strtoul( optarg, NULL, 10 ); break;
+      default:
+        fprintf( stderr, "Usage: %s [-d dir] [-i iterations] [-n scans]\n", argv[0] );
+        return 2;
+    }
+  }
+
+  mkdir( dir, 0755 );
+  snprintf( hostFSRoot, sizeof(hostFSRoot), "%s", dir );
+  if( !hostSeedFile( MAC_OUI_NAMES_DB_FS_PATH ) || !hostSeedFile( BLE_VENDOR_NAMES_DB_FS_PATH ) ) {
+    return 1;
+  }
+  if( !DB.init() ) {
+    log_e("DB init failed");
+    return 1;
+  }
+
+  // warm up, same loop as blecollector-sim
+  scanTaskRunning = true;
+  byte onAfterScanStep = 0;
+  for( uint32_t i=0; i<=scans; i++ ) {
+    while( ScanPipelineUtils::onAfterScanSteps( onAfterScanStep, scan_cursor ) );
+    if( i == scans ) break;
+    ScanPipelineUtils::beginScan();
+    ScanPipelineUtils::simulateScan( SCAN_DURATION );
+    ScanPipelineUtils::endScan();
+    scan_rounds++;
+  }
+  scanTaskRunning = false;
+
+  if( !Benchmark.init( iterations, DB.hasPsram ) ) {
+    log_e("Not enough memory to run the benchmarks");
+    return 1;
+  }
+  Benchmark.runAll();
+  return 0;
+}
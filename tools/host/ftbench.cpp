@@ -0,0 +1,35 @@
+/*
+
+  blecollector-ftbench: the 'ftbench' serial command built for the host, the
+  file transfer protocol of FileTransfer.h runs between two endpoints through
+  the seeded lossy link of FileTransferLoopback. The link clock is virtual so
+  "sim_kbps" is the same on the host and on the device for the same arguments,
+  only "cpu_ms" tells the machines apart.
+
+  Usage: blecollector-ftbench [kbytes] [loss per mille] [mtu] [window] [corrupt per mille]
+    same arguments as 'ftbench', without a loss rate the whole suite runs
+
+*/
+
+#include "HostSettings.h"
+
+
+int main( int argc, char** argv ) {
+  int kbytes  = argc > 1 ? atoi( argv[1] ) : 933;
+  int loss    = argc > 2 ? atoi( argv[2] ) : -1;
+  int mtu     = argc > 3 ? atoi( argv[3] ) : 517;
+  int window  = argc > 4 ? atoi( argv[4] ) : FT_WINDOW;
+  int corrupt = argc > 5 ? atoi( argv[5] ) : 0;
+  if( kbytes <= 0 || mtu <= 0 || window <= 0 ) {
+    fprintf( stderr, "Usage: %s [kbytes] [loss per mille] [mtu] [window] [corrupt per mille]\n", argv[0] );
+    return 2;
+  }
+  bool ok;
+  if( loss > -1 ) {
+    ok = FileTransferLoopback.run( kbytes * 1024, loss, mtu, window, corrupt );
+  } else {
+    ok = FileTransferLoopback.runSuite( kbytes * 1024, mtu, window );
+  }
+  Serial.println("BENCH {\"done\":true}");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,142 @@
+/*
+
+  blecollector-sim: runs the scan pipeline on the host, from the BLESimulator
+  stream or from a recorded trace, into a real SQLite collector DB.
+
+  Same loop as BLEScanUtils::scanTask(), with the scan window played in
+  virtual time (see stubs/Arduino.h) so a day of scans takes seconds.
+  The reference DBs (mac-oui-light.db, ble-oui.db) are copied from the SD
+  folder of the repository into the working directory when missing.
+
+  Usage: blecollector-sim [-d dir] [-n scans] [-t unixtime] [-r trace] [-x speed] [-w trace]
+    -d  working directory, stands for the SD card root (default: ./sd)
+    -n  scans to run, default 10, a replay stops at the end of the trace anyway
+    -t  wall clock at startup (UTC), default: no time set (hobo mode, blemacs.db)
+    -r  replay a trace recorded with the "record" serial command, path relative to -d
+    -x  replay speed, 0 = as fast as possible (default), 1 = real time
+    -w  record the advertisements fed to the pipeline, same format as -r reads
+
+*/
+
+#include "HostSettings.h"
+
+#include <getopt.h>
+#include <sys/stat.h>
+
+static int current_day = -1;
+static int current_hour = -1;
+
+
+// same triggers as timeHousekeeping() in TimeUtils.h
+static void timeHousekeeping() {
+  if( !TimeIsSet ) return;
+  DateTime internalDateTime = DateTime(year(), month(), day(), hour(), minute(), second());
+  if( current_hour != internalDateTime.hour() ) {
+    if( current_hour != -1 ) {
+      HourChangeTrigger = true;
+    }
+    current_hour = internalDateTime.hour();
+  }
+  if( current_day != internalDateTime.day() ) {
+    if( current_day != -1 ) {
+      DayChangeTrigger = true;
+      HourChangeTrigger = false;
+    }
+    current_day = internalDateTime.day();
+  }
+  sprintf(hhmmssString, "%02d:%02d:%02d", internalDateTime.hour(), internalDateTime.minute(), internalDateTime.second());
+  nowDateTime = internalDateTime;
+}
+
+
+int main( int argc, char** argv ) {
+  const char* dir = "./sd";
+  const char* trace = NULL;
+  const char* record = NULL;
+  uint32_t scans = 10;
+  uint32_t startTime = 0;
+  uint16_t speed = 0;
+  int opt;
+  while( ( opt = getopt( argc, argv, "d:n:t:r:x:w:" ) ) != -1 ) {
+    switch( opt ) {
+      case 'd': dir = optarg; break;
+      case 'n': scans = strtoul( optarg, NULL, 10 ); break;
+      case 't': startTime = strtoul( optarg, NULL, 10 ); break;
+      case 'r': trace = optarg; break;
+      case 'x': speed = atoi( optarg ); break;
+      case 'w': record = optarg; break;
+      default:
+        fprintf( stderr, "Usage: %s [-d dir] [-n scans] [-t unixtime] [-r trace] [-x speed] [-w trace]\n", argv[0] );
+        return 2;
+    }
+  }
+
+  mkdir( dir, 0755 );
+  snprintf( hostFSRoot, sizeof(hostFSRoot), "%s", dir );
+  if( !hostSeedFile( MAC_OUI_NAMES_DB_FS_PATH ) || !hostSeedFile( BLE_VENDOR_NAMES_DB_FS_PATH ) ) {
+    return 1;
+  }
+
+  if( startTime > 0 ) {
+    setTime( startTime );
+    TimeIsSet = true;
+    timeHousekeeping();
+  }
+
+  if( !DB.init() ) {
+    log_e("DB init failed");
+    return 1;
+  }
+  if( trace != NULL && !BLETrace.startReplay( trace, speed ) ) {
+    return 1;
+  }
+  if( trace == NULL && record != NULL && !BLETrace.startRecording( record ) ) {
+    return 1;
+  }
+
+  scanTaskRunning = true;
+  byte onAfterScanStep = 0;
+  for( uint32_t i=0; i<scans; i++ ) {
+    while( ScanPipelineUtils::onAfterScanSteps( onAfterScanStep, scan_cursor ) ) {
+      timeHousekeeping();
+    }
+    if( trace != NULL && BLETrace.mode != TRACE_REPLAYING ) break; // end of trace
+    timeHousekeeping();
+    DB.maintain();
+    ScanPipelineUtils::beginScan();
+    unsigned long scanStart = micros();
+    Metrics.scanStarted();
+    if( trace != NULL ) {
+      ScanPipelineUtils::replayScan( SCAN_DURATION );
+    } else {
+      ScanPipelineUtils::simulateScan( SCAN_DURATION );
+    }
+    LatencyStats.add( STAGE_SCAN, micros() - scanStart );
+    Metrics.scanEnded();
+    BLETrace.flush(); // only when recording
+    ScanPipelineUtils::endScan();
+    scan_rounds++;
+  }
+  while( ScanPipelineUtils::onAfterScanSteps( onAfterScanStep, scan_cursor ) ) {
+    timeHousekeeping();
+  }
+  scanTaskRunning = false;
+  BLETrace.stopRecording();
+  BLETrace.stopReplay(); // prints the replay report when -n ran out before the trace
+
+  // same as an hourly replication: cache, sessions and rollups land in the DB
+  timeHousekeeping();
+  DBneedsReplication = true;
+  DB.maintain();
+  entries = DB.getEntries();
+
+  if( trace == NULL ) { // the replay report has them already
+    Serial.printf("\nScan stage latencies (host, %d scans)\n\n", scan_rounds);
+    LatencyStats.print();
+  }
+  Serial.printf("\nSIM {\"db\":\"%s%s\",\"scans\":%d,\"adv\":%u,\"processed\":%u,\"dropped\":%u,\"entries\":%u,\"rendered\":%u,\"rotating\":%u,\"entities\":%u}\n",
+    hostFSRoot, DB.BLEMacsDbFSPath, scan_rounds, advertisementsCount, processedDevicesTotal, droppedDevicesCount,
+    entries, RenderQueue.cards, RotatingCache.inserts, PseudoDevices.used()
+  );
+  return 0;
+}
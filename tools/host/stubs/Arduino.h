@@ -0,0 +1,161 @@
+/*
+
+  Host stand-in for the Arduino-ESP32 core, just enough for the headers the
+  host build compiles (see ../HostSettings.h).
+
+  Time is virtual: millis()/micros() follow the host monotonic clock plus an
+  offset, delay()/vTaskDelay() only move the offset forward. Simulated scans
+  and trace replays run at full speed while the pipeline still sees the same
+  timestamps as on the device, and time measured around real code stays real.
+
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <math.h>
+#include <algorithm>
+#include <string>
+
+using std::min;
+using std::max;
+
+typedef uint8_t byte;
+
+#define constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+
+// time
+
+static uint64_t hostVirtualUs = 0; // delays skipped so far
+
+static uint64_t hostMonotonicUs() {
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  static uint64_t origin = (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+  return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000 - origin;
+}
+
+static unsigned long micros() { return (unsigned long)( hostMonotonicUs() + hostVirtualUs ); }
+static unsigned long millis() { return (unsigned long)( ( hostMonotonicUs() + hostVirtualUs ) / 1000 ); }
+static void delay( uint32_t ms ) { hostVirtualUs += (uint64_t)ms * 1000; }
+static void yield() { }
+
+// logging, same levels as CORE_DEBUG_LEVEL
+
+#ifndef HOST_LOG_LEVEL
+  #define HOST_LOG_LEVEL 2 // 1 = error, 2 = warning, 3 = info, 4 = debug, 5 = verbose
+#endif
+
+static void hostLog( int level, const char* tag, const char* fmt, ... ) {
+  if( level > HOST_LOG_LEVEL ) return;
+  va_list args;
+  va_start( args, fmt );
+  fprintf( stderr, "[%s] ", tag );
+  vfprintf( stderr, fmt, args );
+  fprintf( stderr, "\n" );
+  va_end( args );
+}
+
+#define log_n(...) hostLog( 1, "N", __VA_ARGS__ )
+#define log_e(...) hostLog( 1, "E", __VA_ARGS__ )
+#define log_w(...) hostLog( 2, "W", __VA_ARGS__ )
+#define log_i(...) hostLog( 3, "I", __VA_ARGS__ )
+#define log_d(...) hostLog( 4, "D", __VA_ARGS__ )
+#define log_v(...) hostLog( 5, "V", __VA_ARGS__ )
+
+// Serial goes to stdout
+
+class HardwareSerial {
+  public:
+    void begin( unsigned long ) { }
+    int printf( const char* fmt, ... ) __attribute__((format(printf, 2, 3))) {
+      va_list args;
+      va_start( args, fmt );
+      int len = vprintf( fmt, args );
+      va_end( args );
+      return len;
+    }
+    size_t print( const char* str ) { return fputs( str, stdout ) < 0 ? 0 : strlen( str ); }
+    size_t print( int val ) { return printf( "%d", val ); }
+    size_t println( const char* str = "" ) { return printf( "%s\n", str ); }
+    size_t println( int val ) { return printf( "%d\n", val ); }
+    size_t write( const uint8_t* buf, size_t len ) { return fwrite( buf, 1, len, stdout ); }
+    void flush() { fflush( stdout ); }
+    int available() { return 0; }
+    int read() { return -1; }
+};
+
+static HardwareSerial Serial;
+
+// String, only what the compiled headers use
+
+class String : public std::string {
+  public:
+    String( const char* str = "" ) : std::string( str ? str : "" ) { }
+    String( const std::string &str ) : std::string( str ) { }
+    explicit String( int val ) : std::string( std::to_string( val ) ) { }
+    explicit String( unsigned int val ) : std::string( std::to_string( val ) ) { }
+    void replace( const char* find, const char* replace ) {
+      size_t findLen = strlen( find ), replaceLen = strlen( replace );
+      if( findLen == 0 ) return;
+      for( size_t pos = std::string::find( find ); pos != npos; pos = std::string::find( find, pos + replaceLen ) ) {
+        std::string::replace( pos, findLen, replace );
+      }
+    }
+    String operator+( const String &rhs ) const { return String( (const std::string&)*this + (const std::string&)rhs ); }
+    String operator+( const char* rhs ) const { return String( (const std::string&)*this + rhs ); }
+};
+
+// memory: PSRAM boards by default, -DHOST_PSRAM=false takes the heap-only paths, ps_* allocate from the heap either way
+
+#ifndef HOST_PSRAM
+  #define HOST_PSRAM true
+#endif
+
+#define MALLOC_CAP_INTERNAL 0
+#define MALLOC_CAP_SPIRAM   1
+
+static bool psramInit() { return HOST_PSRAM; }
+static void* ps_malloc( size_t size ) { return malloc( size ); }
+static void* ps_calloc( size_t n, size_t size ) { return calloc( n, size ); }
+static size_t heap_caps_get_free_size( uint32_t ) { return 4 * 1024 * 1024; }
+static size_t esp_get_free_heap_size() { return heap_caps_get_free_size( MALLOC_CAP_INTERNAL ); }
+static size_t esp_get_minimum_free_heap_size() { return heap_caps_get_free_size( MALLOC_CAP_INTERNAL ); }
+static uint32_t getCpuFrequencyMhz() { return 1; } // ESP.getCycleCount() ticks at 1MHz on the host
+
+class EspClass {
+  public:
+    uint32_t getCycleCount() { return (uint32_t)micros(); } // see getCpuFrequencyMhz()
+    uint32_t getFreeHeap() { return heap_caps_get_free_size( MALLOC_CAP_INTERNAL ); }
+    uint32_t getHeapSize() { return heap_caps_get_free_size( MALLOC_CAP_INTERNAL ); }
+    uint32_t getFreePsram() { return heap_caps_get_free_size( MALLOC_CAP_SPIRAM ); }
+    uint64_t getEfuseMac() { return 0x00000000c0feULL; }
+    void restart() { fprintf( stderr, "ESP.restart() called, exiting\n" ); exit( 1 ); }
+};
+
+static EspClass ESP;
+
+// FreeRTOS: the host build is single threaded, tasks are plain function calls
+
+typedef void* TaskHandle_t;
+typedef void* xSemaphoreHandle;
+typedef void* SemaphoreHandle_t;
+typedef int portMUX_TYPE;
+typedef uint32_t TickType_t;
+#define portMUX_INITIALIZER_UNLOCKED 0
+#define portENTER_CRITICAL(mux)
+#define portEXIT_CRITICAL(mux)
+#define portMAX_DELAY 0xffffffff
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) (ms)
+
+static void vTaskDelay( TickType_t ticks ) { delay( ticks ); }
+static void vTaskSuspendAll() { }
+static void xTaskResumeAll() { }
+static void vTaskDelete( TaskHandle_t ) { }
+#define xSemaphoreTakeRecursive(mux, ticks) (true)
+#define xSemaphoreGiveRecursive(mux) (true)
@@ -0,0 +1,103 @@
+/*
+
+  Host stand-in for the NimBLE-Arduino types referenced by the compiled
+  headers. There is no radio on the host: BLEAdvertisedDevice only exists so
+  BlueToothDeviceHelper::store() and BLETrace.capture() compile, the host
+  build feeds the pipeline with BLEAdvRecord through onAdvRecord() instead.
+  BLEUUID is real since store( BLEAdvRecord* ) formats the service UUIDs.
+
+*/
+#pragma once
+
+#include "Arduino.h"
+
+#define BLE_ADDR_PUBLIC     0x00
+#define BLE_ADDR_RANDOM     0x01
+#define BLE_ADDR_PUBLIC_ID  0x02
+#define BLE_ADDR_RANDOM_ID  0x03
+
+
+// same string formats as NimBLEUUID::toString()
+class BLEUUID {
+  public:
+    BLEUUID() { }
+    BLEUUID( uint16_t uuid ) : len( 2 ) {
+      value[0] = uuid & 0xff;
+      value[1] = uuid >> 8;
+    }
+    BLEUUID( const uint8_t* data, size_t size, bool msbFirst ) : len( size == 16 ? 16 : 0 ) {
+      for( uint8_t i=0; i<len; i++ ) {
+        value[i] = msbFirst ? data[len-1-i] : data[i]; // stored lsb first
+      }
+    }
+    std::string toString() const {
+      char str[37] = {0};
+      if( len == 2 ) {
+        snprintf( str, sizeof(str), "0x%04x", value[0] | value[1] << 8 );
+      } else if( len == 16 ) {
+        char* p = str;
+        for( int i=15; i>=0; i-- ) {
+          p += sprintf( p, "%02x", value[i] );
+          if( i == 12 || i == 10 || i == 8 || i == 6 ) *p++ = '-';
+        }
+      }
+      return std::string( str );
+    }
+    bool equals( const BLEUUID &uuid ) const {
+      return len == uuid.len && memcmp( value, uuid.value, len ) == 0;
+    }
+    const uint8_t* getNative() const { return value; }
+  private:
+    uint8_t len = 0;
+    uint8_t value[16] = {0};
+};
+
+
+class BLEAddress {
+  public:
+    std::string toString() const { return std::string( "00:00:00:00:00:00" ); }
+    const uint8_t* getNative() const { return value; }
+  private:
+    uint8_t value[6] = {0};
+};
+
+
+class BLEAdvertisedDevice {
+  public:
+    BLEAddress  getAddress() { return BLEAddress(); }
+    uint8_t     getAddressType() { return BLE_ADDR_PUBLIC; }
+    int         getRSSI() { return 0; }
+    uint8_t*    getPayload() { return NULL; }
+    size_t      getPayloadLength() { return 0; }
+    bool        haveName() { return false; }
+    std::string getName() { return std::string(); }
+    bool        haveAppearance() { return false; }
+    uint16_t    getAppearance() { return 0; }
+    bool        haveManufacturerData() { return false; }
+    std::string getManufacturerData() { return std::string(); }
+    bool        haveServiceData() { return false; }
+    std::string getServiceData() { return std::string(); }
+    BLEUUID     getServiceDataUUID() { return BLEUUID(); }
+    bool        haveServiceUUID() { return false; }
+    BLEUUID     getServiceUUID() { return BLEUUID(); }
+};
+
+
+class BLEEddystoneURL {
+  public:
+    void        setData( std::string ) { }
+    std::string getURL() { return std::string( 1, '\0' ); }
+    std::string getDecodedURL() { return std::string(); }
+    int8_t      getPower() { return 0; }
+};
+
+
+class BLEEddystoneTLM {
+  public:
+    void        setData( std::string ) { }
+    uint16_t    getVolt() { return 0; }
+    float       getTemp() { return 0; }
+    uint32_t    getCount() { return 0; }
+    uint32_t    getTime() { return 0; }
+    std::string toString() { return std::string(); }
+};
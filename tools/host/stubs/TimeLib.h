@@ -0,0 +1,61 @@
+/*
+
+  Host stand-in for https://github.com/PaulStoffregen/Time, the clock is
+  set with setTime() and follows millis() (virtual time, see Arduino.h).
+
+*/
+#pragma once
+
+#include "Arduino.h"
+
+typedef struct {
+  uint8_t Second;
+  uint8_t Minute;
+  uint8_t Hour;
+  uint8_t Wday; // day of week, sunday is day 1
+  uint8_t Day;
+  uint8_t Month;
+  uint8_t Year; // offset from 1970
+} tmElements_t;
+
+static time_t hostTimeBase = 0; // unix time at hostTimeMillis
+static unsigned long hostTimeMillis = 0;
+
+static void breakTime( time_t t, tmElements_t &tm ) {
+  struct tm utc;
+  gmtime_r( &t, &utc );
+  tm.Second = utc.tm_sec;
+  tm.Minute = utc.tm_min;
+  tm.Hour   = utc.tm_hour;
+  tm.Wday   = utc.tm_wday + 1;
+  tm.Day    = utc.tm_mday;
+  tm.Month  = utc.tm_mon + 1;
+  tm.Year   = utc.tm_year - 70;
+}
+
+static time_t makeTime( const tmElements_t &tm ) {
+  struct tm utc = {};
+  utc.tm_sec  = tm.Second;
+  utc.tm_min  = tm.Minute;
+  utc.tm_hour = tm.Hour;
+  utc.tm_mday = tm.Day;
+  utc.tm_mon  = tm.Month - 1;
+  utc.tm_year = tm.Year + 70;
+  return timegm( &utc );
+}
+
+static void setTime( time_t t ) {
+  hostTimeBase = t;
+  hostTimeMillis = millis();
+}
+
+static time_t now() {
+  return hostTimeBase + ( millis() - hostTimeMillis ) / 1000;
+}
+
+static int year()   { tmElements_t tm; breakTime( now(), tm ); return tm.Year + 1970; }
+static int month()  { tmElements_t tm; breakTime( now(), tm ); return tm.Month; }
+static int day()    { tmElements_t tm; breakTime( now(), tm ); return tm.Day; }
+static int hour()   { tmElements_t tm; breakTime( now(), tm ); return tm.Hour; }
+static int minute() { tmElements_t tm; breakTime( now(), tm ); return tm.Minute; }
+static int second() { tmElements_t tm; breakTime( now(), tm ); return tm.Second; }
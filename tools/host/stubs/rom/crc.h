@@ -0,0 +1,14 @@
+/*
+
+  Host stand-in for the ESP32 ROM CRC, crc32_le() gives the same values as
+  zlib's crc32() (also used by tools/BLELookupGen/lookupgen.py).
+
+*/
+#pragma once
+
+#include <stdint.h>
+#include <zlib.h>
+
+static uint32_t crc32_le( uint32_t crc, const uint8_t* buf, uint32_t len ) {
+  return crc32( crc, buf, len );
+}